@@ -78,6 +78,18 @@ vtkSmartPointer<vtkEllipticalSRep> SmartInterpolateSRep(size_t interpolationLeve
   return detail::SRepInterpolateHelper(interpolationLevel, srep).interpolate();
 }
 
+//----------------------------------------------------------------------------
+srep::Vector3d InterpolateMiddleSpokeDirection(
+  const srep::Point3d& startSkeletalPoint,
+  const srep::Vector3d& startDirection,
+  const srep::Point3d& endSkeletalPoint,
+  const srep::Vector3d& endDirection,
+  double lambda)
+{
+  return detail::SRepInterpolateHelper::InterpolateMiddleSpokeDirection(
+    startSkeletalPoint, startDirection, endSkeletalPoint, endDirection, lambda);
+}
+
 namespace detail {
 
 //----------------------------------------------------------------------------
@@ -548,16 +560,32 @@ srep::Vector3d SRepInterpolateHelper::InterpolateMiddleSpokeDirection(
   const vtkSRepSpoke& endSpoke,
   const double lambda)
 {
-  const auto startUnitDirection = startSpoke.GetDirection().Unit();
-  const auto endUnitDirection = endSpoke.GetDirection().Unit();
+  return InterpolateMiddleSpokeDirection(
+    startSpoke.GetSkeletalPoint(),
+    startSpoke.GetDirection(),
+    endSpoke.GetSkeletalPoint(),
+    endSpoke.GetDirection(),
+    lambda);
+}
+
+//----------------------------------------------------------------------------
+srep::Vector3d SRepInterpolateHelper::InterpolateMiddleSpokeDirection(
+  const srep::Point3d& startSkeletalPoint,
+  const srep::Vector3d& startDirection,
+  const srep::Point3d& endSkeletalPoint,
+  const srep::Vector3d& endDirection,
+  const double lambda)
+{
+  const auto startUnitDirection = startDirection.Unit();
+  const auto endUnitDirection = endDirection.Unit();
   const auto start2ndDerivative = Compute2ndDerivative(startUnitDirection, endUnitDirection, startUnitDirection, 0);
   const auto end2ndDerivative = Compute2ndDerivative(startUnitDirection, endUnitDirection, endUnitDirection, lambda);
-  const auto avgSpokeDirection = Average(startSpoke.GetDirection(), endSpoke.GetDirection());
+  const auto avgSpokeDirection = Average(startDirection, endDirection);
   const double halfDist = lambda / 2;
   //if startSpoke == endSpoke then interpolated spoke == both
   //I don't think this should ever really happen
-  if (startSpoke.GetSkeletalPoint() == endSpoke.GetSkeletalPoint() && startSpoke.GetDirection() == endSpoke.GetDirection()) {
-    return startSpoke.GetDirection();
+  if (startSkeletalPoint == endSkeletalPoint && startDirection == endDirection) {
+    return startDirection;
   }
   const auto middleUnitDirection = Slerp(startUnitDirection, endUnitDirection, halfDist);
   const auto innerProd = [](const srep::Vector3d& a, const srep::Vector3d b) {
@@ -22,6 +22,8 @@
 #include <memory>
 #include <vtkEllipticalSRep.h>
 
+#include "vtkSlicerSRepModuleLogicExport.h"
+
 namespace sreplogic {
 
 namespace detail {
@@ -56,6 +58,13 @@ public:
 
   vtkSmartPointer<vtkEllipticalSRep> interpolate();
 
+  static srep::Vector3d InterpolateMiddleSpokeDirection(
+    const srep::Point3d& startSkeletalPoint,
+    const srep::Vector3d& startDirection,
+    const srep::Point3d& endSkeletalPoint,
+    const srep::Vector3d& endDirection,
+    double lambda);
+
 private:
   using Grid = std::vector<std::vector<vtkSmartPointer<vtkSRepSkeletalPoint>>>;
   using Quad = std::array<LineStep, 4>;
@@ -185,6 +194,20 @@ private:
 };
 }
 
+/// Interpolates the direction (and magnitude) of the spoke halfway between two spokes.
+///
+/// This is the direction interpolation used by InterpolateSRep, exposed so callers that only
+/// change spoke directions can re-interpolate them without rebuilding the whole srep.
+/// @param lambda The fraction of the original, non-interpolated, quad that lies between the two spokes.
+///               1.0 for spokes of the original srep, 0.5 for the next level of interpolation, etc.
+/// @throws std::invalid_argument if the interpolated direction has a nan component
+VTK_SLICER_SREP_MODULE_LOGIC_EXPORT srep::Vector3d InterpolateMiddleSpokeDirection(
+  const srep::Point3d& startSkeletalPoint,
+  const srep::Vector3d& startDirection,
+  const srep::Point3d& endSkeletalPoint,
+  const srep::Vector3d& endDirection,
+  double lambda);
+
 VTK_NEWINSTANCE vtkEllipticalSRep* InterpolateSRep(size_t interpolationLevel, const vtkEllipticalSRep& srep);
 vtkSmartPointer<vtkEllipticalSRep> SmartInterpolateSRep(size_t interpolationLevel, const vtkEllipticalSRep& srep);
 
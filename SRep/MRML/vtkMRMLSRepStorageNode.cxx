@@ -604,6 +604,11 @@ int vtkMRMLSRepStorageNode::WriteDataInternal(vtkMRMLNode *refNode)
   }
 
   FILE* fp = fopen(fullName.c_str(), "wb");
+  if (!fp) {
+    vtkErrorMacro("vtkMRMLSRepJsonStorageNode::WriteDataInternal: Writing srep node file failed: unable to open "
+      << fullName);
+    return failure;
+  }
   const auto closeFp = finally([fp](){
     fclose(fp);
   });
@@ -0,0 +1,112 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "SRepFlowSnapshotStore.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+namespace srepcreator {
+
+//---------------------------------------------------------------------------
+FlowSnapshotStore::FlowSnapshotStore(size_t numPoints, size_t memoryBudget, const std::string& spillFileName)
+  : m_numPoints(numPoints)
+  // a store of empty snapshots never needs to spill
+  , m_maxSnapshotsInMemory(numPoints == 0 ? static_cast<size_t>(-1) : memoryBudget / (3 * numPoints * sizeof(double)))
+  , m_spillFileName(spillFileName)
+  , m_memory()
+  , m_numSnapshots(0)
+  , m_spillFile()
+{}
+
+//---------------------------------------------------------------------------
+FlowSnapshotStore::~FlowSnapshotStore() {
+  this->Clear();
+}
+
+//---------------------------------------------------------------------------
+size_t FlowSnapshotStore::SnapshotSize() const {
+  return 3 * m_numPoints;
+}
+
+//---------------------------------------------------------------------------
+void FlowSnapshotStore::Append(const double* points) {
+  if (m_numSnapshots < m_maxSnapshotsInMemory) {
+    m_memory.insert(m_memory.end(), points, points + this->SnapshotSize());
+  } else {
+    if (!m_spillFile.is_open()) {
+      m_spillFile.open(m_spillFileName, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+      if (!m_spillFile) {
+        throw std::runtime_error("Unable to create flow snapshot file " + m_spillFileName);
+      }
+    }
+    m_spillFile.seekp(0, std::ios::end);
+    m_spillFile.write(reinterpret_cast<const char*>(points), this->SnapshotSize() * sizeof(double));
+    if (!m_spillFile) {
+      throw std::runtime_error("Unable to write flow snapshot to " + m_spillFileName);
+    }
+  }
+  ++m_numSnapshots;
+}
+
+//---------------------------------------------------------------------------
+void FlowSnapshotStore::Get(size_t index, double* points) {
+  if (index >= m_numSnapshots) {
+    throw std::out_of_range("No flow snapshot " + std::to_string(index) + " of " + std::to_string(m_numSnapshots));
+  }
+  const auto snapshotSize = this->SnapshotSize();
+  if (index < m_maxSnapshotsInMemory) {
+    std::copy_n(m_memory.begin() + index * snapshotSize, snapshotSize, points);
+    return;
+  }
+  const auto bytes = snapshotSize * sizeof(double);
+  m_spillFile.seekg(static_cast<std::streamoff>((index - m_maxSnapshotsInMemory) * bytes));
+  m_spillFile.read(reinterpret_cast<char*>(points), bytes);
+  if (!m_spillFile) {
+    m_spillFile.clear();
+    throw std::runtime_error("Unable to read flow snapshot " + std::to_string(index) + " from " + m_spillFileName);
+  }
+}
+
+//---------------------------------------------------------------------------
+size_t FlowSnapshotStore::GetNumberOfSnapshots() const {
+  return m_numSnapshots;
+}
+
+//---------------------------------------------------------------------------
+size_t FlowSnapshotStore::GetNumberOfPoints() const {
+  return m_numPoints;
+}
+
+//---------------------------------------------------------------------------
+size_t FlowSnapshotStore::GetNumberOfSpilledSnapshots() const {
+  return m_numSnapshots - std::min(m_numSnapshots, m_maxSnapshotsInMemory);
+}
+
+//---------------------------------------------------------------------------
+void FlowSnapshotStore::Clear() {
+  m_memory.clear();
+  m_memory.shrink_to_fit();
+  m_numSnapshots = 0;
+  if (m_spillFile.is_open()) {
+    m_spillFile.close();
+    std::remove(m_spillFileName.c_str());
+  }
+}
+
+}
@@ -0,0 +1,79 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkSlicerSRepCreatorLogic_SRepFlowSnapshotStore_h
+#define __vtkSlicerSRepCreatorLogic_SRepFlowSnapshotStore_h
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "vtkSlicerSRepCreatorModuleLogicExport.h"
+
+namespace srepcreator {
+
+/// Keeps the points of every iteration of a mesh flow so they can be visited again in any order.
+///
+/// Every snapshot has the same number of points. Snapshots are stored contiguously in memory until
+/// they would take more than the memory budget, and the ones after that are appended to a single
+/// binary spill file. The spill file is only created if it is needed and is removed by Clear and
+/// the destructor.
+class VTK_SLICER_SREPCREATOR_MODULE_LOGIC_EXPORT FlowSnapshotStore {
+public:
+  /// \param numPoints Number of points in each snapshot.
+  /// \param memoryBudget Bytes of snapshots kept in memory.
+  /// \param spillFileName File that snapshots past the memory budget are written to.
+  FlowSnapshotStore(size_t numPoints, size_t memoryBudget, const std::string& spillFileName);
+  ~FlowSnapshotStore();
+
+  FlowSnapshotStore(const FlowSnapshotStore&) = delete;
+  FlowSnapshotStore& operator=(const FlowSnapshotStore&) = delete;
+
+  /// Adds a snapshot after the others.
+  /// \param points 3 * GetNumberOfPoints() coordinates, x y z for each point.
+  /// \throws std::runtime_error if the snapshot needs to be spilled and the spill file can't be written.
+  void Append(const double* points);
+
+  /// Copies snapshot "index", in the order they were appended, into points.
+  /// \param points Room for 3 * GetNumberOfPoints() coordinates.
+  /// \throws std::out_of_range if there is no snapshot "index".
+  /// \throws std::runtime_error if the snapshot can't be read back from the spill file.
+  void Get(size_t index, double* points);
+
+  size_t GetNumberOfSnapshots() const;
+  size_t GetNumberOfPoints() const;
+  /// Gets the number of snapshots that are in the spill file instead of memory.
+  size_t GetNumberOfSpilledSnapshots() const;
+
+  /// Removes every snapshot and the spill file.
+  void Clear();
+
+private:
+  size_t SnapshotSize() const; // number of coordinates in a snapshot
+
+  const size_t m_numPoints;
+  const size_t m_maxSnapshotsInMemory;
+  const std::string m_spillFileName;
+  std::vector<double> m_memory;
+  size_t m_numSnapshots;
+  std::fstream m_spillFile;
+};
+
+}
+
+#endif
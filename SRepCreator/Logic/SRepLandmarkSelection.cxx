@@ -0,0 +1,167 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "SRepLandmarkSelection.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace srepcreator {
+
+namespace {
+
+/// The point picked for a cell so far
+struct CellLandmark {
+  size_t index;
+  double distanceSquared; // from the center of the cell
+};
+
+/// A grid of cubic cells over the points' bounding box
+class LandmarkGrid {
+public:
+  LandmarkGrid(const std::vector<double>& points, const std::array<double, 3>& origin, double cellSize)
+    : m_points(points)
+    , m_origin(origin)
+    , m_cellSize(cellSize)
+  {}
+
+  //---------------------------------------------------------------------------
+  // Gets the landmark of every cell that holds a point
+  std::unordered_map<uint64_t, CellLandmark> FindCellLandmarks() const {
+    std::unordered_map<uint64_t, CellLandmark> cells;
+    const size_t numPoints = m_points.size() / 3;
+    for (size_t i = 0; i < numPoints; ++i) {
+      uint64_t key = 0;
+      double distanceSquared = 0.0;
+      for (size_t axis = 0; axis < 3; ++axis) {
+        const double position = (m_points[3 * i + axis] - m_origin[axis]) / m_cellSize;
+        const auto cell = static_cast<uint64_t>(position);
+        const double offset = position - static_cast<double>(cell) - 0.5;
+        distanceSquared += offset * offset;
+        // 21 bits per axis is 2 million cells, many more than any mesh has landmarks along an axis
+        key = (key << 21) | (cell & ((uint64_t(1) << 21) - 1));
+      }
+      const auto inserted = cells.emplace(key, CellLandmark{i, distanceSquared});
+      auto& landmark = inserted.first->second;
+      if (!inserted.second && distanceSquared < landmark.distanceSquared) {
+        landmark = CellLandmark{i, distanceSquared};
+      }
+    }
+    return cells;
+  }
+
+private:
+  const std::vector<double>& m_points;
+  const std::array<double, 3> m_origin;
+  const double m_cellSize;
+};
+
+} // namespace {}
+
+//---------------------------------------------------------------------------
+std::vector<size_t> SelectLandmarks(const std::vector<double>& points, size_t numLandmarks, uint64_t seed) {
+  if (points.size() % 3 != 0) {
+    throw std::invalid_argument("Expected 3 coordinates per point, got " + std::to_string(points.size()) + " coordinates");
+  }
+  const size_t numPoints = points.size() / 3;
+  std::vector<size_t> landmarks;
+  if (numLandmarks >= numPoints) {
+    landmarks.resize(numPoints);
+    std::iota(landmarks.begin(), landmarks.end(), 0);
+    return landmarks;
+  }
+  if (numLandmarks == 0) {
+    return landmarks;
+  }
+
+  std::array<double, 3> minimum;
+  std::array<double, 3> maximum;
+  minimum.fill(std::numeric_limits<double>::max());
+  maximum.fill(std::numeric_limits<double>::lowest());
+  for (size_t i = 0; i < numPoints; ++i) {
+    for (size_t axis = 0; axis < 3; ++axis) {
+      minimum[axis] = std::min(minimum[axis], points[3 * i + axis]);
+      maximum[axis] = std::max(maximum[axis], points[3 * i + axis]);
+    }
+  }
+  const double extent = std::max({maximum[0] - minimum[0], maximum[1] - minimum[1], maximum[2] - minimum[2]});
+
+  std::mt19937_64 generator(seed);
+  if (extent > 0) {
+    // shift the grid by a random part of a cell so the seed also varies which points share a cell
+    std::uniform_real_distribution<double> shift(0.0, 1.0);
+    const std::array<double, 3> shifts = {shift(generator), shift(generator), shift(generator)};
+
+    // the points are usually samples of a surface, so the number of occupied cells goes as 1 / cellSize^2.
+    // Adjust the cell size until there are at least numLandmarks cells, but not many more.
+    double cellSize = extent / std::sqrt(static_cast<double>(numLandmarks));
+    const auto createGrid = [&](double size) {
+      std::array<double, 3> origin;
+      for (size_t axis = 0; axis < 3; ++axis) {
+        origin[axis] = minimum[axis] - shifts[axis] * size;
+      }
+      return LandmarkGrid(points, origin, size);
+    };
+    // the last grid tried is the one the landmarks are picked from
+    constexpr int maxGrids = 16;
+    std::unordered_map<uint64_t, CellLandmark> cells;
+    for (int grid = 0; grid < maxGrids; ++grid) {
+      cells = createGrid(cellSize).FindCellLandmarks();
+      const size_t numCells = cells.size();
+      if (numCells >= numLandmarks && numCells <= numLandmarks + numLandmarks / 4) {
+        break;
+      }
+      // aim a little past numLandmarks so the next grid is unlikely to fall short
+      cellSize *= std::sqrt(static_cast<double>(numCells) / (1.1 * static_cast<double>(numLandmarks)));
+    }
+
+    for (const auto& cell : cells) {
+      landmarks.push_back(cell.second.index);
+    }
+    // the order of an unordered_map is not portable
+    std::sort(landmarks.begin(), landmarks.end());
+  }
+
+  if (landmarks.size() > numLandmarks) {
+    std::shuffle(landmarks.begin(), landmarks.end(), generator);
+    landmarks.resize(numLandmarks);
+  } else if (landmarks.size() < numLandmarks) {
+    std::vector<bool> picked(numPoints, false);
+    for (const auto index : landmarks) {
+      picked[index] = true;
+    }
+    std::vector<size_t> others;
+    others.reserve(numPoints - landmarks.size());
+    for (size_t i = 0; i < numPoints; ++i) {
+      if (!picked[i]) {
+        others.push_back(i);
+      }
+    }
+    std::shuffle(others.begin(), others.end(), generator);
+    landmarks.insert(landmarks.end(), others.begin(), others.begin() + (numLandmarks - landmarks.size()));
+  }
+  std::sort(landmarks.begin(), landmarks.end());
+  return landmarks;
+}
+
+}
@@ -0,0 +1,45 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkSlicerSRepCreatorLogic_SRepLandmarkSelection_h
+#define __vtkSlicerSRepCreatorLogic_SRepLandmarkSelection_h
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "vtkSlicerSRepCreatorModuleLogicExport.h"
+
+namespace srepcreator {
+
+/// Picks landmarks spread evenly over a set of points by voxel grid stratified sampling.
+///
+/// The points' bounding box is split into cubic cells sized so that about numLandmarks cells hold a
+/// point, and the point closest to the center of each of those cells is picked. If that gives too many
+/// landmarks, a random subset of them is kept, and if it gives too few, random other points are added.
+/// Runs in expected O(N) for N points.
+///
+/// \param points x y z of each point.
+/// \param numLandmarks Number of landmarks to pick. All points are picked if there are fewer.
+/// \param seed Seed of the random choices. The same points, numLandmarks and seed give the same landmarks.
+/// \returns Indices of the picked points in increasing order.
+VTK_SLICER_SREPCREATOR_MODULE_LOGIC_EXPORT
+std::vector<size_t> SelectLandmarks(const std::vector<double>& points, size_t numLandmarks, uint64_t seed);
+
+}
+
+#endif
@@ -0,0 +1,444 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "SRepMeanCurvatureFlow.h"
+
+#include <vtkSMPTools.h>
+#include <vtkSetGet.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace srepcreator {
+
+namespace {
+
+constexpr double Pi = 3.14159265358979323846;
+
+//---------------------------------------------------------------------------
+void Subtract(const double* a, const double* b, double* result) {
+  for (int i = 0; i < 3; ++i) {
+    result[i] = a[i] - b[i];
+  }
+}
+
+//---------------------------------------------------------------------------
+double Dot(const double* a, const double* b) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+//---------------------------------------------------------------------------
+void Cross(const double* a, const double* b, double* result) {
+  result[0] = a[1] * b[2] - a[2] * b[1];
+  result[1] = a[2] * b[0] - a[0] * b[2];
+  result[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+//---------------------------------------------------------------------------
+// Groups the second element of each pair by the first as compressed sparse rows
+void CreateCompressedRows(
+  std::vector<std::pair<size_t, size_t>>& pairs,
+  size_t numRows,
+  std::vector<size_t>& offsets,
+  std::vector<size_t>& values)
+{
+  std::sort(pairs.begin(), pairs.end());
+  offsets.assign(numRows + 1, 0);
+  values.resize(pairs.size());
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    ++offsets[pairs[i].first + 1];
+    values[i] = pairs[i].second;
+  }
+  for (size_t row = 0; row < numRows; ++row) {
+    offsets[row + 1] += offsets[row];
+  }
+}
+
+} // namespace {}
+
+//---------------------------------------------------------------------------
+MeanCurvatureFlow::MeanCurvatureFlow(const std::vector<double>& points, const std::vector<size_t>& triangles)
+  : m_numPoints(points.size() / 3)
+  , m_points(points)
+  , m_triangles(triangles)
+  , m_pointTriangleOffsets()
+  , m_pointTriangles()
+  , m_neighborOffsets()
+  , m_neighbors()
+  , m_onBoundary(m_numPoints, 0)
+  , m_smoothingCoefficients()
+  , m_scratch(points.size())
+  , m_chebyshev()
+  , m_integration(Integration::Explicit)
+  , m_system()
+  , m_mass()
+  , m_solver()
+  , m_analyzed(false)
+{
+  if (points.size() % 3 != 0 || triangles.size() % 3 != 0) {
+    throw std::invalid_argument("Expected 3 coordinates per point and 3 points per triangle");
+  }
+  const size_t numTriangles = triangles.size() / 3;
+  std::vector<std::pair<size_t, size_t>> pointTriangles;
+  pointTriangles.reserve(triangles.size());
+  // each edge once per triangle that has it, smallest point first
+  std::vector<std::pair<size_t, size_t>> edges;
+  edges.reserve(triangles.size());
+  for (size_t t = 0; t < numTriangles; ++t) {
+    for (size_t i = 0; i < 3; ++i) {
+      const auto a = triangles[3 * t + i];
+      const auto b = triangles[3 * t + (i + 1) % 3];
+      if (a >= m_numPoints) {
+        throw std::invalid_argument("Triangle " + std::to_string(t) + " refers to point " + std::to_string(a)
+          + " of " + std::to_string(m_numPoints));
+      }
+      pointTriangles.emplace_back(a, t);
+      edges.emplace_back(std::min(a, b), std::max(a, b));
+    }
+  }
+  CreateCompressedRows(pointTriangles, m_numPoints, m_pointTriangleOffsets, m_pointTriangles);
+
+  std::sort(edges.begin(), edges.end());
+  std::vector<std::pair<size_t, size_t>> neighbors;
+  neighbors.reserve(edges.size());
+  for (size_t i = 0; i < edges.size();) {
+    size_t end = i + 1;
+    while (end < edges.size() && edges[end] == edges[i]) {
+      ++end;
+    }
+    // an edge of only one triangle is on the boundary
+    if (end - i == 1) {
+      m_onBoundary[edges[i].first] = 1;
+      m_onBoundary[edges[i].second] = 1;
+    }
+    neighbors.emplace_back(edges[i].first, edges[i].second);
+    neighbors.emplace_back(edges[i].second, edges[i].first);
+    i = end;
+  }
+  CreateCompressedRows(neighbors, m_numPoints, m_neighborOffsets, m_neighbors);
+}
+
+//---------------------------------------------------------------------------
+void MeanCurvatureFlow::SetSmoothing(double passBand, size_t iterations) {
+  if (iterations == 0) {
+    throw std::invalid_argument("Expected at least one smoothing iteration");
+  }
+  passBand = std::min(2.0, std::max(0.0, passBand));
+  m_smoothingCoefficients.clear();
+  if (passBand == 0) {
+    for (auto& terms : m_chebyshev) {
+      terms.clear();
+    }
+    return;
+  }
+
+  // The windowed sinc filter of Taubin et al. as a sum of Chebyshev polynomials of the Laplacian, with
+  // a Hamming window. As in vtkWindowedSincPolyDataFilter, the cut off is offset by sigma, found by
+  // Newton-Raphson, so the response of the filter at the pass band is 1.
+  const double thetaPassBand = std::acos(1.0 - 0.5 * passBand);
+  std::vector<double> window(iterations + 1);
+  for (size_t i = 0; i <= iterations; ++i) {
+    window[i] = 0.54 + 0.46 * std::cos(i * Pi / (iterations + 1));
+  }
+  auto& c = m_smoothingCoefficients;
+  c.resize(iterations + 1);
+  // the Chebyshev coefficients of the derivative of the filter
+  std::vector<double> cPrime(iterations + 1);
+  double sigma = 0.0;
+  double response = 0.0;
+  for (int search = 0; search < 500; ++search) {
+    c[0] = window[0] * (thetaPassBand + sigma) / Pi;
+    for (size_t i = 1; i <= iterations; ++i) {
+      c[i] = 2.0 * window[i] * std::sin(i * (thetaPassBand + sigma)) / (i * Pi);
+    }
+    cPrime[iterations] = 0.0;
+    cPrime[iterations - 1] = 0.0;
+    if (iterations > 1) {
+      cPrime[iterations - 2] = 2.0 * (iterations - 1) * c[iterations - 1];
+    }
+    for (size_t i = iterations > 2 ? iterations - 2 : 0; i-- > 0;) {
+      cPrime[i] = cPrime[i + 2] + 2.0 * (i + 1) * c[i + 1];
+    }
+    response = c[0];
+    double derivative = cPrime[0] / 2.0;
+    for (size_t i = 1; i <= iterations; ++i) {
+      response += c[i] * std::cos(i * thetaPassBand);
+      derivative += cPrime[i] * std::cos(i * thetaPassBand);
+    }
+    // a first order filter can't be corrected
+    if (iterations == 1 || std::abs(response - 1.0) < 1e-3) {
+      break;
+    }
+    sigma -= (response - 1.0) / derivative;
+  }
+  if (iterations > 1 && std::abs(response - 1.0) >= 1e-3) {
+    vtkGenericWarningMacro("An optimal offset for the smoothing filter could not be found. "
+      "Unpredictable smoothing or shrinkage may result.");
+  }
+  for (auto& terms : m_chebyshev) {
+    terms.resize(m_points.size());
+  }
+}
+
+//---------------------------------------------------------------------------
+void MeanCurvatureFlow::SetIntegration(Integration integration) {
+  m_integration = integration;
+}
+
+//---------------------------------------------------------------------------
+void MeanCurvatureFlow::Step(double dt) {
+  if (!m_smoothingCoefficients.empty()) {
+    this->Smooth();
+  }
+  if (m_integration == Integration::SemiImplicit) {
+    this->FlowSemiImplicit(dt);
+  } else {
+    this->Flow(dt);
+  }
+}
+
+//---------------------------------------------------------------------------
+const std::vector<double>& MeanCurvatureFlow::GetPoints() const {
+  return m_points;
+}
+
+//---------------------------------------------------------------------------
+size_t MeanCurvatureFlow::GetNumberOfPoints() const {
+  return m_numPoints;
+}
+
+//---------------------------------------------------------------------------
+void MeanCurvatureFlow::Smooth() {
+  // With M = I - K / 2 for the umbrella Laplacian K, the terms are T0 = x, T1 = M x and
+  // Tn+1 = 2 M Tn - Tn-1 = Tn + (mean of Tn's neighbors) - Tn-1. The result is the sum of the coefficients
+  // times the terms, accumulated in m_scratch.
+  auto* previous = &m_chebyshev[0];
+  auto* current = &m_chebyshev[1];
+  auto* next = &m_chebyshev[2];
+  *current = m_points;
+  const double* coefficients = m_smoothingCoefficients.data();
+  vtkSMPTools::For(0, static_cast<vtkIdType>(m_numPoints), [&](vtkIdType begin, vtkIdType end) {
+    for (auto i = static_cast<size_t>(begin); i < static_cast<size_t>(end); ++i) {
+      for (int axis = 0; axis < 3; ++axis) {
+        m_scratch[3 * i + axis] = coefficients[0] * m_points[3 * i + axis];
+      }
+    }
+  });
+
+  for (size_t term = 1; term < m_smoothingCoefficients.size(); ++term) {
+    // previous is Tn-1, current is Tn and next gets Tn+1
+    const auto& tPrevious = *previous;
+    const auto& tCurrent = *current;
+    auto& tNext = *next;
+    const double coefficient = coefficients[term];
+    vtkSMPTools::For(0, static_cast<vtkIdType>(m_numPoints), [&](vtkIdType begin, vtkIdType end) {
+      for (auto i = static_cast<size_t>(begin); i < static_cast<size_t>(end); ++i) {
+        const auto firstNeighbor = m_neighborOffsets[i];
+        const auto numNeighbors = m_neighborOffsets[i + 1] - firstNeighbor;
+        for (int axis = 0; axis < 3; ++axis) {
+          double value = tCurrent[3 * i + axis];
+          if (!m_onBoundary[i] && numNeighbors > 0) {
+            double mean = 0.0;
+            for (size_t n = firstNeighbor; n < firstNeighbor + numNeighbors; ++n) {
+              mean += tCurrent[3 * m_neighbors[n] + axis];
+            }
+            mean /= numNeighbors;
+            value = term == 1
+              ? 0.5 * (value + mean)
+              : value + mean - tPrevious[3 * i + axis];
+          }
+          tNext[3 * i + axis] = value;
+          m_scratch[3 * i + axis] += coefficient * value;
+        }
+      }
+    });
+    std::swap(previous, current);
+    std::swap(current, next);
+  }
+
+  // The filter scales a constant by the sum of its coefficients, which sigma leaves a little off 1. Like
+  // vtkWindowedSincPolyDataFilter with NormalizeCoordinates, filter the points relative to the center of
+  // their bounds, so the mesh doesn't move. Points on the boundary stay where they are.
+  double gain = 0.0;
+  for (const auto coefficient : m_smoothingCoefficients) {
+    gain += coefficient;
+  }
+  double bounds[6] = {INFINITY, -INFINITY, INFINITY, -INFINITY, INFINITY, -INFINITY};
+  for (size_t i = 0; i < m_numPoints; ++i) {
+    for (int axis = 0; axis < 3; ++axis) {
+      bounds[2 * axis] = std::min(bounds[2 * axis], m_points[3 * i + axis]);
+      bounds[2 * axis + 1] = std::max(bounds[2 * axis + 1], m_points[3 * i + axis]);
+    }
+  }
+  double offset[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    offset[axis] = (1.0 - gain) * 0.5 * (bounds[2 * axis] + bounds[2 * axis + 1]);
+  }
+  vtkSMPTools::For(0, static_cast<vtkIdType>(m_numPoints), [&](vtkIdType begin, vtkIdType end) {
+    for (auto i = static_cast<size_t>(begin); i < static_cast<size_t>(end); ++i) {
+      for (int axis = 0; axis < 3; ++axis) {
+        m_scratch[3 * i + axis] = m_onBoundary[i] ? m_points[3 * i + axis] : m_scratch[3 * i + axis] + offset[axis];
+      }
+    }
+  });
+  std::swap(m_points, m_scratch);
+}
+
+//---------------------------------------------------------------------------
+void MeanCurvatureFlow::Flow(double dt) {
+  vtkSMPTools::For(0, static_cast<vtkIdType>(m_numPoints), [&](vtkIdType begin, vtkIdType end) {
+    for (auto i = static_cast<size_t>(begin); i < static_cast<size_t>(end); ++i) {
+      const double* p = &m_points[3 * i];
+      // area weighted normal, a third of the area of the triangles around the point, and the
+      // cotangent Laplacian of the point times twice that area
+      double normal[3] = {0.0, 0.0, 0.0};
+      double area = 0.0;
+      double laplacian[3] = {0.0, 0.0, 0.0};
+      for (size_t n = m_pointTriangleOffsets[i]; n < m_pointTriangleOffsets[i + 1]; ++n) {
+        const auto* triangle = &m_triangles[3 * m_pointTriangles[n]];
+        // the triangle's other points, in its order
+        const size_t corner = triangle[0] == i ? 0 : (triangle[1] == i ? 1 : 2);
+        const double* a = &m_points[3 * triangle[(corner + 1) % 3]];
+        const double* b = &m_points[3 * triangle[(corner + 2) % 3]];
+
+        double pa[3], pb[3], ab[3], cross[3];
+        Subtract(a, p, pa);
+        Subtract(b, p, pb);
+        Subtract(b, a, ab);
+        Cross(pa, pb, cross);
+        const double doubleArea = std::sqrt(Dot(cross, cross));
+        if (doubleArea == 0) {
+          continue;
+        }
+        for (int axis = 0; axis < 3; ++axis) {
+          normal[axis] += cross[axis];
+        }
+        area += doubleArea / 6;
+
+        // the edge to a is weighted by the cotangent of the angle at b and vice versa
+        const double cotA = -Dot(pa, ab) / doubleArea;
+        const double cotB = Dot(pb, ab) / doubleArea;
+        for (int axis = 0; axis < 3; ++axis) {
+          laplacian[axis] += 0.5 * (cotB * pa[axis] + cotA * pb[axis]);
+        }
+      }
+
+      double* result = &m_scratch[3 * i];
+      const double normalLength = std::sqrt(Dot(normal, normal));
+      if (area == 0 || normalLength == 0) {
+        std::copy_n(p, 3, result);
+        continue;
+      }
+      // the Laplacian is -2 H n, for the unit normal n and mean curvature H
+      const double meanCurvature = -Dot(laplacian, normal) / (2 * area * normalLength);
+      for (int axis = 0; axis < 3; ++axis) {
+        result[axis] = p[axis] - dt * meanCurvature * normal[axis] / normalLength;
+      }
+    }
+  });
+  std::swap(m_points, m_scratch);
+}
+
+//---------------------------------------------------------------------------
+void MeanCurvatureFlow::CreateSemiImplicitSystem() {
+  std::vector<Eigen::Triplet<double>> pattern;
+  pattern.reserve(m_numPoints + m_neighbors.size());
+  for (size_t i = 0; i < m_numPoints; ++i) {
+    pattern.emplace_back(static_cast<int>(i), static_cast<int>(i), 0.0);
+    for (size_t n = m_neighborOffsets[i]; n < m_neighborOffsets[i + 1]; ++n) {
+      pattern.emplace_back(static_cast<int>(m_neighbors[n]), static_cast<int>(i), 0.0);
+    }
+  }
+  m_system.resize(static_cast<int>(m_numPoints), static_cast<int>(m_numPoints));
+  m_system.setFromTriplets(pattern.begin(), pattern.end());
+  m_system.makeCompressed();
+  m_mass.resize(m_numPoints);
+  m_solver.analyzePattern(m_system);
+  m_analyzed = true;
+}
+
+//---------------------------------------------------------------------------
+void MeanCurvatureFlow::FlowSemiImplicit(double dt) {
+  if (!m_analyzed) {
+    this->CreateSemiImplicitSystem();
+  }
+
+  // the system is symmetric, so column i holds the entries of point i's row and every point fills its own
+  const int* rows = m_system.innerIndexPtr();
+  const int* columnStarts = m_system.outerIndexPtr();
+  double* values = m_system.valuePtr();
+  vtkSMPTools::For(0, static_cast<vtkIdType>(m_numPoints), [&](vtkIdType begin, vtkIdType end) {
+    for (auto i = static_cast<size_t>(begin); i < static_cast<size_t>(end); ++i) {
+      const int* columnBegin = rows + columnStarts[i];
+      const int* columnEnd = rows + columnStarts[i + 1];
+      double* columnValues = values + columnStarts[i];
+      std::fill(columnValues, columnValues + (columnEnd - columnBegin), 0.0);
+      const auto entry = [&](size_t row) -> double& {
+        return columnValues[std::lower_bound(columnBegin, columnEnd, static_cast<int>(row)) - columnBegin];
+      };
+
+      const double* p = &m_points[3 * i];
+      double area = 0.0;
+      double& diagonal = entry(i);
+      for (size_t n = m_pointTriangleOffsets[i]; n < m_pointTriangleOffsets[i + 1]; ++n) {
+        const auto* triangle = &m_triangles[3 * m_pointTriangles[n]];
+        const size_t corner = triangle[0] == i ? 0 : (triangle[1] == i ? 1 : 2);
+        const auto a = triangle[(corner + 1) % 3];
+        const auto b = triangle[(corner + 2) % 3];
+
+        double pa[3], pb[3], ab[3], cross[3];
+        Subtract(&m_points[3 * a], p, pa);
+        Subtract(&m_points[3 * b], p, pb);
+        Subtract(&m_points[3 * b], &m_points[3 * a], ab);
+        Cross(pa, pb, cross);
+        const double doubleArea = std::sqrt(Dot(cross, cross));
+        if (doubleArea == 0) {
+          continue;
+        }
+        area += doubleArea / 6;
+
+        // -dt / 2 times the cotangent weights of the edges to a and b, as in Flow
+        const double weightA = 0.25 * dt * Dot(pb, ab) / doubleArea;
+        const double weightB = -0.25 * dt * Dot(pa, ab) / doubleArea;
+        entry(a) -= weightA;
+        entry(b) -= weightB;
+        diagonal += weightA + weightB;
+      }
+      // a point without area has no weights either, so a unit mass keeps it in place
+      m_mass[i] = area > 0 ? area : 1.0;
+      diagonal += m_mass[i];
+    }
+  });
+
+  m_solver.factorize(m_system);
+  if (m_solver.info() != Eigen::Success) {
+    throw std::runtime_error("Unable to factorize the semi-implicit mean curvature flow system");
+  }
+  Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor>> points(m_points.data(), static_cast<Eigen::Index>(m_numPoints), 3);
+  const Eigen::Map<const Eigen::VectorXd> mass(m_mass.data(), static_cast<Eigen::Index>(m_numPoints));
+  const Eigen::MatrixXd rightHandSide = mass.asDiagonal() * points;
+  const Eigen::MatrixXd result = m_solver.solve(rightHandSide);
+  if (m_solver.info() != Eigen::Success) {
+    throw std::runtime_error("Unable to solve the semi-implicit mean curvature flow system");
+  }
+  points = result;
+}
+
+}
@@ -0,0 +1,111 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkSlicerSRepCreatorLogic_SRepMeanCurvatureFlow_h
+#define __vtkSlicerSRepCreatorLogic_SRepMeanCurvatureFlow_h
+
+#include <cstdlib>
+#include <vector>
+
+#include <Eigen/SparseCholesky>
+#include <Eigen/SparseCore>
+
+#include "vtkSlicerSRepCreatorModuleLogicExport.h"
+
+namespace srepcreator {
+
+/// Flows a closed triangle mesh by its mean curvature.
+///
+/// Each step moves every point along its normal by -dt times its mean curvature, so convex
+/// regions shrink and the mesh becomes rounder. The adjacency of the mesh is computed once, and
+/// each step computes the normals, the cotangent mean curvature and the update of every point in
+/// one multithreaded pass over flat arrays.
+///
+/// With semi-implicit integration, each step instead solves the backward Euler system
+/// (M - dt / 2 L) x' = M x for the cotangent Laplacian L and lumped mass matrix M. Its normal part
+/// moves the points by -dt H n as the explicit step does, with H and n taken after the step, so dt
+/// means the same for both. Unlike the explicit step it keeps the tangential part of the Laplacian,
+/// which also slides the points toward an even spacing over the surface. It stays stable for time
+/// steps at least ten times larger. The sparsity of the system never changes, so its symbolic
+/// factorization is computed once and reused by every step.
+///
+/// Optionally each step first smooths the mesh with the windowed sinc low pass filter of
+/// vtkWindowedSincPolyDataFilter, with a Hamming window and NormalizeCoordinates on. Points on the
+/// boundary of the mesh are not smoothed.
+class VTK_SLICER_SREPCREATOR_MODULE_LOGIC_EXPORT MeanCurvatureFlow {
+public:
+  enum class Integration {
+    Explicit,     ///< forward Euler, only stable for small time steps
+    SemiImplicit, ///< backward Euler in the Laplacian, with the Laplacian of the current mesh
+  };
+
+  /// \param points x y z of each point.
+  /// \param triangles The point indices of each triangle, consistently oriented.
+  /// \throws std::invalid_argument if a triangle refers to a point that doesn't exist.
+  MeanCurvatureFlow(const std::vector<double>& points, const std::vector<size_t>& triangles);
+
+  /// Sets the smoothing done before every step.
+  /// \param passBand Frequencies of the mesh above it are removed, clamped to [0, 2] as
+  ///        vtkWindowedSincPolyDataFilter does. Smaller smooths more. 0 turns smoothing off.
+  /// \param iterations Order of the filter. Higher orders cut off more sharply.
+  /// \throws std::invalid_argument if iterations is 0.
+  void SetSmoothing(double passBand, size_t iterations);
+
+  /// Sets how each step is integrated. Default is Integration::Explicit.
+  void SetIntegration(Integration integration);
+
+  /// Smooths, if on, and then flows the points by dt.
+  /// \throws std::runtime_error if the semi-implicit system can't be factorized, e.g. for a degenerate mesh.
+  void Step(double dt);
+
+  /// Gets x y z of each point.
+  const std::vector<double>& GetPoints() const;
+  size_t GetNumberOfPoints() const;
+
+private:
+  using SparseMatrix = Eigen::SparseMatrix<double>;
+
+  void Smooth();
+  void Flow(double dt);
+  void FlowSemiImplicit(double dt);
+  // Creates m_system with an entry for every point and edge, and analyzes its sparsity
+  void CreateSemiImplicitSystem();
+
+  const size_t m_numPoints;
+  std::vector<double> m_points;
+  const std::vector<size_t> m_triangles;
+  // compressed sparse rows: the triangles around point i are
+  // m_pointTriangles[m_pointTriangleOffsets[i]] to m_pointTriangles[m_pointTriangleOffsets[i + 1] - 1]
+  std::vector<size_t> m_pointTriangleOffsets;
+  std::vector<size_t> m_pointTriangles;
+  // compressed sparse rows of the points that share an edge with each point
+  std::vector<size_t> m_neighborOffsets;
+  std::vector<size_t> m_neighbors;
+  std::vector<char> m_onBoundary;
+  std::vector<double> m_smoothingCoefficients; // one per filter term, empty for no smoothing
+  std::vector<double> m_scratch; // the points being computed
+  std::vector<double> m_chebyshev[3]; // the last terms of the smoothing filter
+  Integration m_integration;
+  SparseMatrix m_system; // M - dt / 2 L, with the points and edges of the mesh as its sparsity
+  std::vector<double> m_mass; // diagonal of M
+  Eigen::SimplicialLDLT<SparseMatrix> m_solver;
+  bool m_analyzed; // if m_solver has the symbolic factorization of m_system
+};
+
+}
+
+#endif
@@ -18,28 +18,25 @@
 // Logic includes
 #include "vtkSlicerSRepCreatorLogic.h"
 #include "vtkSlicerSRepLogic.h"
+#include "SRepLandmarkSelection.h"
+#include "SRepMeanCurvatureFlow.h"
 
 // MRML includes
 #include <vtkMRMLScene.h>
 #include <vtkMRMLDisplayNode.h>
 
 // VTK includes
+#include <vtkCellArray.h>
 #include <vtkCellLocator.h>
-#include <vtkCurvatures.h>
-#include <vtkDecimatePro.h>
-#include <vtkDoubleArray.h>
 #include <vtkGenericCell.h>
+#include <vtkIdList.h>
 #include <vtkIntArray.h>
 #include <vtkMassProperties.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkParametricEllipsoid.h>
 #include <vtkParametricFunctionSource.h>
-#include <vtkPointData.h>
-#include <vtkPolyDataNormals.h>
-#include <vtkPolyDataReader.h>
-#include <vtkPolyDataWriter.h>
-#include <vtkWindowedSincPolyDataFilter.h>
+#include <vtkPoints.h>
 
 #include <vtksys/SystemTools.hxx>
 
@@ -50,10 +47,15 @@
 #include <srepUtil.h>
 
 // STD includes
+#include <algorithm>
 #include <cassert>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
 #include <numeric>
 #include <random>
 #include <sstream>
+#include <thread>
 
 namespace {
   //---------------------------------------------------------------------------
@@ -90,6 +92,58 @@ namespace {
     return srep::Point3d(v(0), v(1), v(2));
   }
 
+  //---------------------------------------------------------------------------
+  // A thin plate spline that frees its linear system once it is solved. For N landmarks the system
+  // matrices hold about (3N)^2 doubles each, while TransformPoint only uses the 3xN deformation
+  // weights, the affine part and the source landmarks.
+  class SolvedThinPlateSpline : public itkThinPlateSplineExtended {
+  public:
+    using Self = SolvedThinPlateSpline;
+    using Superclass = itkThinPlateSplineExtended;
+    using Pointer = itk::SmartPointer<Self>;
+    itkNewMacro(Self);
+
+    void ComputeWMatrixAndReleaseSystem() {
+      this->ComputeWMatrix();
+      this->m_LMatrix = LMatrixType();
+      this->m_KMatrix = KMatrixType();
+      this->m_PMatrix = PMatrixType();
+      this->m_YMatrix = YMatrixType();
+      this->m_WMatrix = WMatrixType();
+    }
+
+  protected:
+    SolvedThinPlateSpline() = default;
+    ~SolvedThinPlateSpline() override = default;
+  };
+
+  //---------------------------------------------------------------------------
+  // Solves the thin plate spline taking each of the source points, x y z after each other, to the target point
+  itkThinPlateSplineExtended::Pointer SolveTPS(const std::vector<double>& sourcePoints, const std::vector<double>& targetPoints) {
+    using PointSetType = itkThinPlateSplineExtended::PointSetType;
+    const auto addLandMarks = [](const std::vector<double>& points, PointSetType& landMarks) {
+      auto container = landMarks.GetPoints();
+      for (size_t i = 0; i < points.size() / 3; ++i) {
+        PointSetType::PointType pt;
+        pt[0] = points[3 * i];
+        pt[1] = points[3 * i + 1];
+        pt[2] = points[3 * i + 2];
+        container->InsertElement(i, pt);
+      }
+    };
+
+    auto sourceLandMarks = PointSetType::New();
+    auto targetLandMarks = PointSetType::New();
+    addLandMarks(sourcePoints, *sourceLandMarks);
+    addLandMarks(targetPoints, *targetLandMarks);
+
+    auto tps = SolvedThinPlateSpline::New();
+    tps->SetSourceLandmarks(sourceLandMarks);
+    tps->SetTargetLandmarks(targetLandMarks);
+    tps->ComputeWMatrixAndReleaseSystem();
+    return itkThinPlateSplineExtended::Pointer(tps.GetPointer());
+  }
+
   //---------------------------------------------------------------------------
   srep::Point3d ApplyTPS(const srep::Point3d& point, itkThinPlateSplineExtended::Pointer tps) {
     const auto transformed = tps->TransformPoint(point.AsArray());
@@ -110,6 +164,37 @@ namespace {
     }
   }
 
+  //---------------------------------------------------------------------------
+  // Gets the point indices of the triangles of mesh's polygons, splitting larger polygons into fans
+  std::vector<size_t> GetTriangles(vtkPolyData& mesh) {
+    std::vector<size_t> triangles;
+    vtkCellArray* polys = mesh.GetPolys();
+    vtkNew<vtkIdList> cell;
+    polys->InitTraversal();
+    while (polys->GetNextCell(cell)) {
+      for (vtkIdType i = 2; i < cell->GetNumberOfIds(); ++i) {
+        triangles.push_back(static_cast<size_t>(cell->GetId(0)));
+        triangles.push_back(static_cast<size_t>(cell->GetId(i - 1)));
+        triangles.push_back(static_cast<size_t>(cell->GetId(i)));
+      }
+    }
+    return triangles;
+  }
+
+  //---------------------------------------------------------------------------
+  // Creates a mesh with the polygons of mesh and the given x y z of each point
+  vtkSmartPointer<vtkPolyData> CreateMeshWithPoints(vtkPolyData& mesh, const std::vector<double>& points) {
+    vtkNew<vtkPoints> meshPoints;
+    meshPoints->SetDataTypeToDouble();
+    meshPoints->SetNumberOfPoints(static_cast<vtkIdType>(points.size() / 3));
+    std::copy(points.begin(), points.end(), static_cast<double*>(meshPoints->GetVoidPointer(0)));
+
+    auto result = vtkSmartPointer<vtkPolyData>::New();
+    result->SetPoints(meshPoints);
+    result->SetPolys(mesh.GetPolys());
+    return result;
+  }
+
   //---------------------------------------------------------------------------
   void ApplyTPSInPlace(vtkEllipticalSRep& srep, itkThinPlateSplineExtended::Pointer tps) {
     using IndexType = vtkEllipticalSRep::IndexType;
@@ -146,7 +231,14 @@ vtkStandardNewMacro(vtkSlicerSRepCreatorLogic);
 
 //----------------------------------------------------------------------------
 vtkSlicerSRepCreatorLogic::vtkSlicerSRepCreatorLogic()
-  : ActualForwardIterations(0)
+  : IdsToWrite()
+  , ForwardSnapshots()
+  , SnapshotMemoryBudget(1024)
+  , NumberOfLandmarks(0)
+  , LandmarkSeed(0)
+  , SemiImplicitFlow(false)
+  , BackflowThreads(0)
+  , ActualForwardIterations(0)
   , SRepNodeId()
   , ModelName()
   , ProgressTracker(*this)
@@ -159,6 +251,11 @@ vtkSlicerSRepCreatorLogic::~vtkSlicerSRepCreatorLogic() = default;
 void vtkSlicerSRepCreatorLogic::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "SnapshotMemoryBudget: " << this->SnapshotMemoryBudget << "\n";
+  os << indent << "NumberOfLandmarks: " << this->NumberOfLandmarks << "\n";
+  os << indent << "LandmarkSeed: " << this->LandmarkSeed << "\n";
+  os << indent << "SemiImplicitFlow: " << this->SemiImplicitFlow << "\n";
+  os << indent << "BackflowThreads: " << this->BackflowThreads << "\n";
 }
 
 //---------------------------------------------------------------------------
@@ -187,20 +284,21 @@ std::string vtkSlicerSRepCreatorLogic::TempFolder() {
 }
 
 //---------------------------------------------------------------------------
-void vtkSlicerSRepCreatorLogic::WriteIteration(vtkPolyData* mesh, const size_t iteration) {
-  vtkNew<vtkPoints> points;
-  double p[3];
-  for (const auto id : this->IdsToWrite) {
-    mesh->GetPoint(id, p);
-    points->InsertNextPoint(p);
-  }
-  vtkNew<vtkPolyData> polydata;
-  polydata->SetPoints(points);
-
-  vtkNew<vtkPolyDataWriter> writer;
-  writer->SetFileName(this->ForwardIterationFilename(iteration).c_str());
-  writer->SetInputData(polydata);
-  writer->Update();
+void vtkSlicerSRepCreatorLogic::StoreIteration(vtkPolyData* mesh) {
+  std::vector<double> points(3 * this->IdsToWrite.size());
+  for (size_t i = 0; i < this->IdsToWrite.size(); ++i) {
+    mesh->GetPoint(this->IdsToWrite[i], &points[3 * i]);
+  }
+  this->ForwardSnapshots->Append(points.data());
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerSRepCreatorLogic::StoreIteration(const std::vector<double>& meshPoints) {
+  std::vector<double> points(3 * this->IdsToWrite.size());
+  for (size_t i = 0; i < this->IdsToWrite.size(); ++i) {
+    std::copy_n(meshPoints.begin() + 3 * this->IdsToWrite[i], 3, points.begin() + 3 * i);
+  }
+  this->ForwardSnapshots->Append(points.data());
 }
 
 //---------------------------------------------------------------------------
@@ -219,7 +317,7 @@ vtkSlicerSRepCreatorLogic::EllipsoidParameters vtkSlicerSRepCreatorLogic::FlowSu
   const auto ellipsoidParameters = CalculateBestFitEllipsoid(*flowedMesh);
   auto ellipsoidalMesh = this->SnapFlowedMeshToEllipsoid(*flowedMesh, ellipsoidParameters);
 
-  this->WriteIteration(ellipsoidalMesh, maxIterations+1);
+  this->StoreIteration(ellipsoidalMesh);
   ++this->ActualForwardIterations;
 
   if (outputEveryNumIterations != 0) {
@@ -249,37 +347,35 @@ vtkSmartPointer<vtkPolyData> vtkSlicerSRepCreatorLogic::FlowSurfaceMesh(
     return nullptr;
   }
 
+  const auto numPoints = static_cast<size_t>(mesh->GetNumberOfPoints());
+  std::vector<double> meshPoints(3 * numPoints);
+  for (size_t i = 0; i < numPoints; ++i) {
+    mesh->GetPoint(static_cast<vtkIdType>(i), &meshPoints[3 * i]);
+  }
+
   { // get the subset of points we will save and use for backflow
-    // Get ~10% of the points that are distributed semi-nicely across the shape
-    this->IdsToWrite.clear();
-    this->IdsToWrite.reserve(mesh->GetNumberOfPoints() / 10);
-
-    vtkNew<vtkDecimatePro> decimate;
-    decimate->SetTargetReduction(0.9);
-    decimate->SetInputData(mesh);
-    decimate->Update();
-    vtkSmartPointer<vtkPolyData> decimatedMesh = decimate->GetOutput();
-
-    std::array<double, 3> pt;
-    std::array<double, 3> dpt;
-    for (int d = 0; d < decimatedMesh->GetNumberOfPoints(); ++d) {
-      decimatedMesh->GetPoint(d, dpt.data());
-      for (int o = 0; o < mesh->GetNumberOfPoints(); ++o) {
-        mesh->GetPoint(o, pt.data());
-        if (pt == dpt) {
-          this->IdsToWrite.push_back(o);
-          break;
-        }
+    // Get the landmarks, by default ~10% of the points, distributed nicely across the shape
+    const auto numLandmarks = this->NumberOfLandmarks > 0
+      ? static_cast<size_t>(this->NumberOfLandmarks)
+      : std::max<size_t>(numPoints / 10, 4);
+    const auto landmarks = srepcreator::SelectLandmarks(meshPoints, numLandmarks, static_cast<uint32_t>(this->LandmarkSeed));
+    this->IdsToWrite.assign(landmarks.begin(), landmarks.end());
+  }
+
+  { // store the flow of those points for the backwards flow
+    // every iteration plus the ellipsoid the flowed mesh is snapped to
+    const size_t numSnapshots = maxIterations + 1;
+    const size_t memoryBudget = static_cast<size_t>(this->SnapshotMemoryBudget) * 1024 * 1024;
+    std::string spillFileName;
+    if (numSnapshots * 3 * this->IdsToWrite.size() * sizeof(double) > memoryBudget) {
+      //create a temp folder for the iterations that don't fit in memory
+      const auto tempFolder = this->TempFolder();
+      if (tempFolder.empty()) {
+        return nullptr;
       }
+      spillFileName = tempFolder + "/forward-flow.bin";
     }
-
-    std::sort(this->IdsToWrite.begin(), this->IdsToWrite.end());
-  }
-
-  //create a temp folder to store stuff for backwards flow in
-  const auto tempFolder = this->TempFolder();
-  if (tempFolder.empty()) {
-    return nullptr;
+    this->ForwardSnapshots.reset(new srepcreator::FlowSnapshotStore(this->IdsToWrite.size(), memoryBudget, spillFileName));
   }
 
   //TODO: delete if don't need volume
@@ -289,71 +385,28 @@ vtkSmartPointer<vtkPolyData> vtkSlicerSRepCreatorLogic::FlowSurfaceMesh(
 
   // const double originalVolume = massFilter->GetVolume();
 
-  const bool smoothing = smoothAmount > 0;
-
-  vtkNew<vtkPolyDataNormals> normalFilter;
-  normalFilter->SplittingOff();
-  normalFilter->ComputeCellNormalsOff();
-  normalFilter->ComputePointNormalsOn();
-  if (!smoothing) {
-    normalFilter->SetInputData(mesh); //mesh only changes if we are smoothing
+  // the adjacency of the mesh is computed once for all of the iterations
+  srepcreator::MeanCurvatureFlow flow(meshPoints, GetTriangles(*mesh));
+  if (smoothAmount > 0) {
+    flow.SetSmoothing(smoothAmount, 20);
   }
-
-  vtkNew<vtkCurvatures> curvatureFilter;
-  curvatureFilter->SetInputConnection(normalFilter->GetOutputPort());
-  curvatureFilter->SetCurvatureTypeToMean();
+  flow.SetIntegration(this->SemiImplicitFlow
+    ? srepcreator::MeanCurvatureFlow::Integration::SemiImplicit
+    : srepcreator::MeanCurvatureFlow::Integration::Explicit);
 
   for (size_t i = 0; i < maxIterations; ++i) {
     this->ProgressTracker.SetForwardProgress(static_cast<double>(i) / maxIterations);
 
-    vtkSmartPointer<vtkWindowedSincPolyDataFilter> smoothFilter;
-    if (smoothing) {
-      //there is something weird about this filter where it doesn't work
-      //if you don't make it new every time
-      smoothFilter = vtkSmartPointer<vtkWindowedSincPolyDataFilter>::New();
-      smoothFilter->SetPassBand(smoothAmount);
-      smoothFilter->NonManifoldSmoothingOn();
-      smoothFilter->NormalizeCoordinatesOn();
-      smoothFilter->SetNumberOfIterations(20);
-      smoothFilter->FeatureEdgeSmoothingOff();
-      smoothFilter->BoundarySmoothingOff();
-
-      smoothFilter->SetInputData(mesh);
-      normalFilter->SetInputConnection(smoothFilter->GetOutputPort());
-    }
-    curvatureFilter->Update();
-    if (smoothing) {
-      mesh = smoothFilter->GetOutput();
-    }
-
-    auto curvature = vtkDoubleArray::SafeDownCast(curvatureFilter->GetOutput()->GetPointData()->GetArray("Mean_Curvature"));
-    auto normals = normalFilter->GetOutput()->GetPointData()->GetNormals();
-    if (!curvature || !normals) {
-      return nullptr;
-    }
-
-    // perform the flow
-    auto points = mesh->GetPoints();
-    for (int i = 0; i < points->GetNumberOfPoints(); ++i) {
-      double p[3];
-      points->GetPoint(i, p);
-      const double* n = normals->GetTuple(i);
-      const auto h = curvature->GetValue(i);
-      for (int j = 0; j < 3; ++j) {
-        p[j] -= dt * h * n[j];
-      }
-      points->SetPoint(i, p);
-    }
-    points->Modified();
-
-    this->WriteIteration(mesh, i+1);
+    flow.Step(dt);
+    this->StoreIteration(flow.GetPoints());
 
     if (outputEveryNumIterations != 0 && i % outputEveryNumIterations == 0) {
-      this->MakeModelNode(mesh,
+      this->MakeModelNode(CreateMeshWithPoints(*mesh, flow.GetPoints()),
         model->GetName() + std::string("-forwardflow-") + std::to_string(i),
         true, model->GetDisplayNode()->GetColor());
     }
   }
+  mesh = CreateMeshWithPoints(*mesh, flow.GetPoints());
   this->ActualForwardIterations = maxIterations;
 
   if (outputEveryNumIterations != 0) {
@@ -365,11 +418,6 @@ vtkSmartPointer<vtkPolyData> vtkSlicerSRepCreatorLogic::FlowSurfaceMesh(
   return mesh;
 }
 
-//---------------------------------------------------------------------------
-std::string vtkSlicerSRepCreatorLogic::ForwardIterationFilename(const long iteration) {
-  return this->TempFolder() + "/" + std::to_string(iteration) + ".vtk";
-}
-
 //---------------------------------------------------------------------------
 vtkSmartPointer<vtkPolyData> vtkSlicerSRepCreatorLogic::SnapFlowedMeshToEllipsoid(vtkPolyData& alreadyFlowedMesh, const EllipsoidParameters& ellipsoid) {
   auto ellipsoidPolyData = vtkSlicerSRepCreatorLogic::MakeEllipsoidPolyData(ellipsoid);
@@ -721,6 +769,7 @@ vtkSmartPointer<vtkEllipticalSRep> vtkSlicerSRepCreatorLogic::GenerateSRep(
 //---------------------------------------------------------------------------
 void vtkSlicerSRepCreatorLogic::Reset() {
   this->ActualForwardIterations = 0;
+  this->ForwardSnapshots.reset();
   this->SRepNodeId.clear();
   this->ModelName.clear();
 }
@@ -773,19 +822,6 @@ vtkMRMLEllipticalSRepNode* vtkSlicerSRepCreatorLogic::RunForward(
 vtkMRMLEllipticalSRepNode* vtkSlicerSRepCreatorLogic::RunBackward(const size_t outputEveryNumIterations) {
   try {
     using TransformType = itkThinPlateSplineExtended;
-    using PointType = itk::Point<double, 3>;
-    using PointSetType = TransformType::PointSetType;
-    using PointIdType = PointSetType::PointIdentifier;
-
-    const auto polyDataPointToPointType = [](vtkPolyData& poly, unsigned int index) {
-      PointType pt;
-      double p[3];
-      poly.GetPoint(index, p);
-      pt[0] = p[0];
-      pt[1] = p[1];
-      pt[2] = p[2];
-      return pt;
-    };
 
     auto mrmlScene = this->GetMRMLScene();
     if (!mrmlScene) {
@@ -806,56 +842,111 @@ vtkMRMLEllipticalSRepNode* vtkSlicerSRepCreatorLogic::RunBackward(const size_t o
     //copy the srep
     auto backflowedSRep = srep->SmartClone();
 
-    vtkNew<vtkPolyDataReader> reader1;
-    vtkNew<vtkPolyDataReader> reader2;
-
-    vtkPolyDataReader* sourceSurfaceReader = reader1;
-    vtkPolyDataReader* targetSurfaceReader = reader2;
-
-    sourceSurfaceReader->SetFileName(this->ForwardIterationFilename(this->ActualForwardIterations).c_str());
-    sourceSurfaceReader->Update();
-
-    for (long iteration = this->ActualForwardIterations; iteration > 1; --iteration) {
-      this->ProgressTracker.SetBackwardProgress(static_cast<double>(this->ActualForwardIterations - iteration) / this->ActualForwardIterations);
-
-      //swap source and target at bottom because target becomes source
-      targetSurfaceReader->SetFileName(this->ForwardIterationFilename(iteration - 1).c_str());
-      targetSurfaceReader->Update();
-
-      vtkSmartPointer<vtkPolyData> polyData_source = sourceSurfaceReader->GetOutput();
-      vtkSmartPointer<vtkPolyData> polyData_target = targetSurfaceReader->GetOutput();
+    if (!this->ForwardSnapshots || this->ForwardSnapshots->GetNumberOfSnapshots() != this->ActualForwardIterations) {
+      vtkErrorMacro("vtkSlicerSRepCreatorLogic::RunBackward() cannot find the forward flow");
+      return nullptr;
+    }
 
-      PointSetType::Pointer sourceLandMarks = PointSetType::New();
-      PointSetType::Pointer targetLandMarks = PointSetType::New();
-      PointSetType::PointsContainer::Pointer sourceLandMarkContainer
-                  = sourceLandMarks->GetPoints();
-      PointSetType::PointsContainer::Pointer targetLandMarkContainer
-                  = targetLandMarks->GetPoints();
+    // transform k flows the landmarks from snapshot numTransforms - k to the one before it. Solving
+    // one only needs the two snapshots, so the workers solve them ahead of the srep, which is moved
+    // by each in order as soon as it is ready.
+    const size_t numTransforms = this->ActualForwardIterations > 0 ? this->ActualForwardIterations - 1 : 0;
+    const size_t numLandMarks = this->ForwardSnapshots->GetNumberOfPoints();
+    // every solve in progress holds its dense system and SVD, so by default only a few run at once
+    constexpr size_t maxDefaultThreads = 4;
+    const size_t numThreads = std::min(numTransforms, this->BackflowThreads > 0
+      ? static_cast<size_t>(this->BackflowThreads)
+      : std::min(maxDefaultThreads, static_cast<size_t>(std::max(1u, std::thread::hardware_concurrency()))));
+    // the solved transforms only keep their weights, but there is no use solving far ahead of the srep
+    const size_t window = 2 * numThreads;
+
+    std::vector<TransformType::Pointer> transforms(numTransforms);
+    std::mutex mutex; // guards transforms, the counters, the flags and ForwardSnapshots
+    std::condition_variable changed;
+    size_t nextToSolve = 0;
+    size_t numApplied = 0;
+    bool stop = false;
+    std::exception_ptr error;
+
+    const auto solveTransforms = [&]() {
+      std::vector<double> sourcePoints(3 * numLandMarks);
+      std::vector<double> targetPoints(3 * numLandMarks);
+      std::unique_lock<std::mutex> lock(mutex);
+      while (true) {
+        changed.wait(lock, [&]() { return stop || nextToSolve >= numTransforms || nextToSolve < numApplied + window; });
+        if (stop || nextToSolve >= numTransforms) {
+          return;
+        }
+        const size_t k = nextToSolve++;
+        TransformType::Pointer tps;
+        std::exception_ptr solveError;
+        try {
+          this->ForwardSnapshots->Get(numTransforms - k, sourcePoints.data());
+          this->ForwardSnapshots->Get(numTransforms - k - 1, targetPoints.data());
+          lock.unlock();
+          tps = SolveTPS(sourcePoints, targetPoints);
+        } catch (...) {
+          solveError = std::current_exception();
+        }
 
-      // Read in the source points set
-      for(unsigned int i = 0; i < polyData_source->GetNumberOfPoints(); ++i) {
-          sourceLandMarkContainer->InsertElement(i, polyDataPointToPointType(*polyData_source, i));
+        if (!lock.owns_lock()) {
+          lock.lock();
+        }
+        if (solveError) {
+          error = solveError;
+          stop = true;
+        } else {
+          transforms[k] = tps;
+        }
+        changed.notify_all();
       }
+    };
 
-      // Read in the target points set
-      for(unsigned int i = 0; i < polyData_target->GetNumberOfPoints(); ++i) {
-          targetLandMarkContainer->InsertElement(i, polyDataPointToPointType(*polyData_target, i));
+    std::vector<std::thread> workers;
+    const auto stopWorkers = [&]() {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
       }
+      changed.notify_all();
+      for (auto& worker : workers) {
+        worker.join();
+      }
+    };
 
-      TransformType::Pointer tps = TransformType::New();
-      tps->SetSourceLandmarks(sourceLandMarks);
-      tps->SetTargetLandmarks(targetLandMarks);
-      tps->ComputeWMatrix();
+    try {
+      for (size_t i = 0; i < numThreads; ++i) {
+        workers.emplace_back(solveTransforms);
+      }
+      for (size_t k = 0; k < numTransforms; ++k) {
+        const size_t iteration = this->ActualForwardIterations - k;
+        this->ProgressTracker.SetBackwardProgress(static_cast<double>(k) / this->ActualForwardIterations);
+
+        TransformType::Pointer tps;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          changed.wait(lock, [&]() { return transforms[k].IsNotNull() || error; });
+          if (error) {
+            std::rethrow_exception(error);
+          }
+          tps = transforms[k];
+          transforms[k] = nullptr;
+          ++numApplied;
+        }
+        changed.notify_all();
 
-      ApplyTPSInPlace(*backflowedSRep, tps);
+        ApplyTPSInPlace(*backflowedSRep, tps);
 
-      if (outputEveryNumIterations != 0 && iteration % outputEveryNumIterations == 0) {
-        // deep copy the srep
-        this->MakeEllipticalSRepNode(backflowedSRep->SmartClone(), this->ModelName + "-backflow-srep-" + std::to_string(iteration));
+        if (outputEveryNumIterations != 0 && iteration % outputEveryNumIterations == 0) {
+          // deep copy the srep
+          this->MakeEllipticalSRepNode(backflowedSRep->SmartClone(), this->ModelName + "-backflow-srep-" + std::to_string(iteration));
+        }
       }
-
-      std::swap(sourceSurfaceReader, targetSurfaceReader);
+    } catch (...) {
+      stopWorkers();
+      throw;
     }
+    stopWorkers();
 
     auto transformedSRepNode = this->MakeEllipticalSRepNode(backflowedSRep, this->ModelName + "-srep");
     return transformedSRepNode;
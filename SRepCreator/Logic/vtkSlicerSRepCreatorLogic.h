@@ -27,12 +27,14 @@
 
 // STD includes
 #include <cstdlib>
+#include <memory>
 
 // Eigen includes
 #include <Eigen/Dense>
 #include <Eigen/Eigenvalues>
 
 #include "vtkSlicerSRepCreatorModuleLogicExport.h"
+#include "SRepFlowSnapshotStore.h"
 #include <vtkEllipticalSRep.h>
 
 
@@ -88,6 +90,47 @@ public:
   /// Resets the state of the logic's srep creating facilities.
   void Reset();
 
+  /// @{
+  /// Megabytes of the forward flow that are kept in memory for RunBackward. The iterations past
+  /// it are written to a file in the temporary folder, which is only created if it is needed.
+  /// Default is 1024.
+  vtkSetClampMacro(SnapshotMemoryBudget, int, 0, VTK_INT_MAX);
+  vtkGetMacro(SnapshotMemoryBudget, int);
+  /// @}
+
+  /// @{
+  /// Number of the model's points whose forward flow is kept and used as landmarks to flow the
+  /// SRep backward. They are picked spread evenly over the model. 0 uses a tenth of the points,
+  /// but at least 4 so the backward flow has an affine part to solve. Default is 0.
+  vtkSetClampMacro(NumberOfLandmarks, int, 0, VTK_INT_MAX);
+  vtkGetMacro(NumberOfLandmarks, int);
+  /// @}
+
+  /// @{
+  /// Seed of the random choices made picking the landmarks, so the same model and seed always
+  /// give the same landmarks. Default is 0.
+  vtkSetMacro(LandmarkSeed, int);
+  vtkGetMacro(LandmarkSeed, int);
+  /// @}
+
+  /// @{
+  /// If the forward flow solves each iteration semi-implicitly instead of explicitly. An
+  /// iteration costs more but stays stable for at least ten times larger dt (on a sphere the
+  /// explicit flow breaks up at twice its stable dt while the semi-implicit one stays round at
+  /// ten times it), so the same flow takes fewer iterations. Default is false.
+  vtkSetMacro(SemiImplicitFlow, bool);
+  vtkGetMacro(SemiImplicitFlow, bool);
+  vtkBooleanMacro(SemiImplicitFlow, bool);
+  /// @}
+
+  /// @{
+  /// Number of threads solving the thin plate splines of RunBackward while the SRep is moved by
+  /// the ones already solved. Each solve needs several dense matrices of (3 * landmarks)^2 doubles
+  /// at once, about 350 MB for 1000 landmarks. 0 uses one per hardware thread, up to 4. Default is 0.
+  vtkSetClampMacro(BackflowThreads, int, 0, VTK_INT_MAX);
+  vtkGetMacro(BackflowThreads, int);
+  /// @}
+
 protected:
   vtkSlicerSRepCreatorLogic();
   virtual ~vtkSlicerSRepCreatorLogic();
@@ -234,15 +277,22 @@ private:
     const std::string& name,
     bool visible = true);
 
-  std::string ForwardIterationFilename(long iteration);
-
   static vtkSmartPointer<vtkPolyData> SnapFlowedMeshToEllipsoid(
     vtkPolyData& alreadyFlowedMesh,
     const EllipsoidParameters& ellipsoid);
 
-  void WriteIteration(vtkPolyData* mesh, const size_t iteration);
+  // Adds the IdsToWrite points of mesh to ForwardSnapshots as the next iteration
+  void StoreIteration(vtkPolyData* mesh);
+  // meshPoints is x y z of each point of the mesh
+  void StoreIteration(const std::vector<double>& meshPoints);
 
   std::vector<vtkIdType> IdsToWrite;
+  std::unique_ptr<srepcreator::FlowSnapshotStore> ForwardSnapshots; // snapshot i is iteration i + 1
+  int SnapshotMemoryBudget;
+  int NumberOfLandmarks;
+  int LandmarkSeed;
+  bool SemiImplicitFlow;
+  int BackflowThreads;
   size_t ActualForwardIterations;
   std::string SRepNodeId;
   std::string ModelName;
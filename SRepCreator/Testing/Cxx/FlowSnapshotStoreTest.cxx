@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include <SRepFlowSnapshotStore.h>
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using srepcreator::FlowSnapshotStore;
+
+namespace {
+
+// a different value for every coordinate of every snapshot
+std::vector<double> MakeSnapshot(size_t index, size_t numPoints) {
+  std::vector<double> points(3 * numPoints);
+  for (size_t i = 0; i < points.size(); ++i) {
+    points[i] = 1000.0 * index + i + 0.25;
+  }
+  return points;
+}
+
+bool FileExists(const std::string& fileName) {
+  return std::ifstream(fileName).good();
+}
+
+} // namespace {}
+
+TEST(FlowSnapshotStoreTest, InMemory) {
+  const std::string spillFileName = ::testing::TempDir() + "FlowSnapshotStoreTestInMemory.bin";
+  const size_t numPoints = 5;
+  FlowSnapshotStore store(numPoints, 1024 * 1024, spillFileName);
+  EXPECT_EQ(numPoints, store.GetNumberOfPoints());
+  EXPECT_EQ(0u, store.GetNumberOfSnapshots());
+
+  for (size_t i = 0; i < 10; ++i) {
+    store.Append(MakeSnapshot(i, numPoints).data());
+  }
+  EXPECT_EQ(10u, store.GetNumberOfSnapshots());
+  EXPECT_EQ(0u, store.GetNumberOfSpilledSnapshots());
+  EXPECT_FALSE(FileExists(spillFileName));
+
+  std::vector<double> points(3 * numPoints);
+  for (size_t i = 10; i-- > 0;) {
+    store.Get(i, points.data());
+    EXPECT_EQ(MakeSnapshot(i, numPoints), points);
+  }
+  EXPECT_THROW(store.Get(10, points.data()), std::out_of_range);
+}
+
+TEST(FlowSnapshotStoreTest, SpillsPastTheBudget) {
+  const std::string spillFileName = ::testing::TempDir() + "FlowSnapshotStoreTestSpill.bin";
+  const size_t numPoints = 7;
+  const size_t snapshotBytes = 3 * numPoints * sizeof(double);
+  std::vector<double> points(3 * numPoints);
+  {
+    // room for three snapshots and a bit
+    FlowSnapshotStore store(numPoints, 3 * snapshotBytes + 8, spillFileName);
+    for (size_t i = 0; i < 8; ++i) {
+      store.Append(MakeSnapshot(i, numPoints).data());
+    }
+    EXPECT_EQ(8u, store.GetNumberOfSnapshots());
+    EXPECT_EQ(5u, store.GetNumberOfSpilledSnapshots());
+    EXPECT_TRUE(FileExists(spillFileName));
+
+    // in any order, and reading doesn't get in the way of appending
+    for (const size_t i : {7, 0, 4, 3, 2, 6, 5, 1, 7}) {
+      store.Get(i, points.data());
+      EXPECT_EQ(MakeSnapshot(i, numPoints), points) << "snapshot " << i;
+    }
+    store.Append(MakeSnapshot(8, numPoints).data());
+    store.Get(8, points.data());
+    EXPECT_EQ(MakeSnapshot(8, numPoints), points);
+    store.Get(5, points.data());
+    EXPECT_EQ(MakeSnapshot(5, numPoints), points);
+
+    store.Clear();
+    EXPECT_EQ(0u, store.GetNumberOfSnapshots());
+    EXPECT_EQ(0u, store.GetNumberOfSpilledSnapshots());
+    EXPECT_FALSE(FileExists(spillFileName));
+
+    // spills again after being cleared, and the destructor removes the file
+    for (size_t i = 0; i < 5; ++i) {
+      store.Append(MakeSnapshot(i, numPoints).data());
+    }
+    EXPECT_EQ(2u, store.GetNumberOfSpilledSnapshots());
+    store.Get(4, points.data());
+    EXPECT_EQ(MakeSnapshot(4, numPoints), points);
+  }
+  EXPECT_FALSE(FileExists(spillFileName));
+}
+
+TEST(FlowSnapshotStoreTest, ZeroBudgetSpillsEverything) {
+  const std::string spillFileName = ::testing::TempDir() + "FlowSnapshotStoreTestZeroBudget.bin";
+  const size_t numPoints = 3;
+  FlowSnapshotStore store(numPoints, 0, spillFileName);
+  for (size_t i = 0; i < 4; ++i) {
+    store.Append(MakeSnapshot(i, numPoints).data());
+  }
+  EXPECT_EQ(4u, store.GetNumberOfSpilledSnapshots());
+  std::vector<double> points(3 * numPoints);
+  store.Get(2, points.data());
+  EXPECT_EQ(MakeSnapshot(2, numPoints), points);
+}
+
+TEST(FlowSnapshotStoreTest, UnwritableSpillFile) {
+  const size_t numPoints = 3;
+  FlowSnapshotStore store(numPoints, 0, ::testing::TempDir() + "no/such/directory/spill.bin");
+  EXPECT_THROW(store.Append(MakeSnapshot(0, numPoints).data()), std::runtime_error);
+}
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <SRepLandmarkSelection.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+using srepcreator::SelectLandmarks;
+
+namespace {
+
+// points spread over an ellipsoid's surface, the kind of mesh the landmarks are picked from
+std::vector<double> MakeEllipsoidPoints(size_t numPoints) {
+  std::vector<double> points;
+  const double goldenAngle = std::acos(-1.0) * (3 - std::sqrt(5.0));
+  for (size_t i = 0; i < numPoints; ++i) {
+    const double z = 1 - 2 * (i + 0.5) / numPoints;
+    const double r = std::sqrt(1 - z * z);
+    points.push_back(3 * r * std::cos(goldenAngle * i));
+    points.push_back(2 * r * std::sin(goldenAngle * i));
+    points.push_back(z);
+  }
+  return points;
+}
+
+void ExpectValidLandmarks(const std::vector<size_t>& landmarks, size_t numPoints) {
+  EXPECT_TRUE(std::is_sorted(landmarks.begin(), landmarks.end()));
+  EXPECT_TRUE(std::adjacent_find(landmarks.begin(), landmarks.end()) == landmarks.end()) << "duplicate landmark";
+  for (const auto index : landmarks) {
+    EXPECT_LT(index, numPoints);
+  }
+}
+
+} // namespace {}
+
+TEST(LandmarkSelectionTest, ExactCount) {
+  for (const size_t numPoints : {50, 1000, 5000}) {
+    const auto points = MakeEllipsoidPoints(numPoints);
+    for (const size_t numLandmarks : {size_t(1), size_t(4), size_t(37), numPoints / 10, numPoints / 2, numPoints - 1}) {
+      const auto landmarks = SelectLandmarks(points, numLandmarks, 3);
+      EXPECT_EQ(numLandmarks, landmarks.size()) << numLandmarks << " of " << numPoints << " points";
+      ExpectValidLandmarks(landmarks, numPoints);
+    }
+  }
+}
+
+TEST(LandmarkSelectionTest, Deterministic) {
+  const auto points = MakeEllipsoidPoints(2000);
+  const auto landmarks = SelectLandmarks(points, 200, 7);
+  EXPECT_EQ(landmarks, SelectLandmarks(points, 200, 7));
+  EXPECT_NE(landmarks, SelectLandmarks(points, 200, 8));
+}
+
+TEST(LandmarkSelectionTest, FewPoints) {
+  // fewer than 10 points, where a tenth of them is no landmarks at all
+  const auto points = MakeEllipsoidPoints(7);
+  EXPECT_TRUE(SelectLandmarks(points, 0, 0).empty());
+
+  const auto four = SelectLandmarks(points, 4, 0);
+  EXPECT_EQ(4u, four.size());
+  ExpectValidLandmarks(four, 7);
+
+  // asking for as many or more than there are picks them all
+  const std::vector<size_t> all = {0, 1, 2, 3, 4, 5, 6};
+  EXPECT_EQ(all, SelectLandmarks(points, 7, 0));
+  EXPECT_EQ(all, SelectLandmarks(points, 20, 0));
+  EXPECT_TRUE(SelectLandmarks({}, 4, 0).empty());
+}
+
+TEST(LandmarkSelectionTest, CoincidentPoints) {
+  // a zero size bounding box has no grid, so the landmarks are all picked at random
+  const std::vector<double> points(3 * 30, 1.5);
+  const auto landmarks = SelectLandmarks(points, 5, 0);
+  EXPECT_EQ(5u, landmarks.size());
+  ExpectValidLandmarks(landmarks, 30);
+}
+
+TEST(LandmarkSelectionTest, SpreadOverTheSurface) {
+  // every point is close to a landmark, which a random subset of this size wouldn't manage
+  const size_t numPoints = 4000;
+  const auto points = MakeEllipsoidPoints(numPoints);
+  const auto landmarks = SelectLandmarks(points, 100, 1);
+  ASSERT_EQ(100u, landmarks.size());
+
+  double farthest = 0.0;
+  for (size_t i = 0; i < numPoints; ++i) {
+    double nearest = INFINITY;
+    for (const auto l : landmarks) {
+      double distanceSquared = 0.0;
+      for (size_t axis = 0; axis < 3; ++axis) {
+        const double d = points[3 * i + axis] - points[3 * l + axis];
+        distanceSquared += d * d;
+      }
+      nearest = std::min(nearest, distanceSquared);
+    }
+    farthest = std::max(farthest, std::sqrt(nearest));
+  }
+  // 100 landmarks evenly over the ellipsoid's area of about 48 are about 0.7 apart. Random subsets leave
+  // some point about 0.9 to 1.1 from its nearest landmark.
+  EXPECT_LT(farthest, 0.8);
+}
+
+TEST(LandmarkSelectionTest, InvalidPoints) {
+  EXPECT_THROW(SelectLandmarks(std::vector<double>(7), 1, 0), std::invalid_argument);
+}
@@ -48,6 +48,7 @@
 #include <algorithm>
 #include <stdlib.h>
 #include <stdio.h>
+#include <vector>
 #define M_PI 3.14159265358979323846
 
 using namespace std;
@@ -55,6 +56,11 @@ using namespace std;
 template<class TYPE, class Func>
 TYPE min_newuoa(int n, TYPE *x, Func &func, TYPE r_start=1e7, TYPE tol=1e-8, int max_iter=5000);
 
+/* Same as above, but on_rho(rho) is called every time the trust region
+   radius RHO is set, e.g. so the radius can be saved to resume from. */
+template<class TYPE, class Func, class RhoFunc>
+TYPE min_newuoa(int n, TYPE *x, Func &func, TYPE r_start, TYPE tol, int max_iter, RhoFunc &on_rho);
+
 template<class TYPE, class Func>
 static int biglag_(int n, int npt, TYPE *xopt, TYPE *xpt, TYPE *bmat, TYPE *zmat, int *idz,
                    int *ndim, int *knew, TYPE *delta, TYPE *d__, TYPE *alpha, TYPE *hcol, TYPE *gc,
@@ -998,13 +1004,13 @@ static int update_(int n, int npt, TYPE *bmat, TYPE *zmat, int *idz, int *ndim,
     return 0;
 }
 
-template<class TYPE, class Func>
+template<class TYPE, class Func, class RhoFunc>
 static TYPE newuob_(int n, int npt, TYPE *x,
                     TYPE rhobeg, TYPE rhoend, int *ret_nf, int maxfun,
                     TYPE *xbase, TYPE *xopt, TYPE *xnew,
                     TYPE *xpt, TYPE *fval, TYPE *gq, TYPE *hq,
                     TYPE *pq, TYPE *bmat, TYPE *zmat, int *ndim,
-                    TYPE *d__, TYPE *vlag, TYPE *w, Func &func)
+                    TYPE *d__, TYPE *vlag, TYPE *w, Func &func, RhoFunc &on_rho)
 {
     /* XBASE will hold a shift of origin that should reduce the
        contributions from rounding errors to values of the model and
@@ -1175,6 +1181,7 @@ L70:
     /* Begin the iterative procedure, because the initial model is
      * complete. */
     rho = rhobeg;
+    on_rho(rho);
     delta = rho;
     idz = 1;
     diffa = diffb = itest = 0;
@@ -1631,6 +1638,7 @@ L490:
         if (ratio <= 16.) rho = rhoend;
         else if (ratio <= 250.) rho = sqrt(ratio) * rhoend;
         else rho = 0.1 * rho;
+        on_rho(rho);
         delta = max(delta, rho);
         goto L90;
     }
@@ -1648,8 +1656,8 @@ L530:
     return f;
 }
 
-template<class TYPE, class Func>
-static TYPE newuoa_(int n, int npt, TYPE *x, TYPE rhobeg, TYPE rhoend, int *ret_nf, int maxfun, TYPE *w, Func &func)
+template<class TYPE, class Func, class RhoFunc>
+static TYPE newuoa_(int n, int npt, TYPE *x, TYPE rhobeg, TYPE rhoend, int *ret_nf, int maxfun, TYPE *w, Func &func, RhoFunc &on_rho)
 {
     /* This subroutine seeks the least value of a function of many
      * variables, by a trust region method that forms quadratic models
@@ -1711,18 +1719,25 @@ static TYPE newuoa_(int n, int npt, TYPE *x, TYPE rhobeg, TYPE rhoend, int *ret_
      * NEWUOB. */
     return newuob_(n, npt, &x[1], rhobeg, rhoend, ret_nf, maxfun, &w[ixb], &w[ixo], &w[ixn],
                    &w[ixp], &w[ifv], &w[igq], &w[ihq], &w[ipq], &w[ibmat], &w[izmat],
-                   &ndim, &w[id], &w[ivl], &w[iw], func);
+                   &ndim, &w[id], &w[ivl], &w[iw], func, on_rho);
 }
 
-template<class TYPE, class Func>
-TYPE min_newuoa(int n, TYPE *x, Func &func, TYPE rb, TYPE tol, int max_iter)
+template<class TYPE, class Func, class RhoFunc>
+TYPE min_newuoa(int n, TYPE *x, Func &func, TYPE rb, TYPE tol, int max_iter, RhoFunc &on_rho)
 {
     int npt = 2 * n + 1, rnf;
     TYPE ret;
-    TYPE *w = (TYPE*)calloc((npt+13)*(npt+n) + 3*n*(n+3)/2 + 11, sizeof(TYPE));
-    ret = newuoa_(n, 2*n+1, x, rb, tol, &rnf, max_iter, w, func);
-    free(w);
+    // a vector so the work space is released if func throws
+    std::vector<TYPE> w((npt+13)*(npt+n) + 3*n*(n+3)/2 + 11, TYPE(0));
+    ret = newuoa_(n, 2*n+1, x, rb, tol, &rnf, max_iter, w.data(), func, on_rho);
     return ret;
 }
 
+template<class TYPE, class Func>
+TYPE min_newuoa(int n, TYPE *x, Func &func, TYPE rb, TYPE tol, int max_iter)
+{
+    auto ignore_rho = [](TYPE) {};
+    return min_newuoa(n, x, func, rb, tol, max_iter, ignore_rho);
+}
+
 #endif
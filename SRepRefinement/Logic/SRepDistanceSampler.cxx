@@ -0,0 +1,64 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "SRepDistanceSampler.h"
+
+#include <vector>
+
+namespace sreprefinement {
+
+//----------------------------------------------------------------------------
+void DistanceSampler::SampleDerivatives(
+  const size_t count,
+  const double* points,
+  double* distanceGradients,
+  double* normalJacobians) const
+{
+  // far below the resolution of any field in millimeters, far above the rounding error of the coordinates
+  constexpr double step = 1e-5;
+
+  // the points moved forward and backward along x, y, then z
+  std::vector<double> probes(18 * count);
+  for (size_t i = 0; i < count; ++i) {
+    for (size_t axis = 0; axis < 3; ++axis) {
+      double* forward = &probes[3 * (6 * i + 2 * axis)];
+      double* backward = forward + 3;
+      for (size_t c = 0; c < 3; ++c) {
+        forward[c] = points[3 * i + c];
+        backward[c] = points[3 * i + c];
+      }
+      forward[axis] += step;
+      backward[axis] -= step;
+    }
+  }
+  std::vector<double> distances(6 * count);
+  std::vector<double> normals(18 * count);
+  this->Sample(6 * count, probes.data(), distances.data(), normals.data());
+
+  for (size_t i = 0; i < count; ++i) {
+    for (size_t axis = 0; axis < 3; ++axis) {
+      const size_t forward = 6 * i + 2 * axis;
+      const size_t backward = forward + 1;
+      distanceGradients[3 * i + axis] = (distances[forward] - distances[backward]) / (2 * step);
+      for (size_t c = 0; c < 3; ++c) {
+        normalJacobians[9 * i + 3 * c + axis] = (normals[3 * forward + c] - normals[3 * backward + c]) / (2 * step);
+      }
+    }
+  }
+}
+
+}
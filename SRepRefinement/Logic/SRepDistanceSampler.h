@@ -0,0 +1,72 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkSlicerSRepRefinementLogic_SRepDistanceSampler_h
+#define __vtkSlicerSRepRefinementLogic_SRepDistanceSampler_h
+
+#include <array>
+#include <cstdlib>
+
+#include "vtkSlicerSRepRefinementModuleLogicExport.h"
+
+namespace sreprefinement {
+
+/// Interface for querying the signed distance to, and the surface normal of, the boundary being refined to.
+///
+/// Sampling must be const and must not modify any state, so a single sampler can be shared between threads.
+class VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT DistanceSampler {
+public:
+  using Dimensions = std::array<size_t, 3>;
+  /// Row major 3x4 affine transform.
+  using AffineTransform = std::array<double, 12>;
+
+  virtual ~DistanceSampler() = default;
+
+  /// Samples the distance and normal at many points.
+  ///
+  /// Points outside of the field are clamped to the closest point on the edge of the field.
+  /// \param count The number of points.
+  /// \param points 3*count world coordinates, xyz interleaved.
+  /// \param[out] distances count interpolated signed distances.
+  /// \param[out] normals 3*count unit normals, xyz interleaved. May be nullptr if normals are not needed.
+  ///             A normal is the zero vector if the gradient vanishes at the point.
+  virtual void Sample(size_t count, const double* points, double* distances, double* normals) const = 0;
+
+  /// Samples the distance and normal at a single point.
+  /// \sa Sample(size_t, const double*, double*, double*)
+  void Sample(const double point[3], double& distance, double normal[3]) const {
+    this->Sample(1, point, &distance, normal);
+  }
+
+  /// Samples the spatial derivatives of the distance and of the normal at many points.
+  ///
+  /// The default takes central differences of Sample a small step along each axis, all in a single
+  /// batch. Samplers that can differentiate their field exactly should override it.
+  /// \param count The number of points.
+  /// \param points 3*count world coordinates, xyz interleaved.
+  /// \param[out] distanceGradients 3*count derivatives of the distance along x, y, and z.
+  /// \param[out] normalJacobians 9*count row major 3x3 matrices, the derivative of normal component i along
+  ///             axis j at row i and column j.
+  virtual void SampleDerivatives(size_t count, const double* points, double* distanceGradients, double* normalJacobians) const;
+
+  /// Gets the number of bytes used by the field.
+  virtual size_t GetMemorySize() const = 0;
+};
+
+}
+
+#endif
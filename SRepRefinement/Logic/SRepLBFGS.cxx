@@ -0,0 +1,168 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "SRepLBFGS.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+//----------------------------------------------------------------------------
+double Dot(const std::vector<double>& a, const std::vector<double>& b) {
+  double dot = 0.0;
+  for (size_t i = 0; i < a.size(); ++i) {
+    dot += a[i] * b[i];
+  }
+  return dot;
+}
+
+//----------------------------------------------------------------------------
+double MaxAbs(const std::vector<double>& a) {
+  double m = 0.0;
+  for (const double v : a) {
+    m = std::max(m, std::abs(v));
+  }
+  return m;
+}
+
+} // namespace {}
+
+namespace sreprefinement {
+
+//----------------------------------------------------------------------------
+double MinimizeLBFGS(const size_t n, double* x, const LBFGSFunction& f, const LBFGSSettings& settings) {
+  // sufficient decrease constant of the Armijo condition
+  constexpr double c1 = 1e-4;
+
+  if (settings.memory == 0) {
+    throw std::invalid_argument("L-BFGS memory must be at least 1");
+  }
+  if (!(settings.maxStepLength > 0) || !(settings.minStepLength > 0) || settings.minStepLength > settings.maxStepLength) {
+    throw std::invalid_argument("L-BFGS step lengths must be positive with the minimum at most the maximum");
+  }
+  if (settings.maxEvaluations == 0) {
+    throw std::invalid_argument("L-BFGS must have at least one evaluation");
+  }
+
+  std::vector<double> gradient(n);
+  double value = f(x, gradient.data());
+  size_t numEvaluations = 1;
+
+  // history of steps (s) and gradient changes (y), oldest first once full
+  std::vector<std::vector<double>> s;
+  std::vector<std::vector<double>> y;
+  std::vector<double> rho;
+  size_t newest = 0;
+
+  std::vector<double> direction(n);
+  std::vector<double> alpha(settings.memory);
+  std::vector<double> trial(n);
+  std::vector<double> trialGradient(n);
+
+  while (numEvaluations < settings.maxEvaluations && MaxAbs(gradient) > settings.gradientTolerance) {
+    // two loop recursion: direction = -H * gradient, going over the history newest first and then oldest first
+    for (size_t i = 0; i < n; ++i) {
+      direction[i] = -gradient[i];
+    }
+    const size_t numHistory = s.size();
+    for (size_t k = 0; k < numHistory; ++k) {
+      const size_t j = (newest + numHistory - k) % numHistory;
+      alpha[j] = rho[j] * Dot(s[j], direction);
+      for (size_t i = 0; i < n; ++i) {
+        direction[i] -= alpha[j] * y[j][i];
+      }
+    }
+    if (numHistory > 0) {
+      const double gamma = Dot(s[newest], y[newest]) / Dot(y[newest], y[newest]);
+      for (auto& d : direction) {
+        d *= gamma;
+      }
+    }
+    for (size_t k = 1; k <= numHistory; ++k) {
+      const size_t j = (newest + k) % numHistory;
+      const double beta = rho[j] * Dot(y[j], direction);
+      for (size_t i = 0; i < n; ++i) {
+        direction[i] += s[j][i] * (alpha[j] - beta);
+      }
+    }
+
+    double slope = Dot(gradient, direction);
+    if (!(slope < 0)) {
+      // the approximation went bad, start over from steepest descent
+      s.clear();
+      y.clear();
+      rho.clear();
+      for (size_t i = 0; i < n; ++i) {
+        direction[i] = -gradient[i];
+      }
+      slope = Dot(gradient, direction);
+    }
+
+    // backtrack from the full step, or the longest allowed step
+    const double directionLength = std::sqrt(Dot(direction, direction));
+    double step = std::min(1.0, settings.maxStepLength / directionLength);
+    bool accepted = false;
+    double trialValue = value;
+    while (numEvaluations < settings.maxEvaluations && step * directionLength >= settings.minStepLength) {
+      for (size_t i = 0; i < n; ++i) {
+        trial[i] = x[i] + step * direction[i];
+      }
+      trialValue = f(trial.data(), trialGradient.data());
+      ++numEvaluations;
+      if (trialValue <= value + c1 * step * slope) {
+        accepted = true;
+        break;
+      }
+      step /= 2;
+    }
+    if (!accepted) {
+      break;
+    }
+
+    // keep the curvature pair only if it keeps the approximation positive definite
+    std::vector<double> stepTaken(n);
+    std::vector<double> gradientChange(n);
+    for (size_t i = 0; i < n; ++i) {
+      stepTaken[i] = trial[i] - x[i];
+      gradientChange[i] = trialGradient[i] - gradient[i];
+    }
+    const double curvature = Dot(stepTaken, gradientChange);
+    if (curvature > 1e-12 * Dot(gradientChange, gradientChange)) {
+      if (s.size() < settings.memory) {
+        s.push_back(std::move(stepTaken));
+        y.push_back(std::move(gradientChange));
+        rho.push_back(1.0 / curvature);
+        newest = s.size() - 1;
+      } else {
+        newest = (newest + 1) % settings.memory;
+        s[newest] = std::move(stepTaken);
+        y[newest] = std::move(gradientChange);
+        rho[newest] = 1.0 / curvature;
+      }
+    }
+
+    std::copy(trial.begin(), trial.end(), x);
+    std::swap(gradient, trialGradient);
+    value = trialValue;
+  }
+  return value;
+}
+
+}
@@ -0,0 +1,57 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkSlicerSRepRefinementLogic_SRepLBFGS_h
+#define __vtkSlicerSRepRefinementLogic_SRepLBFGS_h
+
+#include <cstdlib>
+#include <functional>
+
+#include "vtkSlicerSRepRefinementModuleLogicExport.h"
+
+namespace sreprefinement {
+
+struct LBFGSSettings {
+  /// Number of previous steps used to approximate the inverse Hessian.
+  size_t memory = 6;
+  /// Maximum number of function evaluations, including the one at the starting point.
+  size_t maxEvaluations = 100;
+  /// Longest step a line search tries. Plays the role of NEWUOA's initial trust region radius.
+  double maxStepLength = 0.01;
+  /// Stops once a step, or a line search's trial step, is shorter than this.
+  /// Plays the role of NEWUOA's final trust region radius.
+  double minStepLength = 1e-4;
+  /// Stops once no component of the gradient is larger than this.
+  double gradientTolerance = 1e-10;
+};
+
+/// Evaluates the function at x and writes its gradient to gradient. Both have n elements.
+using LBFGSFunction = std::function<double(const double* x, double* gradient)>;
+
+/// Minimizes f with limited memory BFGS and a backtracking (Armijo) line search.
+///
+/// Every accepted step decreases f, so x always holds the best point found so far. Exceptions
+/// from f are passed on, leaving x at the best point before the throw.
+/// \param n Number of variables.
+/// \param[in,out] x The starting point, overwritten with the minimizer found.
+/// \returns f at x
+VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT
+double MinimizeLBFGS(size_t n, double* x, const LBFGSFunction& f, const LBFGSSettings& settings);
+
+}
+
+#endif
@@ -0,0 +1,410 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+#include "SRepMeshDistanceSampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace {
+
+//----------------------------------------------------------------------------
+double Dot(const double a[3], const double b[3]) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+//----------------------------------------------------------------------------
+void Cross(const double a[3], const double b[3], double out[3]) {
+  out[0] = a[1] * b[2] - a[2] * b[1];
+  out[1] = a[2] * b[0] - a[0] * b[2];
+  out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+//----------------------------------------------------------------------------
+// Angle between a and b, neither of which may be zero
+double Angle(const double a[3], const double b[3]) {
+  double cross[3];
+  Cross(a, b, cross);
+  return std::atan2(std::sqrt(Dot(cross, cross)), Dot(a, b));
+}
+
+} // namespace {}
+
+namespace sreprefinement {
+
+//----------------------------------------------------------------------------
+MeshDistanceSampler::MeshDistanceSampler(
+  const std::vector<double>& points,
+  const std::vector<size_t>& triangles,
+  const double distanceScale)
+  : m_distanceScale(distanceScale)
+  , m_surfaceTolerance(0.0)
+  , m_nodes()
+  , m_triangles()
+  , m_vertexNormals(points.size(), 0.0)
+  , m_edgeNormals()
+{
+  if (!(distanceScale > 0)) {
+    throw std::invalid_argument("MeshDistanceSampler distance scale must be positive");
+  }
+  const size_t numPoints = points.size() / 3;
+  if (numPoints > std::numeric_limits<uint32_t>::max()) {
+    throw std::invalid_argument("MeshDistanceSampler supports at most 2^32 - 1 points");
+  }
+
+  std::vector<Triangle> unsorted;
+  unsorted.reserve(triangles.size() / 3);
+  std::map<std::pair<size_t, size_t>, uint32_t> edges;
+  const auto edgeIndex = [&](size_t v0, size_t v1) {
+    const auto key = std::make_pair(std::min(v0, v1), std::max(v0, v1));
+    const auto inserted = edges.emplace(key, static_cast<uint32_t>(edges.size()));
+    if (inserted.second) {
+      m_edgeNormals.insert(m_edgeNormals.end(), {0.0, 0.0, 0.0});
+    }
+    return inserted.first->second;
+  };
+
+  for (size_t t = 0; t + 2 < triangles.size(); t += 3) {
+    const size_t v[3] = {triangles[t], triangles[t + 1], triangles[t + 2]};
+    if (v[0] >= numPoints || v[1] >= numPoints || v[2] >= numPoints) {
+      throw std::invalid_argument("MeshDistanceSampler triangle " + std::to_string(t / 3) + " has a vertex out of range");
+    }
+    const double* p[3] = {&points[3 * v[0]], &points[3 * v[1]], &points[3 * v[2]]};
+
+    Triangle triangle;
+    for (size_t c = 0; c < 3; ++c) {
+      triangle.a[c] = p[0][c];
+      triangle.ab[c] = p[1][c] - p[0][c];
+      triangle.ac[c] = p[2][c] - p[0][c];
+    }
+    Cross(triangle.ab, triangle.ac, triangle.normal);
+    const double length = std::sqrt(Dot(triangle.normal, triangle.normal));
+    if (!(length > 0)) {
+      continue;
+    }
+    for (size_t c = 0; c < 3; ++c) {
+      triangle.normal[c] /= length;
+    }
+
+    // each face adds its normal weighted by its angle at the vertex, and the full normal to its edges
+    for (size_t k = 0; k < 3; ++k) {
+      const double* corner = p[k];
+      const double* next = p[(k + 1) % 3];
+      const double* previous = p[(k + 2) % 3];
+      const double toNext[3] = {next[0] - corner[0], next[1] - corner[1], next[2] - corner[2]};
+      const double toPrevious[3] = {previous[0] - corner[0], previous[1] - corner[1], previous[2] - corner[2]};
+      const double angle = Angle(toNext, toPrevious);
+      triangle.vertex[k] = static_cast<uint32_t>(v[k]);
+      triangle.edge[k] = edgeIndex(v[k], v[(k + 1) % 3]);
+      for (size_t c = 0; c < 3; ++c) {
+        m_vertexNormals[3 * v[k] + c] += angle * triangle.normal[c];
+        m_edgeNormals[3 * triangle.edge[k] + c] += triangle.normal[c];
+      }
+    }
+    unsorted.push_back(triangle);
+  }
+  if (unsorted.empty()) {
+    throw std::invalid_argument("MeshDistanceSampler requires at least one triangle with area");
+  }
+
+  // a closed mesh wound inward has a negative signed volume. Flipping every triangle of it only
+  // negates the face normals, and with them the pseudonormals summed from them.
+  double signedVolume = 0.0;
+  for (const auto& triangle : unsorted) {
+    double cross[3];
+    Cross(triangle.ab, triangle.ac, cross);
+    signedVolume += Dot(triangle.a, cross) / 6;
+  }
+  if (signedVolume < 0) {
+    for (auto& triangle : unsorted) {
+      for (size_t c = 0; c < 3; ++c) {
+        triangle.normal[c] = -triangle.normal[c];
+      }
+    }
+    for (auto& n : m_vertexNormals) {
+      n = -n;
+    }
+    for (auto& n : m_edgeNormals) {
+      n = -n;
+    }
+  }
+
+  std::vector<double> centroids;
+  centroids.reserve(3 * unsorted.size());
+  for (const auto& triangle : unsorted) {
+    for (size_t c = 0; c < 3; ++c) {
+      centroids.push_back(triangle.a[c] + (triangle.ab[c] + triangle.ac[c]) / 3);
+    }
+  }
+  std::vector<uint32_t> order(unsorted.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = static_cast<uint32_t>(i);
+  }
+
+  // a tree with leaves of one to LeafSize triangles has fewer than 2 * #triangles nodes
+  m_nodes.reserve(2 * unsorted.size());
+  m_nodes.resize(1);
+  this->BuildNode(0, unsorted, centroids, order, 0, order.size());
+
+  // the rounding error of a closest point is relative to the size of the mesh
+  const auto& root = m_nodes[0];
+  const double diagonal[3] = {root.max[0] - root.min[0], root.max[1] - root.min[1], root.max[2] - root.min[2]};
+  m_surfaceTolerance = 1e-10 * std::sqrt(Dot(diagonal, diagonal));
+
+  m_triangles.reserve(unsorted.size());
+  for (const uint32_t i : order) {
+    m_triangles.push_back(unsorted[i]);
+  }
+}
+
+//----------------------------------------------------------------------------
+void MeshDistanceSampler::BuildNode(
+  const size_t node,
+  const std::vector<Triangle>& triangles,
+  const std::vector<double>& centroids,
+  std::vector<uint32_t>& order,
+  const size_t begin,
+  const size_t end)
+{
+  // bounds of the triangles and of their centroids
+  double min[3] = {std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity()};
+  double max[3] = {-min[0], -min[1], -min[2]};
+  double centroidMin[3] = {min[0], min[1], min[2]};
+  double centroidMax[3] = {max[0], max[1], max[2]};
+  for (size_t i = begin; i < end; ++i) {
+    const auto& triangle = triangles[order[i]];
+    for (size_t c = 0; c < 3; ++c) {
+      const double a = triangle.a[c];
+      const double b = a + triangle.ab[c];
+      const double d = a + triangle.ac[c];
+      min[c] = std::min({min[c], a, b, d});
+      max[c] = std::max({max[c], a, b, d});
+      centroidMin[c] = std::min(centroidMin[c], centroids[3 * order[i] + c]);
+      centroidMax[c] = std::max(centroidMax[c], centroids[3 * order[i] + c]);
+    }
+  }
+  std::copy(min, min + 3, m_nodes[node].min);
+  std::copy(max, max + 3, m_nodes[node].max);
+
+  if (end - begin <= LeafSize) {
+    m_nodes[node].first = static_cast<uint32_t>(begin);
+    m_nodes[node].count = static_cast<uint32_t>(end - begin);
+    return;
+  }
+
+  // split at the median centroid along the longest axis of the centroids
+  size_t axis = 0;
+  for (size_t c = 1; c < 3; ++c) {
+    if (centroidMax[c] - centroidMin[c] > centroidMax[axis] - centroidMin[axis]) {
+      axis = c;
+    }
+  }
+  const size_t middle = begin + (end - begin) / 2;
+  std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&](uint32_t i, uint32_t j) {
+    return centroids[3 * i + axis] < centroids[3 * j + axis];
+  });
+
+  // m_nodes may reallocate while the children are built, so don't hold on to a reference
+  const size_t children = m_nodes.size();
+  m_nodes.resize(children + 2);
+  m_nodes[node].first = static_cast<uint32_t>(children);
+  m_nodes[node].count = 0;
+  this->BuildNode(children, triangles, centroids, order, begin, middle);
+  this->BuildNode(children + 1, triangles, centroids, order, middle, end);
+}
+
+//----------------------------------------------------------------------------
+void MeshDistanceSampler::Sample(const size_t count, const double* points, double* distances, double* normals) const {
+  // a balanced tree of at most 2^32 triangles is never this deep
+  constexpr size_t maxDepth = 64;
+  uint32_t stack[maxDepth];
+  size_t closestTriangle = 0;
+
+  for (size_t i = 0; i < count; ++i) {
+    const double* p = points + 3 * i;
+
+    // the closest triangle of the previous point is usually close to this one too, which gives a tight bound to start with
+    double closest[3];
+    Feature feature;
+    double bestDistanceSquared = ClosestPoint(m_triangles[closestTriangle], p, closest, feature);
+
+    size_t stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+      const Node& node = m_nodes[stack[--stackSize]];
+      if (BoxDistanceSquared(node, p) >= bestDistanceSquared) {
+        continue;
+      }
+      if (node.count > 0) {
+        for (size_t t = node.first; t < node.first + node.count; ++t) {
+          double candidate[3];
+          Feature candidateFeature;
+          const double distanceSquared = ClosestPoint(m_triangles[t], p, candidate, candidateFeature);
+          if (distanceSquared < bestDistanceSquared) {
+            bestDistanceSquared = distanceSquared;
+            std::copy(candidate, candidate + 3, closest);
+            feature = candidateFeature;
+            closestTriangle = t;
+          }
+        }
+        continue;
+      }
+      // visit the nearer child first, so it can prune the other one
+      const double leftDistanceSquared = BoxDistanceSquared(m_nodes[node.first], p);
+      const double rightDistanceSquared = BoxDistanceSquared(m_nodes[node.first + 1], p);
+      const bool leftFirst = leftDistanceSquared <= rightDistanceSquared;
+      const double farDistanceSquared = leftFirst ? rightDistanceSquared : leftDistanceSquared;
+      const double nearDistanceSquared = leftFirst ? leftDistanceSquared : rightDistanceSquared;
+      if (farDistanceSquared < bestDistanceSquared) {
+        stack[stackSize++] = leftFirst ? node.first + 1 : node.first;
+      }
+      if (nearDistanceSquared < bestDistanceSquared) {
+        stack[stackSize++] = leftFirst ? node.first : node.first + 1;
+      }
+    }
+
+    const double toPoint[3] = {p[0] - closest[0], p[1] - closest[1], p[2] - closest[2]};
+    const double* pseudonormal = this->GetPseudonormal(m_triangles[closestTriangle], feature);
+    const double sign = Dot(toPoint, pseudonormal) < 0 ? -1.0 : 1.0;
+    const double distance = std::sqrt(bestDistanceSquared);
+    distances[i] = sign * distance * m_distanceScale;
+
+    if (normals) {
+      double* normal = normals + 3 * i;
+      // away from the surface the gradient points straight away from the closest point
+      const bool onSurface = distance <= m_surfaceTolerance;
+      const double* direction = onSurface ? pseudonormal : toPoint;
+      const double length = onSurface ? std::sqrt(Dot(pseudonormal, pseudonormal)) : distance;
+      const double scale = length > 0 ? (onSurface ? 1.0 : sign) / length : 0.0;
+      for (size_t c = 0; c < 3; ++c) {
+        normal[c] = direction[c] * scale;
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+size_t MeshDistanceSampler::GetNumberOfTriangles() const {
+  return m_triangles.size();
+}
+
+//----------------------------------------------------------------------------
+size_t MeshDistanceSampler::GetMemorySize() const {
+  return m_nodes.size() * sizeof(Node)
+    + m_triangles.size() * sizeof(Triangle)
+    + (m_vertexNormals.size() + m_edgeNormals.size()) * sizeof(double);
+}
+
+//----------------------------------------------------------------------------
+double MeshDistanceSampler::ClosestPoint(const Triangle& triangle, const double p[3], double closest[3], Feature& feature) {
+  // Ericson, Real-Time Collision Detection, 5.1.5, keeping track of which feature the closest point is on
+  const double* a = triangle.a;
+  const double* ab = triangle.ab;
+  const double* ac = triangle.ac;
+  const auto setClosest = [&](const double* origin, const double* direction, double t) {
+    for (size_t c = 0; c < 3; ++c) {
+      closest[c] = origin[c] + t * (direction ? direction[c] : 0.0);
+    }
+    const double d[3] = {p[0] - closest[0], p[1] - closest[1], p[2] - closest[2]};
+    return Dot(d, d);
+  };
+
+  const double ap[3] = {p[0] - a[0], p[1] - a[1], p[2] - a[2]};
+  const double d1 = Dot(ab, ap);
+  const double d2 = Dot(ac, ap);
+  if (d1 <= 0 && d2 <= 0) {
+    feature = Feature::VertexA;
+    return setClosest(a, nullptr, 0.0);
+  }
+
+  const double b[3] = {a[0] + ab[0], a[1] + ab[1], a[2] + ab[2]};
+  const double bp[3] = {p[0] - b[0], p[1] - b[1], p[2] - b[2]};
+  const double d3 = Dot(ab, bp);
+  const double d4 = Dot(ac, bp);
+  if (d3 >= 0 && d4 <= d3) {
+    feature = Feature::VertexB;
+    return setClosest(b, nullptr, 0.0);
+  }
+
+  const double vc = d1 * d4 - d3 * d2;
+  if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+    feature = Feature::EdgeAB;
+    return setClosest(a, ab, d1 / (d1 - d3));
+  }
+
+  const double c[3] = {a[0] + ac[0], a[1] + ac[1], a[2] + ac[2]};
+  const double cp[3] = {p[0] - c[0], p[1] - c[1], p[2] - c[2]};
+  const double d5 = Dot(ab, cp);
+  const double d6 = Dot(ac, cp);
+  if (d6 >= 0 && d5 <= d6) {
+    feature = Feature::VertexC;
+    return setClosest(c, nullptr, 0.0);
+  }
+
+  const double vb = d5 * d2 - d1 * d6;
+  if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+    feature = Feature::EdgeCA;
+    return setClosest(a, ac, d2 / (d2 - d6));
+  }
+
+  const double va = d3 * d6 - d5 * d4;
+  if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) {
+    const double bc[3] = {c[0] - b[0], c[1] - b[1], c[2] - b[2]};
+    feature = Feature::EdgeBC;
+    return setClosest(b, bc, (d4 - d3) / ((d4 - d3) + (d5 - d6)));
+  }
+
+  const double denominator = 1 / (va + vb + vc);
+  const double v = vb * denominator;
+  const double w = vc * denominator;
+  feature = Feature::Face;
+  for (size_t k = 0; k < 3; ++k) {
+    closest[k] = a[k] + ab[k] * v + ac[k] * w;
+  }
+  const double d[3] = {p[0] - closest[0], p[1] - closest[1], p[2] - closest[2]};
+  return Dot(d, d);
+}
+
+//----------------------------------------------------------------------------
+double MeshDistanceSampler::BoxDistanceSquared(const Node& node, const double p[3]) {
+  double distanceSquared = 0.0;
+  for (size_t c = 0; c < 3; ++c) {
+    const double d = std::max({node.min[c] - p[c], 0.0, p[c] - node.max[c]});
+    distanceSquared += d * d;
+  }
+  return distanceSquared;
+}
+
+//----------------------------------------------------------------------------
+const double* MeshDistanceSampler::GetPseudonormal(const Triangle& triangle, const Feature feature) const {
+  switch (feature) {
+    case Feature::Face: return triangle.normal;
+    case Feature::VertexA: return &m_vertexNormals[3 * triangle.vertex[0]];
+    case Feature::VertexB: return &m_vertexNormals[3 * triangle.vertex[1]];
+    case Feature::VertexC: return &m_vertexNormals[3 * triangle.vertex[2]];
+    case Feature::EdgeAB: return &m_edgeNormals[3 * triangle.edge[0]];
+    case Feature::EdgeBC: return &m_edgeNormals[3 * triangle.edge[1]];
+    case Feature::EdgeCA: return &m_edgeNormals[3 * triangle.edge[2]];
+  }
+  return triangle.normal;
+}
+
+}
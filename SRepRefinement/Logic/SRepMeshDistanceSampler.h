@@ -0,0 +1,114 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+#ifndef __vtkSlicerSRepRefinementLogic_SRepMeshDistanceSampler_h
+#define __vtkSlicerSRepRefinementLogic_SRepMeshDistanceSampler_h
+
+#include <cstdint>
+#include <vector>
+
+#include "SRepDistanceSampler.h"
+
+namespace sreprefinement {
+
+/// Samples the exact signed distance to, and the normal of, a triangle mesh.
+///
+/// The triangles are kept in a bounding volume hierarchy (BVH) built at construction. Each leaf's
+/// triangles are stored next to each other with their edges and normal precomputed, so the closest
+/// point tests of a leaf read one contiguous block of memory. Consecutive points of a batch are
+/// usually close to each other (e.g. the spoke tips of neighboring spokes), so each query starts
+/// with the closest triangle of the point before it, which prunes most of the hierarchy right away.
+///
+/// The sign comes from the angle weighted pseudonormal of the closest face, edge, or vertex, which
+/// is correct for closed, consistently oriented meshes. Negative is inside. A mesh whose triangles
+/// are all wound inward is detected by its negative signed volume and flipped.
+/// The normal is the gradient of the signed distance, or the normalized pseudonormal on the surface itself.
+/// \sa SDFSampler
+class VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT MeshDistanceSampler : public DistanceSampler {
+public:
+  /// Most triangles in a leaf of the hierarchy.
+  static constexpr size_t LeafSize = 4;
+
+  /// \param points 3 world coordinates per vertex, xyz interleaved.
+  /// \param triangles 3 vertex indices per triangle. Triangles with no area are skipped.
+  /// \param distanceScale Factor the distances are multiplied by, e.g. to express them in the
+  ///        normalized units of an image field. Must be positive.
+  /// \throws std::invalid_argument if there are no triangles with area, an index is out of range,
+  ///         or the scale is not positive
+  MeshDistanceSampler(const std::vector<double>& points, const std::vector<size_t>& triangles, double distanceScale);
+
+  using DistanceSampler::Sample;
+  /// Points are never clamped, since the mesh distance is defined everywhere.
+  void Sample(size_t count, const double* points, double* distances, double* normals) const override;
+
+  size_t GetNumberOfTriangles() const;
+
+  size_t GetMemorySize() const override;
+
+private:
+  /// Part of a triangle a point is closest to
+  enum class Feature : uint8_t {
+    Face,
+    VertexA,
+    VertexB,
+    VertexC,
+    EdgeAB,
+    EdgeBC,
+    EdgeCA,
+  };
+
+  struct Triangle {
+    double a[3];
+    double ab[3];
+    double ac[3];
+    double normal[3];    ///< unit face normal
+    uint32_t vertex[3];  ///< pseudonormal index of each vertex
+    uint32_t edge[3];    ///< pseudonormal index of edges AB, BC, and CA
+  };
+
+  /// Children of an inner node are next to each other at index first. A leaf's triangles are
+  /// m_triangles[first, first + count).
+  struct Node {
+    double min[3];
+    double max[3];
+    uint32_t first;
+    uint32_t count; ///< 0 for inner nodes
+  };
+
+  /// Fills in m_nodes[node] for the triangles order[begin, end), splitting them into children as needed.
+  void BuildNode(
+    size_t node,
+    const std::vector<Triangle>& triangles,
+    const std::vector<double>& centroids,
+    std::vector<uint32_t>& order,
+    size_t begin,
+    size_t end);
+
+  static double ClosestPoint(const Triangle& triangle, const double p[3], double closest[3], Feature& feature);
+  static double BoxDistanceSquared(const Node& node, const double p[3]);
+  const double* GetPseudonormal(const Triangle& triangle, Feature feature) const;
+
+  double m_distanceScale;
+  double m_surfaceTolerance; ///< points closer than this are on the surface, where the gradient is undefined
+  std::vector<Node> m_nodes;
+  std::vector<Triangle> m_triangles; ///< in leaf order
+  std::vector<double> m_vertexNormals; ///< 3 per vertex
+  std::vector<double> m_edgeNormals;   ///< 3 per edge
+};
+
+}
+
+#endif
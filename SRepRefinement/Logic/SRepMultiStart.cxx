@@ -0,0 +1,69 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "SRepMultiStart.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+namespace sreprefinement {
+
+//----------------------------------------------------------------------------
+std::vector<RefinementStart> CreateRefinementStarts(
+  const std::vector<double>& coefficients,
+  const double regionSize,
+  const double minRegionSize,
+  const size_t numStarts,
+  const double jitter,
+  const double regionScale,
+  const uint64_t seed)
+{
+  if (numStarts == 0) {
+    throw std::invalid_argument("Expected at least one start");
+  }
+  if (jitter < 0) {
+    throw std::invalid_argument("Expected a non-negative jitter");
+  }
+  if (regionScale < 1) {
+    throw std::invalid_argument("Expected a region scale of at least 1");
+  }
+
+  std::vector<RefinementStart> starts;
+  starts.reserve(numStarts);
+  starts.push_back(RefinementStart{coefficients, regionSize});
+  for (size_t i = 1; i < numStarts; ++i) {
+    // every start gets its own generator so it doesn't depend on how many numbers the others drew
+    std::mt19937_64 generator(seed + i);
+    std::normal_distribution<double> offset(0.0, jitter);
+
+    RefinementStart start{coefficients, regionSize};
+    if (jitter > 0) {
+      for (auto& c : start.coefficients) {
+        c += offset(generator);
+      }
+    }
+    // 1, 2, 3, 4, ... -> scale, 1/scale, scale^2, 1/scale^2, ...
+    const double exponent = static_cast<double>((i + 1) / 2) * (i % 2 == 1 ? 1.0 : -1.0);
+    start.regionSize = std::max(minRegionSize, regionSize * std::pow(regionScale, exponent));
+    starts.push_back(std::move(start));
+  }
+  return starts;
+}
+
+}
@@ -0,0 +1,56 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkSlicerSRepRefinementLogic_SRepMultiStart_h
+#define __vtkSlicerSRepRefinementLogic_SRepMultiStart_h
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "vtkSlicerSRepRefinementModuleLogicExport.h"
+
+namespace sreprefinement {
+
+/// Where one of the optimizations of a multi-start refinement starts from.
+struct RefinementStart {
+  std::vector<double> coefficients;
+  double regionSize; ///< initial trust region radius
+};
+
+/// Creates the starts of a multi-start optimization.
+///
+/// The first start is coefficients and regionSize unchanged, so a multi-start optimization finds at least
+/// what a single one would. The others add normally distributed offsets with standard deviation jitter to
+/// every coefficient, and use regionSize scaled by regionScale, 1 / regionScale, regionScale^2, 1 / regionScale^2
+/// and so on, but never less than minRegionSize. The starts only depend on the arguments, so the same seed
+/// gives the same starts.
+///
+/// \throws std::invalid_argument if numStarts is 0, jitter is negative or regionScale is less than 1
+VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT
+std::vector<RefinementStart> CreateRefinementStarts(
+  const std::vector<double>& coefficients,
+  double regionSize,
+  double minRegionSize,
+  size_t numStarts,
+  double jitter,
+  double regionScale,
+  uint64_t seed);
+
+}
+
+#endif
@@ -0,0 +1,184 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+#include "SRepPrincipalCurvatures.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+constexpr double pi = 3.14159265358979323846;
+
+//----------------------------------------------------------------------------
+void Subtract(const double* a, const double* b, double* difference) {
+  for (int i = 0; i < 3; ++i) {
+    difference[i] = a[i] - b[i];
+  }
+}
+
+//----------------------------------------------------------------------------
+void Cross(const double* a, const double* b, double* cross) {
+  cross[0] = a[1] * b[2] - a[2] * b[1];
+  cross[1] = a[2] * b[0] - a[0] * b[2];
+  cross[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+//----------------------------------------------------------------------------
+double Dot(const double* a, const double* b) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+//----------------------------------------------------------------------------
+double Norm(const double* a) {
+  return std::sqrt(Dot(a, a));
+}
+
+//----------------------------------------------------------------------------
+// Normalizes a in place and returns its norm, leaving a zero vector as it is
+double Normalize(double* a) {
+  const double norm = Norm(a);
+  if (norm != 0.0) {
+    for (int i = 0; i < 3; ++i) {
+      a[i] /= norm;
+    }
+  }
+  return norm;
+}
+
+//----------------------------------------------------------------------------
+// Angle in [0, pi] between two vectors, computed like vtkMath::AngleBetweenVectors
+double AngleBetweenVectors(const double* a, const double* b) {
+  double cross[3];
+  Cross(a, b, cross);
+  return std::atan2(Norm(cross), Dot(a, b));
+}
+
+}
+
+namespace sreprefinement {
+
+//----------------------------------------------------------------------------
+PrincipalCurvatures ComputePrincipalCurvatures(const std::vector<double>& points, const std::vector<size_t>& triangles) {
+  const size_t numPoints = points.size() / 3;
+  const size_t numTriangles = triangles.size() / 3;
+  if (std::any_of(triangles.begin(), triangles.end(), [numPoints](size_t id) { return id >= numPoints; })) {
+    throw std::invalid_argument("A triangle has a point index out of range");
+  }
+  const auto point = [&](size_t triangle, size_t corner) {
+    return &points[3 * triangles[3 * triangle + corner]];
+  };
+
+  // Gaussian curvature from the angle deficit around each point
+  std::vector<double> angleDeficits(numPoints, 2.0 * pi);
+  std::vector<double> areaSums(numPoints, 0.0);
+  std::vector<double> areas(numTriangles);
+  std::vector<std::array<double, 3>> normals(numTriangles);
+  // the first triangle of each edge, keyed by its points in increasing order. Only edges shared by
+  // exactly two triangles are used for the mean curvature.
+  struct EdgeTriangles {
+    size_t first;
+    size_t second;
+    size_t count;
+  };
+  std::unordered_map<uint64_t, EdgeTriangles> edges;
+  edges.reserve(3 * numTriangles / 2);
+  const auto edgeKey = [&](size_t a, size_t b) {
+    return static_cast<uint64_t>(std::min(a, b)) * numPoints + std::max(a, b);
+  };
+
+  for (size_t t = 0; t < numTriangles; ++t) {
+    const double* corners[3] = {point(t, 0), point(t, 1), point(t, 2)};
+    double sides[3][3];
+    for (int i = 0; i < 3; ++i) {
+      Subtract(corners[(i + 1) % 3], corners[i], sides[i]);
+    }
+    double cross[3];
+    Cross(sides[0], sides[1], cross);
+    const double doubleArea = Norm(cross);
+    areas[t] = 0.5 * doubleArea;
+    for (int i = 0; i < 3; ++i) {
+      normals[t][i] = doubleArea > 0.0 ? cross[i] / doubleArea : 0.0;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+      const size_t id = triangles[3 * t + i];
+      // the interior angle at corner i is between the side leaving it and the reversed side arriving at it
+      const double arriving[3] = {-sides[(i + 2) % 3][0], -sides[(i + 2) % 3][1], -sides[(i + 2) % 3][2]};
+      angleDeficits[id] -= AngleBetweenVectors(sides[i], arriving);
+      areaSums[id] += areas[t];
+
+      auto inserted = edges.insert({edgeKey(id, triangles[3 * t + (i + 1) % 3]), EdgeTriangles{t, t, 0}});
+      auto& edge = inserted.first->second;
+      if (++edge.count == 2) {
+        edge.second = t;
+      }
+    }
+  }
+
+  // mean curvature from the dihedral angle along each edge
+  std::vector<double> meanSums(numPoints, 0.0);
+  std::vector<int> numEdges(numPoints, 0);
+  for (const auto& edge : edges) {
+    if (edge.second.count != 2) {
+      continue;
+    }
+    // the edge is oriented the way the first triangle goes around it
+    const size_t first = edge.second.first;
+    const size_t second = edge.second.second;
+    int corner = 0;
+    while (edgeKey(triangles[3 * first + corner], triangles[3 * first + (corner + 1) % 3]) != edge.first) {
+      ++corner;
+    }
+    const size_t from = triangles[3 * first + corner];
+    const size_t to = triangles[3 * first + (corner + 1) % 3];
+    double direction[3];
+    Subtract(&points[3 * to], &points[3 * from], direction);
+    const double length = Normalize(direction);
+
+    const double cosine = Dot(normals[first].data(), normals[second].data());
+    double cross[3];
+    Cross(normals[first].data(), normals[second].data(), cross);
+    const double sine = Dot(cross, direction);
+    double curvature = sine != 0.0 || cosine != 0.0 ? length * std::atan2(sine, cosine) : 0.0;
+    const double area = areas[first] + areas[second];
+    if (area != 0.0) {
+      curvature *= 3.0 / area;
+    }
+    for (const auto id : {from, to}) {
+      meanSums[id] += curvature;
+      ++numEdges[id];
+    }
+  }
+
+  PrincipalCurvatures curvatures;
+  curvatures.minimum.resize(numPoints);
+  curvatures.maximum.resize(numPoints);
+  for (size_t i = 0; i < numPoints; ++i) {
+    const double gauss = areaSums[i] > 0.0 ? 3.0 * angleDeficits[i] / areaSums[i] : 0.0;
+    const double mean = numEdges[i] > 0 ? 0.5 * meanSums[i] / numEdges[i] : 0.0;
+    const double root = std::sqrt(std::max(0.0, mean * mean - gauss));
+    curvatures.minimum[i] = mean - root;
+    curvatures.maximum[i] = mean + root;
+  }
+  return curvatures;
+}
+
+}
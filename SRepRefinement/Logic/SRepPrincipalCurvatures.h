@@ -0,0 +1,46 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+#ifndef __vtkSlicerSRepRefinementLogic_SRepPrincipalCurvatures_h
+#define __vtkSlicerSRepRefinementLogic_SRepPrincipalCurvatures_h
+
+#include <cstdlib>
+#include <vector>
+
+#include "vtkSlicerSRepRefinementModuleLogicExport.h"
+
+namespace sreprefinement {
+
+/// Minimum and maximum curvature of each point of a mesh
+struct PrincipalCurvatures {
+  std::vector<double> minimum;
+  std::vector<double> maximum;
+};
+
+/// Computes the principal curvatures of each point of a triangle mesh.
+///
+/// The Gaussian and mean curvature are computed the same way vtkCurvatures does, but both in one pass over the
+/// triangles instead of running the filter once for each, and are combined into the principal curvatures.
+///
+/// \param points x, y, z of each point
+/// \param triangles The three point indices of each triangle
+/// \throws std::invalid_argument if a triangle has a point index out of range
+VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT
+PrincipalCurvatures ComputePrincipalCurvatures(const std::vector<double>& points, const std::vector<size_t>& triangles);
+
+}
+
+#endif
@@ -0,0 +1,70 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+#include "SRepRSradKernel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace sreprefinement {
+
+//----------------------------------------------------------------------------
+void ComputeRSradPenalties(const RSradBatch& batch, double* penalties) {
+  // no branches or calls other than sqrt in here, so the loop vectorizes
+  for (size_t k = 0; k < RSradBatch::Size; ++k) {
+    const double U[3] = {batch.U[0][k], batch.U[1][k], batch.U[2][k]};
+
+    // rows of Q = dx * (U^T U - I), i.e. U (dx . U) - dx
+    const double dxduU = batch.dxdu[0][k] * U[0] + batch.dxdu[1][k] * U[1] + batch.dxdu[2][k] * U[2];
+    const double dxdvU = batch.dxdv[0][k] * U[0] + batch.dxdv[1][k] * U[1] + batch.dxdv[2][k] * U[2];
+    double Q0[3];
+    double Q1[3];
+    // rows of the left side, dS - dr U
+    double L0[3];
+    double L1[3];
+    for (size_t c = 0; c < 3; ++c) {
+      Q0[c] = U[c] * dxduU - batch.dxdu[c][k];
+      Q1[c] = U[c] * dxdvU - batch.dxdv[c][k];
+      L0[c] = batch.dSdu[c][k] - batch.drdu[k] * U[c];
+      L1[c] = batch.dSdv[c][k] - batch.drdv[k] * U[c];
+    }
+
+    // Q Q^T
+    const double q00 = Q0[0] * Q0[0] + Q0[1] * Q0[1] + Q0[2] * Q0[2];
+    const double q01 = Q0[0] * Q1[0] + Q0[1] * Q1[1] + Q0[2] * Q1[2];
+    const double q11 = Q1[0] * Q1[0] + Q1[1] * Q1[1] + Q1[2] * Q1[2];
+    const double inverseDeterminant = 1 / (q00 * q11 - q01 * q01);
+
+    // M = L Q^T (Q Q^T)^-1, only the entries the symmetric rSrad matrix uses
+    const double p00 = L0[0] * Q0[0] + L0[1] * Q0[1] + L0[2] * Q0[2];
+    const double p01 = L0[0] * Q1[0] + L0[1] * Q1[1] + L0[2] * Q1[2];
+    const double p10 = L1[0] * Q0[0] + L1[1] * Q0[1] + L1[2] * Q0[2];
+    const double p11 = L1[0] * Q1[0] + L1[1] * Q1[1] + L1[2] * Q1[2];
+    const double m00 = (p00 * q11 - p01 * q01) * inverseDeterminant;
+    const double m01 = (p01 * q00 - p00 * q01) * inverseDeterminant;
+    const double m11 = (p11 * q00 - p10 * q01) * inverseDeterminant;
+
+    // the rSrad matrix is M^T, whose lower triangle is m00, m01, m11
+    const double mean = (m00 + m11) / 2;
+    const double halfDifference = (m00 - m11) / 2;
+    const double maxEigenvalue = mean + std::sqrt(halfDifference * halfDifference + m01 * m01);
+
+    // comparing this way around also gives 0 for nan
+    penalties[k] = maxEigenvalue - 1 > 0 ? maxEigenvalue - 1 : 0.0;
+  }
+}
+
+}
@@ -0,0 +1,54 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+#ifndef __vtkSlicerSRepRefinementLogic_SRepRSradKernel_h
+#define __vtkSlicerSRepRefinementLogic_SRepRSradKernel_h
+
+#include <cstdlib>
+
+#include "vtkSlicerSRepRefinementModuleLogicExport.h"
+
+namespace sreprefinement {
+
+/// Inputs of the rSrad penalty of RSradBatch::Size spokes, one lane per spoke.
+///
+/// Each quantity is stored as its own array over the lanes, so ComputeRSradPenalties works on all
+/// lanes with the same instructions and the compiler can vectorize it.
+/// u is the line-to-line direction and v the step-to-step direction. x is the unit direction of the
+/// spoke, S the direction, and r the radius.
+struct RSradBatch {
+  static constexpr size_t Size = 8;
+
+  double U[3][Size]; ///< unit direction
+  double dxdu[3][Size];
+  double dxdv[3][Size];
+  double dSdu[3][Size];
+  double dSdv[3][Size];
+  double drdu[Size];
+  double drdv[Size];
+};
+
+/// Computes the rSrad penalty, max(0, largest eigenvalue of the rSrad matrix - 1), of every lane.
+///
+/// The rSrad matrix is 2x2, so its inverse and eigenvalues are computed in closed form. As in
+/// Han, Qiong's dissertation, the matrix is treated as symmetric using its lower triangle.
+/// \param[out] penalties RSradBatch::Size penalties. A lane whose matrix can't be computed gets 0.
+VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT
+void ComputeRSradPenalties(const RSradBatch& batch, double* penalties);
+
+}
+
+#endif
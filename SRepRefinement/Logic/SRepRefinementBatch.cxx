@@ -0,0 +1,172 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "SRepRefinementBatch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace {
+
+//----------------------------------------------------------------------------
+// Runs f, returning the error message if it throws and an empty string otherwise
+template <class F>
+std::string CallAndCatch(F&& f, bool& succeeded) {
+  try {
+    f();
+    succeeded = true;
+    return "";
+  } catch (const std::exception& e) {
+    succeeded = false;
+    return e.what();
+  } catch (...) {
+    succeeded = false;
+    return "Unknown error";
+  }
+}
+
+//----------------------------------------------------------------------------
+void WriteCSVString(std::ostream& os, const std::string& s) {
+  os << '"';
+  for (const char c : s) {
+    if (c == '"') {
+      os << '"';
+    }
+    os << c;
+  }
+  os << '"';
+}
+
+} // namespace {}
+
+namespace sreprefinement {
+
+//----------------------------------------------------------------------------
+std::vector<BatchJobResult> RunBatch(
+  const size_t numJobs,
+  size_t numThreads,
+  const std::function<void(size_t)>& work,
+  const std::function<void(size_t)>& finish,
+  const bool workOnCallingThread)
+{
+  std::vector<BatchJobResult> results(numJobs, BatchJobResult{false, 0.0, ""});
+  if (numJobs == 0) {
+    return results;
+  }
+  if (numThreads == 0) {
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  numThreads = std::min(numThreads, numJobs);
+
+  std::atomic<size_t> nextJob(0);
+  std::mutex mutex;
+  std::condition_variable jobDone;
+  std::deque<size_t> doneJobs;
+
+  const auto runJob = [&](size_t job) {
+    auto& result = results[job];
+    const auto start = std::chrono::steady_clock::now();
+    result.errorMessage = CallAndCatch([&]() { work(job); }, result.succeeded);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      doneJobs.push_back(job);
+    }
+    jobDone.notify_one();
+  };
+  const auto worker = [&]() {
+    for (size_t job = nextJob++; job < numJobs; job = nextJob++) {
+      runJob(job);
+    }
+  };
+
+  // each result is only touched by its worker until it is handed over through doneJobs
+  size_t numFinished = 0;
+  const auto finishNextJob = [&](bool wait) {
+    size_t job = 0;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      if (wait) {
+        jobDone.wait(lock, [&]() { return !doneJobs.empty(); });
+      } else if (doneJobs.empty()) {
+        return false;
+      }
+      job = doneJobs.front();
+      doneJobs.pop_front();
+    }
+    auto& result = results[job];
+    if (result.succeeded) {
+      result.errorMessage = CallAndCatch([&]() { finish(job); }, result.succeeded);
+    }
+    ++numFinished;
+    return true;
+  };
+
+  std::vector<std::thread> threads;
+  const size_t numWorkerThreads = workOnCallingThread ? numThreads - 1 : numThreads;
+  threads.reserve(numWorkerThreads);
+  for (size_t i = 0; i < numWorkerThreads; ++i) {
+    threads.emplace_back(worker);
+  }
+
+  if (workOnCallingThread) {
+    for (size_t job = nextJob++; job < numJobs; job = nextJob++) {
+      runJob(job);
+      while (finishNextJob(false)) {
+      }
+    }
+  }
+  while (numFinished < numJobs) {
+    finishNextJob(true);
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return results;
+}
+
+//----------------------------------------------------------------------------
+size_t SplitThreads(size_t numThreads, const size_t numPools) {
+  if (numThreads == 0) {
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  return std::max<size_t>(1, numThreads / std::max<size_t>(1, numPools));
+}
+
+//----------------------------------------------------------------------------
+void WriteBatchResultsCSV(std::ostream& os, const std::vector<BatchJobResult>& results) {
+  const auto oldPrecision = os.precision(std::numeric_limits<double>::max_digits10);
+  os << "job,status,seconds,error\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto& result = results[i];
+    os << i << ',' << (result.succeeded ? "succeeded" : "failed") << ',' << result.seconds << ',';
+    WriteCSVString(os, result.errorMessage);
+    os << '\n';
+  }
+  os.precision(oldPrecision);
+}
+
+}
@@ -0,0 +1,86 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkSlicerSRepRefinementLogic_SRepRefinementBatch_h
+#define __vtkSlicerSRepRefinementLogic_SRepRefinementBatch_h
+
+#include <cstdlib>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "vtkSlicerSRepRefinementModuleLogicExport.h"
+
+class vtkMRMLEllipticalSRepNode;
+class vtkMRMLModelNode;
+
+namespace sreprefinement {
+
+/// One subject of a batch refinement.
+struct BatchJob {
+  vtkMRMLModelNode* model;
+  vtkMRMLEllipticalSRepNode* srep;
+  /// Gets the refined srep once the job finishes. May be nullptr.
+  vtkMRMLEllipticalSRepNode* destination;
+  /// The refined srep is written to this .srep.json file once the job finishes. May be empty.
+  std::string fileName;
+  /// The job checkpoints to this file and resumes from it, see vtkSlicerSRepRefinementLogic::SetCheckpointFileName.
+  /// May be empty for no checkpoints.
+  std::string checkpointFileName;
+};
+
+/// Outcome of one job of a batch.
+struct BatchJobResult {
+  bool succeeded;
+  double seconds;           ///< wall time the job took on its worker thread
+  std::string errorMessage; ///< empty if the job succeeded
+};
+
+/// Runs numJobs independent jobs on a pool of worker threads.
+///
+/// work(i) runs job i on a worker thread. Once it returns, finish(i) is called on the calling thread,
+/// in the order the jobs finish, so it is safe for finish to update MRML nodes. An exception from
+/// either fails only that job, the others still run. Returns when all jobs are done.
+///
+/// If workOnCallingThread, the calling thread is one of the numThreads workers, and finishes the jobs
+/// that are done between its own. That lets work report from the calling thread while the jobs run.
+///
+/// \param numThreads Number of worker threads. 0 uses one per hardware thread.
+/// \returns The result of each job, in job order.
+VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT
+std::vector<BatchJobResult> RunBatch(
+  size_t numJobs,
+  size_t numThreads,
+  const std::function<void(size_t)>& work,
+  const std::function<void(size_t)>& finish,
+  bool workOnCallingThread = false);
+
+/// Gets the threads each of numPools pools may use so that, running at the same time, they use about
+/// numThreads together.
+/// \param numThreads Threads of all the pools. 0 uses one per hardware thread.
+/// \returns At least 1.
+VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT
+size_t SplitThreads(size_t numThreads, size_t numPools);
+
+/// Writes batch results as CSV with a header row, one row per job.
+VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT
+void WriteBatchResultsCSV(std::ostream& os, const std::vector<BatchJobResult>& results);
+
+}
+
+#endif
@@ -0,0 +1,103 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "SRepRefinementBudget.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace sreprefinement {
+
+//----------------------------------------------------------------------------
+const char* ToString(const StopReason reason) {
+  switch (reason) {
+    case StopReason::Completed: return "completed";
+    case StopReason::TimeBudget: return "time budget";
+    case StopReason::EvaluationBudget: return "evaluation budget";
+    case StopReason::Cancelled: return "cancelled";
+  }
+  return "unknown";
+}
+
+//----------------------------------------------------------------------------
+StageBudget::StageBudget(const double seconds, const size_t maxEvaluations)
+  : m_duration(seconds)
+  , m_maxEvaluations(maxEvaluations)
+  , m_started()
+  , m_start()
+  , m_numEvaluations(0)
+  , m_stopReason(StopReason::Completed)
+{}
+
+//----------------------------------------------------------------------------
+bool StageBudget::Spend() {
+  std::call_once(m_started, [this]() { m_start = Clock::now(); });
+  const size_t numEvaluations = ++m_numEvaluations;
+  if (this->IsExhausted()) {
+    return false;
+  }
+  if (m_maxEvaluations > 0 && numEvaluations > m_maxEvaluations) {
+    this->Exhaust(StopReason::EvaluationBudget);
+    return false;
+  }
+  if (m_duration.count() > 0 && Clock::now() - m_start >= m_duration) {
+    this->Exhaust(StopReason::TimeBudget);
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool StageBudget::IsExhausted() const {
+  return m_stopReason != StopReason::Completed;
+}
+
+//----------------------------------------------------------------------------
+StopReason StageBudget::GetStopReason() const {
+  return m_stopReason;
+}
+
+//----------------------------------------------------------------------------
+size_t StageBudget::GetNumberOfEvaluations() const {
+  return m_numEvaluations;
+}
+
+//----------------------------------------------------------------------------
+void StageBudget::Exhaust(const StopReason reason) {
+  // if threads run out for different reasons at once, the first one is kept
+  auto expected = StopReason::Completed;
+  m_stopReason.compare_exchange_strong(expected, reason);
+}
+
+//----------------------------------------------------------------------------
+std::vector<int> SplitLevelIterations(const int maxIterations, const size_t numLevels) {
+  if (numLevels == 0) {
+    throw std::invalid_argument("Expected at least one pyramid level");
+  }
+  std::vector<int> iterations(numLevels);
+  int share = maxIterations / 2;
+  int coarseIterations = 0;
+  for (size_t level = numLevels - 1; level-- > 0;) {
+    share /= 2;
+    iterations[level] = std::max(1, share);
+    coarseIterations += iterations[level];
+  }
+  iterations[numLevels - 1] = std::max(1, maxIterations - coarseIterations);
+  return iterations;
+}
+
+}
@@ -0,0 +1,105 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkSlicerSRepRefinementLogic_SRepRefinementBudget_h
+#define __vtkSlicerSRepRefinementLogic_SRepRefinementBudget_h
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+#include "vtkSlicerSRepRefinementModuleLogicExport.h"
+
+namespace sreprefinement {
+
+/// Why a stage of a refinement stopped.
+enum class StopReason {
+  Completed,        ///< the stage reached its own stopping criteria
+  TimeBudget,       ///< the stage ran out of wall time
+  EvaluationBudget, ///< the stage ran out of evaluations
+  Cancelled,        ///< the refinement was cancelled before the stage finished
+};
+
+VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT
+const char* ToString(StopReason reason);
+
+/// How each stage of a refinement stopped.
+struct RefinementStatus {
+  StopReason up = StopReason::Completed;
+  StopReason down = StopReason::Completed;
+  StopReason crest = StopReason::Completed;
+
+  /// True if every stage reached its own stopping criteria.
+  bool IsCompleted() const {
+    return up == StopReason::Completed && down == StopReason::Completed && crest == StopReason::Completed;
+  }
+};
+
+/// Wall time and evaluation limits of one stage of a refinement.
+///
+/// The clock starts at the first Spend, so time spent before the stage starts (e.g. computing distance
+/// fields or other stages) is not counted. Spend is thread safe so a stage can evaluate on many threads.
+class VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT StageBudget {
+public:
+  /// \param seconds Wall time the stage may take. 0 for no limit.
+  /// \param maxEvaluations Number of evaluations the stage may do. 0 for no limit.
+  StageBudget(double seconds, size_t maxEvaluations);
+
+  StageBudget(const StageBudget&) = delete;
+  StageBudget& operator=(const StageBudget&) = delete;
+
+  /// Counts an evaluation the stage is about to do.
+  /// \returns false if the budget is used up, in which case the evaluation should not be done.
+  ///          Once false, it stays false.
+  bool Spend();
+
+  bool IsExhausted() const;
+
+  /// Gets which limit was reached, or StopReason::Completed if neither was.
+  StopReason GetStopReason() const;
+
+  /// Gets the number of evaluations spent, including the one that found the budget used up.
+  size_t GetNumberOfEvaluations() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  void Exhaust(StopReason reason);
+
+  const std::chrono::duration<double> m_duration;
+  const size_t m_maxEvaluations;
+  std::once_flag m_started;
+  Clock::time_point m_start;
+  std::atomic<size_t> m_numEvaluations;
+  std::atomic<StopReason> m_stopReason;
+};
+
+/// Splits the iterations of a refinement between its pyramid levels, 0 is the coarsest.
+///
+/// The level before the finest gets a quarter of maxIterations and each coarser level half of what the level
+/// after it gets, so the coarse levels together get less than half. The finest level gets the rest.
+///
+/// \returns The iterations of each level, at least one each.
+/// \throws std::invalid_argument if numLevels is 0
+VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT
+std::vector<int> SplitLevelIterations(int maxIterations, size_t numLevels);
+
+}
+
+#endif
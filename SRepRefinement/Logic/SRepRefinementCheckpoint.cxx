@@ -0,0 +1,201 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "SRepRefinementCheckpoint.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+namespace {
+
+constexpr char Magic[8] = {'S', 'R', 'E', 'P', 'C', 'K', 'P', '\0'};
+constexpr uint32_t Version = 2;
+// written in native byte order, so a file from a machine with the other endianness doesn't match
+constexpr uint32_t ByteOrderMark = 0x01020304;
+
+/// Layout of the start of a checkpoint file. It is followed by the level's up and down coefficients,
+/// then for each of the up and down spokes a SpokesHeader and their coefficients.
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrderMark;
+  uint64_t key;
+  uint64_t level;
+  uint32_t stage;
+  int32_t iteration;
+  uint64_t numCoefficients;
+};
+static_assert(sizeof(Header) == 48, "checkpoint file header must be 48 bytes");
+
+struct SpokesHeader {
+  double regionSize;
+  int64_t evaluations;
+  int32_t sweep;
+  int32_t sweepEvaluations;
+  uint64_t finished;
+};
+static_assert(sizeof(SpokesHeader) == 32, "checkpoint spokes header must be 32 bytes");
+
+//----------------------------------------------------------------------------
+void WriteCoefficients(std::ostream& os, const std::vector<double>& coefficients) {
+  os.write(reinterpret_cast<const char*>(coefficients.data()), coefficients.size() * sizeof(double));
+}
+
+//----------------------------------------------------------------------------
+void WriteSpokes(std::ostream& os, const sreprefinement::RefinementCheckpoint::Spokes& spokes) {
+  SpokesHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.regionSize = spokes.regionSize;
+  header.evaluations = spokes.evaluations;
+  header.sweep = spokes.sweep;
+  header.sweepEvaluations = spokes.sweepEvaluations;
+  header.finished = spokes.finished ? 1 : 0;
+  os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  WriteCoefficients(os, spokes.coefficients);
+}
+
+//----------------------------------------------------------------------------
+bool ReadCoefficients(std::istream& is, size_t numCoefficients, std::vector<double>& coefficients) {
+  coefficients.resize(numCoefficients);
+  is.read(reinterpret_cast<char*>(coefficients.data()), numCoefficients * sizeof(double));
+  return static_cast<bool>(is);
+}
+
+//----------------------------------------------------------------------------
+bool ReadSpokes(std::istream& is, size_t numCoefficients, sreprefinement::RefinementCheckpoint::Spokes& spokes) {
+  SpokesHeader header;
+  if (!is.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+    return false;
+  }
+  if (header.finished > 1 || header.sweep < 0 || header.sweepEvaluations < 0) {
+    return false;
+  }
+  spokes.regionSize = header.regionSize;
+  spokes.evaluations = static_cast<int>(header.evaluations);
+  spokes.sweep = header.sweep;
+  spokes.sweepEvaluations = header.sweepEvaluations;
+  spokes.finished = header.finished == 1;
+  return ReadCoefficients(is, numCoefficients, spokes.coefficients);
+}
+
+} // namespace {}
+
+namespace sreprefinement {
+
+//----------------------------------------------------------------------------
+bool WriteRefinementCheckpoint(const std::string& fileName, const RefinementCheckpoint& checkpoint) {
+  const size_t numCoefficients = checkpoint.levelUpCoefficients.size();
+  if (checkpoint.levelDownCoefficients.size() != numCoefficients
+    || checkpoint.up.coefficients.size() != numCoefficients
+    || checkpoint.down.coefficients.size() != numCoefficients)
+  {
+    return false;
+  }
+
+  Header header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, Magic, sizeof(Magic));
+  header.version = Version;
+  header.byteOrderMark = ByteOrderMark;
+  header.key = checkpoint.key;
+  header.level = checkpoint.level;
+  header.stage = static_cast<uint32_t>(checkpoint.stage);
+  header.iteration = checkpoint.iteration;
+  header.numCoefficients = numCoefficients;
+
+  // unique per thread and call, so concurrent writes of the same checkpoint don't write the same file
+  std::ostringstream tempFileName;
+  tempFileName << fileName << "." << std::hash<std::thread::id>()(std::this_thread::get_id())
+    << "." << std::chrono::steady_clock::now().time_since_epoch().count() << ".tmp";
+
+  {
+    std::ofstream file(tempFileName.str(), std::ios::binary);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    WriteCoefficients(file, checkpoint.levelUpCoefficients);
+    WriteCoefficients(file, checkpoint.levelDownCoefficients);
+    WriteSpokes(file, checkpoint.up);
+    WriteSpokes(file, checkpoint.down);
+    if (!file) {
+      file.close();
+      std::remove(tempFileName.str().c_str());
+      return false;
+    }
+  }
+
+  if (std::rename(tempFileName.str().c_str(), fileName.c_str()) != 0) {
+    // rename doesn't replace an existing file on Windows
+    std::remove(fileName.c_str());
+    if (std::rename(tempFileName.str().c_str(), fileName.c_str()) != 0) {
+      std::remove(tempFileName.str().c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool ReadRefinementCheckpoint(const std::string& fileName, RefinementCheckpoint& checkpoint) {
+  std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+  if (!file) {
+    return false;
+  }
+  const auto fileSize = static_cast<uint64_t>(file.tellg());
+  file.seekg(0);
+
+  Header header;
+  if (fileSize < sizeof(Header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+    return false;
+  }
+  if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0
+    || header.version != Version
+    || header.byteOrderMark != ByteOrderMark
+    || header.stage > static_cast<uint32_t>(RefinementCheckpoint::Stage::Crest))
+  {
+    return false;
+  }
+  // checked before allocating, so a corrupt count can't ask for a huge vector
+  const uint64_t numCoefficients = header.numCoefficients;
+  if (numCoefficients > fileSize / sizeof(double)
+    || fileSize != sizeof(Header) + 2 * sizeof(SpokesHeader) + 4 * numCoefficients * sizeof(double))
+  {
+    return false;
+  }
+
+  RefinementCheckpoint read;
+  read.key = header.key;
+  read.level = header.level;
+  read.stage = static_cast<RefinementCheckpoint::Stage>(header.stage);
+  read.iteration = header.iteration;
+  const auto n = static_cast<size_t>(numCoefficients);
+  if (!ReadCoefficients(file, n, read.levelUpCoefficients)
+    || !ReadCoefficients(file, n, read.levelDownCoefficients)
+    || !ReadSpokes(file, n, read.up)
+    || !ReadSpokes(file, n, read.down))
+  {
+    return false;
+  }
+  checkpoint = std::move(read);
+  return true;
+}
+
+}
@@ -0,0 +1,78 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkSlicerSRepRefinementLogic_SRepRefinementCheckpoint_h
+#define __vtkSlicerSRepRefinementLogic_SRepRefinementCheckpoint_h
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vtkSlicerSRepRefinementModuleLogicExport.h"
+
+namespace sreprefinement {
+
+/// State of a refinement that it can be resumed from after the process stops.
+///
+/// The optimizers' internal models are not saved. A resumed optimization restarts from the best
+/// coefficients found so far with the trust region radius it had reached, and gets the evaluations
+/// it had left. A patch refinement restarts the sweep it was in.
+struct RefinementCheckpoint {
+  enum class Stage {
+    Up,    ///< the up spokes of the level are not finished (the down spokes may be refined alongside)
+    Down,  ///< the up spokes of the level are finished, the down spokes are not
+    Crest, ///< the up and down spokes of the level are finished
+  };
+
+  /// Progress of the refinement of one spoke orientation on the checkpoint's level.
+  struct Spokes {
+    std::vector<double> coefficients; ///< best coefficients so far, relative to the srep at the level's start
+    double regionSize;                ///< trust region radius reached
+    int evaluations;                  ///< objective function evaluations done on the level
+    int sweep;                        ///< patch sweep reached on the level, 0 without patches
+    int sweepEvaluations;             ///< objective function evaluations done in that sweep
+    bool finished;                    ///< true once the level is done with these spokes
+  };
+
+  /// Identifies the inputs and settings of the refinement, so a checkpoint is not resumed by another one.
+  uint64_t key;
+  /// Pyramid level the checkpoint was written on, 0 is the coarsest.
+  uint64_t level;
+  Stage stage;
+  /// Progress iteration of the refinement.
+  int iteration;
+  /// Up and down coefficients that refine the input srep to the srep at the start of the level.
+  std::vector<double> levelUpCoefficients;
+  std::vector<double> levelDownCoefficients;
+  Spokes up;
+  Spokes down;
+};
+
+/// Writes a checkpoint to a temporary file and renames it into place, so a crash while writing
+/// leaves the previous checkpoint intact.
+/// \returns false if the checkpoint could not be written
+VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT
+bool WriteRefinementCheckpoint(const std::string& fileName, const RefinementCheckpoint& checkpoint);
+
+/// Reads a checkpoint written by WriteRefinementCheckpoint.
+/// \returns false if the file doesn't exist, is corrupt or truncated, or is from another version
+VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT
+bool ReadRefinementCheckpoint(const std::string& fileName, RefinementCheckpoint& checkpoint);
+
+}
+
+#endif
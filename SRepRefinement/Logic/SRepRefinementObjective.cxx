@@ -0,0 +1,709 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "SRepRefinementObjective.h"
+
+#include <SRepInterpolation.h>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+namespace sreprefinement {
+
+//----------------------------------------------------------------------------
+RefinementObjective::RefinementObjective(
+  const size_t numLines,
+  const size_t numSteps,
+  const size_t interpolationLevel,
+  std::vector<srep::Point3d> skeletalPoints,
+  std::vector<srep::Vector3d> directions,
+  const DistanceSampler& sampler)
+  : m_numLines(numLines)
+  , m_numSteps(numSteps)
+  , m_density(size_t(1) << interpolationLevel)
+  , m_numInterpolatedLines(numLines * m_density)
+  , m_numInterpolatedSteps((numSteps - 1) * m_density + 1)
+  // the rSrad penalty is computed on the primary spokes of the first (interpolated steps / density) steps
+  , m_numSradSteps(m_numInterpolatedSteps / m_density)
+  , m_skeletalPoints()
+  , m_initialDirections(std::move(directions))
+  , m_sampler(sampler)
+  , m_coefficients()
+  , m_directions()
+  , m_unitDirections()
+  , m_radii()
+  , m_quadDistanceSquared()
+  , m_quadNormalPenalty()
+  , m_srad(numLines * numSteps, 0.0)
+  , m_numberOfUpdatedQuads(0)
+  , m_changedSpokes(numLines * numSteps)
+  , m_dirtyQuads()
+  , m_dirtySrad(numLines * numSteps)
+  , m_quadList()
+  , m_sradList()
+  , m_sradPenalties()
+  , m_allQuads()
+  , m_sampleIndices()
+  , m_points()
+  , m_distances()
+  , m_normals()
+  , m_distanceGradients()
+  , m_normalJacobians()
+  , m_spokeGradients()
+  , m_primaryGradients()
+  , m_quadGradients()
+  , m_quadSpokes()
+{
+  const size_t numInterpolatedSpokes = m_numInterpolatedLines * m_numInterpolatedSteps;
+  if (numLines < 1 || numSteps < 2) {
+    throw std::invalid_argument("RefinementObjective requires at least 1 line and 2 steps");
+  }
+  if (skeletalPoints.size() != numInterpolatedSpokes) {
+    throw std::invalid_argument("RefinementObjective expected " + std::to_string(numInterpolatedSpokes)
+      + " interpolated skeletal points, got " + std::to_string(skeletalPoints.size()));
+  }
+  if (m_initialDirections.size() != numLines * numSteps) {
+    throw std::invalid_argument("RefinementObjective expected " + std::to_string(numLines * numSteps)
+      + " spoke directions, got " + std::to_string(m_initialDirections.size()));
+  }
+
+  m_skeletalPoints.reserve(3 * numInterpolatedSpokes);
+  for (const auto& point : skeletalPoints) {
+    m_skeletalPoints.insert(m_skeletalPoints.end(), {point[0], point[1], point[2]});
+  }
+  m_directions.resize(3 * numInterpolatedSpokes, 0.0);
+  m_unitDirections.resize(3 * numInterpolatedSpokes, 0.0);
+  m_radii.resize(numInterpolatedSpokes, 0.0);
+
+  // sized for a full evaluation so Evaluate never needs to allocate
+  const size_t numQuads = numLines * (numSteps - 1);
+  m_coefficients.reserve(4 * numLines * numSteps);
+  m_quadDistanceSquared.resize(numQuads, 0.0);
+  m_quadNormalPenalty.resize(numQuads, 0.0);
+  m_dirtyQuads.resize(numQuads);
+  m_quadList.reserve(numQuads);
+  m_sradList.reserve(numLines * numSteps);
+  m_sradPenalties.resize(numLines * numSteps);
+  m_allQuads.resize(numQuads);
+  std::iota(m_allQuads.begin(), m_allQuads.end(), size_t(0));
+  m_sampleIndices.resize(numInterpolatedSpokes);
+  m_points.resize(3 * numInterpolatedSpokes);
+  m_distances.resize(numInterpolatedSpokes);
+  m_normals.resize(3 * numInterpolatedSpokes);
+  m_distanceGradients.resize(3 * numInterpolatedSpokes);
+  m_normalJacobians.resize(9 * numInterpolatedSpokes);
+  m_spokeGradients.resize(3 * numInterpolatedSpokes);
+  m_primaryGradients.resize(3 * numLines * numSteps);
+  m_quadGradients.resize(3 * (m_density + 1) * (m_density + 1));
+  m_quadSpokes.resize((m_density + 1) * (m_density + 1));
+}
+
+//----------------------------------------------------------------------------
+RefinementObjective::Terms RefinementObjective::Evaluate(const double* coefficients) {
+  const size_t numSpokes = m_numLines * m_numSteps;
+  try {
+    // find the primary spokes that changed since the last evaluation
+    size_t numChanged = numSpokes;
+    if (!m_coefficients.empty()) {
+      numChanged = 0;
+      for (size_t k = 0; k < numSpokes; ++k) {
+        m_changedSpokes[k] = !std::equal(coefficients + 4 * k, coefficients + 4 * k + 4, m_coefficients.begin() + 4 * k);
+        numChanged += m_changedSpokes[k];
+      }
+    }
+    // with most spokes changed nearly every quad is dirty, so just redo everything
+    if (2 * numChanged > numSpokes) {
+      std::fill(m_changedSpokes.begin(), m_changedSpokes.end(), 1);
+    }
+
+    std::fill(m_dirtyQuads.begin(), m_dirtyQuads.end(), 0);
+    std::fill(m_dirtySrad.begin(), m_dirtySrad.end(), 0);
+    for (size_t k = 0; k < numSpokes; ++k) {
+      if (!m_changedSpokes[k]) {
+        continue;
+      }
+      const size_t line = k / m_numSteps;
+      const size_t step = k % m_numSteps;
+      const size_t prevLine = (line + m_numLines - 1) % m_numLines;
+      const size_t nextLine = (line + 1) % m_numLines;
+      SetDirection(InterpolatedIndex(line * m_density, step * m_density), RefineDirection(k, coefficients + 4 * k));
+
+      // every quad with this spoke as a corner
+      for (const size_t quadLine : {prevLine, line}) {
+        if (step > 0) {
+          m_dirtyQuads[QuadIndex(quadLine, step - 1)] = 1;
+        }
+        if (step < m_numSteps - 1) {
+          m_dirtyQuads[QuadIndex(quadLine, step)] = 1;
+        }
+      }
+
+      // the rSrad penalty of a primary spoke uses the interpolated spokes right next to it, which only
+      // depend on the primary spokes at either end of their edge
+      m_dirtySrad[k] = 1;
+      m_dirtySrad[prevLine * m_numSteps + step] = 1;
+      m_dirtySrad[nextLine * m_numSteps + step] = 1;
+      m_dirtySrad[line * m_numSteps + (step > 0 ? step - 1 : step)] = 1;
+      m_dirtySrad[line * m_numSteps + std::min(step + 1, m_numSteps - 1)] = 1;
+    }
+
+    m_quadList.clear();
+    for (size_t q = 0; q < m_dirtyQuads.size(); ++q) {
+      if (m_dirtyQuads[q]) {
+        m_quadList.push_back(q);
+        InterpolateQuad(q / (m_numSteps - 1), q % (m_numSteps - 1));
+      }
+    }
+    ComputeDistanceTerms(m_quadList);
+
+    m_sradList.clear();
+    for (size_t k = 0; k < numSpokes; ++k) {
+      if (m_dirtySrad[k]) {
+        if (k % m_numSteps < m_numSradSteps) {
+          m_sradList.push_back(k);
+        } else {
+          m_srad[k] = 0.0;
+        }
+      }
+    }
+    ComputeRSradPenalties(m_sradList.data(), m_sradList.size(), m_sradPenalties.data());
+    for (size_t i = 0; i < m_sradList.size(); ++i) {
+      m_srad[m_sradList[i]] = m_sradPenalties[i];
+    }
+
+    m_coefficients.assign(coefficients, coefficients + 4 * numSpokes);
+    m_numberOfUpdatedQuads = m_quadList.size();
+  } catch (...) {
+    // the cached state is only partially updated, so start over next time
+    m_coefficients.clear(); // keeps its capacity
+    throw;
+  }
+
+  // sum in a fixed order so the result doesn't depend on which parts were updated
+  Terms terms{0.0, 0.0, 0.0};
+  for (size_t q = 0; q < m_quadDistanceSquared.size(); ++q) {
+    terms.distanceSquared += m_quadDistanceSquared[q];
+    terms.normalPenalty += m_quadNormalPenalty[q];
+  }
+  for (const double srad : m_srad) {
+    terms.srad += srad;
+  }
+  return terms;
+}
+
+//----------------------------------------------------------------------------
+RefinementObjective::Terms RefinementObjective::EvaluateWithGradient(
+  const double* coefficients,
+  const Weights& weights,
+  const double step,
+  double* gradient)
+{
+  if (!(step > 0)) {
+    throw std::invalid_argument("RefinementObjective gradient step must be positive");
+  }
+  const auto terms = this->Evaluate(coefficients);
+
+  std::fill(m_spokeGradients.begin(), m_spokeGradients.end(), 0.0);
+  std::fill(m_primaryGradients.begin(), m_primaryGradients.end(), 0.0);
+  this->AddDistanceTermGradients(weights);
+  this->AddRSradGradients(weights.srad, step);
+  for (const size_t quad : m_allQuads) {
+    this->BackpropagateQuad(quad / (m_numSteps - 1), quad % (m_numSteps - 1), step);
+  }
+
+  // a primary spoke is its unit direction coefficients scaled by exp(log radius scale) times the initial radius
+  for (size_t k = 0; k < m_numLines * m_numSteps; ++k) {
+    const double* spokeGradient = &m_primaryGradients[3 * k];
+    const double scale = std::exp(coefficients[4 * k + 3]) * m_initialDirections[k].GetLength();
+    const auto direction = RefineDirection(k, coefficients + 4 * k);
+    for (size_t c = 0; c < 3; ++c) {
+      gradient[4 * k + c] = spokeGradient[c] * scale;
+    }
+    gradient[4 * k + 3] = spokeGradient[0] * direction[0] + spokeGradient[1] * direction[1] + spokeGradient[2] * direction[2];
+  }
+  return terms;
+}
+
+//----------------------------------------------------------------------------
+size_t RefinementObjective::GetNumberOfUpdatedQuads() const {
+  return m_numberOfUpdatedQuads;
+}
+
+//----------------------------------------------------------------------------
+size_t RefinementObjective::GetNumberOfCoefficients() const {
+  return 4 * m_numLines * m_numSteps;
+}
+
+//----------------------------------------------------------------------------
+size_t RefinementObjective::InterpolatedIndex(const size_t line, const size_t step) const {
+  return (line % m_numInterpolatedLines) * m_numInterpolatedSteps + step;
+}
+
+//----------------------------------------------------------------------------
+size_t RefinementObjective::QuadIndex(const size_t line, const size_t step) const {
+  return line * (m_numSteps - 1) + step;
+}
+
+//----------------------------------------------------------------------------
+srep::Vector3d RefinementObjective::RefineDirection(const size_t spoke, const double* coefficients) const {
+  constexpr double tolerance = 1e-13;
+
+  const auto& oldDirection = m_initialDirections[spoke];
+  const double oldRadius = oldDirection.GetLength();
+  const auto oldUnitDir = oldDirection.Unit();
+
+  const srep::Vector3d newUnitDir(coefficients[0], coefficients[1], coefficients[2]);
+  const double newRadius = std::exp(coefficients[3]) * oldRadius;
+
+  if ( std::abs(oldRadius - newRadius) >= tolerance
+    || std::abs(oldUnitDir[0] - newUnitDir[0]) >= tolerance
+    || std::abs(oldUnitDir[1] - newUnitDir[1]) >= tolerance
+    || std::abs(oldUnitDir[2] - newUnitDir[2]) >= tolerance)
+  {
+    return newUnitDir * newRadius;
+  }
+  return oldDirection;
+}
+
+//----------------------------------------------------------------------------
+srep::Point3d RefinementObjective::GetSkeletalPoint(const size_t index) const {
+  return srep::Point3d(&m_skeletalPoints[3 * index]);
+}
+
+//----------------------------------------------------------------------------
+srep::Vector3d RefinementObjective::GetDirection(const size_t index) const {
+  return srep::Vector3d(&m_directions[3 * index]);
+}
+
+//----------------------------------------------------------------------------
+void RefinementObjective::SetDirection(const size_t index, const srep::Vector3d& direction) {
+  // throws for zero length directions, which can't be compared to the boundary normal
+  const auto unitDirection = direction.Unit();
+  for (size_t c = 0; c < 3; ++c) {
+    m_directions[3 * index + c] = direction[c];
+    m_unitDirections[3 * index + c] = unitDirection[c];
+  }
+  m_radii[index] = direction.GetLength();
+}
+
+//----------------------------------------------------------------------------
+void RefinementObjective::InterpolateQuad(const size_t line, const size_t step) {
+  if (m_density > 1) {
+    InterpolateSubQuad(line, step, 0, 0, m_density, 1.0);
+  }
+}
+
+//----------------------------------------------------------------------------
+void RefinementObjective::InterpolateSubQuad(
+  const size_t line,
+  const size_t step,
+  const size_t i,
+  const size_t j,
+  const size_t length,
+  const double lambda)
+{
+  // (i, j) is the line and step offset of the top left corner from the top left of the enclosing primary quad.
+  // This mirrors SRepInterpolateHelper::InterpolateQuad, but only for the spoke directions.
+  const auto index = [&](size_t di, size_t dj) {
+    return InterpolatedIndex(line * m_density + i + di, step * m_density + j + dj);
+  };
+  const auto middle = [&](size_t start, size_t end) {
+    return sreplogic::InterpolateMiddleSpokeDirection(
+      GetSkeletalPoint(start), GetDirection(start), GetSkeletalPoint(end), GetDirection(end), lambda);
+  };
+
+  const size_t half = length / 2;
+  const auto tl = index(0, 0);
+  const auto tr = index(length, 0);
+  const auto bl = index(0, length);
+  const auto br = index(length, length);
+  const auto tm = index(half, 0);
+  const auto lm = index(0, half);
+  const auto rm = index(length, half);
+  const auto bm = index(half, length);
+  const auto mm = index(half, half);
+
+  SetDirection(tm, middle(tl, tr));
+  SetDirection(lm, middle(tl, bl));
+  SetDirection(rm, middle(tr, br));
+  SetDirection(bm, middle(bl, br));
+
+  // for the very center interpolate off of two directions and average
+  const auto mmLeftRight = middle(lm, rm);
+  const auto mmTopBottom = middle(tm, bm);
+  SetDirection(mm, (mmLeftRight + mmTopBottom) / 2);
+
+  if (length == 2) {
+    return;
+  }
+
+  InterpolateSubQuad(line, step, i, j, half, lambda / 2);
+  InterpolateSubQuad(line, step, i + half, j, half, lambda / 2);
+  InterpolateSubQuad(line, step, i, j + half, half, lambda / 2);
+  InterpolateSubQuad(line, step, i + half, j + half, half, lambda / 2);
+}
+
+//----------------------------------------------------------------------------
+template <typename Function>
+void RefinementObjective::ForEachOwnedSpoke(const size_t quad, Function function) const {
+  const size_t line = quad / (m_numSteps - 1);
+  const size_t step = quad % (m_numSteps - 1);
+  const size_t numOwnedSteps = step == m_numSteps - 2 ? m_density + 1 : m_density;
+  for (size_t i = 0; i < m_density; ++i) {
+    for (size_t j = 0; j < numOwnedSteps; ++j) {
+      function(InterpolatedIndex(line * m_density + i, step * m_density + j));
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+size_t RefinementObjective::GatherTips(const std::vector<size_t>& quads) {
+  size_t n = 0;
+  for (const size_t quad : quads) {
+    ForEachOwnedSpoke(quad, [&](size_t index) {
+      m_sampleIndices[n] = index;
+      for (size_t c = 0; c < 3; ++c) {
+        m_points[3 * n + c] = m_skeletalPoints[3 * index + c] + m_directions[3 * index + c];
+      }
+      ++n;
+    });
+  }
+  return n;
+}
+
+//----------------------------------------------------------------------------
+void RefinementObjective::ComputeDistanceTerms(const std::vector<size_t>& quads) {
+  // gather all the boundary points so the field can be sampled in one batch
+  const size_t numTips = GatherTips(quads);
+  m_sampler.Sample(numTips, m_points.data(), m_distances.data(), m_normals.data());
+
+  size_t n = 0;
+  for (const size_t quad : quads) {
+    double distanceSquared = 0.0;
+    double normalPenalty = 0.0;
+    ForEachOwnedSpoke(quad, [&](size_t index) {
+      const double* normal = &m_normals[3 * n];
+      const double* unitDirection = &m_unitDirections[3 * index];
+      const double distSquared = m_distances[n] * m_distances[n];
+      const double dotProduct = normal[0] * unitDirection[0] + normal[1] * unitDirection[1] + normal[2] * unitDirection[2];
+
+      // The normal match (aka 1-dotProduct) (between [0,1]) is scaled by the distance so that the overall term is comparable
+      distanceSquared += distSquared;
+      normalPenalty += distSquared * (1 - dotProduct);
+      ++n;
+    });
+    m_quadDistanceSquared[quad] = distanceSquared;
+    m_quadNormalPenalty[quad] = normalPenalty;
+  }
+}
+
+//----------------------------------------------------------------------------
+void RefinementObjective::AddDistanceTermGradients(const Weights& weights) {
+  const size_t numTips = GatherTips(m_allQuads);
+  m_sampler.Sample(numTips, m_points.data(), m_distances.data(), m_normals.data());
+  m_sampler.SampleDerivatives(numTips, m_points.data(), m_distanceGradients.data(), m_normalJacobians.data());
+
+  // A tip's terms are d^2 (w0 + w1 (1 - n.u)) for the distance d and normal n at the tip, and the unit
+  // direction u of its spoke S. The tip moves with S, and u moves by (I - u u^T) / |S| times S's change.
+  for (size_t n = 0; n < numTips; ++n) {
+    const size_t index = m_sampleIndices[n];
+    const double distance = m_distances[n];
+    const double* normal = &m_normals[3 * n];
+    const double* distanceGradient = &m_distanceGradients[3 * n];
+    const double* normalJacobian = &m_normalJacobians[9 * n];
+    const double* unitDirection = &m_unitDirections[3 * index];
+    const double dotProduct = normal[0] * unitDirection[0] + normal[1] * unitDirection[1] + normal[2] * unitDirection[2];
+
+    const double byDistance = 2 * distance * (weights.distanceSquared + weights.normalPenalty * (1 - dotProduct));
+    const double byNormal = -weights.normalPenalty * distance * distance;
+    for (size_t c = 0; c < 3; ++c) {
+      const double normalChange = normalJacobian[c] * unitDirection[0]
+        + normalJacobian[3 + c] * unitDirection[1]
+        + normalJacobian[6 + c] * unitDirection[2];
+      m_spokeGradients[3 * index + c] += byDistance * distanceGradient[c]
+        + byNormal * normalChange
+        + byNormal * (normal[c] - dotProduct * unitDirection[c]) / m_radii[index];
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void RefinementObjective::AddRSradGradients(const double weight, const double differenceStep) {
+  // one lane per difference: the spoke whose direction is moved, along which axis, and by how much
+  struct Difference {
+    size_t spoke;
+    size_t axis;
+    double change;
+  };
+  RSradBatch batch;
+  Difference differences[RSradBatch::Size];
+  double penalties[RSradBatch::Size];
+  size_t numLanes = 0;
+  const auto flush = [&]() {
+    for (size_t lane = numLanes; lane < RSradBatch::Size; ++lane) {
+      // fill the unused lanes with the last difference so they don't compute garbage
+      for (size_t c = 0; c < 3; ++c) {
+        batch.U[c][lane] = batch.U[c][numLanes - 1];
+      }
+      batch.drdu[lane] = batch.drdu[numLanes - 1];
+      batch.drdv[lane] = batch.drdv[numLanes - 1];
+      for (size_t c = 0; c < 3; ++c) {
+        batch.dxdu[c][lane] = batch.dxdu[c][numLanes - 1];
+        batch.dxdv[c][lane] = batch.dxdv[c][numLanes - 1];
+        batch.dSdu[c][lane] = batch.dSdu[c][numLanes - 1];
+        batch.dSdv[c][lane] = batch.dSdv[c][numLanes - 1];
+      }
+    }
+    sreprefinement::ComputeRSradPenalties(batch, penalties);
+    for (size_t lane = 0; lane < numLanes; ++lane) {
+      const auto& difference = differences[lane];
+      // the backward difference has a negative change, so it is subtracted
+      m_spokeGradients[3 * difference.spoke + difference.axis] += weight * penalties[lane] / (2 * difference.change);
+    }
+    numLanes = 0;
+  };
+
+  for (size_t line = 0; line < m_numLines; ++line) {
+    for (size_t step = 0; step < m_numSradSteps; ++step) {
+      // the spokes GatherRSradInputs reads
+      const size_t ii = line * m_density;
+      const size_t jj = step * m_density;
+      size_t spokes[5] = {
+        InterpolatedIndex(ii, jj),
+        InterpolatedIndex(ii + m_numInterpolatedLines - 1, jj),
+        InterpolatedIndex(ii + 1, jj),
+        InterpolatedIndex(ii, jj == 0 ? 0 : jj - 1),
+        InterpolatedIndex(ii, std::min(jj + 1, m_numInterpolatedSteps - 1)),
+      };
+      std::sort(spokes, spokes + 5);
+      const size_t numSpokes = std::unique(spokes, spokes + 5) - spokes;
+
+      for (size_t s = 0; s < numSpokes; ++s) {
+        const auto direction = GetDirection(spokes[s]);
+        const double change = differenceStep * direction.GetLength();
+        for (size_t axis = 0; axis < 3; ++axis) {
+          for (const double sign : {1.0, -1.0}) {
+            double moved[3] = {direction[0], direction[1], direction[2]};
+            moved[axis] += sign * change;
+            SetDirection(spokes[s], srep::Vector3d(moved));
+            GatherRSradInputs(line, step, batch, numLanes);
+            differences[numLanes++] = Difference{spokes[s], axis, sign * change};
+          }
+          // restoring the exact direction restores the exact unit direction and radius too
+          SetDirection(spokes[s], direction);
+          if (numLanes == RSradBatch::Size) {
+            flush();
+          }
+        }
+      }
+    }
+  }
+  if (numLanes > 0) {
+    flush();
+  }
+}
+
+//----------------------------------------------------------------------------
+void RefinementObjective::BackpropagateQuad(const size_t line, const size_t step, const double differenceStep) {
+  // the derivatives of the spokes this quad owns. The spokes it shares with other quads get theirs there,
+  // and since the shared spokes are interpolated the same way in every quad the parts add up.
+  const size_t width = m_density + 1;
+  std::fill(m_quadGradients.begin(), m_quadGradients.end(), 0.0);
+  for (size_t i = 0; i <= m_density; ++i) {
+    for (size_t j = 0; j <= m_density; ++j) {
+      m_quadSpokes[i * width + j] = InterpolatedIndex(line * m_density + i, step * m_density + j);
+    }
+  }
+  ForEachOwnedSpoke(QuadIndex(line, step), [&](size_t index) {
+    const size_t i = (index / m_numInterpolatedSteps + m_numInterpolatedLines - line * m_density) % m_numInterpolatedLines;
+    const size_t j = index % m_numInterpolatedSteps - step * m_density;
+    for (size_t c = 0; c < 3; ++c) {
+      m_quadGradients[3 * (i * width + j) + c] = m_spokeGradients[3 * index + c];
+    }
+  });
+
+  if (m_density > 1) {
+    BackpropagateSubQuad(0, 0, m_density, 1.0, differenceStep);
+  }
+
+  const size_t nextLine = (line + 1) % m_numLines;
+  const size_t corners[4][2] = {
+    {0, line * m_numSteps + step},
+    {m_density * width, nextLine * m_numSteps + step},
+    {m_density, line * m_numSteps + step + 1},
+    {m_density * width + m_density, nextLine * m_numSteps + step + 1},
+  };
+  for (const auto& corner : corners) {
+    for (size_t c = 0; c < 3; ++c) {
+      m_primaryGradients[3 * corner[1] + c] += m_quadGradients[3 * corner[0] + c];
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void RefinementObjective::BackpropagateSubQuad(
+  const size_t i,
+  const size_t j,
+  const size_t length,
+  const double lambda,
+  const double differenceStep)
+{
+  // InterpolateSubQuad in reverse: the sub quads, then the center, then the edges. A spoke on an edge
+  // between two sub quads is interpolated by both. Each carries back the part of the derivative it has
+  // gathered so far and clears it, so every part is carried back once.
+  const size_t width = m_density + 1;
+  const auto index = [&](size_t di, size_t dj) {
+    return (i + di) * width + j + dj;
+  };
+  const size_t half = length / 2;
+  if (length > 2) {
+    BackpropagateSubQuad(i + half, j + half, half, lambda / 2, differenceStep);
+    BackpropagateSubQuad(i, j + half, half, lambda / 2, differenceStep);
+    BackpropagateSubQuad(i + half, j, half, lambda / 2, differenceStep);
+    BackpropagateSubQuad(i, j, half, lambda / 2, differenceStep);
+  }
+
+  const auto tl = index(0, 0);
+  const auto tr = index(length, 0);
+  const auto bl = index(0, length);
+  const auto br = index(length, length);
+  const auto tm = index(half, 0);
+  const auto lm = index(0, half);
+  const auto rm = index(length, half);
+  const auto bm = index(half, length);
+  const auto mm = index(half, half);
+
+  const auto take = [&](size_t spoke, double scale, double* gradient) {
+    for (size_t c = 0; c < 3; ++c) {
+      gradient[c] = scale * m_quadGradients[3 * spoke + c];
+      m_quadGradients[3 * spoke + c] = 0.0;
+    }
+  };
+
+  // the center is the average of two middle spokes
+  double gradient[3];
+  take(mm, 0.5, gradient);
+  BackpropagateMiddle(lm, rm, gradient, lambda, differenceStep);
+  BackpropagateMiddle(tm, bm, gradient, lambda, differenceStep);
+
+  const size_t edges[4][3] = {{bm, bl, br}, {rm, tr, br}, {lm, tl, bl}, {tm, tl, tr}};
+  for (const auto& edge : edges) {
+    take(edge[0], 1.0, gradient);
+    BackpropagateMiddle(edge[1], edge[2], gradient, lambda, differenceStep);
+  }
+}
+
+//----------------------------------------------------------------------------
+void RefinementObjective::BackpropagateMiddle(
+  const size_t start,
+  const size_t end,
+  const double* middleGradient,
+  const double lambda,
+  const double differenceStep)
+{
+  if (middleGradient[0] == 0.0 && middleGradient[1] == 0.0 && middleGradient[2] == 0.0) {
+    return;
+  }
+  const auto startPoint = GetSkeletalPoint(m_quadSpokes[start]);
+  const auto endPoint = GetSkeletalPoint(m_quadSpokes[end]);
+  double directions[2][3];
+  for (size_t c = 0; c < 3; ++c) {
+    directions[0][c] = m_directions[3 * m_quadSpokes[start] + c];
+    directions[1][c] = m_directions[3 * m_quadSpokes[end] + c];
+  }
+  const auto weightedMiddle = [&]() {
+    const auto middle = sreplogic::InterpolateMiddleSpokeDirection(
+      startPoint, srep::Vector3d(directions[0]), endPoint, srep::Vector3d(directions[1]), lambda);
+    return middle[0] * middleGradient[0] + middle[1] * middleGradient[1] + middle[2] * middleGradient[2];
+  };
+
+  const size_t spokes[2] = {start, end};
+  for (size_t side = 0; side < 2; ++side) {
+    const double change = differenceStep * srep::Vector3d(directions[side]).GetLength();
+    for (size_t c = 0; c < 3; ++c) {
+      const double original = directions[side][c];
+      directions[side][c] = original + change;
+      const double forward = weightedMiddle();
+      directions[side][c] = original - change;
+      const double backward = weightedMiddle();
+      directions[side][c] = original;
+      m_quadGradients[3 * spokes[side] + c] += (forward - backward) / (2 * change);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void RefinementObjective::ComputeRSradPenalties(const size_t* spokes, const size_t count, double* penalties) const {
+  RSradBatch batch;
+  for (size_t begin = 0; begin < count; begin += RSradBatch::Size) {
+    const size_t batchCount = std::min(RSradBatch::Size, count - begin);
+    for (size_t lane = 0; lane < RSradBatch::Size; ++lane) {
+      // fill the unused lanes with the last spoke so they don't compute garbage
+      const size_t k = spokes[begin + std::min(lane, batchCount - 1)];
+      GatherRSradInputs(k / m_numSteps, k % m_numSteps, batch, lane);
+    }
+    double batchPenalties[RSradBatch::Size];
+    sreprefinement::ComputeRSradPenalties(batch, batchPenalties);
+    std::copy(batchPenalties, batchPenalties + batchCount, penalties + begin);
+  }
+}
+
+//----------------------------------------------------------------------------
+void RefinementObjective::GatherRSradInputs(const size_t line, const size_t step, RSradBatch& batch, const size_t lane) const {
+  const size_t ii = line * m_density;
+  const size_t jj = step * m_density;
+  const double stepSize = 1.0 / m_density;
+
+  // u is line-to-line direction
+  // v is step-to-step direction
+  // dx is the derivative of the unit direction, dS of the direction, and dr of the radius
+  {
+    const size_t u1 = InterpolatedIndex(ii + m_numInterpolatedLines - 1, jj);
+    const size_t u2 = InterpolatedIndex(ii + 1, jj);
+
+    batch.drdu[lane] = (m_radii[u2] - m_radii[u1]) / stepSize / 2;
+    for (size_t c = 0; c < 3; ++c) {
+      batch.dxdu[c][lane] = (m_unitDirections[3 * u2 + c] - m_unitDirections[3 * u1 + c]) / stepSize / 2;
+      batch.dSdu[c][lane] = (m_directions[3 * u2 + c] - m_directions[3 * u1 + c]) / stepSize / 2;
+    }
+  }
+
+  {
+    const size_t prevStep = jj == 0 ? 0 : jj - 1;
+    const size_t nextStep = jj == m_numInterpolatedSteps - 1 ? m_numInterpolatedSteps - 1 : jj + 1;
+    const double divisor = prevStep == jj || nextStep == jj ? 1 : 2;
+
+    const size_t v1 = InterpolatedIndex(ii, prevStep);
+    const size_t v2 = InterpolatedIndex(ii, nextStep);
+
+    batch.drdv[lane] = (m_radii[v2] - m_radii[v1]) / stepSize / divisor;
+    for (size_t c = 0; c < 3; ++c) {
+      batch.dxdv[c][lane] = (m_unitDirections[3 * v2 + c] - m_unitDirections[3 * v1 + c]) / stepSize / divisor;
+      batch.dSdv[c][lane] = (m_directions[3 * v2 + c] - m_directions[3 * v1 + c]) / stepSize / divisor;
+    }
+  }
+
+  const size_t center = InterpolatedIndex(ii, jj);
+  for (size_t c = 0; c < 3; ++c) {
+    batch.U[c][lane] = m_unitDirections[3 * center + c];
+  }
+}
+
+}
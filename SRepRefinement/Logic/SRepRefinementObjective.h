@@ -0,0 +1,185 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkSlicerSRepRefinementLogic_SRepRefinementObjective_h
+#define __vtkSlicerSRepRefinementLogic_SRepRefinementObjective_h
+
+#include <vector>
+
+#include <srepPoint3d.h>
+#include <srepVector3d.h>
+
+#include "SRepDistanceSampler.h"
+#include "SRepRSradKernel.h"
+
+namespace sreprefinement {
+
+/// Evaluates the terms of the refinement objective for the up or down spokes of an srep.
+///
+/// The refinement only changes the spokes of one orientation and never moves the skeletal points,
+/// so the interpolated skeletal points are fixed at construction. Each evaluation compares the
+/// coefficients to the previous evaluation and only re-interpolates the quads that have a changed
+/// primary spoke as a corner. The distance terms are kept per quad and the rSrad penalty per
+/// primary spoke, so only the parts of the sums that can have changed are recomputed.
+///
+/// The spokes are kept as flat arrays of doubles (skeletal points, directions, unit directions and radii)
+/// and all scratch space is allocated at construction, so Evaluate does not touch the heap.
+///
+/// Grids are stored line major. Lines wrap around, steps do not.
+class VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT RefinementObjective {
+public:
+  struct Terms {
+    double distanceSquared; ///< L0
+    double normalPenalty;   ///< L1
+    double srad;            ///< L2
+  };
+
+  /// Weights of the terms in the objective value
+  struct Weights {
+    double distanceSquared;
+    double normalPenalty;
+    double srad;
+  };
+
+  /// \param numLines Number of lines of the primary (non-interpolated) grid.
+  /// \param numSteps Number of steps of the primary grid. Must be at least 2.
+  /// \param interpolationLevel The interpolated grid has 2^interpolationLevel times as many spokes along each direction.
+  /// \param skeletalPoints The skeletal points of the interpolated grid, which has numLines * 2^interpolationLevel
+  ///                       lines and (numSteps - 1) * 2^interpolationLevel + 1 steps.
+  /// \param directions The unrefined directions of the primary spokes.
+  /// \param sampler Distance field of the target boundary. Must outlive this.
+  /// \throws std::invalid_argument if the grid sizes don't match
+  RefinementObjective(
+    size_t numLines,
+    size_t numSteps,
+    size_t interpolationLevel,
+    std::vector<srep::Point3d> skeletalPoints,
+    std::vector<srep::Vector3d> directions,
+    const DistanceSampler& sampler);
+
+  /// Evaluates the objective terms.
+  ///
+  /// \param coefficients Four per primary spoke: the new unit direction and the log of the radius scale.
+  /// \throws std::invalid_argument or std::runtime_error if the spokes can't be interpolated (e.g. nan coefficients).
+  ///         The next evaluation after a throw recomputes everything.
+  Terms Evaluate(const double* coefficients);
+
+  /// Evaluates the objective terms and the gradient of the weighted objective value.
+  ///
+  /// The gradient is computed by the chain rule, in reverse from the objective to the coefficients:
+  /// - Every tip is sampled once more, together with the derivatives of the field's distance and normal
+  ///   (DistanceSampler::SampleDerivatives), which gives the derivative of the distance and normal terms
+  ///   with respect to every interpolated spoke.
+  /// - The rSrad penalty of each primary spoke is differentiated with respect to the spokes it reads by
+  ///   central differences of the penalty alone.
+  /// - These are carried back through the interpolation of each quad to its corners with central
+  ///   differences of each interpolated middle spoke, and then to the coefficients exactly.
+  ///
+  /// The field is sampled twice no matter how many coefficients there are. Differentiating the interpolation
+  /// calls the middle spoke interpolation 12 times for every call the evaluation makes, and the rSrad
+  /// differences evaluate the penalty about 30 times per primary spoke, so a gradient costs about as much as
+  /// a dozen full evaluations at any interpolation level.
+  ///
+  /// \param step Difference step of the interpolation and rSrad derivatives, relative to the length of the
+  ///        spokes being differenced. Must be positive.
+  /// \param[out] gradient GetNumberOfCoefficients() partial derivatives of the weighted objective value.
+  /// \returns The terms at coefficients.
+  /// \throws Same as Evaluate, and std::invalid_argument if step isn't positive.
+  Terms EvaluateWithGradient(const double* coefficients, const Weights& weights, double step, double* gradient);
+
+  /// Number of quads re-interpolated by the last call to Evaluate or EvaluateWithGradient
+  size_t GetNumberOfUpdatedQuads() const;
+
+  size_t GetNumberOfCoefficients() const;
+
+private:
+  size_t InterpolatedIndex(size_t line, size_t step) const;
+  size_t QuadIndex(size_t line, size_t step) const;
+  srep::Vector3d RefineDirection(size_t spoke, const double* coefficients) const;
+  srep::Point3d GetSkeletalPoint(size_t index) const;
+  srep::Vector3d GetDirection(size_t index) const;
+  void SetDirection(size_t index, const srep::Vector3d& direction);
+
+  void InterpolateQuad(size_t line, size_t step);
+  void InterpolateSubQuad(size_t line, size_t step, size_t i, size_t j, size_t length, double lambda);
+  /// Calls function with the interpolated index of every spoke the quad owns. Each quad owns the spokes of
+  /// its first m_density lines and steps, so the quads along an edge don't count the spokes on it twice.
+  /// The quads at the last step also own the last step.
+  template <typename Function>
+  void ForEachOwnedSpoke(size_t quad, Function function) const;
+  /// Fills m_sampleIndices and m_points with the owned spokes of the quads and their tips.
+  /// \returns The number of spokes.
+  size_t GatherTips(const std::vector<size_t>& quads);
+  void ComputeDistanceTerms(const std::vector<size_t>& quads);
+  /// Computes the rSrad penalties of count primary spokes, a batch of spokes at a time.
+  void ComputeRSradPenalties(const size_t* spokes, size_t count, double* penalties) const;
+
+  // Each of these adds to m_spokeGradients, the derivatives of the weighted objective with respect to the direction
+  // of every interpolated spoke, holding the other spokes where they are
+  void AddDistanceTermGradients(const Weights& weights);
+  void AddRSradGradients(double weight, double differenceStep);
+  /// Carries the derivatives of the quad's interpolated spokes back to its corners, adding to m_primaryGradients.
+  void BackpropagateQuad(size_t line, size_t step, double differenceStep);
+  void BackpropagateSubQuad(size_t i, size_t j, size_t length, double lambda, double differenceStep);
+  /// Adds the derivative of the interpolated middle spoke, weighted by its derivative, to the derivatives of the
+  /// start and end spokes. The spokes are local indices into the quad being backpropagated.
+  void BackpropagateMiddle(size_t start, size_t end, const double* middleGradient, double lambda, double differenceStep);
+  void GatherRSradInputs(size_t line, size_t step, RSradBatch& batch, size_t lane) const;
+
+  size_t m_numLines;
+  size_t m_numSteps;
+  size_t m_density;
+  size_t m_numInterpolatedLines;
+  size_t m_numInterpolatedSteps;
+  size_t m_numSradSteps;
+  std::vector<double> m_skeletalPoints; // 3 per interpolated spoke
+  std::vector<srep::Vector3d> m_initialDirections;
+  const DistanceSampler& m_sampler;
+
+  // state of the last evaluation
+  std::vector<double> m_coefficients;
+  std::vector<double> m_directions;     // 3 per interpolated spoke
+  std::vector<double> m_unitDirections; // 3 per interpolated spoke
+  std::vector<double> m_radii;          // 1 per interpolated spoke
+  std::vector<double> m_quadDistanceSquared;
+  std::vector<double> m_quadNormalPenalty;
+  std::vector<double> m_srad;
+  size_t m_numberOfUpdatedQuads;
+
+  // scratch space reused between evaluations
+  std::vector<char> m_changedSpokes;
+  std::vector<char> m_dirtyQuads;
+  std::vector<char> m_dirtySrad;
+  std::vector<size_t> m_quadList;
+  std::vector<size_t> m_sradList;
+  std::vector<double> m_sradPenalties; // one per entry of m_sradList
+  std::vector<size_t> m_allQuads;
+  std::vector<size_t> m_sampleIndices;
+  std::vector<double> m_points;
+  std::vector<double> m_distances;
+  std::vector<double> m_normals;
+  std::vector<double> m_distanceGradients; // 3 per sampled tip
+  std::vector<double> m_normalJacobians;   // 9 per sampled tip
+  std::vector<double> m_spokeGradients;    // 3 per interpolated spoke
+  std::vector<double> m_primaryGradients;  // 3 per primary spoke
+  std::vector<double> m_quadGradients;     // 3 per spoke of the quad being backpropagated, step varying fastest
+  std::vector<size_t> m_quadSpokes;        // interpolated index of each spoke of that quad
+};
+
+}
+
+#endif
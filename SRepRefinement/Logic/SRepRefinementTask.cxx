@@ -0,0 +1,161 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "SRepRefinementTask.h"
+
+#include <chrono>
+#include <exception>
+
+namespace sreprefinement {
+
+//----------------------------------------------------------------------------
+RefinementTask::RefinementTask(vtkMRMLEllipticalSRepNode* destination)
+  : m_destination(destination)
+  , m_cancelRequested(false)
+  , m_progress(0.0)
+  , m_mutex()
+  , m_done()
+  , m_status(Status::Running)
+  , m_errorMessage()
+  , m_refinementStatus()
+  , m_result()
+  , m_resultPublished(true)
+  , m_thread()
+{}
+
+//----------------------------------------------------------------------------
+RefinementTask::~RefinementTask() {
+  this->Cancel();
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+}
+
+//----------------------------------------------------------------------------
+void RefinementTask::Start(Work work) {
+  m_thread = std::thread([this, work]() {
+    try {
+      this->SetResult(work(*this));
+      this->Finish(this->IsCancelRequested() ? Status::Cancelled : Status::Finished, "");
+    } catch (const std::exception& e) {
+      this->Finish(Status::Failed, e.what());
+    } catch (...) {
+      this->Finish(Status::Failed, "Unknown error");
+    }
+  });
+}
+
+//----------------------------------------------------------------------------
+void RefinementTask::Cancel() {
+  m_cancelRequested = true;
+}
+
+//----------------------------------------------------------------------------
+void RefinementTask::Wait() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_done.wait(lock, [this]() { return m_status != Status::Running; });
+}
+
+//----------------------------------------------------------------------------
+bool RefinementTask::WaitFor(const double seconds) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_done.wait_for(lock, std::chrono::duration<double>(seconds), [this]() { return m_status != Status::Running; });
+}
+
+//----------------------------------------------------------------------------
+bool RefinementTask::IsDone() const {
+  return this->GetStatus() != Status::Running;
+}
+
+//----------------------------------------------------------------------------
+RefinementTask::Status RefinementTask::GetStatus() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_status;
+}
+
+//----------------------------------------------------------------------------
+double RefinementTask::GetProgress() const {
+  return m_progress;
+}
+
+//----------------------------------------------------------------------------
+std::string RefinementTask::GetErrorMessage() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_errorMessage;
+}
+
+//----------------------------------------------------------------------------
+RefinementStatus RefinementTask::GetRefinementStatus() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_refinementStatus;
+}
+
+//----------------------------------------------------------------------------
+bool RefinementTask::PublishResult() {
+  vtkSmartPointer<vtkEllipticalSRep> result;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_resultPublished || !m_result) {
+      return false;
+    }
+    result = m_result;
+    m_resultPublished = true;
+  }
+
+  vtkSmartPointer<vtkMRMLEllipticalSRepNode> destination = m_destination.GetPointer();
+  if (!destination) {
+    return false;
+  }
+  // the worker hands over a new srep every time, so this one is never modified again
+  destination->SetEllipticalSRep(result);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool RefinementTask::IsCancelRequested() const {
+  return m_cancelRequested;
+}
+
+//----------------------------------------------------------------------------
+void RefinementTask::SetProgress(const double progress) {
+  m_progress = progress;
+}
+
+//----------------------------------------------------------------------------
+void RefinementTask::SetResult(vtkSmartPointer<vtkEllipticalSRep> srep) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_result = srep;
+  m_resultPublished = false;
+}
+
+//----------------------------------------------------------------------------
+void RefinementTask::SetRefinementStatus(const RefinementStatus& refinementStatus) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_refinementStatus = refinementStatus;
+}
+
+//----------------------------------------------------------------------------
+void RefinementTask::Finish(const Status status, const std::string& errorMessage) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_status = status;
+    m_errorMessage = errorMessage;
+  }
+  m_done.notify_all();
+}
+
+}
@@ -0,0 +1,123 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkSlicerSRepRefinementLogic_SRepRefinementTask_h
+#define __vtkSlicerSRepRefinementLogic_SRepRefinementTask_h
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <vtkSmartPointer.h>
+#include <vtkWeakPointer.h>
+
+#include <vtkEllipticalSRep.h>
+#include <vtkMRMLEllipticalSRepNode.h>
+
+#include "SRepRefinementBudget.h"
+#include "vtkSlicerSRepRefinementModuleLogicExport.h"
+
+class vtkSlicerSRepRefinementLogic;
+
+namespace sreprefinement {
+
+/// Handle to a refinement running on a worker thread.
+///
+/// Created by vtkSlicerSRepRefinementLogic::RunAsync. While running, the refinement hands over its best
+/// srep so far every so often. MRML nodes are not thread safe, so the worker never touches the output
+/// node. Instead call PublishResult from the main thread (e.g. from a timer) to copy the most recent
+/// srep into it.
+///
+/// Destroying the task cancels the refinement and waits for the worker thread to stop.
+class VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT RefinementTask {
+public:
+  enum class Status {
+    Running,
+    Finished,
+    Cancelled,
+    Failed,
+  };
+
+  RefinementTask(const RefinementTask&) = delete;
+  RefinementTask& operator=(const RefinementTask&) = delete;
+  ~RefinementTask();
+
+  /// Asks the refinement to stop and returns right away. The refinement stops at its next objective
+  /// function evaluation and keeps the best srep found so far as its result.
+  void Cancel();
+
+  /// Blocks until the refinement is done.
+  void Wait();
+
+  /// Blocks until the refinement is done or the timeout passes.
+  /// \returns true if the refinement is done
+  bool WaitFor(double seconds);
+
+  bool IsDone() const;
+  Status GetStatus() const;
+
+  /// Gets the progress of the refinement in [0, 1].
+  double GetProgress() const;
+
+  /// Gets the error if the status is Failed.
+  std::string GetErrorMessage() const;
+
+  /// Gets how each stage of the refinement stopped. Only meaningful once the status is Finished or Cancelled.
+  RefinementStatus GetRefinementStatus() const;
+
+  /// Copies the most recent srep into the output node if it has not been already.
+  /// Must be called from the main thread.
+  /// \returns true if the output node was updated
+  bool PublishResult();
+
+private:
+  friend class ::vtkSlicerSRepRefinementLogic;
+  using Work = std::function<vtkSmartPointer<vtkEllipticalSRep>(RefinementTask&)>;
+
+  explicit RefinementTask(vtkMRMLEllipticalSRepNode* destination);
+
+  /// Runs work on the worker thread. Only call once.
+  void Start(Work work);
+
+  // for the worker thread
+  bool IsCancelRequested() const;
+  void SetProgress(double progress);
+  void SetResult(vtkSmartPointer<vtkEllipticalSRep> srep);
+  void SetRefinementStatus(const RefinementStatus& refinementStatus);
+  void Finish(Status status, const std::string& errorMessage);
+
+  vtkWeakPointer<vtkMRMLEllipticalSRepNode> m_destination;
+  std::atomic<bool> m_cancelRequested;
+  std::atomic<double> m_progress;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_done;
+  Status m_status;
+  std::string m_errorMessage;
+  RefinementStatus m_refinementStatus;
+  vtkSmartPointer<vtkEllipticalSRep> m_result;
+  bool m_resultPublished;
+
+  std::thread m_thread;
+};
+
+}
+
+#endif
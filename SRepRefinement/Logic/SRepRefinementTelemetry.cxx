@@ -0,0 +1,159 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "SRepRefinementTelemetry.h"
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace {
+//----------------------------------------------------------------------------
+// JSON has no representation for inf or nan
+void WriteJSONNumber(std::ostream& os, double value) {
+  if (std::isfinite(value)) {
+    os << value;
+  } else {
+    os << "null";
+  }
+}
+} // namespace {}
+
+namespace sreprefinement {
+
+//----------------------------------------------------------------------------
+RefinementTelemetry::RefinementTelemetry(const size_t capacity)
+  : m_mutex()
+  , m_start(std::chrono::steady_clock::now())
+  , m_capacity(capacity)
+  , m_evaluations()
+  , m_next(0)
+  , m_numRecorded(0)
+{
+  m_evaluations.reserve(capacity);
+}
+
+//----------------------------------------------------------------------------
+void RefinementTelemetry::Start() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_start = std::chrono::steady_clock::now();
+  m_evaluations.clear();
+  m_next = 0;
+  m_numRecorded = 0;
+}
+
+//----------------------------------------------------------------------------
+void RefinementTelemetry::Record(Evaluation evaluation) {
+  const auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  ++m_numRecorded;
+  if (m_capacity == 0) {
+    return;
+  }
+
+  evaluation.time = std::chrono::duration<double>(now - m_start).count();
+  if (m_evaluations.size() < m_capacity) {
+    m_evaluations.push_back(evaluation);
+  } else {
+    m_evaluations[m_next] = evaluation;
+    m_next = (m_next + 1) % m_capacity;
+  }
+}
+
+//----------------------------------------------------------------------------
+std::vector<RefinementTelemetry::Evaluation> RefinementTelemetry::GetEvaluations() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<Evaluation> evaluations;
+  evaluations.reserve(m_evaluations.size());
+  evaluations.insert(evaluations.end(), m_evaluations.begin() + m_next, m_evaluations.end());
+  evaluations.insert(evaluations.end(), m_evaluations.begin(), m_evaluations.begin() + m_next);
+  return evaluations;
+}
+
+//----------------------------------------------------------------------------
+size_t RefinementTelemetry::GetNumberOfRecordedEvaluations() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_numRecorded;
+}
+
+//----------------------------------------------------------------------------
+size_t RefinementTelemetry::GetCapacity() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_capacity;
+}
+
+//----------------------------------------------------------------------------
+void RefinementTelemetry::SetCapacity(const size_t capacity) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_capacity = capacity;
+  m_evaluations.clear();
+  m_evaluations.shrink_to_fit();
+  m_evaluations.reserve(capacity);
+  m_next = 0;
+  m_numRecorded = 0;
+}
+
+//----------------------------------------------------------------------------
+void RefinementTelemetry::WriteCSV(std::ostream& os) const {
+  const auto evaluations = this->GetEvaluations();
+  const auto oldPrecision = os.precision(std::numeric_limits<double>::max_digits10);
+  os << "iteration,time,level,spokes,L0,L1,L2,value\n";
+  for (const auto& e : evaluations) {
+    os << e.iteration << ',' << e.time << ',' << e.level << ',' << ToString(e.spokes) << ','
+      << e.distanceSquared << ',' << e.normalPenalty << ',' << e.srad << ',' << e.value << '\n';
+  }
+  os.precision(oldPrecision);
+}
+
+//----------------------------------------------------------------------------
+void RefinementTelemetry::WriteJSON(std::ostream& os) const {
+  const auto evaluations = this->GetEvaluations();
+  const auto numRecorded = this->GetNumberOfRecordedEvaluations();
+  const auto oldPrecision = os.precision(std::numeric_limits<double>::max_digits10);
+  os << "{\n  \"recorded\": " << numRecorded << ",\n  \"evaluations\": [";
+  for (size_t i = 0; i < evaluations.size(); ++i) {
+    const auto& e = evaluations[i];
+    os << (i == 0 ? "\n" : ",\n")
+      << "    {\"iteration\": " << e.iteration
+      << ", \"time\": " << e.time
+      << ", \"level\": " << e.level
+      << ", \"spokes\": \"" << ToString(e.spokes) << "\""
+      << ", \"L0\": ";
+    WriteJSONNumber(os, e.distanceSquared);
+    os << ", \"L1\": ";
+    WriteJSONNumber(os, e.normalPenalty);
+    os << ", \"L2\": ";
+    WriteJSONNumber(os, e.srad);
+    os << ", \"value\": ";
+    WriteJSONNumber(os, e.value);
+    os << "}";
+  }
+  os << (evaluations.empty() ? "]\n}\n" : "\n  ]\n}\n");
+  os.precision(oldPrecision);
+}
+
+//----------------------------------------------------------------------------
+const char* RefinementTelemetry::ToString(const Spokes spokes) {
+  switch (spokes) {
+    case Spokes::Up: return "up";
+    case Spokes::Down: return "down";
+  }
+  throw std::invalid_argument("Unknown spokes " + std::to_string(static_cast<int>(spokes)));
+}
+
+}
@@ -0,0 +1,91 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkSlicerSRepRefinementLogic_SRepRefinementTelemetry_h
+#define __vtkSlicerSRepRefinementLogic_SRepRefinementTelemetry_h
+
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "vtkSlicerSRepRefinementModuleLogicExport.h"
+
+namespace sreprefinement {
+
+/// Records the terms of every objective function evaluation of a refinement.
+///
+/// Evaluations are kept in a fixed capacity ring buffer, so a long refinement keeps its most recent
+/// evaluations without growing. Recording is thread safe so the up and down spokes can be optimized
+/// concurrently.
+class VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT RefinementTelemetry {
+public:
+  enum class Spokes {
+    Up,
+    Down,
+  };
+
+  struct Evaluation {
+    int iteration;          ///< progress iteration of the refinement
+    double time;            ///< seconds since Start, set by Record
+    size_t level;           ///< pyramid level, 0 is the coarsest
+    Spokes spokes;          ///< which spokes were being optimized
+    double distanceSquared; ///< weighted L0 term
+    double normalPenalty;   ///< weighted L1 term
+    double srad;            ///< weighted L2 term
+    double value;           ///< objective function value
+  };
+
+  /// \param capacity Number of evaluations to keep. 0 records nothing.
+  explicit RefinementTelemetry(size_t capacity = 10000);
+
+  /// Removes all recorded evaluations and restarts the clock.
+  void Start();
+
+  /// Records an evaluation, overwriting the oldest one if full.
+  void Record(Evaluation evaluation);
+
+  /// Gets the kept evaluations, oldest first.
+  std::vector<Evaluation> GetEvaluations() const;
+
+  /// Gets the number of evaluations recorded since Start, including ones that were overwritten.
+  size_t GetNumberOfRecordedEvaluations() const;
+
+  size_t GetCapacity() const;
+  /// Sets the capacity. Removes all recorded evaluations.
+  void SetCapacity(size_t capacity);
+
+  /// Writes the kept evaluations as CSV with a header row.
+  void WriteCSV(std::ostream& os) const;
+  /// Writes the kept evaluations as a JSON object. Non-finite values are written as null.
+  void WriteJSON(std::ostream& os) const;
+
+  static const char* ToString(Spokes spokes);
+
+private:
+  mutable std::mutex m_mutex;
+  std::chrono::steady_clock::time_point m_start;
+  size_t m_capacity;
+  std::vector<Evaluation> m_evaluations;
+  size_t m_next; // where the next evaluation goes once m_evaluations is full
+  size_t m_numRecorded;
+};
+
+}
+
+#endif
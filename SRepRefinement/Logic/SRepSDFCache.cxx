@@ -0,0 +1,438 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "SRepSDFCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char Magic[8] = {'S', 'R', 'E', 'P', 'S', 'D', 'F', '\0'};
+constexpr char Extension[] = ".srepsdf";
+constexpr uint32_t Version = 1;
+// written in native byte order, so a file from a machine with the other endianness doesn't match
+constexpr uint32_t ByteOrderMark = 0x01020304;
+
+/// Layout of the start of a cache file. The floats start right after it.
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrderMark;
+  uint64_t key;
+  uint64_t dimensions[3];
+  uint64_t hasGradients;
+  // pads the header to 64 bytes so the floats are well aligned in the mapping
+  uint64_t reserved;
+};
+static_assert(sizeof(Header) == 64, "cache file header must be 64 bytes");
+
+//----------------------------------------------------------------------------
+// splitmix64 finalizer
+uint64_t Mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebull;
+  x ^= x >> 31;
+  return x;
+}
+
+//----------------------------------------------------------------------------
+size_t GetNumberOfVoxels(const uint64_t dimensions[3]) {
+  return static_cast<size_t>(dimensions[0] * dimensions[1] * dimensions[2]);
+}
+
+/// A file in the cache directory
+struct CacheFile {
+  std::string fileName;
+  uint64_t size;
+  /// Last modification time in the file system's units, only good for ordering
+  int64_t modified;
+};
+
+//----------------------------------------------------------------------------
+// Lists the cache files in directory. Files that can't be inspected are left out.
+std::vector<CacheFile> ListCacheFiles(const std::string& directory) {
+  std::vector<CacheFile> files;
+#ifdef _WIN32
+  WIN32_FIND_DATAA data;
+  HANDLE find = FindFirstFileA((directory + "/*" + Extension).c_str(), &data);
+  if (find == INVALID_HANDLE_VALUE) {
+    return files;
+  }
+  do {
+    if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+      const uint64_t size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+      const uint64_t modified = (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32)
+        | data.ftLastWriteTime.dwLowDateTime;
+      files.push_back(CacheFile{directory + "/" + data.cFileName, size, static_cast<int64_t>(modified)});
+    }
+  } while (FindNextFileA(find, &data));
+  FindClose(find);
+#else
+  DIR* dir = opendir(directory.c_str());
+  if (!dir) {
+    return files;
+  }
+  const size_t extensionLength = sizeof(Extension) - 1;
+  while (const dirent* entry = readdir(dir)) {
+    const std::string name = entry->d_name;
+    if (name.size() <= extensionLength || name.compare(name.size() - extensionLength, extensionLength, Extension) != 0) {
+      continue;
+    }
+    const std::string fileName = directory + "/" + name;
+    struct stat status;
+    if (stat(fileName.c_str(), &status) != 0 || !S_ISREG(status.st_mode)) {
+      continue;
+    }
+#ifdef __APPLE__
+    const auto& time = status.st_mtimespec;
+#else
+    const auto& time = status.st_mtim;
+#endif
+    files.push_back(CacheFile{fileName, static_cast<uint64_t>(status.st_size),
+      static_cast<int64_t>(time.tv_sec) * 1000000000 + static_cast<int64_t>(time.tv_nsec)});
+  }
+  closedir(dir);
+#endif
+  return files;
+}
+
+//----------------------------------------------------------------------------
+// Sets the modification time of a file to now, which marks a cache file as recently used
+void Touch(const std::string& fileName) {
+#ifdef _WIN32
+  HANDLE file = CreateFileA(fileName.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+    nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return;
+  }
+  FILETIME now;
+  GetSystemTimeAsFileTime(&now);
+  SetFileTime(file, nullptr, nullptr, &now);
+  CloseHandle(file);
+#else
+  utimensat(AT_FDCWD, fileName.c_str(), nullptr, 0);
+#endif
+}
+
+/// Read only memory mapping of a whole file
+class MappedFile {
+public:
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  //----------------------------------------------------------------------------
+  MappedFile()
+    : m_data(nullptr)
+    , m_size(0)
+  {}
+
+  //----------------------------------------------------------------------------
+  ~MappedFile() {
+    if (!m_data) {
+      return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+#else
+    munmap(const_cast<char*>(m_data), m_size);
+#endif
+  }
+
+  //----------------------------------------------------------------------------
+  // returns false if the file can't be mapped
+  bool Open(const std::string& fileName) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+      nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+      return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+      CloseHandle(file);
+      return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping) {
+      return false;
+    }
+    // the view keeps the mapping alive
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!data) {
+      return false;
+    }
+    m_data = static_cast<const char*>(data);
+    m_size = static_cast<size_t>(size.QuadPart);
+#else
+    const int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size == 0) {
+      close(fd);
+      return false;
+    }
+    const auto size = static_cast<size_t>(status.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after the file is closed
+    close(fd);
+    if (data == MAP_FAILED) {
+      return false;
+    }
+    m_data = static_cast<const char*>(data);
+    m_size = size;
+#endif
+    return true;
+  }
+
+  const char* GetData() const {
+    return m_data;
+  }
+
+  size_t GetSize() const {
+    return m_size;
+  }
+
+private:
+  const char* m_data;
+  size_t m_size;
+};
+
+/// Entry backed by a mapped cache file
+class MappedEntry : public sreprefinement::SDFCache::Entry {
+public:
+  //----------------------------------------------------------------------------
+  MappedEntry(std::unique_ptr<MappedFile> file, const Header& header)
+    : m_file(std::move(file))
+    , m_dimensions{{
+        static_cast<size_t>(header.dimensions[0]),
+        static_cast<size_t>(header.dimensions[1]),
+        static_cast<size_t>(header.dimensions[2])}}
+    , m_distances(reinterpret_cast<const float*>(m_file->GetData() + sizeof(Header)))
+    , m_gradients(header.hasGradients ? m_distances + GetNumberOfVoxels(header.dimensions) : nullptr)
+  {}
+
+  const sreprefinement::SDFCache::Dimensions& GetDimensions() const override {
+    return m_dimensions;
+  }
+
+  const float* GetDistances() const override {
+    return m_distances;
+  }
+
+  const float* GetGradients() const override {
+    return m_gradients;
+  }
+
+private:
+  std::unique_ptr<MappedFile> m_file;
+  sreprefinement::SDFCache::Dimensions m_dimensions;
+  const float* m_distances;
+  const float* m_gradients;
+};
+
+} // namespace {}
+
+namespace sreprefinement {
+
+//----------------------------------------------------------------------------
+Hasher::Hasher()
+  : m_hash(0xcbf29ce484222325ull)
+{}
+
+//----------------------------------------------------------------------------
+void Hasher::Add(const uint64_t value) {
+  m_hash = (m_hash ^ Mix(value)) * 0x100000001b3ull;
+}
+
+//----------------------------------------------------------------------------
+void Hasher::Add(const double value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  this->Add(bits);
+}
+
+//----------------------------------------------------------------------------
+void Hasher::Add(const double* values, const size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    this->Add(values[i]);
+  }
+}
+
+//----------------------------------------------------------------------------
+uint64_t Hasher::GetHash() const {
+  return Mix(m_hash);
+}
+
+//----------------------------------------------------------------------------
+SDFCache::SDFCache(std::string directory, const uint64_t maxBytes)
+  : m_directory(std::move(directory))
+  , m_maxBytes(maxBytes)
+{}
+
+//----------------------------------------------------------------------------
+std::string SDFCache::GetFileName(const Key key) const {
+  std::ostringstream fileName;
+  fileName << m_directory << "/" << std::hex << std::setw(16) << std::setfill('0') << key << Extension;
+  return fileName.str();
+}
+
+//----------------------------------------------------------------------------
+std::unique_ptr<SDFCache::Entry> SDFCache::Find(const Key key, const bool needGradients) const {
+  const auto fileName = this->GetFileName(key);
+  std::unique_ptr<MappedFile> file(new MappedFile);
+  if (!file->Open(fileName) || file->GetSize() < sizeof(Header)) {
+    return nullptr;
+  }
+
+  Header header;
+  std::memcpy(&header, file->GetData(), sizeof(header));
+  if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0
+    || header.version != Version
+    || header.byteOrderMark != ByteOrderMark
+    || header.key != key
+    || (needGradients && !header.hasGradients))
+  {
+    return nullptr;
+  }
+  for (const auto dimension : header.dimensions) {
+    if (dimension < 2) {
+      return nullptr;
+    }
+  }
+  const size_t numFloats = GetNumberOfVoxels(header.dimensions) * (header.hasGradients ? 4 : 1);
+  if (file->GetSize() != sizeof(Header) + numFloats * sizeof(float)) {
+    return nullptr;
+  }
+  if (m_maxBytes > 0) {
+    Touch(fileName);
+  }
+  return std::unique_ptr<Entry>(new MappedEntry(std::move(file), header));
+}
+
+//----------------------------------------------------------------------------
+bool SDFCache::Store(const Key key, const Dimensions& dimensions, const float* distances, const float* gradients) const {
+  if (!distances) {
+    return false;
+  }
+
+  Header header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, Magic, sizeof(Magic));
+  header.version = Version;
+  header.byteOrderMark = ByteOrderMark;
+  header.key = key;
+  for (size_t i = 0; i < 3; ++i) {
+    header.dimensions[i] = dimensions[i];
+  }
+  header.hasGradients = gradients ? 1 : 0;
+  const size_t numVoxels = GetNumberOfVoxels(header.dimensions);
+
+  // unique per thread and call, so concurrent stores of the same key don't write the same file
+  const auto fileName = this->GetFileName(key);
+  std::ostringstream tempFileName;
+  tempFileName << fileName << "." << std::hash<std::thread::id>()(std::this_thread::get_id())
+    << "." << std::chrono::steady_clock::now().time_since_epoch().count() << ".tmp";
+
+  {
+    std::ofstream file(tempFileName.str(), std::ios::binary);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(distances), numVoxels * sizeof(float));
+    if (gradients) {
+      file.write(reinterpret_cast<const char*>(gradients), 3 * numVoxels * sizeof(float));
+    }
+    if (!file) {
+      file.close();
+      std::remove(tempFileName.str().c_str());
+      return false;
+    }
+  }
+
+  if (std::rename(tempFileName.str().c_str(), fileName.c_str()) != 0) {
+    // rename doesn't replace an existing file on Windows
+    std::remove(fileName.c_str());
+    if (std::rename(tempFileName.str().c_str(), fileName.c_str()) != 0) {
+      std::remove(tempFileName.str().c_str());
+      return false;
+    }
+  }
+  if (m_maxBytes > 0) {
+    this->Evict(fileName);
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+uint64_t SDFCache::GetSize() const {
+  uint64_t size = 0;
+  for (const auto& file : ListCacheFiles(m_directory)) {
+    size += file.size;
+  }
+  return size;
+}
+
+//----------------------------------------------------------------------------
+void SDFCache::Evict(const std::string& keepFileName) const {
+  auto files = ListCacheFiles(m_directory);
+  uint64_t size = 0;
+  for (const auto& file : files) {
+    size += file.size;
+  }
+  std::sort(files.begin(), files.end(), [](const CacheFile& a, const CacheFile& b) {
+    return a.modified < b.modified;
+  });
+  // A file another refinement still has mapped may fail to be removed on Windows. It is skipped, and
+  // removed by a later store once it is no longer used.
+  for (const auto& file : files) {
+    if (size <= m_maxBytes) {
+      break;
+    }
+    if (file.fileName != keepFileName && std::remove(file.fileName.c_str()) == 0) {
+      size -= file.size;
+    }
+  }
+}
+
+}
@@ -0,0 +1,100 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkSlicerSRepRefinementLogic_SRepSDFCache_h
+#define __vtkSlicerSRepRefinementLogic_SRepSDFCache_h
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "SRepDistanceSampler.h"
+
+namespace sreprefinement {
+
+/// Incrementally computes a 64 bit hash of a sequence of values. Not cryptographic.
+class VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT Hasher {
+public:
+  Hasher();
+
+  void Add(uint64_t value);
+  void Add(double value);
+  void Add(const double* values, size_t count);
+
+  uint64_t GetHash() const;
+
+private:
+  uint64_t m_hash;
+};
+
+/// Stores signed distance fields (SDF) and their gradients on disk so they don't have to be recomputed.
+///
+/// Each field is a file in the cache directory named after its key. The floats are stored as they are
+/// in memory after a small header, so a cached field is memory mapped instead of read. Files are
+/// written to a temporary name and renamed into place, so concurrent refinements of the same model
+/// never see a partial file. A file that is corrupt, truncated, or from another version is a cache miss.
+///
+/// The cache can be limited to a number of bytes. Finding a field marks its file as used, and storing
+/// a field removes the least recently used files until the cache fits.
+class VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT SDFCache {
+public:
+  using Dimensions = DistanceSampler::Dimensions;
+  using Key = uint64_t;
+
+  /// A cached field. The data is mapped from the cache file and valid as long as this is.
+  class VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT Entry {
+  public:
+    virtual ~Entry() = default;
+    virtual const Dimensions& GetDimensions() const = 0;
+    /// One distance per voxel, x varying fastest then y then z.
+    virtual const float* GetDistances() const = 0;
+    /// Three gradient components per voxel in the same order as the distances. nullptr if not stored.
+    virtual const float* GetGradients() const = 0;
+  };
+
+  /// \param directory Must exist.
+  /// \param maxBytes Total size of the cache files the directory may hold. 0 for no limit.
+  explicit SDFCache(std::string directory, uint64_t maxBytes = 0);
+
+  /// Gets the cached field for key.
+  /// \param needGradients If true, a field stored without gradients is a miss.
+  /// \returns nullptr on a cache miss
+  std::unique_ptr<Entry> Find(Key key, bool needGradients) const;
+
+  /// Stores a field, replacing any field with the same key, and then removes the least recently used
+  /// fields until the cache is within its limit. The field just stored is never removed.
+  /// \param gradients May be nullptr to store only the distances.
+  /// \returns false if the field could not be written
+  bool Store(Key key, const Dimensions& dimensions, const float* distances, const float* gradients) const;
+
+  /// Gets the file a key is stored in.
+  std::string GetFileName(Key key) const;
+
+  /// Gets the total size of the cache files in the directory.
+  uint64_t GetSize() const;
+
+private:
+  /// Removes the least recently used files but keepFileName until the cache is within its limit.
+  void Evict(const std::string& keepFileName) const;
+
+  std::string m_directory;
+  uint64_t m_maxBytes;
+};
+
+}
+
+#endif
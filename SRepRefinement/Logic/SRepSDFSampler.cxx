@@ -0,0 +1,211 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "SRepSDFSampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+//----------------------------------------------------------------------------
+double Clamp(double val, double min, double max) {
+  return val < min ? min : (val > max ? max : val);
+}
+} // namespace {}
+
+namespace sreprefinement {
+
+//----------------------------------------------------------------------------
+SDFSampler::SDFSampler(
+  const Dimensions& dimensions,
+  const AffineTransform& worldToIndex,
+  const float* distances,
+  const float* gradients)
+  : m_dimensions(dimensions)
+  , m_worldToIndex(worldToIndex)
+  , m_strideY(dimensions[0])
+  , m_strideZ(dimensions[0] * dimensions[1])
+  , m_voxels()
+{
+  if (dimensions[0] < 2 || dimensions[1] < 2 || dimensions[2] < 2) {
+    throw std::invalid_argument("SDFSampler requires at least 2 voxels along each axis");
+  }
+  if (!distances || !gradients) {
+    throw std::invalid_argument("SDFSampler requires non-null distances and gradients");
+  }
+
+  const size_t numVoxels = m_strideZ * dimensions[2];
+  m_voxels.resize(numVoxels);
+  for (size_t i = 0; i < numVoxels; ++i) {
+    auto& voxel = m_voxels[i];
+    const float* g = gradients + 3 * i;
+    voxel.distance = distances[i];
+
+    // normalize once here instead of on every lookup
+    const double length = std::sqrt(static_cast<double>(g[0]) * g[0]
+      + static_cast<double>(g[1]) * g[1]
+      + static_cast<double>(g[2]) * g[2]);
+    const double scale = length > 0.0 ? 1.0 / length : 0.0;
+    voxel.normal[0] = static_cast<float>(g[0] * scale);
+    voxel.normal[1] = static_cast<float>(g[1] * scale);
+    voxel.normal[2] = static_cast<float>(g[2] * scale);
+  }
+}
+
+//----------------------------------------------------------------------------
+SDFSampler::Cell SDFSampler::FindCell(const double* p) const {
+  const auto& t = m_worldToIndex;
+  Cell cell;
+  size_t lower[3];
+  for (size_t axis = 0; axis < 3; ++axis) {
+    // continuous index, clamped to the field
+    const double maxIndex = static_cast<double>(m_dimensions[axis] - 1);
+    const double unclamped = t[4 * axis] * p[0] + t[4 * axis + 1] * p[1] + t[4 * axis + 2] * p[2] + t[4 * axis + 3];
+    const double index = Clamp(unclamped, 0.0, maxIndex);
+    cell.clamped[axis] = index != unclamped;
+
+    // the lower corner of the cell containing the point. The upper bound keeps the upper corner in the field
+    lower[axis] = std::min(static_cast<size_t>(index), m_dimensions[axis] - 2);
+    cell.fraction[axis] = index - lower[axis];
+  }
+
+  const Voxel* v000 = &m_voxels[lower[0] + lower[1] * m_strideY + lower[2] * m_strideZ];
+  for (size_t c = 0; c < 8; ++c) {
+    cell.corners[c] = v000 + (c & 1) + ((c >> 1) & 1) * m_strideY + (c >> 2) * m_strideZ;
+  }
+  return cell;
+}
+
+//----------------------------------------------------------------------------
+void SDFSampler::Sample(const size_t count, const double* points, double* distances, double* normals) const {
+  for (size_t i = 0; i < count; ++i) {
+    const auto cell = this->FindCell(points + 3 * i);
+    const double fx = cell.fraction[0];
+    const double fy = cell.fraction[1];
+    const double fz = cell.fraction[2];
+    const double weights[8] = {
+      (1 - fx) * (1 - fy) * (1 - fz), fx * (1 - fy) * (1 - fz),
+      (1 - fx) * fy * (1 - fz),       fx * fy * (1 - fz),
+      (1 - fx) * (1 - fy) * fz,       fx * (1 - fy) * fz,
+      (1 - fx) * fy * fz,             fx * fy * fz,
+    };
+
+    double distance = 0.0;
+    double normal[3] = {0.0, 0.0, 0.0};
+    for (int c = 0; c < 8; ++c) {
+      const Voxel& voxel = *cell.corners[c];
+      distance += weights[c] * voxel.distance;
+      normal[0] += weights[c] * voxel.normal[0];
+      normal[1] += weights[c] * voxel.normal[1];
+      normal[2] += weights[c] * voxel.normal[2];
+    }
+    distances[i] = distance;
+
+    if (normals) {
+      // a blend of unit normals is slightly shorter than unit length
+      const double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+      const double scale = length > 0.0 ? 1.0 / length : 0.0;
+      normals[3 * i + 0] = normal[0] * scale;
+      normals[3 * i + 1] = normal[1] * scale;
+      normals[3 * i + 2] = normal[2] * scale;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void SDFSampler::SampleDerivatives(
+  const size_t count,
+  const double* points,
+  double* distanceGradients,
+  double* normalJacobians) const
+{
+  const auto& t = m_worldToIndex;
+  for (size_t i = 0; i < count; ++i) {
+    const auto cell = this->FindCell(points + 3 * i);
+
+    // the blended normal, and the derivatives of it and of the distance along each index axis
+    double blend[3] = {0.0, 0.0, 0.0};
+    double distanceByIndex[3] = {0.0, 0.0, 0.0};
+    double blendByIndex[3][3] = {}; // [component][axis]
+    for (size_t c = 0; c < 8; ++c) {
+      double factors[3];
+      double slopes[3];
+      for (size_t axis = 0; axis < 3; ++axis) {
+        const bool upper = (c >> axis) & 1;
+        factors[axis] = upper ? cell.fraction[axis] : 1 - cell.fraction[axis];
+        // outside of the field the clamped index doesn't move with the point
+        slopes[axis] = cell.clamped[axis] ? 0.0 : (upper ? 1.0 : -1.0);
+      }
+      const double weight = factors[0] * factors[1] * factors[2];
+      const double weightByIndex[3] = {
+        slopes[0] * factors[1] * factors[2],
+        factors[0] * slopes[1] * factors[2],
+        factors[0] * factors[1] * slopes[2],
+      };
+
+      const Voxel& voxel = *cell.corners[c];
+      for (size_t axis = 0; axis < 3; ++axis) {
+        distanceByIndex[axis] += weightByIndex[axis] * voxel.distance;
+        blend[axis] += weight * voxel.normal[axis];
+        for (size_t component = 0; component < 3; ++component) {
+          blendByIndex[component][axis] += weightByIndex[axis] * voxel.normal[component];
+        }
+      }
+    }
+
+    // the normal is blend / |blend|, whose derivative is (I - n n^T) / |blend| times that of the blend
+    const double length = std::sqrt(blend[0] * blend[0] + blend[1] * blend[1] + blend[2] * blend[2]);
+    const double scale = length > 0.0 ? 1.0 / length : 0.0;
+    const double normal[3] = {blend[0] * scale, blend[1] * scale, blend[2] * scale};
+    double normalByIndex[3][3];
+    for (size_t axis = 0; axis < 3; ++axis) {
+      const double along = normal[0] * blendByIndex[0][axis] + normal[1] * blendByIndex[1][axis] + normal[2] * blendByIndex[2][axis];
+      for (size_t component = 0; component < 3; ++component) {
+        normalByIndex[component][axis] = (blendByIndex[component][axis] - normal[component] * along) * scale;
+      }
+    }
+
+    // chain rule through the world to index transform
+    for (size_t j = 0; j < 3; ++j) {
+      double gradient = 0.0;
+      for (size_t axis = 0; axis < 3; ++axis) {
+        gradient += distanceByIndex[axis] * t[4 * axis + j];
+      }
+      distanceGradients[3 * i + j] = gradient;
+      for (size_t component = 0; component < 3; ++component) {
+        double derivative = 0.0;
+        for (size_t axis = 0; axis < 3; ++axis) {
+          derivative += normalByIndex[component][axis] * t[4 * axis + j];
+        }
+        normalJacobians[9 * i + 3 * component + j] = derivative;
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+const SDFSampler::Dimensions& SDFSampler::GetDimensions() const {
+  return m_dimensions;
+}
+
+//----------------------------------------------------------------------------
+size_t SDFSampler::GetMemorySize() const {
+  return m_voxels.size() * sizeof(Voxel);
+}
+
+}
@@ -0,0 +1,80 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkSlicerSRepRefinementLogic_SRepSDFSampler_h
+#define __vtkSlicerSRepRefinementLogic_SRepSDFSampler_h
+
+#include <vector>
+
+#include "SRepDistanceSampler.h"
+
+namespace sreprefinement {
+
+/// Samples a dense signed distance field (SDF) and its surface normals using trilinear interpolation.
+///
+/// The distance and the normalized gradient of each voxel are stored interleaved in a single
+/// flat buffer so the eight corners of a lookup touch as few cache lines as possible. The
+/// transform from world coordinates to voxel indices is precomputed at construction.
+///
+/// SampleDerivatives differentiates the trilinear interpolation exactly, so its derivatives are those
+/// of the values Sample returns.
+/// \sa SparseSDFSampler
+class VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT SDFSampler : public DistanceSampler {
+public:
+  /// \param dimensions Number of voxels along x, y, and z. Each must be at least 2.
+  /// \param worldToIndex Transform from world coordinates to continuous voxel indices.
+  /// \param distances One distance per voxel, x varying fastest then y then z.
+  /// \param gradients Three components per voxel in the same order as distances. These do not need to be normalized.
+  /// \throws std::invalid_argument if the dimensions are too small or any buffer is nullptr
+  SDFSampler(
+    const Dimensions& dimensions,
+    const AffineTransform& worldToIndex,
+    const float* distances,
+    const float* gradients);
+
+  using DistanceSampler::Sample;
+  void Sample(size_t count, const double* points, double* distances, double* normals) const override;
+  void SampleDerivatives(size_t count, const double* points, double* distanceGradients, double* normalJacobians) const override;
+
+  const Dimensions& GetDimensions() const;
+
+  size_t GetMemorySize() const override;
+
+private:
+  struct alignas(16) Voxel {
+    float distance;
+    float normal[3];
+  };
+
+  /// The voxels at the corners of the cell containing a point, and its position in the cell.
+  struct Cell {
+    const Voxel* corners[8]; ///< x varying fastest then y then z
+    double fraction[3];
+    bool clamped[3];         ///< if the point was outside of the field along each axis
+  };
+  Cell FindCell(const double* point) const;
+
+  Dimensions m_dimensions;
+  AffineTransform m_worldToIndex;
+  size_t m_strideY;
+  size_t m_strideZ;
+  std::vector<Voxel> m_voxels;
+};
+
+}
+
+#endif
@@ -0,0 +1,251 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "SRepSparseSDFSampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+//----------------------------------------------------------------------------
+double Clamp(double val, double min, double max) {
+  return val < min ? min : (val > max ? max : val);
+}
+
+//----------------------------------------------------------------------------
+double Trilinear(const float* v000, size_t strideY, size_t strideZ, double fx, double fy, double fz) {
+  const float* v010 = v000 + strideY;
+  const float* v001 = v000 + strideZ;
+  const float* v011 = v001 + strideY;
+  const double c00 = v000[0] + fx * (v000[1] - v000[0]);
+  const double c10 = v010[0] + fx * (v010[1] - v010[0]);
+  const double c01 = v001[0] + fx * (v001[1] - v001[0]);
+  const double c11 = v011[0] + fx * (v011[1] - v011[0]);
+  const double c0 = c00 + fy * (c10 - c00);
+  const double c1 = c01 + fy * (c11 - c01);
+  return c0 + fz * (c1 - c0);
+}
+} // namespace {}
+
+namespace sreprefinement {
+
+constexpr size_t SparseSDFSampler::BrickSize;
+constexpr size_t SparseSDFSampler::BrickSamples;
+
+//----------------------------------------------------------------------------
+SparseSDFSampler::SparseSDFSampler(
+  const Dimensions& dimensions,
+  const AffineTransform& worldToIndex,
+  const float* distances,
+  const size_t narrowBandWidth)
+  : m_dimensions(dimensions)
+  , m_worldToIndex(worldToIndex)
+  , m_numBricks()
+  , m_brickOffsets()
+  , m_brickSamples()
+  , m_coarseSamples()
+{
+  if (dimensions[0] < 2 || dimensions[1] < 2 || dimensions[2] < 2) {
+    throw std::invalid_argument("SparseSDFSampler requires at least 2 voxels along each axis");
+  }
+  if (!distances) {
+    throw std::invalid_argument("SparseSDFSampler requires non-null distances");
+  }
+
+  for (size_t a = 0; a < 3; ++a) {
+    m_numBricks[a] = (dimensions[a] - 1 + BrickSize - 1) / BrickSize;
+  }
+  const size_t numBricks = m_numBricks[0] * m_numBricks[1] * m_numBricks[2];
+
+  // samples past the end of the field (only in the last brick along an axis) repeat the edge, so
+  // the coarse sample at the far corner of the last brick is at the edge of the field
+  const auto at = [&](size_t x, size_t y, size_t z) {
+    x = std::min(x, dimensions[0] - 1);
+    y = std::min(y, dimensions[1] - 1);
+    z = std::min(z, dimensions[2] - 1);
+    return distances[x + dimensions[0] * (y + dimensions[1] * z)];
+  };
+
+  // 1. coarse grid of the brick corners
+  m_coarseSamples.reserve((m_numBricks[0] + 1) * (m_numBricks[1] + 1) * (m_numBricks[2] + 1));
+  for (size_t z = 0; z <= m_numBricks[2]; ++z) {
+    for (size_t y = 0; y <= m_numBricks[1]; ++y) {
+      for (size_t x = 0; x <= m_numBricks[0]; ++x) {
+        m_coarseSamples.push_back(at(x * BrickSize, y * BrickSize, z * BrickSize));
+      }
+    }
+  }
+
+  // 2. find the bricks the surface passes through
+  std::vector<char> onSurface(numBricks, 0);
+  size_t b = 0;
+  for (size_t bz = 0; bz < m_numBricks[2]; ++bz) {
+    for (size_t by = 0; by < m_numBricks[1]; ++by) {
+      for (size_t bx = 0; bx < m_numBricks[0]; ++bx, ++b) {
+        bool inside = false;
+        bool outside = false;
+        for (size_t z = bz * BrickSize; z <= (bz + 1) * BrickSize && !(inside && outside); ++z) {
+          for (size_t y = by * BrickSize; y <= (by + 1) * BrickSize; ++y) {
+            for (size_t x = bx * BrickSize; x <= (bx + 1) * BrickSize; ++x) {
+              const float d = at(x, y, z);
+              inside = inside || d <= 0;
+              outside = outside || d >= 0;
+            }
+          }
+        }
+        onSurface[b] = inside && outside;
+      }
+    }
+  }
+
+  // 3. grow the surface bricks to cover the narrow band, plus one voxel for the normal's central differences
+  const auto radius = static_cast<long>((narrowBandWidth + 1 + BrickSize - 1) / BrickSize);
+  const long numBricksLong[3] = {
+    static_cast<long>(m_numBricks[0]),
+    static_cast<long>(m_numBricks[1]),
+    static_cast<long>(m_numBricks[2]),
+  };
+  std::vector<char> inBand(numBricks, 0);
+  b = 0;
+  for (long bz = 0; bz < numBricksLong[2]; ++bz) {
+    for (long by = 0; by < numBricksLong[1]; ++by) {
+      for (long bx = 0; bx < numBricksLong[0]; ++bx, ++b) {
+        if (!onSurface[b]) {
+          continue;
+        }
+        for (long z = std::max(0L, bz - radius); z <= std::min(numBricksLong[2] - 1, bz + radius); ++z) {
+          for (long y = std::max(0L, by - radius); y <= std::min(numBricksLong[1] - 1, by + radius); ++y) {
+            for (long x = std::max(0L, bx - radius); x <= std::min(numBricksLong[0] - 1, bx + radius); ++x) {
+              inBand[x + numBricksLong[0] * (y + numBricksLong[1] * z)] = 1;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // 4. copy the samples of the bricks in the band
+  const size_t samplesPerBrick = BrickSamples * BrickSamples * BrickSamples;
+  m_brickOffsets.assign(numBricks, -1);
+  m_brickSamples.reserve(samplesPerBrick * std::count(inBand.begin(), inBand.end(), 1));
+  b = 0;
+  for (size_t bz = 0; bz < m_numBricks[2]; ++bz) {
+    for (size_t by = 0; by < m_numBricks[1]; ++by) {
+      for (size_t bx = 0; bx < m_numBricks[0]; ++bx, ++b) {
+        if (!inBand[b]) {
+          continue;
+        }
+        m_brickOffsets[b] = static_cast<int64_t>(m_brickSamples.size());
+        for (size_t z = bz * BrickSize; z <= (bz + 1) * BrickSize; ++z) {
+          for (size_t y = by * BrickSize; y <= (by + 1) * BrickSize; ++y) {
+            for (size_t x = bx * BrickSize; x <= (bx + 1) * BrickSize; ++x) {
+              m_brickSamples.push_back(at(x, y, z));
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+double SparseSDFSampler::Interpolate(double x, double y, double z) const {
+  x = Clamp(x, 0.0, static_cast<double>(m_dimensions[0] - 1));
+  y = Clamp(y, 0.0, static_cast<double>(m_dimensions[1] - 1));
+  z = Clamp(z, 0.0, static_cast<double>(m_dimensions[2] - 1));
+
+  // the lower corner of the cell containing the point. The upper bound keeps the upper corner in the field
+  const size_t cx = std::min(static_cast<size_t>(x), m_dimensions[0] - 2);
+  const size_t cy = std::min(static_cast<size_t>(y), m_dimensions[1] - 2);
+  const size_t cz = std::min(static_cast<size_t>(z), m_dimensions[2] - 2);
+
+  const size_t bx = cx / BrickSize;
+  const size_t by = cy / BrickSize;
+  const size_t bz = cz / BrickSize;
+  const int64_t offset = m_brickOffsets[bx + m_numBricks[0] * (by + m_numBricks[1] * bz)];
+
+  if (offset >= 0) {
+    const size_t lx = cx - bx * BrickSize;
+    const size_t ly = cy - by * BrickSize;
+    const size_t lz = cz - bz * BrickSize;
+    const float* v000 = &m_brickSamples[offset + lx + BrickSamples * (ly + BrickSamples * lz)];
+    return Trilinear(v000, BrickSamples, BrickSamples * BrickSamples, x - cx, y - cy, z - cz);
+  }
+
+  // far from the surface, use the brick corners. The last brick along an axis may be shorter than the others
+  const auto brickFraction = [this](double i, size_t brick, size_t axis) {
+    const size_t lower = brick * BrickSize;
+    const size_t upper = std::min(lower + BrickSize, m_dimensions[axis] - 1);
+    return (i - lower) / (upper - lower);
+  };
+  const size_t strideY = m_numBricks[0] + 1;
+  const size_t strideZ = strideY * (m_numBricks[1] + 1);
+  const float* v000 = &m_coarseSamples[bx + strideY * by + strideZ * bz];
+  return Trilinear(v000, strideY, strideZ, brickFraction(x, bx, 0), brickFraction(y, by, 1), brickFraction(z, bz, 2));
+}
+
+//----------------------------------------------------------------------------
+void SparseSDFSampler::Sample(const size_t count, const double* points, double* distances, double* normals) const {
+  const auto& t = m_worldToIndex;
+  for (size_t i = 0; i < count; ++i) {
+    const double* p = points + 3 * i;
+    const double x = t[0] * p[0] + t[1] * p[1] + t[2]  * p[2] + t[3];
+    const double y = t[4] * p[0] + t[5] * p[1] + t[6]  * p[2] + t[7];
+    const double z = t[8] * p[0] + t[9] * p[1] + t[10] * p[2] + t[11];
+
+    distances[i] = this->Interpolate(x, y, z);
+
+    if (normals) {
+      // central differences one voxel apart, which is the same as interpolating a central difference gradient image
+      const double indexGradient[3] = {
+        this->Interpolate(x + 1, y, z) - this->Interpolate(x - 1, y, z),
+        this->Interpolate(x, y + 1, z) - this->Interpolate(x, y - 1, z),
+        this->Interpolate(x, y, z + 1) - this->Interpolate(x, y, z - 1),
+      };
+      // chain rule back to world coordinates: the transpose of the linear part of worldToIndex
+      double normal[3];
+      for (int c = 0; c < 3; ++c) {
+        normal[c] = t[c] * indexGradient[0] + t[4 + c] * indexGradient[1] + t[8 + c] * indexGradient[2];
+      }
+      const double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+      const double scale = length > 0.0 ? 1.0 / length : 0.0;
+      normals[3 * i + 0] = normal[0] * scale;
+      normals[3 * i + 1] = normal[1] * scale;
+      normals[3 * i + 2] = normal[2] * scale;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+const SparseSDFSampler::Dimensions& SparseSDFSampler::GetDimensions() const {
+  return m_dimensions;
+}
+
+//----------------------------------------------------------------------------
+size_t SparseSDFSampler::GetNumberOfBricks() const {
+  return m_brickSamples.size() / (BrickSamples * BrickSamples * BrickSamples);
+}
+
+//----------------------------------------------------------------------------
+size_t SparseSDFSampler::GetMemorySize() const {
+  return m_brickSamples.size() * sizeof(float)
+    + m_coarseSamples.size() * sizeof(float)
+    + m_brickOffsets.size() * sizeof(int64_t);
+}
+
+}
@@ -0,0 +1,82 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkSlicerSRepRefinementLogic_SRepSparseSDFSampler_h
+#define __vtkSlicerSRepRefinementLogic_SRepSparseSDFSampler_h
+
+#include <cstdint>
+#include <vector>
+
+#include "SRepDistanceSampler.h"
+
+namespace sreprefinement {
+
+/// Samples a signed distance field (SDF) that is only stored at full resolution near the surface.
+///
+/// The field is split into bricks of BrickSize^3 voxels. Only bricks within the narrow band of the
+/// surface keep their samples. Each kept brick stores (BrickSize+1)^3 samples so a trilinear lookup
+/// never has to leave the brick. Everywhere else the distance is interpolated from a coarse grid
+/// made of the samples at the brick corners, which is accurate enough far from the surface where the
+/// distance is close to linear.
+///
+/// Normals are central differences of the interpolated field, so no gradient image is stored.
+/// \sa SDFSampler
+class VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT SparseSDFSampler : public DistanceSampler {
+public:
+  /// Number of voxels along each edge of a brick.
+  static constexpr size_t BrickSize = 8;
+
+  /// \param dimensions Number of voxels along x, y, and z. Each must be at least 2.
+  /// \param worldToIndex Transform from world coordinates to continuous voxel indices.
+  /// \param distances One distance per voxel, x varying fastest then y then z. Negative is inside.
+  ///        Only read during construction.
+  /// \param narrowBandWidth Number of voxels on either side of the surface that are kept at full resolution.
+  /// \throws std::invalid_argument if the dimensions are too small or distances is nullptr
+  SparseSDFSampler(
+    const Dimensions& dimensions,
+    const AffineTransform& worldToIndex,
+    const float* distances,
+    size_t narrowBandWidth);
+
+  using DistanceSampler::Sample;
+  void Sample(size_t count, const double* points, double* distances, double* normals) const override;
+
+  const Dimensions& GetDimensions() const;
+
+  /// Gets the number of bricks stored at full resolution.
+  size_t GetNumberOfBricks() const;
+
+  size_t GetMemorySize() const override;
+
+private:
+  static constexpr size_t BrickSamples = BrickSize + 1;
+
+  /// Interpolates the distance at a continuous voxel index. The index is clamped to the field.
+  double Interpolate(double x, double y, double z) const;
+
+  Dimensions m_dimensions;
+  AffineTransform m_worldToIndex;
+  Dimensions m_numBricks;
+  /// Offset of each brick into m_brickSamples, or -1 if the brick is not stored.
+  std::vector<int64_t> m_brickOffsets;
+  std::vector<float> m_brickSamples;
+  std::vector<float> m_coarseSamples;
+};
+
+}
+
+#endif
@@ -0,0 +1,120 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+#include "SRepSpokePatches.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+//----------------------------------------------------------------------------
+// Number of lines between the closest lines of two ranges of lines that wrap around. 0 if they overlap.
+size_t LineDistance(const sreprefinement::SpokePatch& a, const sreprefinement::SpokePatch& b, size_t numLines) {
+  const auto forward = [numLines](size_t from, size_t to) {
+    return (to + numLines - from % numLines) % numLines;
+  };
+  if (forward(a.firstLine, b.firstLine) < a.numLines || forward(b.firstLine, a.firstLine) < b.numLines) {
+    return 0;
+  }
+  return std::min(
+    forward(a.firstLine + a.numLines - 1, b.firstLine),
+    forward(b.firstLine + b.numLines - 1, a.firstLine));
+}
+
+//----------------------------------------------------------------------------
+// Number of steps between the closest steps of two ranges of steps. 0 if they overlap.
+size_t StepDistance(const sreprefinement::SpokePatch& a, const sreprefinement::SpokePatch& b) {
+  if (a.firstStep + a.numSteps <= b.firstStep) {
+    return b.firstStep - (a.firstStep + a.numSteps - 1);
+  }
+  if (b.firstStep + b.numSteps <= a.firstStep) {
+    return a.firstStep - (b.firstStep + b.numSteps - 1);
+  }
+  return 0;
+}
+
+} // namespace {}
+
+namespace sreprefinement {
+
+//----------------------------------------------------------------------------
+std::vector<std::vector<SpokePatch>> CreateSpokePatches(
+  const size_t numLines,
+  const size_t numSteps,
+  const size_t patchSize,
+  const size_t overlap)
+{
+  if (numLines == 0 || numSteps == 0) {
+    throw std::invalid_argument("Cannot split an empty spoke grid into patches");
+  }
+  if (patchSize == 0) {
+    throw std::invalid_argument("Spoke patch size must be positive");
+  }
+
+  std::vector<SpokePatch> patches;
+  for (size_t line = 0; line < numLines; line += patchSize) {
+    for (size_t step = 0; step < numSteps; step += patchSize) {
+      SpokePatch patch;
+      // lines wrap around, so the overlap before the first tile comes from the last lines
+      const size_t tileLines = std::min(patchSize, numLines - line);
+      patch.numLines = std::min(numLines, tileLines + 2 * overlap);
+      patch.firstLine = patch.numLines == numLines ? 0 : (line + numLines - overlap % numLines) % numLines;
+      patch.firstStep = step > overlap ? step - overlap : 0;
+      patch.numSteps = std::min(numSteps, step + patchSize + overlap) - patch.firstStep;
+      patches.push_back(patch);
+    }
+  }
+
+  // greedy coloring, in tile order
+  std::vector<std::vector<SpokePatch>> colors;
+  for (const auto& patch : patches) {
+    const auto color = std::find_if(colors.begin(), colors.end(), [&](const std::vector<SpokePatch>& colorPatches) {
+      return std::none_of(colorPatches.begin(), colorPatches.end(), [&](const SpokePatch& other) {
+        return DoSpokePatchesInteract(patch, other, numLines);
+      });
+    });
+    if (color == colors.end()) {
+      colors.push_back({patch});
+    } else {
+      color->push_back(patch);
+    }
+  }
+  return colors;
+}
+
+//----------------------------------------------------------------------------
+bool DoSpokePatchesInteract(const SpokePatch& a, const SpokePatch& b, const size_t numLines) {
+  // the closest lines and the closest steps can always be picked together, since patches are rectangles
+  const size_t lineDistance = LineDistance(a, b, numLines);
+  const size_t stepDistance = StepDistance(a, b);
+  return (lineDistance <= 1 && stepDistance <= 1) || lineDistance + stepDistance <= 2;
+}
+
+//----------------------------------------------------------------------------
+std::vector<size_t> GetSpokePatchIndices(const SpokePatch& patch, const size_t numLines, const size_t numSteps) {
+  std::vector<size_t> indices;
+  indices.reserve(patch.numLines * patch.numSteps);
+  for (size_t i = 0; i < patch.numLines; ++i) {
+    const size_t line = (patch.firstLine + i) % numLines;
+    for (size_t step = patch.firstStep; step < patch.firstStep + patch.numSteps; ++step) {
+      indices.push_back(line * numSteps + step);
+    }
+  }
+  return indices;
+}
+
+}
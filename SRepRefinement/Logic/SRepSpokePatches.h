@@ -0,0 +1,59 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+#ifndef __vtkSlicerSRepRefinementLogic_SRepSpokePatches_h
+#define __vtkSlicerSRepRefinementLogic_SRepSpokePatches_h
+
+#include <cstdlib>
+#include <vector>
+
+#include "vtkSlicerSRepRefinementModuleLogicExport.h"
+
+namespace sreprefinement {
+
+/// A rectangle of the primary spoke grid. Lines wrap around, steps do not.
+struct SpokePatch {
+  size_t firstLine;
+  size_t numLines;
+  size_t firstStep;
+  size_t numSteps;
+};
+
+/// Splits a grid of numLines by numSteps primary spokes into overlapping patches for block coordinate refinement.
+///
+/// The grid is tiled by squares of patchSize spokes, and each tile grows by overlap spokes on every side to give
+/// its patch. The patches are grouped into colors such that no two patches of a color interact (see
+/// DoSpokePatchesInteract), so the patches of a color can be optimized at the same time.
+///
+/// \returns The patches of each color.
+/// \throws std::invalid_argument if the grid is empty or patchSize is 0
+VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT
+std::vector<std::vector<SpokePatch>> CreateSpokePatches(size_t numLines, size_t numSteps, size_t patchSize, size_t overlap);
+
+/// Checks if any term of the refinement objective depends on spokes of both patches.
+///
+/// Each distance term depends on the four corners of a quad, and each rSrad penalty on a spoke and its four
+/// neighbors, so spokes interact if they are at most one line and one step apart or two lines or steps apart.
+VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT
+bool DoSpokePatchesInteract(const SpokePatch& a, const SpokePatch& b, size_t numLines);
+
+/// Gets the index (line * numSteps + step) of every spoke in patch, line by line from its first line.
+VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT
+std::vector<size_t> GetSpokePatchIndices(const SpokePatch& patch, size_t numLines, size_t numSteps);
+
+}
+
+#endif
@@ -18,38 +18,73 @@
 // SRepRefinement Logic includes
 #include "vtkSlicerSRepRefinementLogic.h"
 #include "vtkSlicerSRepLogic.h"
+#include "SRepLBFGS.h"
+#include "SRepMeshDistanceSampler.h"
+#include "SRepMultiStart.h"
+#include "SRepPrincipalCurvatures.h"
+#include "SRepRefinementBudget.h"
+#include "SRepRefinementCheckpoint.h"
+#include "SRepRefinementObjective.h"
+#include "SRepRefinementTask.h"
+#include "SRepRefinementTelemetry.h"
+#include "SRepSDFCache.h"
+#include "SRepSDFSampler.h"
+#include "SRepSparseSDFSampler.h"
+#include "SRepSpokePatches.h"
 
 // MRML includes
+#include <vtkMRMLApplicationLogic.h>
 #include <vtkMRMLScene.h>
+#include <vtkMRMLSRepStorageNode.h>
 
 // VTK includes
-#include <vtkCurvatures.h>
+#include <vtkCollection.h>
 #include <vtkDoubleArray.h>
 #include <vtkImageData.h>
-#include <vtkImageMagnitude.h>
-#include <vtkImageStencil.h>
-#include <vtkImplicitPolyDataDistance.h>
+#include <vtkImageStencilToImage.h>
+#include <vtkIdList.h>
 #include <vtkIntArray.h>
 #include <vtkMatrix4x4.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkPointData.h>
-#include <vtkPointLocator.h>
 #include <vtkPoints.h>
 #include <vtkPolyData.h>
 #include <vtkPolyDataToImageStencil.h>
+#include <vtkSMPTools.h>
+#include <vtkStaticPointLocator.h>
+#include <vtkStringArray.h>
+#include <vtkTable.h>
+#include <vtkTriangleFilter.h>
+
+// vtksys includes
+#include <vtksys/SystemTools.hxx>
 
 // ITK includes
-#include <itkApproximateSignedDistanceMapImageFilter.h>
 #include <itkCovariantVector.h>
 #include <itkGradientImageFilter.h>
 #include <itkImage.h>
+#include <itkSignedMaurerDistanceMapImageFilter.h>
 #include <itkVTKImageToImageFilter.h>
 
 // STD includes
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <tuple>
 #include <vector>
 
@@ -64,11 +99,6 @@ using SDFAndGradient = std::tuple<itk::SmartPointer<RealImage>, itk::SmartPointe
 
 namespace {
 
-//---------------------------------------------------------------------------
-double Clamp(double val, double min, double max) {
-  return val < min ? min : (val > max ? max : val);
-}
-
 //---------------------------------------------------------------------------
 size_t Pow(size_t val, size_t exp) {
   size_t ret = 1;
@@ -164,9 +194,38 @@ Bounds ComputePolyDataToImageDataNewBounds(const Bounds& bounds)
   return newBounds;
 }
 
+/// The voxels of the unit cube that a distance field covers. Voxel i of an axis is at i * voxelSpacing.
+struct VoxelGrid {
+  std::array<int, 3> offset; // index of the grid's first voxel
+  std::array<int, 3> dimensions;
+};
+
 //---------------------------------------------------------------------------
-// bounds must be able to contain the bounds of the polydata
-vtkSmartPointer<vtkImageData> ConvertPolyDataToImageData(vtkPolyData* polydata, const Bounds& bounds, const double voxelSpacing)
+// Fits the grid to the image coordinates of bounds plus a margin on every side, so the shorter axes of
+// elongated models don't pay for the whole unit cube. The grid stays within the 1 / voxelSpacing cube
+// of voxels, so it never holds more voxels, or voxels at other positions, than the whole cube did.
+VoxelGrid ComputeVoxelGrid(const Bounds& bounds, double voxelSpacing)
+{
+  // room for spokes that overshoot the model, in units of its largest dimension. Points past the grid
+  // get the distance at its edge.
+  constexpr double margin = 0.1;
+
+  const auto newBounds = ComputePolyDataToImageDataNewBounds(bounds);
+  const int cubeDimension = static_cast<int>(1 / voxelSpacing);
+  VoxelGrid grid;
+  for (int i = 0; i < 3; ++i) {
+    const int first = std::max(0, static_cast<int>(std::floor((newBounds[2 * i] - margin) / voxelSpacing)));
+    const int last = std::min(cubeDimension - 1, static_cast<int>(std::ceil((newBounds[2 * i + 1] + margin) / voxelSpacing)));
+    grid.offset[i] = first;
+    grid.dimensions[i] = last - first + 1;
+  }
+  return grid;
+}
+
+//---------------------------------------------------------------------------
+// bounds must be able to contain the bounds of the polydata. Voxels inside the polydata are 255 and the others 0.
+// threads is the number of threads to voxelize on, 0 for one per hardware thread.
+vtkSmartPointer<vtkImageData> ConvertPolyDataToImageData(vtkPolyData* polydata, const Bounds& bounds, const double voxelSpacing, size_t threads)
 {
   if (!polydata) {
     throw std::invalid_argument("expected non null PolyData when converting PolyData to ImageData");
@@ -201,95 +260,142 @@ vtkSmartPointer<vtkImageData> ConvertPolyDataToImageData(vtkPolyData* polydata,
   transMesh->SetPoints(newPts);
   transMesh->SetPolys(polydata->GetPolys());
 
-  auto whiteImage = vtkSmartPointer<vtkImageData>::New();
-
-  double spacing[3]; // desired volume spacing
-  spacing[0] = voxelSpacing;
-  spacing[1] = voxelSpacing;
-  spacing[2] = voxelSpacing;
-  whiteImage->SetSpacing(spacing);
-
-  // compute dimensions
-  int dim[3];
-  for (int i = 0; i < 3; i++)
-  {
-      dim[i] = static_cast<int>(1 / spacing[i]);
+  // the extent places the grid's voxels in the unit cube, so the origin is the cube's
+  const auto grid = ComputeVoxelGrid(bounds, voxelSpacing);
+  const double spacing[3] = {voxelSpacing, voxelSpacing, voxelSpacing};
+  const double origin[3] = {0.0, 0.0, 0.0};
+  int extent[6];
+  for (int i = 0; i < 3; ++i) {
+    extent[2 * i] = grid.offset[i];
+    extent[2 * i + 1] = grid.offset[i] + grid.dimensions[i] - 1;
   }
-  whiteImage->SetDimensions(dim);
-  whiteImage->SetExtent(0, dim[0] - 1, 0, dim[1] - 1, 0, dim[2] - 1);
 
-  double origin[3];
-  origin[0] = newBounds[0];
-  origin[1] = newBounds[2];
-  origin[2] = newBounds[4];
-
-  whiteImage->SetOrigin(origin);
-  whiteImage->AllocateScalars(VTK_UNSIGNED_CHAR,1);
+  auto image = vtkSmartPointer<vtkImageData>::New();
+  image->SetSpacing(spacing);
+  image->SetOrigin(origin);
+  image->SetExtent(extent);
+  image->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+
+  // vtkPolyDataToImageStencil only uses one thread, so slabs of slices are voxelized in parallel and each
+  // is copied into its part of the image. There are more slabs than threads since the slices through the
+  // middle of the model take the longest.
+  const size_t numThreads = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+  const auto numSlices = static_cast<size_t>(grid.dimensions[2]);
+  const size_t numSlabs = std::min(4 * numThreads, numSlices);
+  const auto sliceSize = static_cast<size_t>(grid.dimensions[0]) * static_cast<size_t>(grid.dimensions[1]);
+  auto* voxels = static_cast<unsigned char*>(image->GetScalarPointer());
+
+  // traversing the polygons isn't thread safe, so every running slab cuts its own copy of the mesh.
+  // The copies are reused by later slabs, so there are at most as many as threads.
+  std::mutex meshesMutex;
+  std::vector<vtkSmartPointer<vtkPolyData>> meshes;
+  const auto acquireMesh = [&]() {
+    std::lock_guard<std::mutex> lock(meshesMutex);
+    if (!meshes.empty()) {
+      auto mesh = meshes.back();
+      meshes.pop_back();
+      return mesh;
+    }
+    auto mesh = vtkSmartPointer<vtkPolyData>::New();
+    mesh->DeepCopy(transMesh);
+    return mesh;
+  };
+  const auto releaseMesh = [&](vtkSmartPointer<vtkPolyData> mesh) {
+    std::lock_guard<std::mutex> lock(meshesMutex);
+    meshes.push_back(mesh);
+  };
 
-  // fill the image with foreground voxels:
-  constexpr unsigned char inval = 255;
-  constexpr unsigned char outval = 0;
-  vtkIdType count = whiteImage->GetNumberOfPoints();
-  for (vtkIdType i = 0; i < count; ++i)
-  {
-      whiteImage->GetPointData()->GetScalars()->SetTuple1(i, inval);
+  const auto results = sreprefinement::RunBatch(numSlabs, numThreads,
+    [&](size_t slab) {
+      const size_t firstSlice = numSlices * slab / numSlabs;
+      const size_t endSlice = numSlices * (slab + 1) / numSlabs;
+      int slabExtent[6] = {extent[0], extent[1], extent[2], extent[3],
+        grid.offset[2] + static_cast<int>(firstSlice), grid.offset[2] + static_cast<int>(endSlice) - 1};
+
+      const auto slabMesh = acquireMesh();
+      vtkNew<vtkPolyDataToImageStencil> stencil;
+      stencil->SetInputData(slabMesh);
+      stencil->SetTolerance(0);
+      stencil->SetOutputOrigin(origin);
+      stencil->SetOutputSpacing(spacing);
+      stencil->SetOutputWholeExtent(slabExtent);
+
+      vtkNew<vtkImageStencilToImage> stencilToImage;
+      stencilToImage->SetInputConnection(stencil->GetOutputPort());
+      stencilToImage->SetInsideValue(255);
+      stencilToImage->SetOutsideValue(0);
+      stencilToImage->SetOutputScalarTypeToUnsignedChar();
+      stencilToImage->SetNumberOfThreads(1);
+      stencilToImage->Update();
+
+      const auto* slabVoxels = static_cast<const unsigned char*>(stencilToImage->GetOutput()->GetScalarPointer());
+      std::copy_n(slabVoxels, sliceSize * (endSlice - firstSlice), voxels + sliceSize * firstSlice);
+      releaseMesh(slabMesh);
+    },
+    [](size_t) {});
+
+  for (const auto& result : results) {
+    if (!result.succeeded) {
+      throw std::runtime_error("Error voxelizing PolyData: " + result.errorMessage);
+    }
   }
-
-  // polygonal data --> image stencil:
-  auto pol2stenc = vtkSmartPointer<vtkPolyDataToImageStencil>::New();
-  pol2stenc->SetInputData(transMesh);
-  pol2stenc->SetTolerance(0);
-  double polOrigin[3] = {0.0, 0.0, 0.0};
-  pol2stenc->SetOutputOrigin(polOrigin);
-  pol2stenc->SetOutputSpacing(spacing);
-  pol2stenc->SetOutputWholeExtent(whiteImage->GetExtent());
-  pol2stenc->Update();
-
-  // cut the corresponding white image and set the background:
-  auto imgstenc = vtkSmartPointer<vtkImageStencil>::New();
-  imgstenc->SetInputData(whiteImage);
-  imgstenc->SetStencilConnection(pol2stenc->GetOutputPort());
-  imgstenc->ReverseStencilOff();
-  imgstenc->SetBackgroundValue(outval);
-  imgstenc->Update();
-
-  return imgstenc->GetOutput();
+  return image;
 }
 
 //---------------------------------------------------------------------------
-itk::SmartPointer<RealImage> CreateApproximateSignedDistanceMap(vtkImageData* input)
+// Limits an ITK filter to the given number of threads. 0 keeps ITK's default.
+void SetNumberOfThreads(itk::ProcessObject& filter, size_t threads)
 {
-  using ApproxSDFFilterType = itk::ApproximateSignedDistanceMapImageFilter<ImageType, RealImage>;
+  if (threads > 0) {
+    filter.GetMultiThreader()->SetMaximumNumberOfThreads(static_cast<itk::ThreadIdType>(threads));
+    filter.SetNumberOfWorkUnits(static_cast<itk::ThreadIdType>(threads));
+  }
+}
 
-  auto magnitude = vtkSmartPointer<vtkImageMagnitude>::New();
-  magnitude->SetInputData(input);
-  magnitude->Update();
+//---------------------------------------------------------------------------
+// Computes the exact signed distance to the surface of the foreground voxels of input, negative inside
+itk::SmartPointer<RealImage> CreateSignedDistanceMap(vtkImageData* input, size_t threads)
+{
+  using DistanceFilterType = itk::SignedMaurerDistanceMapImageFilter<ImageType, RealImage>;
 
   auto filter = itk::VTKImageToImageFilter< ImageType >::New();
-  filter->SetInput(magnitude->GetOutput());
+  filter->SetInput(input);
   try {
     filter->Update();
-    auto asdfFilter = ApproxSDFFilterType::New();
-    asdfFilter->SetInput(filter->GetOutput());
-    asdfFilter->SetInsideValue(255);
-    asdfFilter->SetOutsideValue(0);
-    asdfFilter->Update();
-
-    return asdfFilter->GetOutput();
+    auto distanceFilter = DistanceFilterType::New();
+    distanceFilter->SetInput(filter->GetOutput());
+    distanceFilter->SetBackgroundValue(0);
+    distanceFilter->SetInsideIsPositive(false);
+    distanceFilter->SetSquaredDistance(false);
+    distanceFilter->SetUseImageSpacing(true);
+    SetNumberOfThreads(*distanceFilter, threads);
+    distanceFilter->Update();
+    itk::SmartPointer<RealImage> sdf = distanceFilter->GetOutput();
+
+    // The filter measures from the centers of the outermost foreground voxels. The surface is halfway
+    // between them and the background voxels next to them, as with the isocontour of the voxels.
+    const auto halfVoxel = static_cast<float>(0.5 * input->GetSpacing()[0]);
+    float* distances = sdf->GetBufferPointer();
+    const auto numVoxels = sdf->GetBufferedRegion().GetNumberOfPixels();
+    for (size_t i = 0; i < numVoxels; ++i) {
+      distances[i] -= halfVoxel;
+    }
+    return sdf;
   } catch (itk::ExceptionObject& error) {
     std::stringstream ss;
-    ss << "Error creating ApproximateSignedDistanceMap: " << error;
+    ss << "Error creating SignedMaurerDistanceMap: " << error;
     error.SetDescription(ss.str().c_str());
     throw;
   }
 }
 
 //---------------------------------------------------------------------------
-itk::SmartPointer<VectorImage> CreateGradientDistanceFilter(itk::SmartPointer<RealImage> image)
+itk::SmartPointer<VectorImage> CreateGradientDistanceFilter(itk::SmartPointer<RealImage> image, size_t threads)
 {
   using GradientFilterType = itk::GradientImageFilter<RealImage, float>;
   auto gradientFilter = GradientFilterType::New();
   gradientFilter->SetInput(image);
+  SetNumberOfThreads(*gradientFilter, threads);
 
   try {
     gradientFilter->Update();
@@ -304,13 +410,248 @@ itk::SmartPointer<VectorImage> CreateGradientDistanceFilter(itk::SmartPointer<Re
 
 //---------------------------------------------------------------------------
 // bounds must be able to contain the bounds of the polydata
-SDFAndGradient CreateAntiAliasSignedDistanceMap(vtkPolyData* polyData, const Bounds& bounds, double voxelSpacing)
+SDFAndGradient CreateSignedDistanceMapAndGradient(vtkPolyData* polyData, const Bounds& bounds, double voxelSpacing, size_t threads)
 {
-  auto imageData = ConvertPolyDataToImageData(polyData, bounds, voxelSpacing);
-  auto antiAliasedSDFImage = CreateApproximateSignedDistanceMap(imageData);
-  auto gradDistFilter = CreateGradientDistanceFilter(antiAliasedSDFImage);
+  auto imageData = ConvertPolyDataToImageData(polyData, bounds, voxelSpacing, threads);
+  auto sdfImage = CreateSignedDistanceMap(imageData, threads);
+  auto gradDistFilter = CreateGradientDistanceFilter(sdfImage, threads);
+
+  return std::make_tuple(sdfImage, gradDistFilter);
+}
+
+/// Settings that control how the refinement is computed, as opposed to what is being optimized.
+struct RefinerSettings {
+  /// One of vtkSlicerSRepRefinementLogic::DistanceMethodType.
+  int distanceMethod = vtkSlicerSRepRefinementLogic::DistanceMethodImage;
+  /// Spacing of the finest distance field in the unit cube the model is scaled to.
+  double voxelSpacing = 0.005;
+  /// Voxels on either side of the surface the distance field is kept at full resolution. 0 for a dense field.
+  size_t narrowBandWidth = 4;
+  /// Threads the distance fields are computed on. 0 uses one per hardware thread.
+  size_t distanceMapThreads = 0;
+  /// Number of resolutions to refine at, coarsest first. Each coarser level doubles the voxel spacing.
+  size_t pyramidLevels = 1;
+  /// Optimize the up and down spokes on separate threads.
+  bool concurrentUpDown = true;
+  /// One of vtkSlicerSRepRefinementLogic::OptimizerType.
+  int optimizer = vtkSlicerSRepRefinementLogic::OptimizerNEWUOA;
+  /// Tile size of the spoke patches for block coordinate refinement. 0 optimizes all spokes at once.
+  size_t patchSize = 0;
+  /// Spokes each patch extends past its tile on every side.
+  size_t patchOverlap = 1;
+  /// Maximum sweeps over the patches per pyramid level.
+  size_t maxPatchSweeps = 4;
+  /// Optimizations each pyramid level runs from different starts for each spoke orientation.
+  size_t numStarts = 1;
+  /// Standard deviation of the noise added to the coefficients of every start but the first.
+  double startJitter = 0.05;
+  /// Factor between the initial trust regions of successive starts.
+  double startRegionScale = 2.0;
+  /// Seed of the start jitter.
+  uint64_t startSeed = 0;
+  /// Threads the spoke orientations optimize patches or starts on, split between them when they run
+  /// concurrently. 0 uses one per hardware thread.
+  size_t orientationThreads = 0;
+  /// Wall time in seconds each stage (up, down, crest) may take. 0 for no limit.
+  double stageTimeBudget = 0.0;
+  /// Evaluations each stage (up, down, crest) may do. 0 for no limit.
+  size_t stageEvaluationBudget = 0;
+  /// Records every objective function evaluation if not nullptr. Must outlive the refinement.
+  sreprefinement::RefinementTelemetry* telemetry = nullptr;
+  /// Prints every nth objective function evaluation to stdout. 0 prints nothing.
+  int consoleOutputInterval = 0;
+  /// Reuses distance fields stored here by earlier refinements if not nullptr. Must outlive the refinement.
+  const sreprefinement::SDFCache* sdfCache = nullptr;
+  /// Checkpoints are written to this file, and a refinement resumes from it if it holds a checkpoint of
+  /// the same refinement. Empty for no checkpoints.
+  std::string checkpointFileName;
+  /// Minimum seconds between checkpoints.
+  double checkpointInterval = 60.0;
+};
+
+//---------------------------------------------------------------------------
+// Identifies the distance field computed for polyData on the grid given by bounds and voxelSpacing
+sreprefinement::SDFCache::Key ComputeSDFCacheKey(vtkPolyData* polyData, const Bounds& bounds, double voxelSpacing) {
+  // change this whenever the distance field computation changes so old cache files are not used
+  constexpr uint64_t sdfVersion = 3;
+
+  sreprefinement::Hasher hasher;
+  hasher.Add(sdfVersion);
+  hasher.Add(bounds.data(), bounds.size());
+  hasher.Add(voxelSpacing);
+
+  const auto numPoints = polyData->GetNumberOfPoints();
+  hasher.Add(static_cast<uint64_t>(numPoints));
+  double point[3];
+  for (vtkIdType i = 0; i < numPoints; ++i) {
+    polyData->GetPoint(i, point);
+    hasher.Add(point, 3);
+  }
+
+  // only the polygons are voxelized
+  vtkCellArray* polys = polyData->GetPolys();
+  hasher.Add(static_cast<uint64_t>(polys->GetNumberOfCells()));
+  vtkNew<vtkIdList> cell;
+  polys->InitTraversal();
+  while (polys->GetNextCell(cell)) {
+    hasher.Add(static_cast<uint64_t>(cell->GetNumberOfIds()));
+    for (vtkIdType i = 0; i < cell->GetNumberOfIds(); ++i) {
+      hasher.Add(static_cast<uint64_t>(cell->GetId(i)));
+    }
+  }
+  return hasher.GetHash();
+}
+
+//---------------------------------------------------------------------------
+sreprefinement::DistanceSampler::AffineTransform CreateSRepToIndexTransform(const Bounds& bounds, double voxelSpacing)
+{
+  // srep coordinates -> image coordinates in [0,1] -> voxel index in the unit cube -> voxel index in the grid
+  const auto boundsToImage = CreateBoundsToImageCoordsTransform(bounds);
+  const auto grid = ComputeVoxelGrid(bounds, voxelSpacing);
+  sreprefinement::DistanceSampler::AffineTransform srepToIndex;
+  for (int row = 0; row < 3; ++row) {
+    for (int col = 0; col < 4; ++col) {
+      srepToIndex[4 * row + col] = boundsToImage->GetElement(row, col) / voxelSpacing;
+    }
+    srepToIndex[4 * row + 3] -= grid.offset[row];
+  }
+  return srepToIndex;
+}
+
+//---------------------------------------------------------------------------
+// bounds must be able to contain the bounds of the polydata
+std::unique_ptr<const sreprefinement::DistanceSampler> CreateDistanceSampler(
+  vtkPolyData* polyData,
+  const Bounds& bounds,
+  double voxelSpacing,
+  size_t narrowBandWidth,
+  size_t threads,
+  const sreprefinement::SDFCache* cache)
+{
+  const auto srepToIndex = CreateSRepToIndexTransform(bounds, voxelSpacing);
+  // the sparse sampler computes its own normals, so it doesn't need the gradient image
+  const bool needGradients = narrowBandWidth == 0;
+  const auto createSampler = [&](const sreprefinement::DistanceSampler::Dimensions& dimensions, const float* distances, const float* gradients) {
+    if (needGradients) {
+      return std::unique_ptr<const sreprefinement::DistanceSampler>(new sreprefinement::SDFSampler(
+        dimensions, srepToIndex, distances, gradients));
+    }
+    return std::unique_ptr<const sreprefinement::DistanceSampler>(new sreprefinement::SparseSDFSampler(
+      dimensions, srepToIndex, distances, narrowBandWidth));
+  };
+
+  sreprefinement::SDFCache::Key key = 0;
+  if (cache) {
+    key = ComputeSDFCacheKey(polyData, bounds, voxelSpacing);
+    const auto entry = cache->Find(key, needGradients);
+    if (entry) {
+      return createSampler(entry->GetDimensions(), entry->GetDistances(), entry->GetGradients());
+    }
+  }
+
+  const auto getDimensions = [](const itk::ImageBase<3>& image) {
+    const auto size = image.GetLargestPossibleRegion().GetSize();
+    return sreprefinement::DistanceSampler::Dimensions{{size[0], size[1], size[2]}};
+  };
+
+  itk::SmartPointer<RealImage> sdf;
+  itk::SmartPointer<VectorImage> gradient;
+  if (needGradients) {
+    std::tie(sdf, gradient) = CreateSignedDistanceMapAndGradient(polyData, bounds, voxelSpacing, threads);
+  } else {
+    // the dense distance map only lives until the sparse sampler is constructed, so computing it peaks
+    // at the dense size; it is only the memory held while refining that is sparse
+    sdf = CreateSignedDistanceMap(ConvertPolyDataToImageData(polyData, bounds, voxelSpacing, threads), threads);
+  }
+  const auto dimensions = getDimensions(*sdf);
+  // CovariantVector<float, 3> is laid out as 3 contiguous floats
+  const float* gradients = gradient ? reinterpret_cast<const float*>(gradient->GetBufferPointer()) : nullptr;
 
-  return std::make_tuple(antiAliasedSDFImage, gradDistFilter);
+  if (cache && !cache->Store(key, dimensions, sdf->GetBufferPointer(), gradients)) {
+    vtkGenericWarningMacro("Unable to store the distance field in " << cache->GetFileName(key));
+  }
+  return createSampler(dimensions, sdf->GetBufferPointer(), gradients);
+}
+
+//---------------------------------------------------------------------------
+/// Points and triangles of a mesh, in the layout MeshDistanceSampler takes
+struct TriangleMesh {
+  std::vector<double> points;    ///< 3 world coordinates per point, xyz interleaved
+  std::vector<size_t> triangles; ///< 3 point indices per triangle
+};
+
+//---------------------------------------------------------------------------
+// Triangulates the polygons of polyData. The points keep their ids.
+TriangleMesh GetTriangleMesh(vtkPolyData* polyData) {
+  vtkNew<vtkTriangleFilter> triangleFilter;
+  triangleFilter->SetInputData(polyData);
+  triangleFilter->PassVertsOff();
+  triangleFilter->PassLinesOff();
+  triangleFilter->Update();
+  vtkPolyData* triangulated = triangleFilter->GetOutput();
+
+  TriangleMesh mesh;
+  mesh.points.resize(3 * static_cast<size_t>(triangulated->GetNumberOfPoints()));
+  for (vtkIdType i = 0; i < triangulated->GetNumberOfPoints(); ++i) {
+    triangulated->GetPoint(i, &mesh.points[3 * i]);
+  }
+  mesh.triangles.reserve(3 * static_cast<size_t>(triangulated->GetNumberOfPolys()));
+  vtkCellArray* polys = triangulated->GetPolys();
+  vtkNew<vtkIdList> cell;
+  polys->InitTraversal();
+  while (polys->GetNextCell(cell)) {
+    for (vtkIdType i = 0; i < cell->GetNumberOfIds(); ++i) {
+      mesh.triangles.push_back(static_cast<size_t>(cell->GetId(i)));
+    }
+  }
+  return mesh;
+}
+
+//---------------------------------------------------------------------------
+// Samples the exact distance to the polygons of polyData, in the same units as the image fields
+std::unique_ptr<const sreprefinement::DistanceSampler> CreateMeshDistanceSampler(vtkPolyData* polyData, const Bounds& bounds) {
+  const auto mesh = GetTriangleMesh(polyData);
+  // the image fields are in the unit cube the largest dimension of bounds is scaled to
+  const double largestRange = std::max({bounds[1] - bounds[0], bounds[3] - bounds[2], bounds[5] - bounds[4]});
+  return std::unique_ptr<const sreprefinement::DistanceSampler>(
+    new sreprefinement::MeshDistanceSampler(mesh.points, mesh.triangles, 1.0 / largestRange));
+}
+
+//---------------------------------------------------------------------------
+// Gets the number of pyramid levels to refine at
+size_t GetNumberOfPyramidLevels(const RefinerSettings& settings) {
+  if (settings.pyramidLevels < 1) {
+    throw std::invalid_argument("Expected at least one pyramid level");
+  }
+  // the mesh distance is exact, so there is nothing to gain from coarser levels
+  return settings.distanceMethod == vtkSlicerSRepRefinementLogic::DistanceMethodMesh ? 1 : settings.pyramidLevels;
+}
+
+//---------------------------------------------------------------------------
+// Gets the progress iterations of the up or down spokes on each pyramid level. Every start of a spoke orientation
+// reports its evaluations as progress.
+std::vector<int> GetStageIterations(const std::vector<int>& levelIterations, size_t numStarts) {
+  std::vector<int> iterations(levelIterations.size());
+  for (size_t level = 0; level < levelIterations.size(); ++level) {
+    iterations[level] = levelIterations[level] * static_cast<int>(numStarts);
+  }
+  return iterations;
+}
+
+//---------------------------------------------------------------------------
+// Creates the sampler of a pyramid level, 0 is the coarsest. Each coarser level doubles the voxel spacing.
+std::unique_ptr<const sreprefinement::DistanceSampler> CreateLevelDistanceSampler(
+  vtkPolyData* polyData,
+  const Bounds& bounds,
+  const RefinerSettings& settings,
+  size_t level)
+{
+  if (settings.distanceMethod == vtkSlicerSRepRefinementLogic::DistanceMethodMesh) {
+    return CreateMeshDistanceSampler(polyData, bounds);
+  }
+  const double voxelSpacing = settings.voxelSpacing * Pow(2, GetNumberOfPyramidLevels(settings) - 1 - level);
+  return CreateDistanceSampler(
+    polyData, bounds, voxelSpacing, settings.narrowBandWidth, settings.distanceMapThreads, settings.sdfCache);
 }
 
 //---------------------------------------------------------------------------
@@ -332,8 +673,86 @@ Bounds ComputeMasterBounds(vtkPolyData* polyData, const vtkEllipticalSRep& srep)
   };
 }
 
+//---------------------------------------------------------------------------
+// Identifies a refinement by everything that changes its result, so a checkpoint is only resumed by the same refinement
+uint64_t ComputeCheckpointKey(
+  const vtkEllipticalSRep& srep,
+  vtkPolyData* polyData,
+  double initialRegionSize,
+  double finalRegionSize,
+  int maxIterations,
+  int interpolationLevel,
+  double L0Weight,
+  double L1Weight,
+  double L2Weight,
+  const RefinerSettings& settings)
+{
+  sreprefinement::Hasher hasher;
+  // covers the model and the bounds the srep is scaled by
+  hasher.Add(ComputeSDFCacheKey(polyData, ComputeMasterBounds(polyData, srep), settings.voxelSpacing));
+
+  const auto addSpoke = [&hasher](const vtkSRepSpoke& spoke) {
+    const auto skeletalPoint = spoke.GetSkeletalPoint().AsArray();
+    const auto direction = spoke.GetDirection().AsArray();
+    hasher.Add(skeletalPoint.data(), skeletalPoint.size());
+    hasher.Add(direction.data(), direction.size());
+  };
+  hasher.Add(static_cast<uint64_t>(srep.GetNumberOfLines()));
+  hasher.Add(static_cast<uint64_t>(srep.GetNumberOfSteps()));
+  for (vtkEllipticalSRep::IndexType l = 0; l < srep.GetNumberOfLines(); ++l) {
+    for (vtkEllipticalSRep::IndexType s = 0; s < srep.GetNumberOfSteps(); ++s) {
+      const auto* skeletalPoint = srep.GetSkeletalPoint(l, s);
+      addSpoke(*skeletalPoint->GetUpSpoke());
+      addSpoke(*skeletalPoint->GetDownSpoke());
+      if (skeletalPoint->IsCrest()) {
+        addSpoke(*skeletalPoint->GetCrestSpoke());
+      }
+    }
+  }
+
+  const double parameters[] = {initialRegionSize, finalRegionSize, L0Weight, L1Weight, L2Weight};
+  hasher.Add(parameters, 5);
+  hasher.Add(static_cast<uint64_t>(maxIterations));
+  hasher.Add(static_cast<uint64_t>(interpolationLevel));
+  hasher.Add(static_cast<uint64_t>(settings.distanceMethod));
+  hasher.Add(static_cast<uint64_t>(settings.narrowBandWidth));
+  hasher.Add(static_cast<uint64_t>(settings.pyramidLevels));
+  hasher.Add(static_cast<uint64_t>(settings.optimizer));
+  hasher.Add(static_cast<uint64_t>(settings.patchSize));
+  hasher.Add(static_cast<uint64_t>(settings.patchOverlap));
+  hasher.Add(static_cast<uint64_t>(settings.maxPatchSweeps));
+  hasher.Add(static_cast<uint64_t>(settings.numStarts));
+  hasher.Add(settings.startJitter);
+  hasher.Add(settings.startRegionScale);
+  hasher.Add(settings.startSeed);
+  // a stage that runs out of its budget stops with different spokes
+  hasher.Add(settings.stageTimeBudget);
+  hasher.Add(static_cast<uint64_t>(settings.stageEvaluationBudget));
+  return hasher.GetHash();
+}
+
 /// Progress returned will be in range [0,1]
 using ProgressCallbackFunction = std::function<void(double)>;
+/// Returns true if the refinement should stop. Called from many threads.
+using CancelCallbackFunction = std::function<bool()>;
+/// Receives the best srep so far. The refiner never modifies it again.
+using SnapshotCallbackFunction = std::function<void(vtkSmartPointer<vtkEllipticalSRep>)>;
+
+/// Thrown out of the optimization when the refinement is cancelled
+class RefinementCancelled : public std::runtime_error {
+public:
+  RefinementCancelled()
+    : std::runtime_error("SRep refinement cancelled")
+  {}
+};
+
+/// Thrown out of the optimization when a stage runs out of its budget
+class BudgetExhausted : public std::runtime_error {
+public:
+  BudgetExhausted()
+    : std::runtime_error("SRep refinement stage budget exhausted")
+  {}
+};
 
 /// Class for doing the refinement. Do not use directly, call free function RefineSRep instead.
 class Refiner {
@@ -348,27 +767,72 @@ public:
     int interpolationLevel,
     double L0Weight,
     double L1Weight,
-    double L2Weight)
-    : m_voxelSpacing(0.005)
-    , m_polyData(polyData)
+    double L2Weight,
+    const RefinerSettings& settings)
+    : m_polyData(polyData)
     , m_srep(srep.SmartClone())
+    // checkpoints store the spokes of each level relative to the input
+    , m_inputSRep(settings.checkpointFileName.empty() ? vtkSmartPointer<vtkEllipticalSRep>() : srep.SmartClone())
     , m_masterBounds(ComputeMasterBounds(m_polyData, *m_srep))
-    , m_sdfAndGradient(CreateAntiAliasSignedDistanceMap(m_polyData, m_masterBounds, m_voxelSpacing))
-    , m_srepToImageCoordsTransform(CreateBoundsToImageCoordsTransform(m_masterBounds))
+    , m_samplerSettings(settings)
+    , m_numLevels(GetNumberOfPyramidLevels(settings))
+    , m_distanceSampler()
     , m_flattenedUpCoeff()
     , m_flattenedDownCoeff()
     , m_initialRegionSize(initialRegionSize)
     , m_finalRegionSize(finalRegionSize)
     , m_maxIterations(maxIterations)
+    , m_levelIterations(sreprefinement::SplitLevelIterations(maxIterations, m_numLevels))
     , m_interpolationLevel(interpolationLevel)
-    , m_currentCoeff(nullptr)
+    , m_concurrentUpDown(settings.concurrentUpDown)
+    , m_optimizer(settings.optimizer)
+    , m_patchSize(settings.patchSize)
+    , m_patchOverlap(settings.patchOverlap)
+    , m_maxPatchSweeps(settings.maxPatchSweeps)
+    , m_numStarts(settings.numStarts)
+    , m_startJitter(settings.startJitter)
+    , m_startRegionScale(settings.startRegionScale)
+    , m_startSeed(settings.startSeed)
+    , m_orientationThreads(settings.orientationThreads)
+    , m_stageIterations(GetStageIterations(m_levelIterations, m_patchSize > 0 ? 1 : m_numStarts))
+    , m_telemetry(settings.telemetry)
+    , m_consoleOutputInterval(settings.consoleOutputInterval)
+    , m_level(0)
     , m_srepLogic()
     , m_L0Weight(L0Weight)
     , m_L1Weight(L1Weight)
     , m_L2Weight(L2Weight)
     , m_iteration(0)
-    , m_totalProgressIterations(2 * m_maxIterations + 2 * m_srep->GetNumberOfLines()) // up and down iterations + 2 * # crest points
+    // up and down iterations for each level + 2 * # crest points
+    , m_totalProgressIterations(
+        2 * std::accumulate(m_stageIterations.begin(), m_stageIterations.end(), 0) + 2 * m_srep->GetNumberOfLines())
     , m_progressCallback()
+    , m_progressThread()
+    , m_cancelCallback()
+    , m_snapshotCallback()
+    , m_snapshotInterval(0)
+    , m_lastSnapshot()
+    , m_bestMutex()
+    , m_bestUpCoeff()
+    , m_bestDownCoeff()
+    , m_bestUpValue(std::numeric_limits<double>::infinity())
+    , m_bestDownValue(std::numeric_limits<double>::infinity())
+    , m_upBudget(settings.stageTimeBudget, settings.stageEvaluationBudget)
+    , m_downBudget(settings.stageTimeBudget, settings.stageEvaluationBudget)
+    , m_crestBudget(settings.stageTimeBudget, settings.stageEvaluationBudget)
+    // a stage that never finishes was cancelled
+    , m_status{sreprefinement::StopReason::Cancelled, sreprefinement::StopReason::Cancelled, sreprefinement::StopReason::Cancelled}
+    , m_upProgress()
+    , m_downProgress()
+    , m_checkpointFileName(settings.checkpointFileName)
+    , m_checkpointInterval(settings.checkpointInterval)
+    , m_checkpointKey(settings.checkpointFileName.empty() ? 0 : ComputeCheckpointKey(
+        srep, polyData, initialRegionSize, finalRegionSize, maxIterations, interpolationLevel, L0Weight, L1Weight, L2Weight, settings))
+    , m_checkpointMutex()
+    , m_lastCheckpoint()
+    , m_levelUpCoeff()
+    , m_levelDownCoeff()
+    , m_resume()
   {
     this->GetInitialCoefficients();
   }
@@ -377,17 +841,54 @@ public:
     this->m_progressCallback = f;
   }
 
+  /// The refinement checks f before every objective function evaluation and stops with the best spokes
+  /// found so far once it returns true.
+  void SetCancelCallback(CancelCallbackFunction f) {
+    this->m_cancelCallback = f;
+  }
+
+  /// f is called from the thread that called Run with the best srep so far at most every intervalSeconds,
+  /// and after every pyramid level.
+  void SetSnapshotCallback(SnapshotCallbackFunction f, double intervalSeconds) {
+    this->m_snapshotCallback = f;
+    this->m_snapshotInterval = std::chrono::duration<double>(intervalSeconds);
+  }
+
+  /// Gets how each stage of Run stopped. Only meaningful once Run returns.
+  const sreprefinement::RefinementStatus& GetStatus() const {
+    return m_status;
+  }
+
   //---------------------------------------------------------------------------
   /// WARNING: don't call this more than once
   vtkSmartPointer<vtkEllipticalSRep> Run() {
+    m_progressThread = std::this_thread::get_id();
+    m_lastSnapshot = std::chrono::steady_clock::now();
+    m_lastCheckpoint = m_lastSnapshot;
     if (!m_srep->IsEmpty()) {
-      m_iteration = 0; ReportProgress();
-      this->RefineSpokes(SpokeType::UpOrientation);
-      m_iteration = 1 * m_maxIterations; ReportProgress();
-      this->RefineSpokes(SpokeType::DownOrientation);
-      m_iteration = 2 * m_maxIterations; ReportProgress();
-      this->RefineSpokes(SpokeType::CrestOrientation);
+      this->ReadCheckpoint();
+      try {
+        this->RunLevels();
+      } catch (const RefinementCancelled&) {
+        // the level was interrupted, keep the best spokes it found. The checkpoint keeps them too, so
+        // the refinement can be resumed.
+        this->WriteCheckpoint(false);
+        this->ApplyBestCoefficients();
+        return m_srep;
+      }
+      // the crest spokes sample the mesh itself
+      m_distanceSampler.reset();
+      m_iteration = this->GetLevelProgressIteration(m_numLevels);
+      ReportProgress();
+      this->RefineCrestSpokes();
+      m_status.crest = this->IsCancelRequested() ? sreprefinement::StopReason::Cancelled : m_crestBudget.GetStopReason();
       m_iteration = m_totalProgressIterations;
+      // a refinement cancelled during the crest stage can still be resumed from it
+      if (!m_checkpointFileName.empty() && m_status.crest != sreprefinement::StopReason::Cancelled) {
+        std::remove(m_checkpointFileName.c_str());
+      }
+    } else {
+      m_status = sreprefinement::RefinementStatus();
     }
     return m_srep;
   }
@@ -395,177 +896,788 @@ public:
 private:
   using SpokeType = vtkSRepSkeletalPoint::SpokeOrientation;
   using IndexType = vtkEllipticalSRep::IndexType;
+
+  //---------------------------------------------------------------------------
+  // Optimizes the up and down spokes at every pyramid level
+  void RunLevels() {
+    const auto numLevels = static_cast<int>(m_numLevels);
+    const int firstLevel = m_resume ? static_cast<int>(m_resume->level) : 0;
+    for (int level = firstLevel; level < numLevels; ++level) {
+      // only one level's distance field is kept at a time, so the coarser one is freed before the next is built
+      m_distanceSampler.reset();
+      m_distanceSampler = CreateLevelDistanceSampler(m_polyData, m_masterBounds, m_samplerSettings, level);
+      m_level = static_cast<size_t>(level);
+
+      // each finer level starts with half the trust region of the one before it, and the coarser
+      // levels stop once they reach the size the next level starts at
+      const double initialRegionSize = std::max(m_finalRegionSize, m_initialRegionSize / Pow(2, level));
+      const double finalRegionSize = level == numLevels - 1
+        ? m_finalRegionSize
+        : std::max(m_finalRegionSize, m_initialRegionSize / Pow(2, level + 1));
+
+      if (m_resume) {
+        this->ResumeLevel(*m_resume);
+        m_resume.reset();
+      } else {
+        if (level > 0) {
+          // warm start from where the coarser level left off
+          this->GetInitialCoefficients();
+        }
+        this->ResetBestCoefficients();
+        for (auto* progress : {&m_upProgress, &m_downProgress}) {
+          progress->evaluations = 0;
+          progress->regionSize = initialRegionSize;
+          progress->sweep = 0;
+          progress->sweepEvaluations = 0;
+          progress->finished = false;
+        }
+        if (!m_checkpointFileName.empty()) {
+          m_levelUpCoeff = this->ComputeInputCoefficients(SpokeType::UpOrientation);
+          m_levelDownCoeff = this->ComputeInputCoefficients(SpokeType::DownOrientation);
+        }
+        m_iteration = this->GetLevelProgressIteration(m_level);
+      }
+      ReportProgress();
+      this->WriteCheckpoint(false);
+
+      if (m_concurrentUpDown) {
+        // Each optimization only reads m_srep and only changes spokes of its own orientation, so they can run at
+        // the same time as long as m_srep is not updated until both are done. The up spokes are optimized on this
+        // thread so progress keeps being reported from it.
+        auto down = std::async(std::launch::async, [&]() {
+          this->OptimizeUpDownSpokes(SpokeType::DownOrientation, initialRegionSize, finalRegionSize);
+        });
+        this->OptimizeUpDownSpokes(SpokeType::UpOrientation, initialRegionSize, finalRegionSize);
+        down.get();
+      } else {
+        this->OptimizeUpDownSpokes(SpokeType::UpOrientation, initialRegionSize, finalRegionSize);
+        m_iteration = this->GetLevelProgressIteration(m_level) + m_stageIterations[m_level];
+        ReportProgress();
+        this->OptimizeUpDownSpokes(SpokeType::DownOrientation, initialRegionSize, finalRegionSize);
+      }
+      this->WriteCheckpoint(false);
+      this->ApplyUpDownSpokes(SpokeType::UpOrientation);
+      this->ApplyUpDownSpokes(SpokeType::DownOrientation);
+      if (m_snapshotCallback) {
+        m_snapshotCallback(m_srep->SmartClone());
+        m_lastSnapshot = std::chrono::steady_clock::now();
+      }
+    }
+  }
+
   class MinNewouaHelper {
   public:
     using SpokeType = Refiner::SpokeType;
 
-    MinNewouaHelper(Refiner& refiner, SpokeType spokeType)
+    MinNewouaHelper(Refiner& refiner, sreprefinement::RefinementObjective& objective, SpokeType spokeType)
       : m_refiner(refiner)
+      , m_objective(objective)
       , m_spokeType(spokeType)
     {}
 
     double operator()(double* coeff) {
-      return m_refiner.EvaluateObjectiveFunction(coeff, m_spokeType);
+      return m_refiner.EvaluateObjectiveFunction(coeff, nullptr, m_objective, m_spokeType);
     }
   private:
     Refiner& m_refiner;
+    sreprefinement::RefinementObjective& m_objective;
     SpokeType m_spokeType;
   };
   friend class MinNewouaHelper;
 
-  double m_voxelSpacing;
+  /// New skeletal point and radius of a refined crest spoke
+  struct CrestSpokeUpdate {
+    IndexType line;
+    IndexType step;
+    srep::Point3d skeletalPoint;
+    srep::Vector3d direction;
+  };
+
+  /// Refines the crest spokes of a range of lines for vtkSMPTools::For.
+  class CrestSpokeFunctor {
+  public:
+    CrestSpokeFunctor(
+      Refiner& refiner,
+      const sreprefinement::DistanceSampler& distanceSampler,
+      vtkStaticPointLocator* locator,
+      const sreprefinement::PrincipalCurvatures& curvatures,
+      std::vector<std::vector<CrestSpokeUpdate>>& updates)
+      : m_refiner(refiner)
+      , m_distanceSampler(distanceSampler)
+      , m_locator(locator)
+      , m_curvatures(curvatures)
+      , m_updates(updates)
+    {}
+
+    void operator()(vtkIdType beginLine, vtkIdType endLine) {
+      for (vtkIdType l = beginLine; l < endLine; ++l) {
+        // exceptions can't leave vtkSMPTools, so cancelling skips the remaining lines instead
+        if (m_refiner.IsCancelRequested()) {
+          return;
+        }
+        try {
+          m_refiner.ComputeCrestSpokeUpdates(
+            static_cast<IndexType>(l), m_distanceSampler, *m_locator, m_curvatures, m_updates[l]);
+        } catch (const BudgetExhausted&) {
+          // the spokes computed so far are kept, the ones not reached keep their spokes
+          return;
+        }
+      }
+    }
+
+  private:
+    Refiner& m_refiner;
+    const sreprefinement::DistanceSampler& m_distanceSampler;
+    vtkStaticPointLocator* m_locator;
+    const sreprefinement::PrincipalCurvatures& m_curvatures;
+    std::vector<std::vector<CrestSpokeUpdate>>& m_updates;
+  };
+  friend class CrestSpokeFunctor;
+
+  /// How far the optimization of one spoke orientation got on the current pyramid level, for checkpoints
+  struct SpokesProgress {
+    std::atomic<int> evaluations;
+    std::atomic<double> regionSize; // the trust region radius reached
+    std::atomic<int> sweep; // the patch sweep reached
+    std::atomic<int> sweepEvaluations; // evaluations done in that sweep
+    bool finished; // guarded by m_bestMutex so it always comes with the final coefficients
+  };
+
   vtkSmartPointer<vtkPolyData> m_polyData;
   vtkSmartPointer<vtkEllipticalSRep> m_srep;
+  vtkSmartPointer<vtkEllipticalSRep> m_inputSRep; // only kept for checkpoints
   Bounds m_masterBounds;
-  SDFAndGradient m_sdfAndGradient;
-  vtkSmartPointer<vtkMatrix4x4> m_srepToImageCoordsTransform;
+  RefinerSettings m_samplerSettings; // for creating the distance sampler of each pyramid level
+  size_t m_numLevels; // the number of pyramid levels
+  std::unique_ptr<const sreprefinement::DistanceSampler> m_distanceSampler; // the current pyramid level
   std::vector<double> m_flattenedUpCoeff;
   std::vector<double> m_flattenedDownCoeff;
   double m_initialRegionSize;
   double m_finalRegionSize;
   int m_maxIterations;
+  std::vector<int> m_levelIterations; // m_maxIterations split between the pyramid levels
   int m_interpolationLevel;
-  std::vector<double>* m_currentCoeff;
+  bool m_concurrentUpDown;
+  int m_optimizer;
+  size_t m_patchSize;
+  size_t m_patchOverlap;
+  size_t m_maxPatchSweeps;
+  size_t m_numStarts; // not used for patches
+  double m_startJitter;
+  double m_startRegionScale;
+  uint64_t m_startSeed;
+  size_t m_orientationThreads;
+  std::vector<int> m_stageIterations; // progress iterations of the up or down spokes on each pyramid level
+  sreprefinement::RefinementTelemetry* m_telemetry;
+  int m_consoleOutputInterval;
+  size_t m_level; // the current pyramid level
   vtkNew<vtkSlicerSRepLogic> m_srepLogic;
   double m_L0Weight;
   double m_L1Weight;
   double m_L2Weight;
-  int m_iteration;
+  std::atomic<int> m_iteration;
   int m_totalProgressIterations;
   ProgressCallbackFunction m_progressCallback;
+  std::thread::id m_progressThread; // the thread Run was called from
+  CancelCallbackFunction m_cancelCallback;
+  SnapshotCallbackFunction m_snapshotCallback;
+  std::chrono::duration<double> m_snapshotInterval;
+  std::chrono::steady_clock::time_point m_lastSnapshot;
+  // best coefficients evaluated on the current pyramid level, kept so a cancelled level still has a result
+  std::mutex m_bestMutex;
+  std::vector<double> m_bestUpCoeff;
+  std::vector<double> m_bestDownCoeff;
+  double m_bestUpValue;
+  double m_bestDownValue;
+  // each stage's budget covers all of its pyramid levels
+  sreprefinement::StageBudget m_upBudget;
+  sreprefinement::StageBudget m_downBudget;
+  sreprefinement::StageBudget m_crestBudget;
+  sreprefinement::RefinementStatus m_status;
+  SpokesProgress m_upProgress;
+  SpokesProgress m_downProgress;
+  std::string m_checkpointFileName;
+  std::chrono::duration<double> m_checkpointInterval;
+  uint64_t m_checkpointKey;
+  std::mutex m_checkpointMutex;
+  std::chrono::steady_clock::time_point m_lastCheckpoint;
+  // coefficients that refine m_inputSRep to the srep the current pyramid level started from
+  std::vector<double> m_levelUpCoeff;
+  std::vector<double> m_levelDownCoeff;
+  std::unique_ptr<sreprefinement::RefinementCheckpoint> m_resume; // the checkpoint Run resumes from
 
   //---------------------------------------------------------------------------
-  void IncrementIteration() {
-    ++m_iteration;
+  // returns the new iteration
+  int IncrementIteration() {
+    const int iteration = ++m_iteration;
     ReportProgress();
+    return iteration;
   }
 
   //---------------------------------------------------------------------------
-  void ReportProgress() {
-    if (m_progressCallback) {
-      // we go through max iterations 3 times (up, down, crest)
-      m_progressCallback(static_cast<double>(m_iteration) / m_totalProgressIterations);
+  bool IsCancelRequested() const {
+    return m_cancelCallback && m_cancelCallback();
+  }
+
+  //---------------------------------------------------------------------------
+  // Starts tracking the best coefficients from the current initial coefficients
+  void ResetBestCoefficients() {
+    std::lock_guard<std::mutex> lock(m_bestMutex);
+    m_bestUpCoeff = m_flattenedUpCoeff;
+    m_bestDownCoeff = m_flattenedDownCoeff;
+    m_bestUpValue = std::numeric_limits<double>::infinity();
+    m_bestDownValue = std::numeric_limits<double>::infinity();
+  }
+
+  //---------------------------------------------------------------------------
+  void UpdateBestCoefficients(const double* coeff, double value, SpokeType spokeType) {
+    std::lock_guard<std::mutex> lock(m_bestMutex);
+    auto& bestValue = spokeType == SpokeType::UpOrientation ? m_bestUpValue : m_bestDownValue;
+    if (value < bestValue) {
+      auto& bestCoeff = spokeType == SpokeType::UpOrientation ? m_bestUpCoeff : m_bestDownCoeff;
+      std::copy(coeff, coeff + bestCoeff.size(), bestCoeff.begin());
+      bestValue = value;
     }
   }
 
   //---------------------------------------------------------------------------
-  void RefineSpokes(SpokeType spokeType) {
-    if (spokeType == SpokeType::CrestOrientation) {
-      RefineCrestSpokes();
-    } else {
-      RefineUpDownSpokes(spokeType);
+  // Updates m_srep with the best coefficients of the current pyramid level
+  void ApplyBestCoefficients() {
+    {
+      std::lock_guard<std::mutex> lock(m_bestMutex);
+      m_flattenedUpCoeff = m_bestUpCoeff;
+      m_flattenedDownCoeff = m_bestDownCoeff;
     }
+    this->ApplyUpDownSpokes(SpokeType::UpOrientation);
+    this->ApplyUpDownSpokes(SpokeType::DownOrientation);
   }
 
   //---------------------------------------------------------------------------
-  void OptimizeCrestSpokeLengths(const double stepSize, const size_t maxIter) {
-    constexpr double epsilon = 1e-5;
-    vtkNew<vtkImplicitPolyDataDistance> implicitPolyDataDistance;
-    implicitPolyDataDistance->SetInput(m_polyData);
+  // Sends m_srep refined by the best coefficients so far if the snapshot interval has passed
+  void SendSnapshotIfDue() {
+    // the callback may update the GUI, so only call it from the thread that called Run
+    if (!m_snapshotCallback || std::this_thread::get_id() != m_progressThread) {
+      return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    if (now - m_lastSnapshot < m_snapshotInterval) {
+      return;
+    }
+    m_lastSnapshot = now;
 
-    vtkEllipticalSRep::ModifiedBlocker blocker(m_srep);
+    std::vector<double> upCoeff;
+    std::vector<double> downCoeff;
+    {
+      std::lock_guard<std::mutex> lock(m_bestMutex);
+      upCoeff = m_bestUpCoeff;
+      downCoeff = m_bestDownCoeff;
+    }
+    // m_srep is only read while optimizing, so this is safe to do alongside the other optimization
+    auto snapshot = this->Refine(*m_srep, upCoeff.data(), SpokeType::UpOrientation);
+    m_snapshotCallback(this->Refine(*snapshot, downCoeff.data(), SpokeType::DownOrientation));
+  }
+
+  //---------------------------------------------------------------------------
+  SpokesProgress& GetSpokesProgress(SpokeType spokeType) {
+    return spokeType == SpokeType::UpOrientation ? m_upProgress : m_downProgress;
+  }
+
+  //---------------------------------------------------------------------------
+  // Gets the coefficients that refine m_inputSRep to m_srep
+  std::vector<double> ComputeInputCoefficients(SpokeType spokeType) const {
+    std::vector<double> coeff;
+    coeff.reserve(m_srep->GetNumberOfLines() * m_srep->GetNumberOfSteps() * 4);
     for (IndexType l = 0; l < m_srep->GetNumberOfLines(); ++l) {
       for (IndexType s = 0; s < m_srep->GetNumberOfSteps(); ++s) {
-        auto* skeletalPoint = m_srep->GetSkeletalPoint(l, s);
-        if (skeletalPoint->IsCrest()) {
-          IncrementIteration();
-          // get spoke by reference so we can update
-          auto& spoke = *skeletalPoint->GetCrestSpoke();
-          double dist = implicitPolyDataDistance->FunctionValue(spoke.GetBoundaryPoint().AsArray().data());
-          double oldDist = dist;
-          double thisStepSize = stepSize;
-          for (size_t i = 0; i < maxIter; ++i) {
-            if (abs(dist) <= epsilon) {
-              break;
-            }
+        const auto& spoke = *m_srep->GetSkeletalPoint(l, s)->GetSpoke(spokeType);
+        const double inputRadius = m_inputSRep->GetSkeletalPoint(l, s)->GetSpoke(spokeType)->GetRadius();
+        const auto unitDir = spoke.GetDirection().Unit();
+        coeff.push_back(unitDir[0]);
+        coeff.push_back(unitDir[1]);
+        coeff.push_back(unitDir[2]);
+        // Refine scales the radius, so a zero radius stays zero
+        coeff.push_back(inputRadius > 0 && spoke.GetRadius() > 0 ? std::log(spoke.GetRadius() / inputRadius) : 0.0);
+      }
+    }
+    return coeff;
+  }
 
-            if (dist > 0) {
-              // if spoke is too long, shorten it
-              spoke.SetRadius(spoke.GetRadius() - thisStepSize);
-            } else {
-              // if spoke is too short, make it larger
-              spoke.SetRadius(spoke.GetRadius() + thisStepSize);
-            }
+  //---------------------------------------------------------------------------
+  // Sets m_resume to the checkpoint in m_checkpointFileName if there is one for this refinement
+  void ReadCheckpoint() {
+    if (m_checkpointFileName.empty()) {
+      return;
+    }
+    std::unique_ptr<sreprefinement::RefinementCheckpoint> checkpoint(new sreprefinement::RefinementCheckpoint());
+    if (!sreprefinement::ReadRefinementCheckpoint(m_checkpointFileName, *checkpoint)) {
+      // most likely there is no checkpoint yet
+      return;
+    }
+    if (checkpoint->key != m_checkpointKey
+      || checkpoint->level >= m_numLevels
+      || checkpoint->levelUpCoefficients.size() != m_flattenedUpCoeff.size())
+    {
+      vtkGenericWarningMacro("Ignoring SRep refinement checkpoint " << m_checkpointFileName
+        << " because it is from a different refinement");
+      return;
+    }
+    vtkGenericWarningMacro("Resuming SRep refinement from checkpoint " << m_checkpointFileName);
+    m_resume = std::move(checkpoint);
+  }
 
-            dist = implicitPolyDataDistance->FunctionValue(spoke.GetBoundaryPoint().AsArray().data());
-            if (oldDist * dist < 0) {
-              // changed from outside to inside (or vice versa), decay step size
-              thisStepSize /= 10;
-            }
-            oldDist = dist;
-          }
-        }
+  //---------------------------------------------------------------------------
+  // Restores the state of the current pyramid level from a checkpoint
+  void ResumeLevel(const sreprefinement::RefinementCheckpoint& checkpoint) {
+    // m_srep is still the input, so this rebuilds the srep the level started from
+    m_flattenedUpCoeff = checkpoint.levelUpCoefficients;
+    m_flattenedDownCoeff = checkpoint.levelDownCoefficients;
+    this->ApplyUpDownSpokes(SpokeType::UpOrientation);
+    this->ApplyUpDownSpokes(SpokeType::DownOrientation);
+    m_levelUpCoeff = checkpoint.levelUpCoefficients;
+    m_levelDownCoeff = checkpoint.levelDownCoefficients;
+
+    m_flattenedUpCoeff = checkpoint.up.coefficients;
+    m_flattenedDownCoeff = checkpoint.down.coefficients;
+    this->ResetBestCoefficients();
+    for (const auto spokeType : {SpokeType::UpOrientation, SpokeType::DownOrientation}) {
+      const auto& spokes = spokeType == SpokeType::UpOrientation ? checkpoint.up : checkpoint.down;
+      auto& progress = this->GetSpokesProgress(spokeType);
+      progress.evaluations = spokes.evaluations;
+      progress.regionSize = spokes.regionSize;
+      progress.sweep = spokes.sweep;
+      progress.sweepEvaluations = spokes.sweepEvaluations;
+      progress.finished = spokes.finished;
+    }
+    m_iteration = checkpoint.iteration;
+  }
+
+  //---------------------------------------------------------------------------
+  // Writes the state of the current pyramid level to m_checkpointFileName.
+  // If onlyIfDue, it is only written if the checkpoint interval has passed and no other thread is writing one.
+  // Safe to call from any thread while optimizing, so checkpoints are still written while only the down
+  // spokes are being optimized on their own thread.
+  void WriteCheckpoint(bool onlyIfDue) {
+    if (m_checkpointFileName.empty()) {
+      return;
+    }
+    std::unique_lock<std::mutex> lock(m_checkpointMutex, std::defer_lock);
+    if (onlyIfDue) {
+      if (!lock.try_lock() || std::chrono::steady_clock::now() - m_lastCheckpoint < m_checkpointInterval) {
+        return;
       }
+    } else {
+      lock.lock();
+    }
+    m_lastCheckpoint = std::chrono::steady_clock::now();
+
+    sreprefinement::RefinementCheckpoint checkpoint;
+    checkpoint.key = m_checkpointKey;
+    checkpoint.level = m_level;
+    checkpoint.iteration = m_iteration;
+    checkpoint.levelUpCoefficients = m_levelUpCoeff;
+    checkpoint.levelDownCoefficients = m_levelDownCoeff;
+    {
+      std::lock_guard<std::mutex> bestLock(m_bestMutex);
+      checkpoint.up.coefficients = m_bestUpCoeff;
+      checkpoint.down.coefficients = m_bestDownCoeff;
+      checkpoint.up.finished = m_upProgress.finished;
+      checkpoint.down.finished = m_downProgress.finished;
+    }
+    checkpoint.up.regionSize = m_upProgress.regionSize;
+    checkpoint.up.evaluations = m_upProgress.evaluations;
+    checkpoint.up.sweep = m_upProgress.sweep;
+    checkpoint.up.sweepEvaluations = m_upProgress.sweepEvaluations;
+    checkpoint.down.regionSize = m_downProgress.regionSize;
+    checkpoint.down.evaluations = m_downProgress.evaluations;
+    checkpoint.down.sweep = m_downProgress.sweep;
+    checkpoint.down.sweepEvaluations = m_downProgress.sweepEvaluations;
+    checkpoint.stage = !checkpoint.up.finished
+      ? sreprefinement::RefinementCheckpoint::Stage::Up
+      : !checkpoint.down.finished
+        ? sreprefinement::RefinementCheckpoint::Stage::Down
+        : sreprefinement::RefinementCheckpoint::Stage::Crest;
+
+    if (!sreprefinement::WriteRefinementCheckpoint(m_checkpointFileName, checkpoint)) {
+      vtkGenericWarningMacro("Unable to write the SRep refinement checkpoint " << m_checkpointFileName);
     }
   }
 
   //---------------------------------------------------------------------------
-  void RefineCrestSpokes() {
+  // Gets the progress iterations reached once the up and down spokes of every level before level are done
+  int GetLevelProgressIteration(size_t level) const {
+    return 2 * std::accumulate(m_stageIterations.begin(), m_stageIterations.begin() + level, 0);
+  }
+
+  //---------------------------------------------------------------------------
+  void ReportProgress() {
+    // the callback may update the GUI, so only call it from the thread that called Run
+    if (m_progressCallback && std::this_thread::get_id() == m_progressThread) {
+      // we go through each level's iterations twice (up, down) and then the crest.
+      // Patch optimizations can evaluate more often than that, so don't report past the end.
+      m_progressCallback(std::min(1.0, static_cast<double>(m_iteration) / m_totalProgressIterations));
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  // Computes the refined crest spokes of one line without changing m_srep, so lines can be refined in parallel.
+  void ComputeCrestSpokeUpdates(
+    IndexType line,
+    const sreprefinement::DistanceSampler& distanceSampler,
+    vtkStaticPointLocator& locator,
+    const sreprefinement::PrincipalCurvatures& curvatures,
+    std::vector<CrestSpokeUpdate>& updates)
+  {
+    constexpr double epsilon = 1e-5;
     // it makes no real sense to have the initial region size for min_newuoa (not used here) be the step size for
     // this optimization, but it was how it was before.
-    OptimizeCrestSpokeLengths(m_initialRegionSize, m_maxIterations);
+    const double stepSize = m_initialRegionSize;
+    const auto maxIter = static_cast<size_t>(m_maxIterations);
 
-    vtkNew<vtkCurvatures> curvaturesFilter;
-    curvaturesFilter->SetInputData(m_polyData);
-    curvaturesFilter->SetCurvatureTypeToMaximum();
-    curvaturesFilter->Update();
-
-    vtkSmartPointer<vtkDoubleArray> maxC =
-      vtkDoubleArray::SafeDownCast(curvaturesFilter->GetOutput()->GetPointData()->GetArray("Maximum_Curvature"));
+    for (IndexType s = 0; s < m_srep->GetNumberOfSteps(); ++s) {
+      const auto* skeletalPoint = m_srep->GetSkeletalPoint(line, s);
+      if (!skeletalPoint->IsCrest()) {
+        continue;
+      }
+      IncrementIteration();
+      const auto& spoke = *skeletalPoint->GetCrestSpoke();
+      CrestSpokeUpdate update{line, s, spoke.GetSkeletalPoint(), spoke.GetDirection()};
+      const auto distanceToBoundary = [&]() {
+        if (!m_crestBudget.Spend()) {
+          throw BudgetExhausted();
+        }
+        double distance = 0.0;
+        distanceSampler.Sample(1, (update.skeletalPoint + update.direction).AsArray().data(), &distance, nullptr);
+        return distance;
+      };
+
+      // 1. optimize the spoke length
+      double dist = distanceToBoundary();
+      double oldDist = dist;
+      double thisStepSize = stepSize;
+      for (size_t i = 0; i < maxIter; ++i) {
+        if (abs(dist) <= epsilon) {
+          break;
+        }
 
-    if(!maxC) {
-      throw std::runtime_error("Error getting max curvature");
-    }
+        if (dist > 0) {
+          // if spoke is too long, shorten it
+          update.direction.Resize(update.direction.GetLength() - thisStepSize);
+        } else {
+          // if spoke is too short, make it larger
+          update.direction.Resize(update.direction.GetLength() + thisStepSize);
+        }
 
-    curvaturesFilter->SetCurvatureTypeToMinimum();
-    curvaturesFilter->Update();
+        dist = distanceToBoundary();
+        if (oldDist * dist < 0) {
+          // changed from outside to inside (or vice versa), decay step size
+          thisStepSize /= 10;
+        }
+        oldDist = dist;
+      }
 
-    vtkSmartPointer<vtkDoubleArray> minC =
-        vtkDoubleArray::SafeDownCast(curvaturesFilter->GetOutput()->GetPointData()->GetArray("Minimum_Curvature"));
-    if(!minC) {
-      throw std::runtime_error("Error getting min curvature");
+      // 2. shorten the spoke to the radius of curvature of the boundary, moving the skeletal point outward
+      IncrementIteration();
+      const vtkIdType idNearest = locator.FindClosestPoint((update.skeletalPoint + update.direction).AsArray().data());
+      const double curMax = curvatures.maximum[idNearest];
+      const double curMin = curvatures.minimum[idNearest];
+      const double rCrest = 1 / (max(abs(curMax), abs(curMin)));
+      const double rDiff = update.direction.GetLength() - rCrest;
+      if (rDiff > 0) {
+        // move skeletal point of this crest outward by rDiff
+        update.skeletalPoint = update.skeletalPoint + update.direction.Unit() * rDiff;
+        update.direction.Resize(rCrest);
+      }
+      updates.push_back(update);
     }
+  }
+
+  //---------------------------------------------------------------------------
+  void RefineCrestSpokes() {
+    // the mesh is only read from here on, so every thread shares its exact distance and curvatures
+    const auto mesh = GetTriangleMesh(m_polyData);
+    const auto curvatures = sreprefinement::ComputePrincipalCurvatures(mesh.points, mesh.triangles);
+    const sreprefinement::MeshDistanceSampler distanceSampler(mesh.points, mesh.triangles, 1.0);
 
-    vtkNew<vtkPointLocator> locator;
+    // vtkStaticPointLocator can be queried from many threads once built
+    vtkNew<vtkStaticPointLocator> locator;
     locator->SetDataSet(m_polyData);
     locator->BuildLocator();
 
-    for (IndexType l = 0; l < m_srep->GetNumberOfLines(); ++l) {
-      for (IndexType s = 0; s < m_srep->GetNumberOfSteps(); ++s) {
-        auto* skeletalPoint = m_srep->GetSkeletalPoint(l, s);
-        if (skeletalPoint->IsCrest()) {
-          IncrementIteration();
-          auto& spoke = *skeletalPoint->GetCrestSpoke();
-          const vtkIdType idNearest = locator->FindClosestPoint(spoke.GetBoundaryPoint().AsArray().data());
-          const double curMax = maxC->GetValue(idNearest);
-          const double curMin = minC->GetValue(idNearest);
-          const double rCrest = 1 / (max(abs(curMax), abs(curMin)));
-          const double rDiff = spoke.GetRadius() - rCrest;
-          if (rDiff <= 0) {
-            continue;
-          }
+    // crest spokes are independent of each other, so compute them in parallel and only update m_srep after
+    const auto numLines = m_srep->GetNumberOfLines();
+    std::vector<std::vector<CrestSpokeUpdate>> updates(numLines);
+    CrestSpokeFunctor functor(*this, distanceSampler, locator, curvatures, updates);
+    vtkSMPTools::For(0, numLines, functor);
+
+    vtkEllipticalSRep::ModifiedBlocker blocker(m_srep);
+    for (const auto& lineUpdates : updates) {
+      for (const auto& update : lineUpdates) {
+        auto& spoke = *m_srep->GetSkeletalPoint(update.line, update.step)->GetCrestSpoke();
+        spoke.SetSkeletalPoint(update.skeletalPoint);
+        spoke.SetDirectionAndMagnitude(update.direction);
+      }
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  sreprefinement::StageBudget& GetBudget(SpokeType spokeType) {
+    return spokeType == SpokeType::UpOrientation ? m_upBudget : m_downBudget;
+  }
+
+  //---------------------------------------------------------------------------
+  // Gets the threads the optimization of one spoke orientation may use. The up and down spokes split
+  // m_orientationThreads when they are optimized at the same time.
+  size_t GetOrientationThreads() const {
+    return sreprefinement::SplitThreads(m_orientationThreads, m_concurrentUpDown ? 2 : 1);
+  }
+
+  //---------------------------------------------------------------------------
+  std::vector<double>& GetCoefficients(SpokeType spokeType) {
+    return spokeType == SpokeType::UpOrientation ? m_flattenedUpCoeff : m_flattenedDownCoeff;
+  }
+
+  //---------------------------------------------------------------------------
+  // Optimizes the coefficients for the "spokeType" spokes without changing m_srep.
+  // Safe to call for the up and down spokes at the same time.
+  void OptimizeUpDownSpokes(SpokeType spokeType, double initialRegionSize, double finalRegionSize) {
+    const auto& budget = this->GetBudget(spokeType);
+    auto& progress = this->GetSpokesProgress(spokeType);
+    // a stage that ran out on a coarser level keeps where it stopped, and spokes resumed from a checkpoint
+    // written after they finished the level are done
+    if (!budget.IsExhausted() && !progress.finished) {
+      if (m_patchSize > 0) {
+        // each sweep sets its own trust region, and a resumed one restarts the sweep its checkpoint was in
+        this->OptimizeUpDownSpokesByPatch(spokeType, initialRegionSize, finalRegionSize, m_levelIterations[m_level]);
+      } else {
+        // a resumed optimization restarts from the trust region and evaluations its checkpoint had reached.
+        // The starts share the evaluations, so each gets an equal part of what is left.
+        const double regionSize = std::max(finalRegionSize, std::min<double>(initialRegionSize, progress.regionSize));
+        const int maxIterations =
+          std::max(1, m_levelIterations[m_level] - progress.evaluations / static_cast<int>(m_numStarts));
+        this->OptimizeAllUpDownSpokes(spokeType, regionSize, finalRegionSize, maxIterations);
+      }
+    }
+    {
+      // checkpoints written from now on resume from the finished coefficients
+      std::lock_guard<std::mutex> lock(m_bestMutex);
+      auto& bestCoeff = spokeType == SpokeType::UpOrientation ? m_bestUpCoeff : m_bestDownCoeff;
+      bestCoeff = GetCoefficients(spokeType);
+      progress.finished = true;
+    }
+    if (m_level == m_numLevels - 1) {
+      auto& stopReason = spokeType == SpokeType::UpOrientation ? m_status.up : m_status.down;
+      stopReason = budget.GetStopReason();
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  // Optimizes all of the coefficients for the "spokeType" spokes at once without changing m_srep.
+  // With more than one start, the starts are optimized in parallel and the best of them is kept.
+  void OptimizeAllUpDownSpokes(SpokeType spokeType, double initialRegionSize, double finalRegionSize, int maxIterations) {
+    auto& coeff = GetCoefficients(spokeType);
+    if (m_numStarts == 1) {
+      auto objective = this->CreateObjective(spokeType);
+      try {
+        this->MinimizeUpDownSpokes(coeff, *objective, spokeType, initialRegionSize, finalRegionSize, maxIterations, true);
+      } catch (const BudgetExhausted&) {
+        // the optimizer was stopped partway, so its coefficients are not necessarily the best it evaluated
+        std::lock_guard<std::mutex> lock(m_bestMutex);
+        coeff = spokeType == SpokeType::UpOrientation ? m_bestUpCoeff : m_bestDownCoeff;
+      }
+      return;
+    }
 
-          // move skeletal point of this crest outward by rDiff
-          const auto unitDir = spoke.GetDirection().Unit();
-          const auto skeletalPoint = spoke.GetSkeletalPoint();
-          spoke.SetSkeletalPoint(srep::Point3d(
-            spoke.GetSkeletalPoint()[0] + unitDir[0] * rDiff,
-            spoke.GetSkeletalPoint()[1] + unitDir[1] * rDiff,
-            spoke.GetSkeletalPoint()[2] + unitDir[2] * rDiff));
-          spoke.SetRadius(rCrest);
+    // the up and down spokes are jittered differently
+    const auto seed = m_startSeed + (spokeType == SpokeType::UpOrientation ? 0 : m_numStarts);
+    const auto starts = sreprefinement::CreateRefinementStarts(
+      coeff, initialRegionSize, finalRegionSize, m_numStarts, m_startJitter, m_startRegionScale, seed);
+    const auto results = sreprefinement::RunBatch(starts.size(), this->GetOrientationThreads(),
+      [&](size_t i) {
+        // an objective caches its last evaluation, so every start needs its own
+        auto objective = this->CreateObjective(spokeType);
+        auto x = starts[i].coefficients;
+        // checkpoints resume all of the starts from the trust region of the unjittered one
+        this->MinimizeUpDownSpokes(x, *objective, spokeType, starts[i].regionSize, finalRegionSize, maxIterations, i == 0);
+      },
+      [&](size_t) {
+        // the other workers can't report, since only the thread that called Run may
+        this->ReportProgress();
+        this->SendSnapshotIfDue();
+      },
+      // the thread that called Run optimizes starts too, so it reports while they run
+      true);
+
+    for (const auto& result : results) {
+      if (!result.succeeded) {
+        if (this->IsCancelRequested()) {
+          throw RefinementCancelled();
+        }
+        // a start stopped by the budget already left its evaluations in the best coefficients
+        if (!this->GetBudget(spokeType).IsExhausted()) {
+          throw std::runtime_error("Error optimizing from refinement start: " + result.errorMessage);
         }
       }
     }
+
+    // every start updates the same best coefficients, so they are the lowest objective of any start
+    std::lock_guard<std::mutex> lock(m_bestMutex);
+    coeff = spokeType == SpokeType::UpOrientation ? m_bestUpCoeff : m_bestDownCoeff;
+  }
+
+  //---------------------------------------------------------------------------
+  // Runs the optimizer on "x", the coefficients for the "spokeType" spokes, starting with the given
+  // trust region. If recordRegionSize, the trust region is recorded in the spokes' progress for checkpoints.
+  void MinimizeUpDownSpokes(std::vector<double>& x,
+                            sreprefinement::RefinementObjective& objective,
+                            SpokeType spokeType,
+                            double initialRegionSize,
+                            double finalRegionSize,
+                            int maxIterations,
+                            bool recordRegionSize)
+  {
+    if (m_optimizer == vtkSlicerSRepRefinementLogic::OptimizerLBFGS) {
+      sreprefinement::LBFGSSettings settings;
+      settings.maxEvaluations = static_cast<size_t>(maxIterations);
+      settings.maxStepLength = initialRegionSize;
+      settings.minStepLength = finalRegionSize;
+      sreprefinement::MinimizeLBFGS(x.size(), x.data(),
+        [&](const double* coeff, double* gradient) {
+          return this->EvaluateObjectiveFunction(coeff, gradient, objective, spokeType);
+        },
+        settings);
+    } else {
+      MinNewouaHelper helper(*this, objective, spokeType);
+      auto& progress = this->GetSpokesProgress(spokeType);
+      auto onRegionSize = [&progress, recordRegionSize](double rho) {
+        if (recordRegionSize) {
+          progress.regionSize = rho;
+        }
+      };
+      min_newuoa(static_cast<int>(x.size()), x.data(), helper, initialRegionSize, finalRegionSize, maxIterations, onRegionSize);
+    }
   }
 
   //---------------------------------------------------------------------------
-  void RefineUpDownSpokes(SpokeType spokeType) {
-    m_currentCoeff = spokeType == SpokeType::UpOrientation ? &m_flattenedUpCoeff : &m_flattenedDownCoeff;
-    MinNewouaHelper helper(*this, spokeType);
-    min_newuoa(static_cast<int>(m_currentCoeff->size()), m_currentCoeff->data(), helper, m_initialRegionSize, m_finalRegionSize, m_maxIterations);
+  // Optimizes the coefficients for the "spokeType" spokes one patch of spokes at a time, holding the other
+  // spokes fixed, without changing m_srep. Patches of the same color share no term of the objective, so
+  // they are optimized in parallel from the same coefficients and their results combined after.
+  // Each patch gets up to maxIterations evaluations. A resumed refinement restarts the sweep its checkpoint
+  // was in, and the patches of that sweep share what its evaluations left.
+  void OptimizeUpDownSpokesByPatch(SpokeType spokeType, double initialRegionSize, double finalRegionSize, int maxIterations) {
+    auto& coeff = GetCoefficients(spokeType);
+    auto& progress = this->GetSpokesProgress(spokeType);
+    const auto numLines = static_cast<size_t>(m_srep->GetNumberOfLines());
+    const auto numSteps = static_cast<size_t>(m_srep->GetNumberOfSteps());
+    const auto colors = sreprefinement::CreateSpokePatches(numLines, numSteps, m_patchSize, m_patchOverlap);
+    size_t numPatches = 0;
+    for (const auto& patches : colors) {
+      numPatches += patches.size();
+    }
 
+    // an objective caches its last evaluation, so every running patch needs its own
+    using ObjectivePointer = std::unique_ptr<sreprefinement::RefinementObjective>;
+    std::mutex objectivesMutex;
+    std::vector<ObjectivePointer> objectives;
+    const auto acquireObjective = [&]() {
+      {
+        std::lock_guard<std::mutex> lock(objectivesMutex);
+        if (!objectives.empty()) {
+          auto objective = std::move(objectives.back());
+          objectives.pop_back();
+          return objective;
+        }
+      }
+      return this->CreateObjective(spokeType);
+    };
+    const auto releaseObjective = [&](ObjectivePointer objective) {
+      std::lock_guard<std::mutex> lock(objectivesMutex);
+      objectives.push_back(std::move(objective));
+    };
+
+    const auto firstSweep = static_cast<size_t>(progress.sweep);
+    for (size_t sweep = firstSweep; sweep < m_maxPatchSweeps; ++sweep) {
+      const auto sweepStart = coeff;
+      const double sweepRegionSize = std::max(finalRegionSize, initialRegionSize / Pow(2, sweep));
+      const int patchIterations = sweep == firstSweep
+        ? std::max(1, maxIterations - progress.sweepEvaluations / static_cast<int>(std::max<size_t>(1, numPatches)))
+        : maxIterations;
+      progress.regionSize = sweepRegionSize;
+      if (sweep != firstSweep) {
+        progress.sweep = static_cast<int>(sweep);
+        progress.sweepEvaluations = 0;
+      }
+      for (const auto& patches : colors) {
+        // the patches all start from colorStart while coeff gets their results
+        const auto colorStart = coeff;
+        std::vector<std::vector<double>> patchCoeffs(patches.size());
+        const auto results = sreprefinement::RunBatch(patches.size(), this->GetOrientationThreads(),
+          [&](size_t p) {
+            const auto spokes = sreprefinement::GetSpokePatchIndices(patches[p], numLines, numSteps);
+            auto objective = acquireObjective();
+            auto allCoeff = colorStart;
+            auto& x = patchCoeffs[p];
+            x.resize(4 * spokes.size());
+            for (size_t i = 0; i < spokes.size(); ++i) {
+              std::copy_n(allCoeff.begin() + 4 * spokes[i], 4, x.begin() + 4 * i);
+            }
+            auto evaluatePatch = [&](double* patchCoeff) {
+              for (size_t i = 0; i < spokes.size(); ++i) {
+                std::copy_n(patchCoeff + 4 * i, 4, allCoeff.begin() + 4 * spokes[i]);
+              }
+              return this->EvaluateObjectiveFunction(allCoeff.data(), nullptr, *objective, spokeType);
+            };
+            min_newuoa(static_cast<int>(x.size()), x.data(), evaluatePatch, sweepRegionSize, finalRegionSize, patchIterations);
+            releaseObjective(std::move(objective));
+          },
+          [&](size_t p) {
+            const auto spokes = sreprefinement::GetSpokePatchIndices(patches[p], numLines, numSteps);
+            for (size_t i = 0; i < spokes.size(); ++i) {
+              std::copy_n(patchCoeffs[p].begin() + 4 * i, 4, coeff.begin() + 4 * spokes[i]);
+            }
+            // the other workers can't report, since only the thread that called Run may
+            this->ReportProgress();
+            this->SendSnapshotIfDue();
+          },
+          // the thread that called Run optimizes patches too, so it reports while they run
+          true);
+
+        for (const auto& result : results) {
+          if (!result.succeeded) {
+            // a cancelled evaluation or a used up budget are the only expected ways for a patch to fail
+            if (this->IsCancelRequested()) {
+              throw RefinementCancelled();
+            }
+            // patches of a color are independent, so the ones that finished are kept
+            if (this->GetBudget(spokeType).IsExhausted()) {
+              return;
+            }
+            throw std::runtime_error("Error optimizing spoke patch: " + result.errorMessage);
+          }
+        }
+      }
+
+      // no patch evaluated all of the sweep's results together, so this also keeps them as the best coefficients
+      try {
+        this->EvaluateObjectiveFunction(coeff.data(), nullptr, *acquireObjective(), spokeType);
+      } catch (const BudgetExhausted&) {
+        return;
+      }
+
+      double maxChange = 0.0;
+      for (size_t i = 0; i < coeff.size(); ++i) {
+        maxChange = std::max(maxChange, std::abs(coeff[i] - sweepStart[i]));
+      }
+      if (maxChange <= finalRegionSize) {
+        break;
+      }
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  // Updates the "spokeType" spokes of m_srep from the optimized coefficients
+  void ApplyUpDownSpokes(SpokeType spokeType) {
     // note: only the "spokeType" spokes are refined
-    auto refinedSRep = this->Refine(*m_srep, m_currentCoeff->data(), spokeType);
+    auto refinedSRep = this->Refine(*m_srep, GetCoefficients(spokeType).data(), spokeType);
 
     if (m_srep->GetNumberOfLines() != refinedSRep->GetNumberOfLines()) {
       throw std::runtime_error("Error: expected equal number of lines "
@@ -585,8 +1697,8 @@ private:
   }
 
   //---------------------------------------------------------------------------
-  // this temporary srep is constructed to compute the cost function value
-  // The original srep should not be changed by each iteration
+  // Returns a copy of srep with the "spokeType" spokes refined by coeff.
+  // The objective applies the same refinement to the spoke directions in RefinementObjective::Evaluate
   vtkSmartPointer<vtkEllipticalSRep> Refine(vtkEllipticalSRep& srep, double* coeff, SpokeType spokeType) {
     constexpr double tolerance = 1e-13;
 
@@ -620,182 +1732,33 @@ private:
   }
 
   //---------------------------------------------------------------------------
-  std::pair<double, double> ComputeDistanceSquaredAndNormalToImage(const vtkEllipticalSRep& srep, SpokeType spokeType) {
-    double totalDistSquared = 0.0;
-    double totalNormalPenalty = 0.0;
-
-    for (IndexType l = 0; l < srep.GetNumberOfLines(); ++l) {
-      for (IndexType s = 0; s < srep.GetNumberOfSteps(); ++s) {
-        const auto& spoke = *(srep.GetSkeletalPoint(l, s)->GetSpoke(spokeType));
-        const auto boundaryPoint = spoke.GetBoundaryPoint();
-
-        // transform boundary to image coordinate system
-        const double boundaryArray[4] = {boundaryPoint[0], boundaryPoint[1], boundaryPoint[2], 1};
-        double transformedBoundaryArray[4];
-        m_srepToImageCoordsTransform->MultiplyPoint(boundaryArray, transformedBoundaryArray);
-
-        //convert image coordinate system of [0,1] to index into image
-
-        const long maxIndex = std::lround(1 / m_voxelSpacing) - 1;
-
-        const long x = Clamp(std::lround(transformedBoundaryArray[0] / m_voxelSpacing), 0, maxIndex);
-        const long y = Clamp(std::lround(transformedBoundaryArray[1] / m_voxelSpacing), 0, maxIndex);
-        const long z = Clamp(std::lround(transformedBoundaryArray[2] / m_voxelSpacing), 0, maxIndex);
-
-        RealImage::IndexType pixelIndex = {{x,y,z}};
-        const float dist = std::get<0>(m_sdfAndGradient)->GetPixel(pixelIndex);
-        const double distSquared = static_cast<double>(dist) * dist;
-
-        VectorImage::IndexType indexGrad;
-        indexGrad[0] = x;
-        indexGrad[1] = y;
-        indexGrad[2] = z;
-
-        VectorImage::PixelType grad = std::get<1>(m_sdfAndGradient)->GetPixel(indexGrad);
-        double normalVector[3];
-        normalVector[0] = static_cast<double>(grad[0]);
-        normalVector[1] = static_cast<double>(grad[1]);
-        normalVector[2] = static_cast<double>(grad[2]);
-        // normalize the normal vector
-        vtkMath::Normalize(normalVector);
-
-        const auto spokeDirection = spoke.GetDirection().Unit().AsArray();
-        const double dotProduct = vtkMath::Dot(normalVector, spokeDirection.data());
-
-        // The normal match (aka 1-dotProduct) (between [0,1]) is scaled by the distance so that the overall term is comparable
-        totalDistSquared += distSquared;
-        totalNormalPenalty += distSquared * (1 - dotProduct);
-      }
-    }
-    return std::make_pair(totalDistSquared, totalNormalPenalty);
-  }
-
-  //---------------------------------------------------------------------------
-  void ComputeRSradDerivatives(
-    const vtkEllipticalSRep& interpolatedSRep,
-    SpokeType spokeType,
-    IndexType line,
-    IndexType step,
-    srep::Vector3d& dxdu,
-    srep::Vector3d& dSdu,
-    double& drdu,
-    srep::Vector3d& dxdv,
-    srep::Vector3d& dSdv,
-    double& drdv)
-  {
-    const auto density = Pow(2, m_interpolationLevel);
-    const auto stepSize = 1.0 / density;
-    const auto numLines = interpolatedSRep.GetNumberOfLines();
-    const auto numSteps = interpolatedSRep.GetNumberOfSteps();
-
-    // U direction
-    {
-      const auto prevLine = (numLines + line - 1) % numLines;
-      const auto nextLine = (numLines + line + 1) % numLines;
-
-      const auto& u1 = *interpolatedSRep.GetSkeletalPoint(prevLine, step)->GetSpoke(spokeType);
-      const auto& u2 = *interpolatedSRep.GetSkeletalPoint(nextLine, step)->GetSpoke(spokeType);
-
-      drdu = (u2.GetRadius() - u1.GetRadius()) / stepSize / 2;
-      dxdu = (u2.GetDirection().Unit() - u1.GetDirection().Unit()) / stepSize / 2;
-      dSdu = (u2.GetDirection() - u1.GetDirection()) / stepSize / 2;
-    }
-
-    // V direction
-    {
-      const auto prevStep = step == 0 ? 0 : step - 1;
-      const auto nextStep = step == numSteps - 1 ? numSteps - 1 : step + 1;
-      const auto divisor = prevStep == step || nextStep == step ? 1 : 2;
-
-      const auto& v1 = *interpolatedSRep.GetSkeletalPoint(line, prevStep)->GetSpoke(spokeType);
-      const auto& v2 = *interpolatedSRep.GetSkeletalPoint(line, nextStep)->GetSpoke(spokeType);
+  // The objective for the "spokeType" spokes of m_srep on the current pyramid level
+  std::unique_ptr<sreprefinement::RefinementObjective> CreateObjective(SpokeType spokeType) {
+    const auto numLines = m_srep->GetNumberOfLines();
+    const auto numSteps = m_srep->GetNumberOfSteps();
 
-      drdv = (v2.GetRadius() - v1.GetRadius()) / stepSize / divisor;
-      dxdv = (v2.GetDirection().Unit() - v1.GetDirection().Unit()) / stepSize / divisor;
-      dSdv = (v2.GetDirection() - v1.GetDirection()) / stepSize / divisor;
+    std::vector<srep::Vector3d> directions;
+    directions.reserve(numLines * numSteps);
+    for (IndexType l = 0; l < numLines; ++l) {
+      for (IndexType s = 0; s < numSteps; ++s) {
+        directions.push_back(m_srep->GetSkeletalPoint(l, s)->GetSpoke(spokeType)->GetDirection());
+      }
     }
-  }
 
-  //---------------------------------------------------------------------------
-  // Uses the interpolated SRep and m_interpolationLevel to know which spokes are primary
-  double ComputeRSradPenalty(const vtkEllipticalSRep& interpolatedSRep, SpokeType spokeType) {
-    if (interpolatedSRep.IsEmpty()) {
-      return 0;
-    }
-
-    double penalty = 0.0;
-    const auto density = Pow(2, m_interpolationLevel);
-
-    const auto numLines = interpolatedSRep.GetNumberOfLines() / static_cast<IndexType>(density);
-    const auto numSteps = interpolatedSRep.GetNumberOfSteps() / static_cast<IndexType>(density);
-
-    srep::Vector3d dxdu;
-    srep::Vector3d dSdu;
-    double drdu;
-    srep::Vector3d dxdv;
-    srep::Vector3d dSdv;
-    double drdv;
-
-    for (IndexType i = 0; i < numLines; ++i) {
-      const auto ii = i * density;
-      for (IndexType j = 0; j < numSteps; ++j) {
-        const auto jj = j * density;
-
-        // u is line-to-line direction
-        // v is step-to-step direction
-        ComputeRSradDerivatives(interpolatedSRep, spokeType, ii, jj, dxdu, dSdu, drdu, dxdv, dSdv, drdv);
-
-        const auto U = interpolatedSRep.GetSkeletalPoint(ii, jj)->GetSpoke(spokeType)->GetDirection().Unit();
-
-        // 2. construct rSrad Matrix
-        double UTU[3][3]; // UT*U - I
-        UTU[0][0] = U[0] * U[0] - 1;
-        UTU[0][1] = U[0] * U[1];
-        UTU[0][2] = U[0] * U[2];
-        UTU[1][0] = U[1] * U[0];
-        UTU[1][1] = U[1] * U[1] -1;
-        UTU[1][2] = U[1] * U[2];
-        UTU[2][0] = U[2] * U[0];
-        UTU[2][1] = U[2] * U[1];
-        UTU[2][2] = U[2] * U[2] -1;
-
-        // Notation in Han, Qiong's dissertation
-        Eigen::MatrixXd Q(2,3);
-        Q(0,0) = dxdu[0] * UTU[0][0] + dxdu[1] * UTU[1][0] + dxdu[2] * UTU[2][0];
-        Q(0,1) = dxdu[0] * UTU[0][1] + dxdu[1] * UTU[1][1] + dxdu[2] * UTU[2][1];
-        Q(0,2) = dxdu[0] * UTU[0][2] + dxdu[1] * UTU[1][2] + dxdu[2] * UTU[2][2];
-
-        Q(1,0) = dxdv[0] * UTU[0][0] + dxdv[1] * UTU[1][0] + dxdv[2] * UTU[2][0];
-        Q(1,1) = dxdv[0] * UTU[0][1] + dxdv[1] * UTU[1][1] + dxdv[2] * UTU[2][1];
-        Q(1,2) = dxdv[0] * UTU[0][2] + dxdv[1] * UTU[1][2] + dxdv[2] * UTU[2][2];
-
-        Eigen::MatrixXd leftSide(2,3), rightSide(3, 2);
-        leftSide(0,0) = dSdu[0] - drdu * U[0];
-        leftSide(0,1) = dSdu[1] - drdu * U[1];
-        leftSide(0,2) = dSdu[2] - drdu * U[2];
-
-        leftSide(1,0) = dSdv[0] - drdv * U[0];
-        leftSide(1,1) = dSdv[1] - drdv * U[1];
-        leftSide(1,2) = dSdv[2] - drdv * U[2];
-
-        Eigen::Matrix2d QQT, QQT_inv;
-        QQT = Q * Q.transpose();
-        QQT_inv = QQT.inverse();
-
-        rightSide = Q.transpose() * QQT_inv;
-
-        Eigen::Matrix2d rSradMat;
-        rSradMat = leftSide * rightSide;
-        rSradMat.transposeInPlace();
-        // 3. compute rSrad penalty
-        Eigen::SelfAdjointEigenSolver<Eigen::Matrix2d> eigensolver(rSradMat);
-        double maxEigen = eigensolver.eigenvalues()[1];
-
-        penalty += std::max(0.0, maxEigen - 1);
+    // the skeletal points don't change during the optimization, so they only need to be interpolated once
+    const auto interpolatedSRep = m_interpolationLevel > 0
+      ? m_srepLogic->SmartInterpolateSRep(*m_srep, m_interpolationLevel)
+      : m_srep;
+    std::vector<srep::Point3d> skeletalPoints;
+    skeletalPoints.reserve(interpolatedSRep->GetNumberOfLines() * interpolatedSRep->GetNumberOfSteps());
+    for (IndexType l = 0; l < interpolatedSRep->GetNumberOfLines(); ++l) {
+      for (IndexType s = 0; s < interpolatedSRep->GetNumberOfSteps(); ++s) {
+        skeletalPoints.push_back(interpolatedSRep->GetSkeletalPoint(l, s)->GetSpoke(spokeType)->GetSkeletalPoint());
       }
     }
 
-    return penalty;
+    return std::unique_ptr<sreprefinement::RefinementObjective>(new sreprefinement::RefinementObjective(
+      numLines, numSteps, m_interpolationLevel, std::move(skeletalPoints), std::move(directions), *m_distanceSampler));
   }
 
   //---------------------------------------------------------------------------
@@ -813,30 +1776,67 @@ private:
   /// Liu, Z., Hong, J., Vicory, J., Damon, J. N., & Pizer, S. M. (2021).
   /// Fitting unbranching skeletal structures to objects.
   /// Medical Image Analysis, 70, 102020.
-  double EvaluateObjectiveFunction(double* coeff, SpokeType spokeType) {
-    // this function cannot throw because it will cause a memory leak in min_newuoa
-    try {
-      auto tempSRep = this->Refine(*m_srep, coeff, spokeType);
-      auto interpolatedTempSRep = m_srepLogic->SmartInterpolateSRep(*tempSRep, m_interpolationLevel);
-
-      const auto L0AndL1 = ComputeDistanceSquaredAndNormalToImage(*interpolatedTempSRep, spokeType);
-      const auto& distanceSquared = L0AndL1.first; // L0
-      const auto& normalPenalty = L0AndL1.second; // L1
+  ///
+  /// If gradient is not nullptr, the gradient of the objective function is written to it.
+  double EvaluateObjectiveFunction(const double* coeff, double* gradient, sreprefinement::RefinementObjective& objective, SpokeType spokeType) {
+    // stopping the optimization is the only reason to throw out of the optimizer, either by a cancel or a budget
+    if (this->IsCancelRequested()) {
+      throw RefinementCancelled();
+    }
+    if (!this->GetBudget(spokeType).Spend()) {
+      throw BudgetExhausted();
+    }
+    auto& progress = this->GetSpokesProgress(spokeType);
+    ++progress.evaluations;
+    ++progress.sweepEvaluations;
+    this->SendSnapshotIfDue();
+    this->WriteCheckpoint(true);
 
-      const auto srad = ComputeRSradPenalty(*interpolatedTempSRep, spokeType); // L2
+    // any other error is reported as a bad value so the optimization moves away from it
+    try {
+      // small next to the trust region sizes, large enough to stay well above rounding error
+      constexpr double gradientStep = 1e-6;
+      // only re-interpolates the parts of the srep whose spokes changed since the last evaluation
+      const auto terms = gradient
+        ? objective.EvaluateWithGradient(coeff, {m_L0Weight, m_L1Weight, m_L2Weight}, gradientStep, gradient)
+        : objective.Evaluate(coeff);
+      const auto& distanceSquared = terms.distanceSquared; // L0
+      const auto& normalPenalty = terms.normalPenalty; // L1
+      const auto& srad = terms.srad; // L2
 
       const auto val =  distanceSquared * m_L0Weight + normalPenalty * m_L1Weight + srad * m_L2Weight;
-      this->IncrementIteration();
-      std::cout  << "Eval func " << m_iteration << ": " << val <<
-        " = " << (distanceSquared * m_L0Weight) << " + " << (normalPenalty * m_L1Weight) << " + " << (srad * m_L2Weight) << std::endl;
+      this->UpdateBestCoefficients(coeff, val, spokeType);
+      const auto iteration = this->IncrementIteration();
+      if (m_telemetry) {
+        m_telemetry->Record(sreprefinement::RefinementTelemetry::Evaluation{
+          iteration,
+          0.0,
+          m_level,
+          spokeType == SpokeType::UpOrientation
+            ? sreprefinement::RefinementTelemetry::Spokes::Up
+            : sreprefinement::RefinementTelemetry::Spokes::Down,
+          distanceSquared * m_L0Weight,
+          normalPenalty * m_L1Weight,
+          srad * m_L2Weight,
+          val});
+      }
+      if (m_consoleOutputInterval > 0 && iteration % m_consoleOutputInterval == 0) {
+        // build the line first so lines from concurrent optimizations don't interleave
+        std::ostringstream line;
+        line << "Eval func " << iteration << ": " << val <<
+          " = " << (distanceSquared * m_L0Weight) << " + " << (normalPenalty * m_L1Weight) << " + " << (srad * m_L2Weight) << "\n";
+        std::cout << line.str();
+      }
       return val;
     } catch (const std::exception& e) {
       std::cerr << "Error in SRepRefinement evaluating objective function: " << e.what() << std::endl;
-      return 1e10;
     } catch (...) {
       std::cerr << "Unknown error in SRepRefinement evaluating objective function" << std::endl;
-      return 1e10;
     }
+    if (gradient) {
+      std::fill(gradient, gradient + objective.GetNumberOfCoefficients(), 0.0);
+    }
+    return 1e10;
   }
 
   //---------------------------------------------------------------------------
@@ -844,6 +1844,8 @@ private:
     const auto numLines = m_srep->GetNumberOfLines();
     const auto numSteps = m_srep->GetNumberOfSteps();
 
+    m_flattenedUpCoeff.clear();
+    m_flattenedDownCoeff.clear();
     m_flattenedUpCoeff.reserve(numLines * numSteps * 4);
     m_flattenedDownCoeff.reserve(numLines * numSteps * 4);
     for (IndexType l = 0; l < numLines; ++l) {
@@ -875,11 +1877,71 @@ vtkSmartPointer<vtkEllipticalSRep> RefineSRep(
   double L0Weight,
   double L1Weight,
   double L2Weight,
-  ProgressCallbackFunction progressCallback)
+  const RefinerSettings& settings,
+  ProgressCallbackFunction progressCallback,
+  sreprefinement::RefinementStatus* status)
 {
-  Refiner refiner(srep, polyData, initialRegionSize, finalRegionSize, maxIterations, interpolationLevel, L0Weight, L1Weight, L2Weight);
+  Refiner refiner(srep, polyData, initialRegionSize, finalRegionSize, maxIterations, interpolationLevel, L0Weight, L1Weight, L2Weight, settings);
   refiner.SetProgressCallback(progressCallback);
-  return refiner.Run();
+  auto refinedSRep = refiner.Run();
+  if (status) {
+    *status = refiner.GetStatus();
+  }
+  return refinedSRep;
+}
+
+//---------------------------------------------------------------------------
+RefinerSettings CreateRefinerSettings(vtkSlicerSRepRefinementLogic& logic, sreprefinement::RefinementTelemetry* telemetry) {
+  RefinerSettings settings;
+  settings.distanceMethod = logic.GetDistanceMethod();
+  settings.voxelSpacing = logic.GetVoxelSpacing();
+  settings.narrowBandWidth = static_cast<size_t>(logic.GetNarrowBandWidth());
+  settings.distanceMapThreads = static_cast<size_t>(logic.GetDistanceMapThreads());
+  settings.pyramidLevels = static_cast<size_t>(logic.GetPyramidLevels());
+  settings.concurrentUpDown = logic.GetConcurrentUpDown();
+  settings.optimizer = logic.GetOptimizer();
+  settings.patchSize = static_cast<size_t>(logic.GetPatchSize());
+  settings.patchOverlap = static_cast<size_t>(logic.GetPatchOverlap());
+  settings.maxPatchSweeps = static_cast<size_t>(logic.GetMaxPatchSweeps());
+  settings.numStarts = static_cast<size_t>(logic.GetNumberOfStarts());
+  settings.startJitter = logic.GetStartJitter();
+  settings.startRegionScale = logic.GetStartRegionScale();
+  settings.startSeed = static_cast<uint64_t>(static_cast<uint32_t>(logic.GetStartSeed()));
+  settings.stageTimeBudget = logic.GetStageTimeBudget();
+  settings.stageEvaluationBudget = static_cast<size_t>(logic.GetStageEvaluationBudget());
+  settings.checkpointFileName = logic.GetCheckpointFileName();
+  settings.checkpointInterval = logic.GetCheckpointInterval();
+  settings.telemetry = telemetry;
+  settings.consoleOutputInterval = logic.GetConsoleOutputInterval();
+  return settings;
+}
+
+//---------------------------------------------------------------------------
+void WriteSRepFile(vtkEllipticalSRep* srep, const std::string& fileName) {
+  auto srepNode = vtkSmartPointer<vtkMRMLEllipticalSRepNode>::New();
+  srepNode->SetEllipticalSRep(srep);
+  auto storageNode = vtkSmartPointer<vtkMRMLSRepStorageNode>::New();
+  storageNode->SetFileName(fileName.c_str());
+  if (!storageNode->WriteData(srepNode)) {
+    throw std::runtime_error("Unable to write SRep to " + fileName);
+  }
+}
+
+//---------------------------------------------------------------------------
+static_assert(vtkSlicerSRepRefinementLogic::StopReasonCompleted == static_cast<int>(sreprefinement::StopReason::Completed)
+  && vtkSlicerSRepRefinementLogic::StopReasonTimeBudget == static_cast<int>(sreprefinement::StopReason::TimeBudget)
+  && vtkSlicerSRepRefinementLogic::StopReasonEvaluationBudget == static_cast<int>(sreprefinement::StopReason::EvaluationBudget)
+  && vtkSlicerSRepRefinementLogic::StopReasonCancelled == static_cast<int>(sreprefinement::StopReason::Cancelled),
+  "the logic's stop reasons must match sreprefinement::StopReason");
+
+// Gets the vtkSlicerSRepRefinementLogic::StopReasonType of a vtkSlicerSRepRefinementLogic::StageType
+int GetStopReasonOfStage(const sreprefinement::RefinementStatus& status, int stage) {
+  switch (stage) {
+    case vtkSlicerSRepRefinementLogic::StageUp: return static_cast<int>(status.up);
+    case vtkSlicerSRepRefinementLogic::StageDown: return static_cast<int>(status.down);
+    case vtkSlicerSRepRefinementLogic::StageCrest: return static_cast<int>(status.crest);
+  }
+  throw std::invalid_argument("Unknown SRep refinement stage " + std::to_string(stage));
 }
 
 } //namespace {}
@@ -888,7 +1950,37 @@ vtkSmartPointer<vtkEllipticalSRep> RefineSRep(
 vtkStandardNewMacro(vtkSlicerSRepRefinementLogic);
 
 //----------------------------------------------------------------------------
-vtkSlicerSRepRefinementLogic::vtkSlicerSRepRefinementLogic() = default;
+vtkSlicerSRepRefinementLogic::vtkSlicerSRepRefinementLogic()
+  : DistanceMethod(DistanceMethodImage)
+  , VoxelSpacing(0.005)
+  , NarrowBandWidth(4)
+  , DistanceMapThreads(0)
+  , PyramidLevels(1)
+  , ConcurrentUpDown(true)
+  , Optimizer(OptimizerNEWUOA)
+  , PatchSize(0)
+  , PatchOverlap(1)
+  , MaxPatchSweeps(4)
+  , NumberOfStarts(1)
+  , StartJitter(0.05)
+  , StartRegionScale(2.0)
+  , StartSeed(0)
+  , StageTimeBudget(0.0)
+  , StageEvaluationBudget(0)
+  , CheckpointFileName()
+  , CheckpointInterval(60.0)
+  , TelemetryCapacity(10000)
+  , ConsoleOutputInterval(0)
+  , PublishInterval(1.0)
+  , BatchThreads(0)
+  , UseSDFCache(false)
+  , SDFCacheDirectory()
+  , SDFCacheSizeLimit(2048)
+  , BatchResults()
+  , BatchRefinementStatuses()
+  , LastRefinementStatus()
+  , Telemetry(new sreprefinement::RefinementTelemetry(static_cast<size_t>(TelemetryCapacity)))
+{}
 
 //----------------------------------------------------------------------------
 vtkSlicerSRepRefinementLogic::~vtkSlicerSRepRefinementLogic() = default;
@@ -897,6 +1989,197 @@ vtkSlicerSRepRefinementLogic::~vtkSlicerSRepRefinementLogic() = default;
 void vtkSlicerSRepRefinementLogic::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "DistanceMethod: " << this->DistanceMethod << "\n";
+  os << indent << "VoxelSpacing: " << this->VoxelSpacing << "\n";
+  os << indent << "NarrowBandWidth: " << this->NarrowBandWidth << "\n";
+  os << indent << "DistanceMapThreads: " << this->DistanceMapThreads << "\n";
+  os << indent << "PyramidLevels: " << this->PyramidLevels << "\n";
+  os << indent << "ConcurrentUpDown: " << this->ConcurrentUpDown << "\n";
+  os << indent << "Optimizer: " << this->Optimizer << "\n";
+  os << indent << "PatchSize: " << this->PatchSize << "\n";
+  os << indent << "PatchOverlap: " << this->PatchOverlap << "\n";
+  os << indent << "MaxPatchSweeps: " << this->MaxPatchSweeps << "\n";
+  os << indent << "NumberOfStarts: " << this->NumberOfStarts << "\n";
+  os << indent << "StartJitter: " << this->StartJitter << "\n";
+  os << indent << "StartRegionScale: " << this->StartRegionScale << "\n";
+  os << indent << "StartSeed: " << this->StartSeed << "\n";
+  os << indent << "StageTimeBudget: " << this->StageTimeBudget << "\n";
+  os << indent << "StageEvaluationBudget: " << this->StageEvaluationBudget << "\n";
+  os << indent << "CheckpointFileName: " << this->CheckpointFileName << "\n";
+  os << indent << "CheckpointInterval: " << this->CheckpointInterval << "\n";
+  os << indent << "TelemetryCapacity: " << this->TelemetryCapacity << "\n";
+  os << indent << "ConsoleOutputInterval: " << this->ConsoleOutputInterval << "\n";
+  os << indent << "PublishInterval: " << this->PublishInterval << "\n";
+  os << indent << "BatchThreads: " << this->BatchThreads << "\n";
+  os << indent << "UseSDFCache: " << this->UseSDFCache << "\n";
+  os << indent << "SDFCacheDirectory: " << this->SDFCacheDirectory << "\n";
+  os << indent << "SDFCacheSizeLimit: " << this->SDFCacheSizeLimit << "\n";
+}
+
+//----------------------------------------------------------------------------
+const sreprefinement::RefinementTelemetry& vtkSlicerSRepRefinementLogic::GetTelemetry() const {
+  return *this->Telemetry;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerSRepRefinementLogic::GetTelemetryAsTable(vtkTable* table) const {
+  if (!table) {
+    throw std::invalid_argument("Expected non null table for the SRep refinement telemetry");
+  }
+  const auto evaluations = this->Telemetry->GetEvaluations();
+  const auto numRows = static_cast<vtkIdType>(evaluations.size());
+  const auto createColumn = [&](vtkDataArray* column, const char* name) {
+    column->SetName(name);
+    column->SetNumberOfValues(numRows);
+  };
+  vtkNew<vtkIntArray> iterations;
+  createColumn(iterations, "iteration");
+  vtkNew<vtkDoubleArray> times;
+  createColumn(times, "time");
+  vtkNew<vtkIntArray> levels;
+  createColumn(levels, "level");
+  vtkNew<vtkStringArray> spokes;
+  spokes->SetName("spokes");
+  spokes->SetNumberOfValues(numRows);
+  vtkNew<vtkDoubleArray> distanceSquared;
+  createColumn(distanceSquared, "L0");
+  vtkNew<vtkDoubleArray> normalPenalties;
+  createColumn(normalPenalties, "L1");
+  vtkNew<vtkDoubleArray> srads;
+  createColumn(srads, "L2");
+  vtkNew<vtkDoubleArray> values;
+  createColumn(values, "value");
+
+  for (vtkIdType i = 0; i < numRows; ++i) {
+    const auto& evaluation = evaluations[i];
+    iterations->SetValue(i, evaluation.iteration);
+    times->SetValue(i, evaluation.time);
+    levels->SetValue(i, static_cast<int>(evaluation.level));
+    spokes->SetValue(i, sreprefinement::RefinementTelemetry::ToString(evaluation.spokes));
+    distanceSquared->SetValue(i, evaluation.distanceSquared);
+    normalPenalties->SetValue(i, evaluation.normalPenalty);
+    srads->SetValue(i, evaluation.srad);
+    values->SetValue(i, evaluation.value);
+  }
+
+  table->Initialize();
+  table->AddColumn(iterations);
+  table->AddColumn(times);
+  table->AddColumn(levels);
+  table->AddColumn(spokes);
+  table->AddColumn(distanceSquared);
+  table->AddColumn(normalPenalties);
+  table->AddColumn(srads);
+  table->AddColumn(values);
+}
+
+//----------------------------------------------------------------------------
+const sreprefinement::RefinementStatus& vtkSlicerSRepRefinementLogic::GetLastRefinementStatus() const {
+  return this->LastRefinementStatus;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerSRepRefinementLogic::GetLastStopReason(int stage) const {
+  return GetStopReasonOfStage(this->LastRefinementStatus, stage);
+}
+
+//----------------------------------------------------------------------------
+const char* vtkSlicerSRepRefinementLogic::GetStopReasonAsString(int stopReason) {
+  if (stopReason < StopReasonCompleted || stopReason > StopReasonCancelled) {
+    return "unknown";
+  }
+  return sreprefinement::ToString(static_cast<sreprefinement::StopReason>(stopReason));
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerSRepRefinementLogic::WriteTelemetryAsCSV(const std::string& fileName) const {
+  std::ofstream file(fileName);
+  this->Telemetry->WriteCSV(file);
+  return static_cast<bool>(file);
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerSRepRefinementLogic::WriteTelemetryAsJSON(const std::string& fileName) const {
+  std::ofstream file(fileName);
+  this->Telemetry->WriteJSON(file);
+  return static_cast<bool>(file);
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerSRepRefinementLogic::SetSDFCacheDirectory(const std::string& directory) {
+  if (this->SDFCacheDirectory != directory) {
+    this->SDFCacheDirectory = directory;
+    this->Modified();
+  }
+}
+
+//----------------------------------------------------------------------------
+std::string vtkSlicerSRepRefinementLogic::GetSDFCacheDirectory() const {
+  return this->SDFCacheDirectory;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerSRepRefinementLogic::SetCheckpointFileName(const std::string& fileName) {
+  if (this->CheckpointFileName != fileName) {
+    this->CheckpointFileName = fileName;
+    this->Modified();
+  }
+}
+
+//----------------------------------------------------------------------------
+std::string vtkSlicerSRepRefinementLogic::GetCheckpointFileName() const {
+  return this->CheckpointFileName;
+}
+
+//----------------------------------------------------------------------------
+std::shared_ptr<const sreprefinement::SDFCache> vtkSlicerSRepRefinementLogic::CreateSDFCache() {
+  // only the image fields are cached
+  if (!this->UseSDFCache || this->DistanceMethod != DistanceMethodImage) {
+    return nullptr;
+  }
+  std::string directory = this->SDFCacheDirectory;
+  if (directory.empty()) {
+    if (!this->GetApplicationLogic() || !this->GetApplicationLogic()->GetTemporaryPath()) {
+      return nullptr;
+    }
+    directory = std::string(this->GetApplicationLogic()->GetTemporaryPath()) + "/SRepRefinementSDFCache";
+  }
+  if (!vtksys::SystemTools::FileExists(directory, false) && !vtksys::SystemTools::MakeDirectory(directory)) {
+    vtkWarningMacro("Unable to create SDF cache directory " << directory << ", refining without a cache");
+    return nullptr;
+  }
+  const uint64_t maxBytes = static_cast<uint64_t>(this->SDFCacheSizeLimit) * 1024 * 1024;
+  return std::make_shared<const sreprefinement::SDFCache>(directory, maxBytes);
+}
+
+//----------------------------------------------------------------------------
+const std::vector<sreprefinement::BatchJobResult>& vtkSlicerSRepRefinementLogic::GetBatchResults() const {
+  return this->BatchResults;
+}
+
+//----------------------------------------------------------------------------
+const std::vector<sreprefinement::RefinementStatus>& vtkSlicerSRepRefinementLogic::GetBatchRefinementStatuses() const {
+  return this->BatchRefinementStatuses;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerSRepRefinementLogic::GetNumberOfBatchRefinementStatuses() const {
+  return static_cast<int>(this->BatchRefinementStatuses.size());
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerSRepRefinementLogic::GetBatchStopReason(int job, int stage) const {
+  if (job < 0 || job >= this->GetNumberOfBatchRefinementStatuses()) {
+    throw std::invalid_argument("No refinement batch job " + std::to_string(job));
+  }
+  return GetStopReasonOfStage(this->BatchRefinementStatuses[job], stage);
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerSRepRefinementLogic::WriteBatchResultsAsCSV(const std::string& fileName) const {
+  std::ofstream file(fileName);
+  sreprefinement::WriteBatchResultsCSV(file, this->BatchResults);
+  return static_cast<bool>(file);
 }
 
 //---------------------------------------------------------------------------
@@ -904,6 +2187,87 @@ void vtkSlicerSRepRefinementLogic::ProgressCallback(double progress) {
   this->InvokeEvent(vtkCommand::ProgressEvent, &progress);
 }
 
+//---------------------------------------------------------------------------
+void vtkSlicerSRepRefinementLogic::ValidateRunArguments(
+  vtkMRMLModelNode* model,
+  vtkMRMLEllipticalSRepNode* srepNode,
+  int maxIterations,
+  int interpolationLevel) const
+{
+  if (!model) {
+    throw std::invalid_argument("Cannot refine an SRep with a null model");
+  }
+  if (!srepNode || !srepNode->GetSRep() || srepNode->GetSRep()->IsEmpty()) {
+    throw std::invalid_argument("Cannot refine an SRep with a null srep");
+  }
+  if (maxIterations < 1) {
+    throw std::invalid_argument("must have at least one iteration");
+  }
+  if (interpolationLevel < 0) {
+    throw std::invalid_argument("interpolation level must be non-negative");
+  }
+  if (this->VoxelSpacing <= 0 || this->VoxelSpacing > 0.5) {
+    throw std::invalid_argument("voxel spacing must be in (0, 0.5]");
+  }
+  if (this->NarrowBandWidth < 0) {
+    throw std::invalid_argument("narrow band width must be non-negative");
+  }
+  if (this->DistanceMapThreads < 0) {
+    throw std::invalid_argument("distance map threads must be non-negative");
+  }
+  if (this->PyramidLevels < 1) {
+    throw std::invalid_argument("must have at least one pyramid level");
+  }
+  if (this->VoxelSpacing * Pow(2, this->PyramidLevels - 1) > 0.5) {
+    throw std::invalid_argument("voxel spacing of the coarsest pyramid level must be at most 0.5");
+  }
+  if (this->PatchSize < 0) {
+    throw std::invalid_argument("patch size must be non-negative");
+  }
+  if (this->PatchOverlap < 0) {
+    throw std::invalid_argument("patch overlap must be non-negative");
+  }
+  if (this->MaxPatchSweeps < 1) {
+    throw std::invalid_argument("must have at least one patch sweep");
+  }
+  if (this->NumberOfStarts < 1) {
+    throw std::invalid_argument("must have at least one start");
+  }
+  if (this->StartJitter < 0) {
+    throw std::invalid_argument("start jitter must be non-negative");
+  }
+  if (this->StartRegionScale < 1) {
+    throw std::invalid_argument("start region scale must be at least 1");
+  }
+  if (this->StageTimeBudget < 0) {
+    throw std::invalid_argument("stage time budget must be non-negative");
+  }
+  if (this->StageEvaluationBudget < 0) {
+    throw std::invalid_argument("stage evaluation budget must be non-negative");
+  }
+  if (this->CheckpointInterval < 0) {
+    throw std::invalid_argument("checkpoint interval must be non-negative");
+  }
+  if (this->TelemetryCapacity < 0) {
+    throw std::invalid_argument("telemetry capacity must be non-negative");
+  }
+  if (this->ConsoleOutputInterval < 0) {
+    throw std::invalid_argument("console output interval must be non-negative");
+  }
+  if (this->PublishInterval < 0) {
+    throw std::invalid_argument("publish interval must be non-negative");
+  }
+}
+
+//---------------------------------------------------------------------------
+sreprefinement::RefinementTelemetry* vtkSlicerSRepRefinementLogic::StartTelemetry() {
+  if (this->Telemetry->GetCapacity() != static_cast<size_t>(this->TelemetryCapacity)) {
+    this->Telemetry->SetCapacity(static_cast<size_t>(this->TelemetryCapacity));
+  }
+  this->Telemetry->Start();
+  return this->Telemetry.get();
+}
+
 //---------------------------------------------------------------------------
 vtkMRMLEllipticalSRepNode* vtkSlicerSRepRefinementLogic::Run(
   vtkMRMLModelNode* model,
@@ -944,18 +2308,10 @@ void vtkSlicerSRepRefinementLogic::Run(
   vtkMRMLEllipticalSRepNode* destination)
 {
   try {
-    if (!model) {
-      throw std::invalid_argument("Cannot refine an SRep with a null model");
-    }
-    if (!srepNode || !srepNode->GetSRep() || srepNode->GetSRep()->IsEmpty()) {
-      throw std::invalid_argument("Cannot refine an SRep with a null srep");
-    }
-    if (maxIterations < 1) {
-      throw std::invalid_argument("must have at least one iteration");
-    }
-    if (interpolationLevel < 0) {
-      throw std::invalid_argument("interpolation level must be non-negative");
-    }
+    this->ValidateRunArguments(model, srepNode, maxIterations, interpolationLevel);
+    const auto sdfCache = this->CreateSDFCache();
+    auto settings = CreateRefinerSettings(*this, this->StartTelemetry());
+    settings.sdfCache = sdfCache.get();
 
     auto refinedSRep = RefineSRep(
       *srepNode->GetEllipticalSRep(),
@@ -967,7 +2323,9 @@ void vtkSlicerSRepRefinementLogic::Run(
       L0Weight,
       L1Weight,
       L2Weight,
-      [this](double p){ this->ProgressCallback(p); });
+      settings,
+      [this](double p){ this->ProgressCallback(p); },
+      &this->LastRefinementStatus);
     destination->SetEllipticalSRep(refinedSRep);
   } catch (const std::exception& e) {
     vtkErrorMacro("Error running SRep refinement: " << e.what());
@@ -978,3 +2336,198 @@ void vtkSlicerSRepRefinementLogic::Run(
     throw;
   }
 }
+
+//---------------------------------------------------------------------------
+std::unique_ptr<sreprefinement::RefinementTask> vtkSlicerSRepRefinementLogic::RunAsync(
+  vtkMRMLModelNode* model,
+  vtkMRMLEllipticalSRepNode* srepNode,
+  double initialRegionSize,
+  double finalRegionSize,
+  int maxIterations,
+  int interpolationLevel,
+  double L0Weight,
+  double L1Weight,
+  double L2Weight,
+  vtkMRMLEllipticalSRepNode* destination)
+{
+  try {
+    this->ValidateRunArguments(model, srepNode, maxIterations, interpolationLevel);
+    if (!destination) {
+      throw std::invalid_argument("Cannot refine an SRep into a null destination");
+    }
+    const auto sdfCache = this->CreateSDFCache();
+    auto settings = CreateRefinerSettings(*this, this->StartTelemetry());
+    settings.sdfCache = sdfCache.get();
+    const double publishInterval = this->PublishInterval;
+
+    // the worker thread must not touch the MRML nodes, so it refines copies of their data
+    vtkSmartPointer<vtkEllipticalSRep> srep = srepNode->GetEllipticalSRep()->SmartClone();
+    auto polyData = vtkSmartPointer<vtkPolyData>::New();
+    polyData->DeepCopy(model->GetPolyData());
+
+    std::unique_ptr<sreprefinement::RefinementTask> task(new sreprefinement::RefinementTask(destination));
+    task->Start([=](sreprefinement::RefinementTask& t) {
+      // holding a reference keeps the cache alive until the refinement is done
+      const auto cache = sdfCache;
+      Refiner refiner(*srep, polyData, initialRegionSize, finalRegionSize, maxIterations, interpolationLevel, L0Weight, L1Weight, L2Weight, settings);
+      refiner.SetProgressCallback([&t](double p) { t.SetProgress(p); });
+      refiner.SetCancelCallback([&t]() { return t.IsCancelRequested(); });
+      refiner.SetSnapshotCallback([&t](vtkSmartPointer<vtkEllipticalSRep> snapshot) { t.SetResult(snapshot); }, publishInterval);
+      auto refinedSRep = refiner.Run();
+      t.SetRefinementStatus(refiner.GetStatus());
+      t.SetProgress(1.0);
+      return refinedSRep;
+    });
+    return task;
+  } catch (const std::exception& e) {
+    vtkErrorMacro("Error starting SRep refinement: " << e.what());
+    throw;
+  }
+  catch (...) {
+    vtkErrorMacro("Unknown error starting SRep refinement");
+    throw;
+  }
+}
+
+//---------------------------------------------------------------------------
+std::vector<sreprefinement::BatchJobResult> vtkSlicerSRepRefinementLogic::RunBatch(
+  const std::vector<sreprefinement::BatchJob>& jobs,
+  double initialRegionSize,
+  double finalRegionSize,
+  int maxIterations,
+  int interpolationLevel,
+  double L0Weight,
+  double L1Weight,
+  double L2Weight)
+{
+  try {
+    if (this->BatchThreads < 0) {
+      throw std::invalid_argument("batch threads must be non-negative");
+    }
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      const auto& job = jobs[i];
+      try {
+        this->ValidateRunArguments(job.model, job.srep, maxIterations, interpolationLevel);
+        if (!job.destination && job.fileName.empty()) {
+          throw std::invalid_argument("must have a destination or a file name");
+        }
+      } catch (const std::invalid_argument& e) {
+        throw std::invalid_argument("batch job " + std::to_string(i) + ": " + e.what());
+      }
+    }
+
+    const auto sdfCache = this->CreateSDFCache();
+    auto settings = CreateRefinerSettings(*this, nullptr);
+    settings.concurrentUpDown = false;
+    // the jobs already keep every thread busy
+    settings.orientationThreads = 1;
+    settings.distanceMapThreads = 1;
+    settings.sdfCache = sdfCache.get();
+
+    // the workers must not touch the MRML nodes, so they refine copies of their data
+    std::vector<vtkSmartPointer<vtkEllipticalSRep>> sreps;
+    std::vector<vtkSmartPointer<vtkPolyData>> polyDatas;
+    sreps.reserve(jobs.size());
+    polyDatas.reserve(jobs.size());
+    for (const auto& job : jobs) {
+      sreps.push_back(job.srep->GetEllipticalSRep()->SmartClone());
+      polyDatas.push_back(vtkSmartPointer<vtkPolyData>::New());
+      polyDatas.back()->DeepCopy(job.model->GetPolyData());
+    }
+
+    this->BatchRefinementStatuses.assign(jobs.size(), sreprefinement::RefinementStatus());
+    size_t numFinished = 0;
+    this->BatchResults = sreprefinement::RunBatch(jobs.size(), static_cast<size_t>(this->BatchThreads),
+      [&](size_t i) {
+        // the jobs can't share a checkpoint, they each have their own
+        auto jobSettings = settings;
+        jobSettings.checkpointFileName = jobs[i].checkpointFileName;
+        // each job builds its own refiner and distance field
+        auto refinedSRep = RefineSRep(
+          *sreps[i],
+          polyDatas[i],
+          initialRegionSize,
+          finalRegionSize,
+          maxIterations,
+          interpolationLevel,
+          L0Weight,
+          L1Weight,
+          L2Weight,
+          jobSettings,
+          ProgressCallbackFunction(),
+          &this->BatchRefinementStatuses[i]);
+        // the input copies are no longer needed, and the result is handed to the calling thread in their place
+        polyDatas[i] = nullptr;
+        sreps[i] = refinedSRep;
+      },
+      [&](size_t i) {
+        ++numFinished;
+        this->ProgressCallback(static_cast<double>(numFinished) / jobs.size());
+        const auto refinedSRep = std::move(sreps[i]);
+        if (jobs[i].destination) {
+          jobs[i].destination->SetEllipticalSRep(refinedSRep);
+        }
+        if (!jobs[i].fileName.empty()) {
+          WriteSRepFile(refinedSRep, jobs[i].fileName);
+        }
+      });
+    // failed jobs are never finished, so the progress has not reached the end if any failed
+    if (numFinished < jobs.size()) {
+      this->ProgressCallback(1.0);
+    }
+
+    for (size_t i = 0; i < this->BatchResults.size(); ++i) {
+      if (!this->BatchResults[i].succeeded) {
+        vtkErrorMacro("Error running SRep refinement batch job " << i << ": " << this->BatchResults[i].errorMessage);
+      }
+    }
+    return this->BatchResults;
+  } catch (const std::exception& e) {
+    vtkErrorMacro("Error running SRep refinement batch: " << e.what());
+    throw;
+  }
+  catch (...) {
+    vtkErrorMacro("Unknown error running SRep refinement batch");
+    throw;
+  }
+}
+
+//---------------------------------------------------------------------------
+int vtkSlicerSRepRefinementLogic::RunBatch(
+  vtkCollection* models,
+  vtkCollection* sreps,
+  vtkCollection* destinations,
+  vtkStringArray* fileNames,
+  double initialRegionSize,
+  double finalRegionSize,
+  int maxIterations,
+  int interpolationLevel,
+  double L0Weight,
+  double L1Weight,
+  double L2Weight)
+{
+  if (!models || !sreps) {
+    throw std::invalid_argument("Cannot run an SRep refinement batch with null models or sreps");
+  }
+  const int numJobs = models->GetNumberOfItems();
+  if (sreps->GetNumberOfItems() != numJobs
+    || (destinations && destinations->GetNumberOfItems() != numJobs)
+    || (fileNames && fileNames->GetNumberOfValues() != numJobs))
+  {
+    throw std::invalid_argument("Expected the same number of models, sreps, destinations and file names");
+  }
+
+  std::vector<sreprefinement::BatchJob> jobs(static_cast<size_t>(numJobs));
+  for (int i = 0; i < numJobs; ++i) {
+    auto& job = jobs[i];
+    job.model = vtkMRMLModelNode::SafeDownCast(models->GetItemAsObject(i));
+    job.srep = vtkMRMLEllipticalSRepNode::SafeDownCast(sreps->GetItemAsObject(i));
+    job.destination = destinations ? vtkMRMLEllipticalSRepNode::SafeDownCast(destinations->GetItemAsObject(i)) : nullptr;
+    job.fileName = fileNames ? std::string(fileNames->GetValue(i)) : std::string();
+  }
+
+  const auto results = this->RunBatch(
+    jobs, initialRegionSize, finalRegionSize, maxIterations, interpolationLevel, L0Weight, L1Weight, L2Weight);
+  return static_cast<int>(std::count_if(results.begin(), results.end(),
+    [](const sreprefinement::BatchJobResult& result) { return result.succeeded; }));
+}
@@ -31,8 +31,25 @@
 #include <vtkMRMLModelNode.h>
 #include <vtkMRMLEllipticalSRepNode.h>
 
+#include "SRepRefinementBatch.h"
+#include "SRepRefinementBudget.h"
+#include "SRepRefinementTask.h"
 #include "vtkSlicerSRepRefinementModuleLogicExport.h"
 
+// STD includes
+#include <memory>
+#include <string>
+#include <vector>
+
+class vtkCollection;
+class vtkStringArray;
+class vtkTable;
+
+namespace sreprefinement {
+class RefinementTelemetry;
+class SDFCache;
+}
+
 /// \ingroup Slicer_QtModules_ExtensionTemplate
 class VTK_SLICER_SREPREFINEMENT_MODULE_LOGIC_EXPORT vtkSlicerSRepRefinementLogic :
   public vtkSlicerModuleLogic
@@ -58,6 +75,10 @@ public:
   ///        from being perpendicular to the boundary.
   /// \param L2Weight The weight to put on the L2 parameter. The L2 parameter is the geometric illegality
   ///        of spokes. This parameter is intended to prevent spokes from crossing each other.
+  ///
+  /// StageTimeBudget and StageEvaluationBudget bound how long each stage may run. A stage that runs
+  /// out keeps the best spokes it found, and GetLastRefinementStatus says which limit stopped it.
+  /// If CheckpointFileName is set, the refinement resumes from a checkpoint of the same refinement.
   /// \returns The refined SRep.
   vtkMRMLEllipticalSRepNode* Run(
     vtkMRMLModelNode* model,
@@ -82,11 +103,405 @@ public:
     vtkMRMLEllipticalSRepNode* destination);
   /// @}
 
+  /// Starts refining the given SRep to a Model on a worker thread and returns right away.
+  /// The parameters are the same as for Run. Invalid arguments throw before anything is started.
+  ///
+  /// The best srep so far is handed to the task every PublishInterval seconds and after every
+  /// pyramid level, and RefinementTask::PublishResult copies it into destination. Cancelling the
+  /// task leaves the best srep found before the cancel as its result.
+  ///
+  /// The model and srep are copied, so they can be changed while the refinement runs. The logic
+  /// must outlive the task, and only one refinement should run at a time because they share the
+  /// telemetry. Progress events are not invoked, use RefinementTask::GetProgress instead.
+  /// RefinementTask::GetRefinementStatus says how each stage stopped.
+  std::unique_ptr<sreprefinement::RefinementTask> RunAsync(
+    vtkMRMLModelNode* model,
+    vtkMRMLEllipticalSRepNode* srep,
+    double initialRegionSize,
+    double finalRegionSize,
+    int maxIterations,
+    int interpolationLevel,
+    double L0Weight,
+    double L1Weight,
+    double L2Weight,
+    vtkMRMLEllipticalSRepNode* destination);
+
+  /// @{
+  /// Refines many subjects with the same parameters, spread over BatchThreads worker threads.
+  /// The other parameters are the same as for Run. Every job is validated before any is started,
+  /// and invalid arguments throw.
+  ///
+  /// Each job refines copies of its model and srep with its own distance field. As each job
+  /// finishes, its refined srep is set on its destination node and/or written to its file from the
+  /// calling thread, and a progress event with the fraction of finished jobs is invoked.
+  /// A job that fails does not stop the others.
+  ///
+  /// Up and down spokes are optimized one after the other within a job since the jobs already keep
+  /// the cores busy, and no telemetry is recorded. Each job checkpoints to its own
+  /// BatchJob::checkpointFileName, and CheckpointFileName is not used.
+  /// \returns The status and timing of each job, also available from GetBatchResults. How each stage
+  ///          of each job stopped is available from GetBatchRefinementStatuses.
+  std::vector<sreprefinement::BatchJobResult> RunBatch(
+    const std::vector<sreprefinement::BatchJob>& jobs,
+    double initialRegionSize,
+    double finalRegionSize,
+    int maxIterations,
+    int interpolationLevel,
+    double L0Weight,
+    double L1Weight,
+    double L2Weight);
+  /// Python friendly RunBatch. Job i refines the ith vtkMRMLModelNode of models and vtkMRMLEllipticalSRepNode
+  /// of sreps into the ith vtkMRMLEllipticalSRepNode of destinations and the ith file of fileNames.
+  /// Either destinations or fileNames may be nullptr.
+  /// \returns The number of jobs that succeeded.
+  int RunBatch(
+    vtkCollection* models,
+    vtkCollection* sreps,
+    vtkCollection* destinations,
+    vtkStringArray* fileNames,
+    double initialRegionSize,
+    double finalRegionSize,
+    int maxIterations,
+    int interpolationLevel,
+    double L0Weight,
+    double L1Weight,
+    double L2Weight);
+  /// @}
+
+  /// Gets the results of the most recent RunBatch.
+  const std::vector<sreprefinement::BatchJobResult>& GetBatchResults() const;
+
+  /// Gets how each stage of each job of the most recent RunBatch stopped, in job order.
+  /// Jobs that failed are left as completed.
+  const std::vector<sreprefinement::RefinementStatus>& GetBatchRefinementStatuses() const;
+
+  /// @{
+  /// Python friendly GetBatchRefinementStatuses. Gets the StopReasonType of the given StageType of a job.
+  int GetNumberOfBatchRefinementStatuses() const;
+  int GetBatchStopReason(int job, int stage) const;
+  /// @}
+
+  /// Writes the results of the most recent RunBatch as CSV.
+  /// \returns false if the file could not be written.
+  bool WriteBatchResultsAsCSV(const std::string& fileName) const;
+
+  /// @{
+  /// If true, the distance fields the SRep is refined against are stored on disk and reused by later
+  /// refinements of the same model with the same bounds and VoxelSpacing, e.g. when only the weights
+  /// or iteration counts change. Default is false.
+  vtkSetMacro(UseSDFCache, bool);
+  vtkGetMacro(UseSDFCache, bool);
+  vtkBooleanMacro(UseSDFCache, bool);
+  /// @}
+
+  /// @{
+  /// Directory the distance fields are cached in. It is created if it doesn't exist. If empty, the
+  /// SRepRefinementSDFCache directory in the application's temporary directory is used. Default is empty.
+  void SetSDFCacheDirectory(const std::string& directory);
+  std::string GetSDFCacheDirectory() const;
+  /// @}
+
+  /// @{
+  /// Megabytes the cached distance fields may take. Storing a field removes the least recently used
+  /// ones until the cache fits. 0 for no limit. Default is 2048.
+  vtkSetClampMacro(SDFCacheSizeLimit, int, 0, VTK_INT_MAX);
+  vtkGetMacro(SDFCacheSizeLimit, int);
+  /// @}
+
+  /// @{
+  /// Number of worker threads RunBatch uses. 0 uses one per hardware thread. Default is 0.
+  vtkSetMacro(BatchThreads, int);
+  vtkGetMacro(BatchThreads, int);
+  /// @}
+
+  enum DistanceMethodType {
+    DistanceMethodImage = 0,
+    DistanceMethodMesh,
+  };
+
+  /// @{
+  /// How the distance from the spoke tips to the model's surface is computed.
+  /// DistanceMethodImage voxelizes the model into a signed distance field (see VoxelSpacing,
+  /// NarrowBandWidth, PyramidLevels and UseSDFCache).
+  /// DistanceMethodMesh computes the exact distance to the model's triangles. There is no field to
+  /// compute or store and the distance is not limited by a voxel size, but each sample costs more.
+  /// The settings of the image fields are not used, and the refinement runs at a single level.
+  /// Default is DistanceMethodImage.
+  vtkSetClampMacro(DistanceMethod, int, DistanceMethodImage, DistanceMethodMesh);
+  vtkGetMacro(DistanceMethod, int);
+  void SetDistanceMethodToImage() { this->SetDistanceMethod(DistanceMethodImage); }
+  void SetDistanceMethodToMesh() { this->SetDistanceMethod(DistanceMethodMesh); }
+  /// @}
+
+  /// @{
+  /// Spacing of the signed distance field that the SRep is refined against.
+  /// The model and SRep are scaled so that their largest dimension is 1, so the default
+  /// of 0.005 gives 200 voxels along that dimension. Must be in (0, 0.5].
+  vtkSetMacro(VoxelSpacing, double);
+  vtkGetMacro(VoxelSpacing, double);
+  /// @}
+
+  /// @{
+  /// Number of voxels on either side of the model's surface that the signed distance field
+  /// is kept at full resolution. Further away the distance is interpolated from a coarse grid.
+  /// Smaller values use less memory while refining, which lets more pyramid levels and batch
+  /// refinements share memory. The field is still computed densely and then compressed, so the
+  /// peak memory of computing it at a given VoxelSpacing is the same as for the dense field.
+  /// Normals come from differences of the interpolated field instead of a gradient image, which
+  /// agree closely wherever the field is smooth.
+  /// 0 keeps the full dense field. Default is 4.
+  vtkSetMacro(NarrowBandWidth, int);
+  vtkGetMacro(NarrowBandWidth, int);
+  /// @}
+
+  /// @{
+  /// Number of threads the signed distance fields are voxelized and computed on. The result does not
+  /// depend on it. 0 uses one per hardware thread. Default is 0.
+  vtkSetMacro(DistanceMapThreads, int);
+  vtkGetMacro(DistanceMapThreads, int);
+  /// @}
+
+  /// @{
+  /// Number of resolutions to refine at. With more than one level, the refinement is first run
+  /// against a distance field with VoxelSpacing * 2^(PyramidLevels-1) and each following level
+  /// halves the spacing and the initial trust region size, starting from the previous level's result.
+  /// The last level uses VoxelSpacing and finalRegionSize. Each level's distance field is computed when
+  /// the level starts and freed once it is done, so only one is kept at a time.
+  /// maxIterations is split between the levels rather than given to each of them: the level before the
+  /// last gets a quarter of it, each coarser level half of what the level after it gets, and the last
+  /// level gets the rest, so the coarse levels never take more than half of maxIterations.
+  /// Default is 1, which refines only at VoxelSpacing.
+  vtkSetMacro(PyramidLevels, int);
+  vtkGetMacro(PyramidLevels, int);
+  /// @}
+
+  /// @{
+  /// If true, the up and down spokes are optimized on separate threads. The two optimizations are
+  /// independent, so the result is the same either way. Progress events are still only invoked from
+  /// the thread that called Run. The two split the hardware threads their starts or patches run on.
+  /// Default is true.
+  vtkSetMacro(ConcurrentUpDown, bool);
+  vtkGetMacro(ConcurrentUpDown, bool);
+  vtkBooleanMacro(ConcurrentUpDown, bool);
+  /// @}
+
+  enum OptimizerType {
+    OptimizerNEWUOA = 0,
+    OptimizerLBFGS,
+  };
+
+  /// @{
+  /// The optimizer used for the up and down spokes.
+  /// OptimizerNEWUOA is derivative free and needs many evaluations for sreps with many spokes.
+  /// OptimizerLBFGS follows the gradient of the objective function, which is found by the chain rule
+  /// through the distance field's derivatives and the spoke interpolation. A gradient costs about as much
+  /// as a dozen full evaluations no matter how many spokes there are. For LBFGS the initialRegionSize and
+  /// finalRegionSize passed to Run are the longest and shortest line search steps, and maxIterations
+  /// is the maximum number of gradient evaluations. Default is OptimizerNEWUOA.
+  vtkSetClampMacro(Optimizer, int, OptimizerNEWUOA, OptimizerLBFGS);
+  vtkGetMacro(Optimizer, int);
+  void SetOptimizerToNEWUOA() { this->SetOptimizer(OptimizerNEWUOA); }
+  void SetOptimizerToLBFGS() { this->SetOptimizer(OptimizerLBFGS); }
+  /// @}
+
+  /// @{
+  /// If positive, the up and down spokes are refined by block coordinate descent instead of all at once.
+  /// The spoke grid is split into overlapping patches of about PatchSize + 2 * PatchOverlap lines and
+  /// steps, and each patch is optimized with NEWUOA while the other spokes are held fixed. Patches that
+  /// share no term of the objective are optimized in parallel. Each patch optimization gets up to
+  /// the pyramid level's share of maxIterations evaluations (see PyramidLevels). The Optimizer setting is not used for patches.
+  /// This keeps the optimizations small for sreps with many spokes, where optimizing every
+  /// coefficient at once is slow. 0 optimizes all spokes at once. Default is 0.
+  vtkSetMacro(PatchSize, int);
+  vtkGetMacro(PatchSize, int);
+  /// @}
+
+  /// @{
+  /// Number of spokes each patch extends past its tile on every side. Default is 1.
+  vtkSetMacro(PatchOverlap, int);
+  vtkGetMacro(PatchOverlap, int);
+  /// @}
+
+  /// @{
+  /// Maximum number of sweeps over all patches per pyramid level. Sweeping stops early once a sweep
+  /// moves no coefficient by more than finalRegionSize. Each sweep starts its patches with half the
+  /// trust region of the sweep before it. Default is 4.
+  vtkSetMacro(MaxPatchSweeps, int);
+  vtkGetMacro(MaxPatchSweeps, int);
+  /// @}
+
+  /// @{
+  /// Number of optimizations each pyramid level runs from different starting points for the up and down
+  /// spokes, keeping the spokes with the lowest objective. The first start is the usual one, and the
+  /// others jitter its coefficients by StartJitter and scale its trust region by powers of
+  /// StartRegionScale. The starts share the distance field and run in parallel, each with up to
+  /// the pyramid level's share of maxIterations evaluations (see PyramidLevels). Not used with PatchSize. Default is 1.
+  vtkSetMacro(NumberOfStarts, int);
+  vtkGetMacro(NumberOfStarts, int);
+  /// @}
+
+  /// @{
+  /// Standard deviation of the noise added to every coefficient of the extra starts. The coefficients
+  /// are a spoke's change of direction and of log radius, so 0.05 is about 3 degrees and 5% of the
+  /// radius. Default is 0.05.
+  vtkSetMacro(StartJitter, double);
+  vtkGetMacro(StartJitter, double);
+  /// @}
+
+  /// @{
+  /// Factor between the initial trust regions of successive extra starts, which alternate between
+  /// larger and smaller than initialRegionSize. 1 keeps every start's trust region. Default is 2.
+  vtkSetMacro(StartRegionScale, double);
+  vtkGetMacro(StartRegionScale, double);
+  /// @}
+
+  /// @{
+  /// Seed of the jitter, so refinements with the same seed start from the same points. Default is 0.
+  vtkSetMacro(StartSeed, int);
+  vtkGetMacro(StartSeed, int);
+  /// @}
+
+  /// @{
+  /// Wall time in seconds each stage of a refinement may take. The up spokes, down spokes and crest
+  /// spokes are separate stages, each with its own budget over all pyramid levels, and a stage's clock
+  /// starts when it first evaluates. Once a stage runs out, it keeps the best spokes found so far and any
+  /// remaining pyramid levels skip it. Crest spokes that were not reached keep their spokes.
+  /// 0 for no limit. Default is 0.
+  vtkSetMacro(StageTimeBudget, double);
+  vtkGetMacro(StageTimeBudget, double);
+  /// @}
+
+  /// @{
+  /// Number of evaluations each stage of a refinement may do, with the same stages as StageTimeBudget.
+  /// For the up and down spokes these are objective function evaluations, and for the crest spokes they
+  /// are distance evaluations. 0 for no limit. Default is 0.
+  vtkSetMacro(StageEvaluationBudget, int);
+  vtkGetMacro(StageEvaluationBudget, int);
+  /// @}
+
+  /// @{
+  /// If not empty, the state of a refinement is written to this file every CheckpointInterval seconds,
+  /// at the start and end of every pyramid level, and when it is cancelled. A later refinement with the
+  /// same model, srep, parameters and settings resumes from it, e.g. after a crash. The checkpoint is
+  /// removed once a refinement finishes. Checkpoints of other refinements are ignored.
+  ///
+  /// The optimizer's internal model is not saved, so a resumed optimization restarts from the best
+  /// spokes found so far with the trust region radius and the evaluations it had left. The stage
+  /// budgets are part of the settings that have to match, and they start over when a refinement is
+  /// resumed. Default is empty.
+  void SetCheckpointFileName(const std::string& fileName);
+  std::string GetCheckpointFileName() const;
+  /// @}
+
+  /// @{
+  /// Minimum seconds between checkpoints while a pyramid level is being refined. Default is 60.
+  vtkSetMacro(CheckpointInterval, double);
+  vtkGetMacro(CheckpointInterval, double);
+  /// @}
+
+  /// Why a stage of a refinement stopped, the same as sreprefinement::StopReason.
+  enum StopReasonType {
+    StopReasonCompleted = 0,
+    StopReasonTimeBudget,
+    StopReasonEvaluationBudget,
+    StopReasonCancelled,
+  };
+
+  /// The stages of a refinement, in the order they run.
+  enum StageType {
+    StageUp = 0,
+    StageDown,
+    StageCrest,
+  };
+
+  /// Gets how each stage of the most recent Run stopped.
+  const sreprefinement::RefinementStatus& GetLastRefinementStatus() const;
+
+  /// Python friendly GetLastRefinementStatus. Gets the StopReasonType of the given StageType.
+  int GetLastStopReason(int stage) const;
+
+  /// Gets the name of a StopReasonType, e.g. "time budget".
+  static const char* GetStopReasonAsString(int stopReason);
+
+  /// @{
+  /// Number of objective function evaluations kept by the telemetry. Once full, the oldest
+  /// evaluations are overwritten. 0 records nothing. Default is 10000.
+  vtkSetMacro(TelemetryCapacity, int);
+  vtkGetMacro(TelemetryCapacity, int);
+  /// @}
+
+  /// @{
+  /// Prints every nth objective function evaluation to the console. 0 prints nothing. Default is 0.
+  vtkSetMacro(ConsoleOutputInterval, int);
+  vtkGetMacro(ConsoleOutputInterval, int);
+  /// @}
+
+  /// @{
+  /// Minimum seconds between the partial results RunAsync hands to its task. Building a partial
+  /// result copies the srep, so this throttles how often that happens. Default is 1.
+  vtkSetMacro(PublishInterval, double);
+  vtkGetMacro(PublishInterval, double);
+  /// @}
+
+  /// Gets the objective function evaluations recorded by the most recent Run.
+  const sreprefinement::RefinementTelemetry& GetTelemetry() const;
+
+  /// Python friendly GetTelemetry. Replaces the contents of table with one row per kept evaluation,
+  /// oldest first, and the columns of WriteTelemetryAsCSV: iteration, time, level, spokes ("up" or
+  /// "down"), L0, L1, L2 and value.
+  void GetTelemetryAsTable(vtkTable* table) const;
+
+  /// @{
+  /// Writes the objective function evaluations recorded by the most recent Run.
+  /// \returns false if the file could not be written.
+  bool WriteTelemetryAsCSV(const std::string& fileName) const;
+  bool WriteTelemetryAsJSON(const std::string& fileName) const;
+  /// @}
+
 protected:
   vtkSlicerSRepRefinementLogic();
   virtual ~vtkSlicerSRepRefinementLogic();
 private:
   void ProgressCallback(double progress);
+  void ValidateRunArguments(
+    vtkMRMLModelNode* model,
+    vtkMRMLEllipticalSRepNode* srepNode,
+    int maxIterations,
+    int interpolationLevel) const;
+  /// Applies the telemetry settings and restarts it for a new refinement.
+  sreprefinement::RefinementTelemetry* StartTelemetry();
+  /// Gets the cache to use for a new refinement, or nullptr if the cache is off or unavailable.
+  std::shared_ptr<const sreprefinement::SDFCache> CreateSDFCache();
+
+  int DistanceMethod;
+  double VoxelSpacing;
+  int NarrowBandWidth;
+  int DistanceMapThreads;
+  int PyramidLevels;
+  bool ConcurrentUpDown;
+  int Optimizer;
+  int PatchSize;
+  int PatchOverlap;
+  int MaxPatchSweeps;
+  int NumberOfStarts;
+  double StartJitter;
+  double StartRegionScale;
+  int StartSeed;
+  double StageTimeBudget;
+  int StageEvaluationBudget;
+  std::string CheckpointFileName;
+  double CheckpointInterval;
+  int TelemetryCapacity;
+  int ConsoleOutputInterval;
+  double PublishInterval;
+  int BatchThreads;
+  bool UseSDFCache;
+  std::string SDFCacheDirectory;
+  int SDFCacheSizeLimit;
+  std::vector<sreprefinement::BatchJobResult> BatchResults;
+  std::vector<sreprefinement::RefinementStatus> BatchRefinementStatuses;
+  sreprefinement::RefinementStatus LastRefinementStatus;
+  std::unique_ptr<sreprefinement::RefinementTelemetry> Telemetry;
 
   vtkSlicerSRepRefinementLogic(const vtkSlicerSRepRefinementLogic&); // Not implemented
   void operator=(const vtkSlicerSRepRefinementLogic&); // Not implemented
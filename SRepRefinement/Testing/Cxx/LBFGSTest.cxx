@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include <SRepLBFGS.h>
+
+#include <stdexcept>
+#include <vector>
+
+using sreprefinement::LBFGSSettings;
+using sreprefinement::MinimizeLBFGS;
+
+TEST(LBFGSTest, Rosenbrock) {
+  size_t numEvaluations = 0;
+  const auto rosenbrock = [&](const double* x, double* gradient) {
+    ++numEvaluations;
+    const double a = 1 - x[0];
+    const double b = x[1] - x[0] * x[0];
+    gradient[0] = -2 * a - 400 * x[0] * b;
+    gradient[1] = 200 * b;
+    return a * a + 100 * b * b;
+  };
+
+  LBFGSSettings settings;
+  settings.maxEvaluations = 500;
+  settings.maxStepLength = 1.0;
+  settings.minStepLength = 1e-12;
+  double x[2] = {-1.2, 1.0};
+  const double value = MinimizeLBFGS(2, x, rosenbrock, settings);
+  EXPECT_NEAR(1.0, x[0], 1e-4);
+  EXPECT_NEAR(1.0, x[1], 1e-4);
+  EXPECT_NEAR(0.0, value, 1e-8);
+  EXPECT_LE(numEvaluations, settings.maxEvaluations);
+}
+
+TEST(LBFGSTest, QuadraticNeedsFewEvaluations) {
+  constexpr size_t n = 50;
+  size_t numEvaluations = 0;
+  // ill conditioned separable quadratic with its minimum at x[i] = i
+  const auto quadratic = [&](const double* x, double* gradient) {
+    ++numEvaluations;
+    double value = 0;
+    for (size_t i = 0; i < n; ++i) {
+      const double scale = 1.0 + i;
+      const double d = x[i] - static_cast<double>(i);
+      value += 0.5 * scale * d * d;
+      gradient[i] = scale * d;
+    }
+    return value;
+  };
+
+  LBFGSSettings settings;
+  settings.maxEvaluations = 200;
+  settings.maxStepLength = 100.0;
+  settings.minStepLength = 1e-12;
+  std::vector<double> x(n, 0.0);
+  MinimizeLBFGS(n, x.data(), quadratic, settings);
+  for (size_t i = 0; i < n; ++i) {
+    EXPECT_NEAR(static_cast<double>(i), x[i], 1e-5);
+  }
+  EXPECT_LT(numEvaluations, 100u);
+}
+
+TEST(LBFGSTest, RespectsLimits) {
+  size_t numEvaluations = 0;
+  const auto line = [&](const double* x, double* gradient) {
+    ++numEvaluations;
+    gradient[0] = 1.0;
+    return x[0];
+  };
+
+  LBFGSSettings settings;
+  settings.maxEvaluations = 5;
+  settings.maxStepLength = 0.5;
+  double x = 0.0;
+  const double value = MinimizeLBFGS(1, &x, line, settings);
+  EXPECT_EQ(5u, numEvaluations);
+  EXPECT_DOUBLE_EQ(x, value);
+  // no step is longer than maxStepLength
+  EXPECT_GE(x, -0.5 * 4 - 1e-12);
+  EXPECT_LT(x, 0.0);
+
+  settings.minStepLength = 1.0;
+  EXPECT_THROW(MinimizeLBFGS(1, &x, line, settings), std::invalid_argument);
+}
+
+TEST(LBFGSTest, ExceptionsKeepBestPoint) {
+  size_t numEvaluations = 0;
+  const auto f = [&](const double* x, double* gradient) {
+    if (++numEvaluations == 4) {
+      throw std::runtime_error("stop");
+    }
+    gradient[0] = 2 * (x[0] - 3);
+    return (x[0] - 3) * (x[0] - 3);
+  };
+
+  LBFGSSettings settings;
+  settings.maxStepLength = 1.0;
+  double x = 0.0;
+  EXPECT_THROW(MinimizeLBFGS(1, &x, f, settings), std::runtime_error);
+  EXPECT_GT(x, 0.0);
+  EXPECT_LE(x, 3.0);
+}
@@ -0,0 +1,203 @@
+#include <gtest/gtest.h>
+#include <SRepMeshDistanceSampler.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+using sreprefinement::MeshDistanceSampler;
+
+namespace {
+
+// [-1, 1]^3 with outward facing triangles. Vertex x + 2y + 4z is at (2x - 1, 2y - 1, 2z - 1).
+struct Cube {
+  std::vector<double> points;
+  std::vector<size_t> triangles{
+    0, 2, 3,  0, 3, 1, // -z
+    4, 5, 7,  4, 7, 6, // +z
+    0, 1, 5,  0, 5, 4, // -y
+    2, 6, 7,  2, 7, 3, // +y
+    0, 4, 6,  0, 6, 2, // -x
+    1, 3, 7,  1, 7, 5, // +x
+  };
+
+  Cube() {
+    for (size_t i = 0; i < 8; ++i) {
+      points.insert(points.end(), {2.0 * (i & 1) - 1, 2.0 * ((i >> 1) & 1) - 1, 2.0 * ((i >> 2) & 1) - 1});
+    }
+  }
+};
+
+double BoxDistance(const double p[3]) {
+  double outside = 0.0;
+  double largest = -std::numeric_limits<double>::infinity();
+  for (size_t c = 0; c < 3; ++c) {
+    const double q = std::abs(p[c]) - 1;
+    outside += std::max(q, 0.0) * std::max(q, 0.0);
+    largest = std::max(largest, q);
+  }
+  return std::sqrt(outside) + std::min(largest, 0.0);
+}
+
+// unit sphere with numRings rings of numSegments vertices between the poles, facing outward
+struct Sphere {
+  std::vector<double> points;
+  std::vector<size_t> triangles;
+
+  Sphere(size_t numRings, size_t numSegments) {
+    const double pi = std::acos(-1.0);
+    points.insert(points.end(), {0.0, 0.0, 1.0});
+    for (size_t r = 1; r <= numRings; ++r) {
+      const double theta = pi * r / (numRings + 1);
+      for (size_t s = 0; s < numSegments; ++s) {
+        const double phi = 2 * pi * s / numSegments;
+        points.insert(points.end(), {std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta)});
+      }
+    }
+    points.insert(points.end(), {0.0, 0.0, -1.0});
+    const size_t south = numRings * numSegments + 1;
+    const auto ring = [&](size_t r, size_t s) { return 1 + (r - 1) * numSegments + s % numSegments; };
+    for (size_t s = 0; s < numSegments; ++s) {
+      triangles.insert(triangles.end(), {0, ring(1, s), ring(1, s + 1)});
+      for (size_t r = 1; r < numRings; ++r) {
+        triangles.insert(triangles.end(), {ring(r, s), ring(r + 1, s), ring(r + 1, s + 1)});
+        triangles.insert(triangles.end(), {ring(r, s), ring(r + 1, s + 1), ring(r, s + 1)});
+      }
+      triangles.insert(triangles.end(), {ring(numRings, s), south, ring(numRings, s + 1)});
+    }
+  }
+};
+
+} // namespace {}
+
+TEST(MeshDistanceSamplerTest, Construction) {
+  Cube cube;
+  const MeshDistanceSampler sampler(cube.points, cube.triangles, 1.0);
+  EXPECT_EQ(12u, sampler.GetNumberOfTriangles());
+  EXPECT_LT(0u, sampler.GetMemorySize());
+
+  EXPECT_THROW(MeshDistanceSampler(cube.points, cube.triangles, 0.0), std::invalid_argument);
+  EXPECT_THROW(MeshDistanceSampler(cube.points, {0, 1, 8}, 1.0), std::invalid_argument);
+  // no triangle with area
+  EXPECT_THROW(MeshDistanceSampler(cube.points, {0, 1, 1}, 1.0), std::invalid_argument);
+  EXPECT_THROW(MeshDistanceSampler(cube.points, {}, 1.0), std::invalid_argument);
+}
+
+TEST(MeshDistanceSamplerTest, CubeDistances) {
+  Cube cube;
+  const MeshDistanceSampler sampler(cube.points, cube.triangles, 1.0);
+
+  std::mt19937 generator(7);
+  std::uniform_real_distribution<double> coordinate(-3.0, 3.0);
+  std::vector<double> points(3 * 500);
+  for (auto& c : points) {
+    c = coordinate(generator);
+  }
+  std::vector<double> distances(500);
+  sampler.Sample(500, points.data(), distances.data(), nullptr);
+  for (size_t i = 0; i < 500; ++i) {
+    EXPECT_NEAR(BoxDistance(&points[3 * i]), distances[i], 1e-12);
+  }
+
+  const MeshDistanceSampler scaled(cube.points, cube.triangles, 0.5);
+  double distance = 0.0;
+  double normal[3];
+  const double outside[3] = {3.0, 0.0, 0.0};
+  scaled.Sample(outside, distance, normal);
+  EXPECT_DOUBLE_EQ(1.0, distance);
+}
+
+TEST(MeshDistanceSamplerTest, CubeNormals) {
+  Cube cube;
+  const MeshDistanceSampler sampler(cube.points, cube.triangles, 1.0);
+  const double r = 1 / std::sqrt(2.0);
+  const std::vector<double> points{
+    2.0, 0.1, -0.2, // outside a face
+    0.5, 0.0, 0.0,  // inside, closest to the +x face
+    2.0, 2.0, 0.0,  // outside an edge
+    1.0, 0.3, 0.3,  // on a face
+    1.0, 1.0, 0.0,  // on an edge
+  };
+  const std::vector<double> expected{
+    1, 0, 0,
+    1, 0, 0,
+    r, r, 0,
+    1, 0, 0,
+    r, r, 0,
+  };
+  std::vector<double> distances(5);
+  std::vector<double> normals(15);
+  sampler.Sample(5, points.data(), distances.data(), normals.data());
+  for (size_t i = 0; i < normals.size(); ++i) {
+    EXPECT_NEAR(expected[i], normals[i], 1e-12) << "component " << i;
+  }
+  EXPECT_DOUBLE_EQ(-0.5, distances[1]);
+  EXPECT_NEAR(0.0, distances[3], 1e-12);
+}
+
+TEST(MeshDistanceSamplerTest, InwardWindingIsFlipped) {
+  Cube cube;
+  auto inward = cube.triangles;
+  for (size_t t = 0; t < inward.size(); t += 3) {
+    std::swap(inward[t + 1], inward[t + 2]);
+  }
+  const MeshDistanceSampler outwardSampler(cube.points, cube.triangles, 1.0);
+  const MeshDistanceSampler inwardSampler(cube.points, inward, 1.0);
+
+  std::mt19937 generator(11);
+  std::uniform_real_distribution<double> coordinate(-3.0, 3.0);
+  std::vector<double> points(3 * 200);
+  for (auto& c : points) {
+    c = coordinate(generator);
+  }
+  std::vector<double> expectedDistances(200);
+  std::vector<double> expectedNormals(3 * 200);
+  std::vector<double> distances(200);
+  std::vector<double> normals(3 * 200);
+  outwardSampler.Sample(200, points.data(), expectedDistances.data(), expectedNormals.data());
+  inwardSampler.Sample(200, points.data(), distances.data(), normals.data());
+  for (size_t i = 0; i < distances.size(); ++i) {
+    EXPECT_DOUBLE_EQ(expectedDistances[i], distances[i]);
+  }
+  for (size_t i = 0; i < normals.size(); ++i) {
+    EXPECT_NEAR(expectedNormals[i], normals[i], 1e-12);
+  }
+}
+
+TEST(MeshDistanceSamplerTest, SphereBatchMatchesSinglePoints) {
+  Sphere sphere(40, 80);
+  const MeshDistanceSampler sampler(sphere.points, sphere.triangles, 1.0);
+
+  std::mt19937 generator(11);
+  std::uniform_real_distribution<double> coordinate(-1.5, 1.5);
+  constexpr size_t count = 1000;
+  std::vector<double> points(3 * count);
+  for (auto& c : points) {
+    c = coordinate(generator);
+  }
+  std::vector<double> distances(count);
+  std::vector<double> normals(3 * count);
+  sampler.Sample(count, points.data(), distances.data(), normals.data());
+
+  for (size_t i = 0; i < count; ++i) {
+    const double* p = &points[3 * i];
+    const double length = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+    // the facets are at most about 1 - cos(pi / 80) inside the unit sphere
+    EXPECT_NEAR(length - 1, distances[i], 2e-3);
+    if (std::abs(length - 1) > 0.1) {
+      for (size_t c = 0; c < 3; ++c) {
+        EXPECT_NEAR(p[c] / length, normals[3 * i + c], 0.05);
+      }
+    }
+
+    // the result doesn't depend on the points sampled before
+    double distance = 0.0;
+    double normal[3];
+    sampler.Sample(p, distance, normal);
+    EXPECT_EQ(distances[i], distance);
+    EXPECT_EQ(normals[3 * i], normal[0]);
+  }
+}
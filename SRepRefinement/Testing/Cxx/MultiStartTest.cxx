@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include <SRepMultiStart.h>
+#include <SRepRefinementTelemetry.h>
+#include <vtkSlicerSRepRefinementLogic.h>
+
+#include "SRepRefinementTestHelpers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+using sreprefinement::CreateRefinementStarts;
+using sreprefinement::RefinementTelemetry;
+
+namespace {
+
+// the lowest objective function value evaluated for the given spokes, which is the one the refinement keeps
+double GetBestValue(const RefinementTelemetry& telemetry, RefinementTelemetry::Spokes spokes) {
+  double best = std::numeric_limits<double>::infinity();
+  for (const auto& evaluation : telemetry.GetEvaluations()) {
+    if (evaluation.spokes == spokes) {
+      best = std::min(best, evaluation.value);
+    }
+  }
+  return best;
+}
+
+} // namespace {}
+
+TEST(MultiStartTest, FirstStartIsUnchanged) {
+  const std::vector<double> coefficients{1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.5};
+  const auto starts = CreateRefinementStarts(coefficients, 0.1, 0.001, 4, 0.05, 2.0, 7);
+  ASSERT_EQ(4u, starts.size());
+  EXPECT_EQ(coefficients, starts[0].coefficients);
+  EXPECT_EQ(0.1, starts[0].regionSize);
+  for (size_t i = 1; i < starts.size(); ++i) {
+    ASSERT_EQ(coefficients.size(), starts[i].coefficients.size());
+    EXPECT_NE(coefficients, starts[i].coefficients);
+  }
+}
+
+TEST(MultiStartTest, RegionSizesAlternate) {
+  const std::vector<double> coefficients(4, 0.0);
+  const auto starts = CreateRefinementStarts(coefficients, 0.1, 0.02, 7, 0.0, 2.0, 0);
+  ASSERT_EQ(7u, starts.size());
+  EXPECT_DOUBLE_EQ(0.1, starts[0].regionSize);
+  EXPECT_DOUBLE_EQ(0.2, starts[1].regionSize);
+  EXPECT_DOUBLE_EQ(0.05, starts[2].regionSize);
+  EXPECT_DOUBLE_EQ(0.4, starts[3].regionSize);
+  EXPECT_DOUBLE_EQ(0.025, starts[4].regionSize);
+  EXPECT_DOUBLE_EQ(0.8, starts[5].regionSize);
+  // clamped to the minimum
+  EXPECT_DOUBLE_EQ(0.02, starts[6].regionSize);
+  // no jitter leaves the coefficients alone
+  for (const auto& start : starts) {
+    EXPECT_EQ(coefficients, start.coefficients);
+  }
+}
+
+TEST(MultiStartTest, JitterIsReproducible) {
+  const std::vector<double> coefficients(4000, 1.0);
+  const auto a = CreateRefinementStarts(coefficients, 0.1, 0.001, 3, 0.05, 1.0, 42);
+  const auto b = CreateRefinementStarts(coefficients, 0.1, 0.001, 3, 0.05, 1.0, 42);
+  const auto c = CreateRefinementStarts(coefficients, 0.1, 0.001, 3, 0.05, 1.0, 43);
+  EXPECT_EQ(a[1].coefficients, b[1].coefficients);
+  EXPECT_EQ(a[2].coefficients, b[2].coefficients);
+  EXPECT_NE(a[1].coefficients, c[1].coefficients);
+  EXPECT_NE(a[1].coefficients, a[2].coefficients);
+  EXPECT_EQ(0.1, a[1].regionSize);
+
+  double sum = 0.0;
+  double sumSquares = 0.0;
+  for (const auto x : a[1].coefficients) {
+    sum += x - 1.0;
+    sumSquares += (x - 1.0) * (x - 1.0);
+  }
+  const double n = static_cast<double>(coefficients.size());
+  EXPECT_NEAR(0.0, sum / n, 0.005);
+  EXPECT_NEAR(0.05, std::sqrt(sumSquares / n), 0.005);
+}
+
+TEST(MultiStartTest, InvalidArguments) {
+  const std::vector<double> coefficients(4, 0.0);
+  EXPECT_THROW(CreateRefinementStarts(coefficients, 0.1, 0.01, 0, 0.05, 2.0, 0), std::invalid_argument);
+  EXPECT_THROW(CreateRefinementStarts(coefficients, 0.1, 0.01, 2, -0.05, 2.0, 0), std::invalid_argument);
+  EXPECT_THROW(CreateRefinementStarts(coefficients, 0.1, 0.01, 2, 0.05, 0.5, 0), std::invalid_argument);
+}
+
+TEST(MultiStartTest, NeverWorseThanFirstStart) {
+  const auto model = srepRefinementTestHelpers::MakeEllipsoidModel();
+  const auto srep = srepRefinementTestHelpers::MakeEllipsoidSRep(8, 4);
+
+  const auto refine = [&](int numberOfStarts) {
+    auto logic = vtkSmartPointer<vtkSlicerSRepRefinementLogic>::New();
+    logic->SetDistanceMethodToMesh();
+    logic->SetPyramidLevels(1);
+    logic->SetNumberOfStarts(numberOfStarts);
+    // keep every evaluation so the best one is never overwritten
+    logic->SetTelemetryCapacity(1000000);
+    auto refined = vtkSmartPointer<vtkMRMLEllipticalSRepNode>::New();
+    logic->Run(model, srep, 0.01, 0.0001, 200, 1, 0.004, 20, 50, refined);
+    EXPECT_TRUE(logic->GetLastRefinementStatus().IsCompleted());
+    return logic;
+  };
+
+  // the first start is the single start refinement, so the best of the starts can only improve on it
+  const auto single = refine(1);
+  const auto multi = refine(4);
+  for (const auto spokes : {RefinementTelemetry::Spokes::Up, RefinementTelemetry::Spokes::Down}) {
+    const double singleValue = GetBestValue(single->GetTelemetry(), spokes);
+    const double multiValue = GetBestValue(multi->GetTelemetry(), spokes);
+    ASSERT_TRUE(std::isfinite(singleValue));
+    EXPECT_LE(multiValue, singleValue + 1e-12 * std::abs(singleValue));
+  }
+}
@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+#include <SRepPrincipalCurvatures.h>
+
+#include <vtkCellArray.h>
+#include <vtkCurvatures.h>
+#include <vtkDataArray.h>
+#include <vtkIdList.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkPolyData.h>
+#include <vtkSphereSource.h>
+#include <vtkTransform.h>
+#include <vtkTransformPolyDataFilter.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+using sreprefinement::ComputePrincipalCurvatures;
+
+namespace {
+
+// sphere of the given radius with numRings rings of numSegments vertices between the poles, facing outward
+struct Sphere {
+  std::vector<double> points;
+  std::vector<size_t> triangles;
+
+  Sphere(double radius, size_t numRings, size_t numSegments) {
+    const double pi = std::acos(-1.0);
+    points.insert(points.end(), {0.0, 0.0, radius});
+    for (size_t r = 1; r <= numRings; ++r) {
+      const double theta = pi * r / (numRings + 1);
+      for (size_t s = 0; s < numSegments; ++s) {
+        const double phi = 2 * pi * s / numSegments;
+        points.insert(points.end(), {
+          radius * std::sin(theta) * std::cos(phi), radius * std::sin(theta) * std::sin(phi), radius * std::cos(theta)});
+      }
+    }
+    points.insert(points.end(), {0.0, 0.0, -radius});
+
+    const size_t south = 1 + numRings * numSegments;
+    const auto ring = [numSegments](size_t r, size_t s) { return 1 + (r - 1) * numSegments + s % numSegments; };
+    for (size_t s = 0; s < numSegments; ++s) {
+      triangles.insert(triangles.end(), {0, ring(1, s), ring(1, s + 1)});
+      for (size_t r = 1; r < numRings; ++r) {
+        triangles.insert(triangles.end(), {ring(r, s), ring(r + 1, s), ring(r + 1, s + 1)});
+        triangles.insert(triangles.end(), {ring(r, s), ring(r + 1, s + 1), ring(r, s + 1)});
+      }
+      triangles.insert(triangles.end(), {south, ring(numRings, s + 1), ring(numRings, s)});
+    }
+  }
+};
+
+// Compares the principal curvatures of a triangulated mesh against the ones combined from vtkCurvatures's Gaussian
+// and mean curvature
+void ExpectMatchesVTKCurvatures(vtkPolyData* polyData) {
+  std::vector<double> points(3 * polyData->GetNumberOfPoints());
+  for (vtkIdType i = 0; i < polyData->GetNumberOfPoints(); ++i) {
+    polyData->GetPoint(i, &points[3 * i]);
+  }
+  std::vector<size_t> triangles;
+  vtkNew<vtkIdList> cell;
+  auto* polys = polyData->GetPolys();
+  polys->InitTraversal();
+  while (polys->GetNextCell(cell)) {
+    ASSERT_EQ(cell->GetNumberOfIds(), 3);
+    for (vtkIdType i = 0; i < 3; ++i) {
+      triangles.push_back(static_cast<size_t>(cell->GetId(i)));
+    }
+  }
+  const auto curvatures = ComputePrincipalCurvatures(points, triangles);
+
+  vtkNew<vtkCurvatures> gaussFilter;
+  gaussFilter->SetInputData(polyData);
+  gaussFilter->SetCurvatureTypeToGaussian();
+  gaussFilter->Update();
+  vtkNew<vtkCurvatures> meanFilter;
+  meanFilter->SetInputData(polyData);
+  meanFilter->SetCurvatureTypeToMean();
+  meanFilter->Update();
+  auto* gaussCurvatures = gaussFilter->GetOutput()->GetPointData()->GetArray("Gauss_Curvature");
+  auto* meanCurvatures = meanFilter->GetOutput()->GetPointData()->GetArray("Mean_Curvature");
+  ASSERT_NE(gaussCurvatures, nullptr);
+  ASSERT_NE(meanCurvatures, nullptr);
+
+  ASSERT_EQ(curvatures.minimum.size(), static_cast<size_t>(polyData->GetNumberOfPoints()));
+  ASSERT_EQ(curvatures.maximum.size(), static_cast<size_t>(polyData->GetNumberOfPoints()));
+  for (vtkIdType i = 0; i < polyData->GetNumberOfPoints(); ++i) {
+    const double gauss = gaussCurvatures->GetTuple1(i);
+    const double mean = meanCurvatures->GetTuple1(i);
+    const double root = std::sqrt(std::max(0.0, mean * mean - gauss));
+    const double tolerance = 1e-6 * std::max(1.0, std::abs(mean) + root);
+    EXPECT_NEAR(curvatures.minimum[i], mean - root, tolerance) << "point " << i;
+    EXPECT_NEAR(curvatures.maximum[i], mean + root, tolerance) << "point " << i;
+  }
+}
+
+}
+
+//----------------------------------------------------------------------------
+TEST(PrincipalCurvatures, Sphere) {
+  // both principal curvatures of a sphere are 1 / radius
+  const Sphere sphere(2.0, 30, 60);
+  const auto curvatures = ComputePrincipalCurvatures(sphere.points, sphere.triangles);
+  ASSERT_EQ(curvatures.minimum.size(), sphere.points.size() / 3);
+  ASSERT_EQ(curvatures.maximum.size(), sphere.points.size() / 3);
+  // the poles have a fan of long thin triangles, so only the rings away from them are checked
+  for (size_t i = 1 + 5 * 60; i < 1 + 25 * 60; ++i) {
+    EXPECT_LE(curvatures.minimum[i], curvatures.maximum[i]);
+    EXPECT_NEAR(std::abs(curvatures.minimum[i]), 0.5, 0.05) << "point " << i;
+    EXPECT_NEAR(std::abs(curvatures.maximum[i]), 0.5, 0.05) << "point " << i;
+  }
+}
+
+//----------------------------------------------------------------------------
+TEST(PrincipalCurvatures, IndexOutOfRange) {
+  const std::vector<double> points{0, 0, 0, 1, 0, 0, 0, 1, 0};
+  EXPECT_THROW(ComputePrincipalCurvatures(points, {0, 1, 3}), std::invalid_argument);
+  EXPECT_NO_THROW(ComputePrincipalCurvatures(points, {0, 1, 2}));
+}
+
+//----------------------------------------------------------------------------
+TEST(PrincipalCurvatures, MatchesVTKCurvaturesOnSphere) {
+  vtkNew<vtkSphereSource> sphere;
+  sphere->SetRadius(2.0);
+  sphere->SetThetaResolution(40);
+  sphere->SetPhiResolution(30);
+  sphere->Update();
+  ExpectMatchesVTKCurvatures(sphere->GetOutput());
+}
+
+//----------------------------------------------------------------------------
+TEST(PrincipalCurvatures, MatchesVTKCurvaturesOnEllipsoid) {
+  vtkNew<vtkSphereSource> sphere;
+  sphere->SetRadius(1.0);
+  sphere->SetThetaResolution(40);
+  sphere->SetPhiResolution(30);
+  vtkNew<vtkTransform> transform;
+  transform->Scale(3.0, 2.0, 1.0);
+  vtkNew<vtkTransformPolyDataFilter> ellipsoid;
+  ellipsoid->SetInputConnection(sphere->GetOutputPort());
+  ellipsoid->SetTransform(transform);
+  ellipsoid->Update();
+  ExpectMatchesVTKCurvatures(ellipsoid->GetOutput());
+}
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+#include <SRepRSradKernel.h>
+
+#include <Eigen/Dense>
+#include <Eigen/Eigenvalues>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+using sreprefinement::ComputeRSradPenalties;
+using sreprefinement::RSradBatch;
+
+namespace {
+
+// the penalty computed with general matrices, as in Han, Qiong's dissertation
+double ReferencePenalty(const RSradBatch& batch, size_t k) {
+  Eigen::Vector3d U(batch.U[0][k], batch.U[1][k], batch.U[2][k]);
+  Eigen::Vector3d dxdu(batch.dxdu[0][k], batch.dxdu[1][k], batch.dxdu[2][k]);
+  Eigen::Vector3d dxdv(batch.dxdv[0][k], batch.dxdv[1][k], batch.dxdv[2][k]);
+  Eigen::Vector3d dSdu(batch.dSdu[0][k], batch.dSdu[1][k], batch.dSdu[2][k]);
+  Eigen::Vector3d dSdv(batch.dSdv[0][k], batch.dSdv[1][k], batch.dSdv[2][k]);
+
+  const Eigen::Matrix3d UTU = U * U.transpose() - Eigen::Matrix3d::Identity();
+  Eigen::MatrixXd Q(2, 3);
+  Q.row(0) = dxdu.transpose() * UTU;
+  Q.row(1) = dxdv.transpose() * UTU;
+  Eigen::MatrixXd leftSide(2, 3);
+  leftSide.row(0) = (dSdu - batch.drdu[k] * U).transpose();
+  leftSide.row(1) = (dSdv - batch.drdv[k] * U).transpose();
+
+  const Eigen::MatrixXd rightSide = Q.transpose() * (Q * Q.transpose()).inverse();
+  Eigen::MatrixXd rSradMat = leftSide * rightSide;
+  rSradMat.transposeInPlace();
+  Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigensolver(rSradMat);
+  return std::max(0.0, eigensolver.eigenvalues()[1] - 1);
+}
+
+void FillRandom(RSradBatch& batch, std::mt19937& generator) {
+  std::normal_distribution<double> normal(0.0, 1.0);
+  for (size_t k = 0; k < RSradBatch::Size; ++k) {
+    const Eigen::Vector3d U = Eigen::Vector3d(normal(generator), normal(generator), normal(generator)).normalized();
+    for (size_t c = 0; c < 3; ++c) {
+      batch.U[c][k] = U[c];
+      batch.dxdu[c][k] = normal(generator);
+      batch.dxdv[c][k] = normal(generator);
+      batch.dSdu[c][k] = normal(generator);
+      batch.dSdv[c][k] = normal(generator);
+    }
+    batch.drdu[k] = normal(generator);
+    batch.drdv[k] = normal(generator);
+  }
+}
+
+} // namespace {}
+
+TEST(RSradKernelTest, MatchesGeneralMatrices) {
+  std::mt19937 generator(3);
+  size_t numPositive = 0;
+  for (int i = 0; i < 200; ++i) {
+    RSradBatch batch;
+    FillRandom(batch, generator);
+    double penalties[RSradBatch::Size];
+    ComputeRSradPenalties(batch, penalties);
+    for (size_t k = 0; k < RSradBatch::Size; ++k) {
+      const double expected = ReferencePenalty(batch, k);
+      EXPECT_NEAR(expected, penalties[k], 1e-9 * (1 + std::abs(expected)));
+      numPositive += penalties[k] > 0;
+    }
+  }
+  // make sure both sides of the max were tested
+  EXPECT_LT(0u, numPositive);
+  EXPECT_GT(200 * RSradBatch::Size, numPositive);
+}
+
+TEST(RSradKernelTest, DegenerateLaneIsZero) {
+  std::mt19937 generator(5);
+  RSradBatch batch;
+  FillRandom(batch, generator);
+  // the unit direction doesn't change along the lines or steps, so Q Q^T is singular
+  for (size_t c = 0; c < 3; ++c) {
+    batch.dxdu[c][2] = 0.0;
+    batch.dxdv[c][2] = 0.0;
+  }
+  batch.dxdu[0][4] = std::numeric_limits<double>::quiet_NaN();
+
+  double penalties[RSradBatch::Size];
+  ComputeRSradPenalties(batch, penalties);
+  EXPECT_EQ(0.0, penalties[2]);
+  EXPECT_EQ(0.0, penalties[4]);
+  EXPECT_NEAR(ReferencePenalty(batch, 3), penalties[3], 1e-9 * (1 + penalties[3]));
+}
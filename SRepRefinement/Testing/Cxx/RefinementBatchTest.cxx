@@ -0,0 +1,165 @@
+#include <gtest/gtest.h>
+#include <SRepRefinementBatch.h>
+#include <vtkSlicerSRepRefinementLogic.h>
+
+#include "SRepRefinementTestHelpers.h"
+
+#include <vtkCallbackCommand.h>
+#include <vtkCommand.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using sreprefinement::RunBatch;
+
+TEST(RefinementBatchTest, RunsEveryJobOnce) {
+  constexpr size_t numJobs = 50;
+  std::vector<std::atomic<int>> runs(numJobs);
+  for (auto& r : runs) {
+    r = 0;
+  }
+  std::vector<size_t> finished;
+  const auto callingThread = std::this_thread::get_id();
+
+  const auto results = RunBatch(numJobs, 4,
+    [&](size_t job) { ++runs[job]; },
+    [&](size_t job) {
+      EXPECT_EQ(callingThread, std::this_thread::get_id());
+      finished.push_back(job);
+    });
+
+  ASSERT_EQ(numJobs, results.size());
+  for (size_t i = 0; i < numJobs; ++i) {
+    EXPECT_EQ(1, runs[i]);
+    EXPECT_TRUE(results[i].succeeded);
+    EXPECT_GE(results[i].seconds, 0.0);
+    EXPECT_TRUE(results[i].errorMessage.empty());
+  }
+  EXPECT_EQ(numJobs, std::set<size_t>(finished.begin(), finished.end()).size());
+}
+
+TEST(RefinementBatchTest, CallingThreadWorks) {
+  constexpr size_t numJobs = 20;
+  const auto callingThread = std::this_thread::get_id();
+  std::vector<std::thread::id> workers(numJobs);
+  std::vector<size_t> finished;
+
+  const auto results = RunBatch(numJobs, 3,
+    [&](size_t job) {
+      workers[job] = std::this_thread::get_id();
+      // long enough that every thread gets some of the jobs
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    },
+    [&](size_t job) {
+      EXPECT_EQ(callingThread, std::this_thread::get_id());
+      finished.push_back(job);
+    },
+    true);
+
+  ASSERT_EQ(numJobs, results.size());
+  for (const auto& result : results) {
+    EXPECT_TRUE(result.succeeded);
+  }
+  EXPECT_EQ(numJobs, std::set<size_t>(finished.begin(), finished.end()).size());
+  EXPECT_NE(workers.end(), std::find(workers.begin(), workers.end(), callingThread));
+  // the calling thread is one of the 3 threads
+  EXPECT_GE(3u, std::set<std::thread::id>(workers.begin(), workers.end()).size());
+
+  // a single thread runs everything on the calling thread
+  std::vector<std::thread::id> singleWorkers(4);
+  RunBatch(4, 1, [&](size_t job) { singleWorkers[job] = std::this_thread::get_id(); }, [](size_t) {}, true);
+  for (const auto& worker : singleWorkers) {
+    EXPECT_EQ(callingThread, worker);
+  }
+}
+
+TEST(RefinementBatchTest, SplitThreads) {
+  EXPECT_EQ(4u, sreprefinement::SplitThreads(8, 2));
+  EXPECT_EQ(3u, sreprefinement::SplitThreads(7, 2));
+  EXPECT_EQ(8u, sreprefinement::SplitThreads(8, 1));
+  // every pool gets a thread, even if that is more than asked for
+  EXPECT_EQ(1u, sreprefinement::SplitThreads(1, 2));
+  EXPECT_EQ(5u, sreprefinement::SplitThreads(5, 0));
+
+  const size_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+  EXPECT_EQ(hardwareThreads, sreprefinement::SplitThreads(0, 1));
+  EXPECT_EQ(std::max<size_t>(1, hardwareThreads / 2), sreprefinement::SplitThreads(0, 2));
+}
+
+TEST(RefinementBatchTest, FailuresOnlyFailTheirJob) {
+  std::vector<size_t> finished;
+  const auto results = RunBatch(4, 0,
+    [](size_t job) {
+      if (job == 1) {
+        throw std::runtime_error("bad subject");
+      }
+    },
+    [&](size_t job) {
+      finished.push_back(job);
+      if (job == 2) {
+        throw std::runtime_error("can't write");
+      }
+    });
+
+  ASSERT_EQ(4u, results.size());
+  EXPECT_TRUE(results[0].succeeded);
+  EXPECT_FALSE(results[1].succeeded);
+  EXPECT_EQ("bad subject", results[1].errorMessage);
+  EXPECT_FALSE(results[2].succeeded);
+  EXPECT_EQ("can't write", results[2].errorMessage);
+  EXPECT_TRUE(results[3].succeeded);
+  // failed jobs are not finished
+  EXPECT_EQ(3u, finished.size());
+}
+
+TEST(RefinementBatchTest, NoJobs) {
+  const auto results = RunBatch(0, 2, [](size_t) {}, [](size_t) {});
+  EXPECT_TRUE(results.empty());
+}
+
+TEST(RefinementBatchTest, WriteCSV) {
+  std::ostringstream os;
+  sreprefinement::WriteBatchResultsCSV(os, {{true, 1.5, ""}, {false, 0.25, "bad \"srep\""}});
+  EXPECT_EQ("job,status,seconds,error\n0,succeeded,1.5,\"\"\n1,failed,0.25,\"bad \"\"srep\"\"\"\n", os.str());
+}
+
+TEST(RefinementBatchTest, LogicProgressEndsWhenAJobFails) {
+  auto logic = vtkSmartPointer<vtkSlicerSRepRefinementLogic>::New();
+  logic->SetDistanceMethodToMesh();
+  std::vector<double> progress;
+  vtkNew<vtkCallbackCommand> observer;
+  observer->SetClientData(&progress);
+  observer->SetCallback([](vtkObject*, unsigned long, void* clientData, void* callData) {
+    static_cast<std::vector<double>*>(clientData)->push_back(*static_cast<double*>(callData));
+  });
+  logic->AddObserver(vtkCommand::ProgressEvent, observer);
+
+  const auto model = srepRefinementTestHelpers::MakeEllipsoidModel();
+  // a model without triangles has no distance to refine to
+  auto emptyModel = vtkSmartPointer<vtkMRMLModelNode>::New();
+  emptyModel->SetAndObservePolyData(vtkSmartPointer<vtkPolyData>::New());
+  const auto srep = srepRefinementTestHelpers::MakeEllipsoidSRep(8, 4);
+  std::vector<vtkSmartPointer<vtkMRMLEllipticalSRepNode>> destinations{
+    vtkSmartPointer<vtkMRMLEllipticalSRepNode>::New(), vtkSmartPointer<vtkMRMLEllipticalSRepNode>::New()};
+  std::vector<sreprefinement::BatchJob> jobs(2);
+  jobs[0].model = model;
+  jobs[1].model = emptyModel;
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    jobs[i].srep = srep;
+    jobs[i].destination = destinations[i];
+  }
+
+  const auto results = logic->RunBatch(jobs, 0.01, 0.001, 20, 1, 0.004, 20, 50);
+  ASSERT_EQ(2u, results.size());
+  EXPECT_TRUE(results[0].succeeded);
+  EXPECT_FALSE(results[1].succeeded);
+  ASSERT_FALSE(progress.empty());
+  EXPECT_EQ(1.0, progress.back());
+}
@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+#include <SRepRefinementBudget.h>
+#include <vtkSlicerSRepRefinementLogic.h>
+
+#include "SRepRefinementTestHelpers.h"
+
+#include <vtkCollection.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using sreprefinement::RefinementStatus;
+using sreprefinement::StageBudget;
+using sreprefinement::StopReason;
+
+TEST(RefinementBudgetTest, UnlimitedNeverRunsOut) {
+  StageBudget budget(0.0, 0);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(budget.Spend());
+  }
+  EXPECT_FALSE(budget.IsExhausted());
+  EXPECT_EQ(StopReason::Completed, budget.GetStopReason());
+  EXPECT_EQ(1000u, budget.GetNumberOfEvaluations());
+}
+
+TEST(RefinementBudgetTest, EvaluationBudget) {
+  StageBudget budget(0.0, 3);
+  EXPECT_TRUE(budget.Spend());
+  EXPECT_TRUE(budget.Spend());
+  EXPECT_TRUE(budget.Spend());
+  EXPECT_FALSE(budget.IsExhausted());
+  EXPECT_FALSE(budget.Spend());
+  EXPECT_TRUE(budget.IsExhausted());
+  EXPECT_EQ(StopReason::EvaluationBudget, budget.GetStopReason());
+  EXPECT_FALSE(budget.Spend());
+}
+
+TEST(RefinementBudgetTest, TimeBudgetStartsAtFirstSpend) {
+  StageBudget budget(0.05, 0);
+  // time before the stage starts is not counted
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_TRUE(budget.Spend());
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_FALSE(budget.Spend());
+  EXPECT_EQ(StopReason::TimeBudget, budget.GetStopReason());
+  EXPECT_FALSE(budget.Spend());
+}
+
+TEST(RefinementBudgetTest, ConcurrentSpendsStopAtTheLimit) {
+  constexpr size_t maxEvaluations = 1000;
+  StageBudget budget(0.0, maxEvaluations);
+  std::atomic<size_t> numSpent(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&]() {
+      while (budget.Spend()) {
+        ++numSpent;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(maxEvaluations, numSpent.load());
+  EXPECT_EQ(StopReason::EvaluationBudget, budget.GetStopReason());
+}
+
+TEST(RefinementBudgetTest, Status) {
+  RefinementStatus status;
+  EXPECT_TRUE(status.IsCompleted());
+  status.down = StopReason::TimeBudget;
+  EXPECT_FALSE(status.IsCompleted());
+  EXPECT_EQ(std::string("time budget"), sreprefinement::ToString(status.down));
+  EXPECT_EQ(std::string("completed"), sreprefinement::ToString(status.up));
+}
+
+TEST(RefinementBudgetTest, SplitLevelIterations) {
+  EXPECT_EQ(std::vector<int>({100}), sreprefinement::SplitLevelIterations(100, 1));
+  EXPECT_EQ(std::vector<int>({25, 75}), sreprefinement::SplitLevelIterations(100, 2));
+  EXPECT_EQ(std::vector<int>({6, 12, 25, 57}), sreprefinement::SplitLevelIterations(100, 4));
+  // every level gets an iteration even if there are too few to go around
+  EXPECT_EQ(std::vector<int>({1, 1, 1}), sreprefinement::SplitLevelIterations(2, 3));
+  EXPECT_THROW(sreprefinement::SplitLevelIterations(100, 0), std::invalid_argument);
+}
+
+TEST(RefinementBudgetTest, LogicStopReasons) {
+  using Logic = vtkSlicerSRepRefinementLogic;
+  const auto model = srepRefinementTestHelpers::MakeEllipsoidModel();
+  const auto srep = srepRefinementTestHelpers::MakeEllipsoidSRep(8, 4);
+  auto logic = vtkSmartPointer<Logic>::New();
+  logic->SetDistanceMethodToMesh();
+  logic->SetPyramidLevels(1);
+  // far fewer evaluations than the optimizer needs
+  logic->SetStageEvaluationBudget(5);
+  auto refined = vtkSmartPointer<vtkMRMLEllipticalSRepNode>::New();
+  logic->Run(model, srep, 0.01, 0.001, 100, 1, 0.004, 20, 50, refined);
+
+  const auto& status = logic->GetLastRefinementStatus();
+  EXPECT_EQ(StopReason::EvaluationBudget, status.up);
+  EXPECT_EQ(Logic::StopReasonEvaluationBudget, logic->GetLastStopReason(Logic::StageUp));
+  EXPECT_EQ(static_cast<int>(status.down), logic->GetLastStopReason(Logic::StageDown));
+  EXPECT_EQ(static_cast<int>(status.crest), logic->GetLastStopReason(Logic::StageCrest));
+  EXPECT_THROW(logic->GetLastStopReason(3), std::invalid_argument);
+  EXPECT_EQ(std::string("evaluation budget"), Logic::GetStopReasonAsString(Logic::StopReasonEvaluationBudget));
+  EXPECT_EQ(std::string("unknown"), Logic::GetStopReasonAsString(-1));
+
+  vtkNew<vtkCollection> models;
+  models->AddItem(model);
+  vtkNew<vtkCollection> sreps;
+  sreps->AddItem(srep);
+  vtkNew<vtkCollection> destinations;
+  destinations->AddItem(vtkSmartPointer<vtkMRMLEllipticalSRepNode>::New());
+  ASSERT_EQ(1, logic->RunBatch(models, sreps, destinations, nullptr, 0.01, 0.001, 100, 1, 0.004, 20, 50));
+  ASSERT_EQ(1, logic->GetNumberOfBatchRefinementStatuses());
+  const auto& jobStatus = logic->GetBatchRefinementStatuses()[0];
+  EXPECT_EQ(Logic::StopReasonEvaluationBudget, logic->GetBatchStopReason(0, Logic::StageUp));
+  EXPECT_EQ(static_cast<int>(jobStatus.down), logic->GetBatchStopReason(0, Logic::StageDown));
+  EXPECT_EQ(static_cast<int>(jobStatus.crest), logic->GetBatchStopReason(0, Logic::StageCrest));
+  EXPECT_THROW(logic->GetBatchStopReason(1, Logic::StageUp), std::invalid_argument);
+}
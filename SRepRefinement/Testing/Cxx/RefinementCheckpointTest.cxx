@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <SRepRefinementCheckpoint.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using sreprefinement::RefinementCheckpoint;
+
+namespace {
+
+RefinementCheckpoint MakeCheckpoint() {
+  RefinementCheckpoint checkpoint;
+  checkpoint.key = 0xfeedbeef;
+  checkpoint.level = 1;
+  checkpoint.stage = RefinementCheckpoint::Stage::Down;
+  checkpoint.iteration = 1234;
+  for (int i = 0; i < 8; ++i) {
+    checkpoint.levelUpCoefficients.push_back(0.5 * i);
+    checkpoint.levelDownCoefficients.push_back(-0.5 * i);
+  }
+  checkpoint.up = RefinementCheckpoint::Spokes{checkpoint.levelUpCoefficients, 1e-4, 500, 0, 0, true};
+  checkpoint.down = RefinementCheckpoint::Spokes{checkpoint.levelDownCoefficients, 0.01, 37, 2, 11, false};
+  checkpoint.down.coefficients[3] = 0.125;
+  return checkpoint;
+}
+
+std::string GetFileName() {
+  return ::testing::TempDir() + "/RefinementCheckpointTest.ckpt";
+}
+
+} // namespace {}
+
+TEST(RefinementCheckpointTest, WriteAndRead) {
+  const auto fileName = GetFileName();
+  const auto written = MakeCheckpoint();
+  ASSERT_TRUE(sreprefinement::WriteRefinementCheckpoint(fileName, written));
+
+  RefinementCheckpoint read;
+  ASSERT_TRUE(sreprefinement::ReadRefinementCheckpoint(fileName, read));
+  EXPECT_EQ(written.key, read.key);
+  EXPECT_EQ(written.level, read.level);
+  EXPECT_EQ(written.stage, read.stage);
+  EXPECT_EQ(written.iteration, read.iteration);
+  EXPECT_EQ(written.levelUpCoefficients, read.levelUpCoefficients);
+  EXPECT_EQ(written.levelDownCoefficients, read.levelDownCoefficients);
+  EXPECT_EQ(written.up.coefficients, read.up.coefficients);
+  EXPECT_EQ(written.up.regionSize, read.up.regionSize);
+  EXPECT_EQ(written.up.evaluations, read.up.evaluations);
+  EXPECT_TRUE(read.up.finished);
+  EXPECT_EQ(written.down.coefficients, read.down.coefficients);
+  EXPECT_EQ(written.down.regionSize, read.down.regionSize);
+  EXPECT_EQ(written.down.evaluations, read.down.evaluations);
+  EXPECT_EQ(written.down.sweep, read.down.sweep);
+  EXPECT_EQ(written.down.sweepEvaluations, read.down.sweepEvaluations);
+  EXPECT_FALSE(read.down.finished);
+
+  // a newer checkpoint replaces the old one
+  auto newer = written;
+  newer.stage = RefinementCheckpoint::Stage::Crest;
+  newer.down.finished = true;
+  ASSERT_TRUE(sreprefinement::WriteRefinementCheckpoint(fileName, newer));
+  ASSERT_TRUE(sreprefinement::ReadRefinementCheckpoint(fileName, read));
+  EXPECT_EQ(RefinementCheckpoint::Stage::Crest, read.stage);
+  EXPECT_TRUE(read.down.finished);
+  std::remove(fileName.c_str());
+}
+
+TEST(RefinementCheckpointTest, MismatchedCoefficientsAreNotWritten) {
+  auto checkpoint = MakeCheckpoint();
+  checkpoint.down.coefficients.pop_back();
+  EXPECT_FALSE(sreprefinement::WriteRefinementCheckpoint(GetFileName(), checkpoint));
+}
+
+TEST(RefinementCheckpointTest, BadFilesAreNotRead) {
+  const auto fileName = GetFileName();
+  RefinementCheckpoint read;
+  std::remove(fileName.c_str());
+  EXPECT_FALSE(sreprefinement::ReadRefinementCheckpoint(fileName, read));
+
+  ASSERT_TRUE(sreprefinement::WriteRefinementCheckpoint(fileName, MakeCheckpoint()));
+  std::string contents;
+  {
+    std::ifstream file(fileName, std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+
+  // truncated
+  {
+    std::ofstream file(fileName, std::ios::binary);
+    file.write(contents.data(), contents.size() - 8);
+  }
+  EXPECT_FALSE(sreprefinement::ReadRefinementCheckpoint(fileName, read));
+
+  // not a checkpoint
+  {
+    auto corrupt = contents;
+    corrupt[0] = 'X';
+    std::ofstream file(fileName, std::ios::binary);
+    file.write(corrupt.data(), corrupt.size());
+  }
+  EXPECT_FALSE(sreprefinement::ReadRefinementCheckpoint(fileName, read));
+  std::remove(fileName.c_str());
+}
@@ -0,0 +1,245 @@
+#include <gtest/gtest.h>
+#include <SRepRefinementObjective.h>
+#include <vtkSlicerSRepLogic.h>
+
+#include "SRepRefinementTestHelpers.h"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using sreprefinement::DistanceSampler;
+using sreprefinement::RefinementObjective;
+using SpokeType = vtkSRepSkeletalPoint::SpokeOrientation;
+using IndexType = vtkEllipticalSRep::IndexType;
+
+namespace {
+
+// sphere of radius 2 at the origin, about the size of the test ellipsoid
+class SphereSampler : public DistanceSampler {
+public:
+  using DistanceSampler::Sample;
+  void Sample(size_t count, const double* points, double* distances, double* normals) const override {
+    for (size_t i = 0; i < count; ++i) {
+      const double* p = points + 3 * i;
+      const double length = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+      distances[i] = length - 2.0;
+      if (normals) {
+        for (size_t c = 0; c < 3; ++c) {
+          normals[3 * i + c] = p[c] / length;
+        }
+      }
+    }
+  }
+
+  size_t GetMemorySize() const override {
+    return 0;
+  }
+};
+
+// The objective as the refinement evaluated it before RefinementObjective: every evaluation refines a copy of
+// the srep, interpolates all of it with vtkSlicerSRepLogic::SmartInterpolateSRep, and sums the terms over every
+// spoke of the copy. Only the distance field is swapped for a DistanceSampler.
+class ReferenceObjective {
+public:
+  ReferenceObjective(const vtkEllipticalSRep& srep, SpokeType spokeType, size_t interpolationLevel, const DistanceSampler& sampler)
+    : m_srep(srep.SmartClone())
+    , m_spokeType(spokeType)
+    , m_interpolationLevel(interpolationLevel)
+    , m_sampler(sampler)
+    , m_srepLogic()
+  {}
+
+  RefinementObjective::Terms Evaluate(const double* coefficients) {
+    const auto refined = this->Refine(coefficients);
+    const auto interpolated = m_srepLogic->SmartInterpolateSRep(*refined, m_interpolationLevel);
+    RefinementObjective::Terms terms{0.0, 0.0, 0.0};
+    for (IndexType l = 0; l < interpolated->GetNumberOfLines(); ++l) {
+      for (IndexType s = 0; s < interpolated->GetNumberOfSteps(); ++s) {
+        const auto& spoke = *interpolated->GetSkeletalPoint(l, s)->GetSpoke(m_spokeType);
+        const auto boundary = spoke.GetBoundaryPoint();
+        const double point[3] = {boundary[0], boundary[1], boundary[2]};
+        double distance = 0.0;
+        double normal[3];
+        m_sampler.Sample(point, distance, normal);
+        const auto unitDir = spoke.GetDirection().Unit();
+        const double dot = normal[0] * unitDir[0] + normal[1] * unitDir[1] + normal[2] * unitDir[2];
+        terms.distanceSquared += distance * distance;
+        terms.normalPenalty += distance * distance * (1 - dot);
+      }
+    }
+    terms.srad = this->ComputeRSradPenalty(*interpolated);
+    return terms;
+  }
+
+private:
+  vtkSmartPointer<vtkEllipticalSRep> Refine(const double* coeff) const {
+    constexpr double tolerance = 1e-13;
+    auto clone = m_srep->SmartClone();
+    size_t c = 0;
+    for (IndexType l = 0; l < clone->GetNumberOfLines(); ++l) {
+      for (IndexType s = 0; s < clone->GetNumberOfSteps(); ++s) {
+        auto& spoke = *clone->GetSkeletalPoint(l, s)->GetSpoke(m_spokeType);
+        const double oldRadius = spoke.GetRadius();
+        const auto oldUnitDir = spoke.GetDirection().Unit();
+        const srep::Vector3d newUnitDir(coeff[c], coeff[c + 1], coeff[c + 2]);
+        c += 3;
+        const double newRadius = std::exp(coeff[c++]) * oldRadius;
+        if (std::abs(oldRadius - newRadius) >= tolerance
+          || std::abs(oldUnitDir[0] - newUnitDir[0]) >= tolerance
+          || std::abs(oldUnitDir[1] - newUnitDir[1]) >= tolerance
+          || std::abs(oldUnitDir[2] - newUnitDir[2]) >= tolerance)
+        {
+          spoke.SetDirectionAndMagnitude(newUnitDir * newRadius);
+        }
+      }
+    }
+    return clone;
+  }
+
+  double ComputeRSradPenalty(const vtkEllipticalSRep& interpolated) const {
+    const auto density = static_cast<IndexType>(1) << m_interpolationLevel;
+    const double stepSize = 1.0 / density;
+    const auto numInterpolatedLines = interpolated.GetNumberOfLines();
+    const auto numInterpolatedSteps = interpolated.GetNumberOfSteps();
+    const auto spoke = [&](IndexType line, IndexType step) {
+      return interpolated.GetSkeletalPoint(line, step)->GetSpoke(m_spokeType);
+    };
+
+    double penalty = 0.0;
+    for (IndexType i = 0; i < numInterpolatedLines / density; ++i) {
+      const auto ii = i * density;
+      for (IndexType j = 0; j < numInterpolatedSteps / density; ++j) {
+        const auto jj = j * density;
+
+        // u is the line to line direction, v the step to step one
+        const auto& u1 = *spoke((numInterpolatedLines + ii - 1) % numInterpolatedLines, jj);
+        const auto& u2 = *spoke((ii + 1) % numInterpolatedLines, jj);
+        const double drdu = (u2.GetRadius() - u1.GetRadius()) / stepSize / 2;
+        const auto dxdu = (u2.GetDirection().Unit() - u1.GetDirection().Unit()) / stepSize / 2;
+        const auto dSdu = (u2.GetDirection() - u1.GetDirection()) / stepSize / 2;
+
+        const auto prevStep = jj == 0 ? 0 : jj - 1;
+        const auto nextStep = jj == numInterpolatedSteps - 1 ? numInterpolatedSteps - 1 : jj + 1;
+        const double divisor = prevStep == jj || nextStep == jj ? 1 : 2;
+        const auto& v1 = *spoke(ii, prevStep);
+        const auto& v2 = *spoke(ii, nextStep);
+        const double drdv = (v2.GetRadius() - v1.GetRadius()) / stepSize / divisor;
+        const auto dxdv = (v2.GetDirection().Unit() - v1.GetDirection().Unit()) / stepSize / divisor;
+        const auto dSdv = (v2.GetDirection() - v1.GetDirection()) / stepSize / divisor;
+
+        const auto U = spoke(ii, jj)->GetDirection().Unit();
+        Eigen::Matrix3d UTU;
+        for (int r = 0; r < 3; ++r) {
+          for (int c = 0; c < 3; ++c) {
+            UTU(r, c) = U[r] * U[c] - (r == c ? 1 : 0);
+          }
+        }
+        Eigen::MatrixXd Q(2, 3);
+        Eigen::MatrixXd leftSide(2, 3);
+        for (int c = 0; c < 3; ++c) {
+          Q(0, c) = dxdu[0] * UTU(0, c) + dxdu[1] * UTU(1, c) + dxdu[2] * UTU(2, c);
+          Q(1, c) = dxdv[0] * UTU(0, c) + dxdv[1] * UTU(1, c) + dxdv[2] * UTU(2, c);
+          leftSide(0, c) = dSdu[c] - drdu * U[c];
+          leftSide(1, c) = dSdv[c] - drdv * U[c];
+        }
+        const Eigen::Matrix2d QQT = Q * Q.transpose();
+        const Eigen::MatrixXd rightSide = Q.transpose() * QQT.inverse();
+        Eigen::Matrix2d rSradMat = leftSide * rightSide;
+        rSradMat.transposeInPlace();
+        Eigen::SelfAdjointEigenSolver<Eigen::Matrix2d> eigensolver(rSradMat);
+        penalty += std::max(0.0, eigensolver.eigenvalues()[1] - 1);
+      }
+    }
+    return penalty;
+  }
+
+  vtkSmartPointer<vtkEllipticalSRep> m_srep;
+  SpokeType m_spokeType;
+  size_t m_interpolationLevel;
+  const DistanceSampler& m_sampler;
+  vtkNew<vtkSlicerSRepLogic> m_srepLogic;
+};
+
+// builds a RefinementObjective the way the refinement does
+RefinementObjective CreateObjective(const vtkEllipticalSRep& srep, SpokeType spokeType, size_t interpolationLevel,
+  const DistanceSampler& sampler)
+{
+  std::vector<srep::Vector3d> directions;
+  for (IndexType l = 0; l < srep.GetNumberOfLines(); ++l) {
+    for (IndexType s = 0; s < srep.GetNumberOfSteps(); ++s) {
+      directions.push_back(srep.GetSkeletalPoint(l, s)->GetSpoke(spokeType)->GetDirection());
+    }
+  }
+  vtkNew<vtkSlicerSRepLogic> srepLogic;
+  const auto interpolated = srepLogic->SmartInterpolateSRep(srep, interpolationLevel);
+  std::vector<srep::Point3d> skeletalPoints;
+  for (IndexType l = 0; l < interpolated->GetNumberOfLines(); ++l) {
+    for (IndexType s = 0; s < interpolated->GetNumberOfSteps(); ++s) {
+      skeletalPoints.push_back(interpolated->GetSkeletalPoint(l, s)->GetSpoke(spokeType)->GetSkeletalPoint());
+    }
+  }
+  return RefinementObjective(static_cast<size_t>(srep.GetNumberOfLines()), static_cast<size_t>(srep.GetNumberOfSteps()),
+    interpolationLevel, std::move(skeletalPoints), std::move(directions), sampler);
+}
+
+std::vector<double> GetInitialCoefficients(const vtkEllipticalSRep& srep, SpokeType spokeType) {
+  std::vector<double> coefficients;
+  for (IndexType l = 0; l < srep.GetNumberOfLines(); ++l) {
+    for (IndexType s = 0; s < srep.GetNumberOfSteps(); ++s) {
+      const auto unitDir = srep.GetSkeletalPoint(l, s)->GetSpoke(spokeType)->GetDirection().Unit();
+      coefficients.insert(coefficients.end(), {unitDir[0], unitDir[1], unitDir[2], 0.0});
+    }
+  }
+  return coefficients;
+}
+
+void ExpectTermsNear(const RefinementObjective::Terms& expected, const RefinementObjective::Terms& actual,
+  const std::string& where)
+{
+  constexpr double tolerance = 1e-9;
+  EXPECT_NEAR(expected.distanceSquared, actual.distanceSquared, tolerance * (1 + std::abs(expected.distanceSquared))) << where;
+  EXPECT_NEAR(expected.normalPenalty, actual.normalPenalty, tolerance * (1 + std::abs(expected.normalPenalty))) << where;
+  EXPECT_NEAR(expected.srad, actual.srad, tolerance * (1 + std::abs(expected.srad))) << where;
+}
+
+} // namespace {}
+
+TEST(RefinementObjectiveEquivalenceTest, MatchesInterpolatedSRepObjective) {
+  const SphereSampler sampler;
+  const auto srepNode = srepRefinementTestHelpers::MakeEllipsoidSRep(8, 4);
+  const auto& srep = *srepNode->GetEllipticalSRep();
+
+  for (const auto spokeType : {SpokeType::UpOrientation, SpokeType::DownOrientation}) {
+    for (size_t level = 1; level <= 3; ++level) {
+      ReferenceObjective reference(srep, spokeType, level, sampler);
+      auto incremental = CreateObjective(srep, spokeType, level, sampler);
+      auto coefficients = GetInitialCoefficients(srep, spokeType);
+      const std::string where = "at level " + std::to_string(level)
+        + (spokeType == SpokeType::UpOrientation ? " of the up spokes" : " of the down spokes");
+
+      ExpectTermsNear(reference.Evaluate(coefficients.data()), incremental.Evaluate(coefficients.data()), where);
+
+      // the path an optimizer takes, changing a few coefficients at a time, with enough tilt to make the rSrad
+      // penalty positive
+      std::mt19937 generator(5);
+      std::uniform_int_distribution<size_t> index(0, coefficients.size() - 1);
+      std::uniform_real_distribution<double> delta(-0.3, 0.3);
+      bool sawSrad = false;
+      for (int i = 0; i < 40; ++i) {
+        for (int k = 0; k < 3; ++k) {
+          coefficients[index(generator)] += delta(generator);
+        }
+        const auto expected = reference.Evaluate(coefficients.data());
+        ExpectTermsNear(expected, incremental.Evaluate(coefficients.data()), where + ", step " + std::to_string(i));
+        sawSrad = sawSrad || expected.srad > 0;
+      }
+      EXPECT_TRUE(sawSrad) << where;
+    }
+  }
+}
@@ -0,0 +1,289 @@
+#include <gtest/gtest.h>
+#include <SRepRefinementObjective.h>
+#include <SRepSDFSampler.h>
+
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+using sreprefinement::DistanceSampler;
+using sreprefinement::RefinementObjective;
+using sreprefinement::SDFSampler;
+
+namespace {
+
+// unit sphere at the origin
+class SphereSampler : public DistanceSampler {
+public:
+  using DistanceSampler::Sample;
+  void Sample(size_t count, const double* points, double* distances, double* normals) const override {
+    for (size_t i = 0; i < count; ++i) {
+      const double* p = points + 3 * i;
+      const double length = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+      distances[i] = length - 1.0;
+      if (normals) {
+        for (size_t c = 0; c < 3; ++c) {
+          normals[3 * i + c] = p[c] / length;
+        }
+      }
+    }
+  }
+
+  size_t GetMemorySize() const override {
+    return 0;
+  }
+};
+
+// counts the calls into the sphere's field
+class CountingSampler : public SphereSampler {
+public:
+  using SphereSampler::Sample;
+  void Sample(size_t count, const double* points, double* distances, double* normals) const override {
+    ++numSampleCalls;
+    SphereSampler::Sample(count, points, distances, normals);
+  }
+
+  void SampleDerivatives(size_t count, const double* points, double* distanceGradients, double* normalJacobians) const override {
+    ++numDerivativeCalls;
+    SphereSampler::SampleDerivatives(count, points, distanceGradients, normalJacobians);
+  }
+
+  mutable size_t numSampleCalls = 0;
+  mutable size_t numDerivativeCalls = 0;
+};
+
+// the unit sphere sampled on a grid over about [-2, 2]^3. The grid is shifted off of the planes of symmetry
+// of the srep, where the interpolated field has kinks that differences of it average over.
+struct SphereField {
+  SDFSampler::Dimensions dimensions{{41, 41, 41}};
+  std::vector<float> distances;
+  std::vector<float> gradients;
+
+  SphereField() {
+    for (size_t z = 0; z < dimensions[2]; ++z) {
+      for (size_t y = 0; y < dimensions[1]; ++y) {
+        for (size_t x = 0; x < dimensions[0]; ++x) {
+          const double p[3] = {0.1 * x - 2.037, 0.1 * y - 2.037, 0.1 * z - 2.037};
+          const double length = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+          distances.push_back(static_cast<float>(length - 1));
+          for (size_t c = 0; c < 3; ++c) {
+            gradients.push_back(static_cast<float>(length > 0 ? p[c] / length : 0.0));
+          }
+        }
+      }
+    }
+  }
+
+  SDFSampler CreateSampler() const {
+    const SDFSampler::AffineTransform worldToIndex{{
+      10, 0, 0, 20.37,
+      0, 10, 0, 20.37,
+      0, 0, 10, 20.37,
+    }};
+    return SDFSampler(dimensions, worldToIndex, distances.data(), gradients.data());
+  }
+};
+
+// a flat disk of skeletal points with spokes pointing up and outward
+struct DiskSRep {
+  const size_t numLines = 6;
+  const size_t numSteps = 3;
+  const size_t interpolationLevel;
+  std::vector<srep::Point3d> skeletalPoints;
+  std::vector<srep::Vector3d> directions;
+  std::vector<double> coefficients;
+
+  explicit DiskSRep(size_t interpolationLevel_)
+    : interpolationLevel(interpolationLevel_)
+  {
+    const double pi = std::acos(-1.0);
+    const size_t density = size_t(1) << interpolationLevel;
+    const size_t interpolatedLines = numLines * density;
+    const size_t interpolatedSteps = (numSteps - 1) * density + 1;
+    for (size_t l = 0; l < interpolatedLines; ++l) {
+      const double angle = 2 * pi * l / interpolatedLines;
+      for (size_t s = 0; s < interpolatedSteps; ++s) {
+        const double r = 0.2 + 0.5 * s / (interpolatedSteps - 1);
+        skeletalPoints.emplace_back(r * std::cos(angle), r * std::sin(angle), 0.0);
+      }
+    }
+    for (size_t l = 0; l < numLines; ++l) {
+      const double angle = 2 * pi * l / numLines;
+      for (size_t s = 0; s < numSteps; ++s) {
+        const double outward = 0.1 + 0.2 * s;
+        directions.emplace_back(outward * std::cos(angle), outward * std::sin(angle), 0.6 - 0.1 * s);
+        const auto unit = directions.back().Unit();
+        coefficients.insert(coefficients.end(), {unit[0], unit[1], unit[2], 0.0});
+      }
+    }
+  }
+
+  RefinementObjective CreateObjective(const DistanceSampler& sampler) const {
+    return RefinementObjective(numLines, numSteps, interpolationLevel, skeletalPoints, directions, sampler);
+  }
+};
+
+void ExpectTermsNear(const RefinementObjective::Terms& expected, const RefinementObjective::Terms& actual) {
+  EXPECT_NEAR(expected.distanceSquared, actual.distanceSquared, 1e-12 * (1 + std::abs(expected.distanceSquared)));
+  EXPECT_NEAR(expected.normalPenalty, actual.normalPenalty, 1e-12 * (1 + std::abs(expected.normalPenalty)));
+  EXPECT_NEAR(expected.srad, actual.srad, 1e-12 * (1 + std::abs(expected.srad)));
+}
+
+// compares EvaluateWithGradient to central differences of full evaluations. A tilt moves the unit directions
+// away from the disk's, which crosses neighbouring spokes and makes the rSrad penalty positive.
+void ExpectGradientMatchesDifferences(const DiskSRep& srep, const DistanceSampler& sampler, double tolerance,
+  double tilt = 0.0)
+{
+  const RefinementObjective::Weights weights{1.0, 2.0, 3.0};
+  const double step = 1e-6;
+
+  auto coefficients = srep.coefficients;
+  for (size_t i = 0; i < coefficients.size(); ++i) {
+    if (i % 4 == 3) {
+      coefficients[i] = 0.05 * std::sin(static_cast<double>(i));
+    } else {
+      coefficients[i] += tilt * std::sin(static_cast<double>(7 * i));
+    }
+  }
+
+  auto objective = srep.CreateObjective(sampler);
+  std::vector<double> gradient(objective.GetNumberOfCoefficients());
+  const auto terms = objective.EvaluateWithGradient(coefficients.data(), weights, step, gradient.data());
+  ExpectTermsNear(srep.CreateObjective(sampler).Evaluate(coefficients.data()), terms);
+  if (tilt != 0.0) {
+    EXPECT_GT(terms.srad, 0.0) << "at level " << srep.interpolationLevel;
+  }
+
+  const auto value = [&](const std::vector<double>& c) {
+    // a new objective for every evaluation, so nothing is incremental
+    const auto t = srep.CreateObjective(sampler).Evaluate(c.data());
+    return t.distanceSquared * weights.distanceSquared + t.normalPenalty * weights.normalPenalty + t.srad * weights.srad;
+  };
+  for (size_t i = 0; i < coefficients.size(); ++i) {
+    auto forward = coefficients;
+    auto backward = coefficients;
+    forward[i] += step;
+    backward[i] -= step;
+    const double expected = (value(forward) - value(backward)) / (2 * step);
+    EXPECT_NEAR(expected, gradient[i], tolerance * (1 + std::abs(expected)))
+      << "coefficient " << i << " at level " << srep.interpolationLevel;
+  }
+
+  // the cached state is left at coefficients
+  ExpectTermsNear(terms, objective.Evaluate(coefficients.data()));
+  EXPECT_EQ(0u, objective.GetNumberOfUpdatedQuads());
+}
+
+} // namespace {}
+
+TEST(RefinementObjectiveTest, Construction) {
+  const SphereSampler sampler;
+  const DiskSRep srep(2);
+  EXPECT_NO_THROW(srep.CreateObjective(sampler));
+  EXPECT_EQ(4 * srep.numLines * srep.numSteps, srep.CreateObjective(sampler).GetNumberOfCoefficients());
+
+  // skeletal points for the wrong interpolation level
+  EXPECT_THROW(RefinementObjective(srep.numLines, srep.numSteps, 1, srep.skeletalPoints, srep.directions, sampler),
+    std::invalid_argument);
+  EXPECT_THROW(RefinementObjective(srep.numLines, srep.numSteps, 2, srep.skeletalPoints, {}, sampler),
+    std::invalid_argument);
+  EXPECT_THROW(RefinementObjective(srep.numLines, 1, 2, srep.skeletalPoints, srep.directions, sampler),
+    std::invalid_argument);
+}
+
+TEST(RefinementObjectiveTest, IncrementalMatchesFullEvaluation) {
+  const SphereSampler sampler;
+  for (size_t level = 0; level <= 2; ++level) {
+    const DiskSRep srep(level);
+    auto incremental = srep.CreateObjective(sampler);
+    auto coefficients = srep.coefficients;
+    const size_t numQuads = srep.numLines * (srep.numSteps - 1);
+
+    ExpectTermsNear(srep.CreateObjective(sampler).Evaluate(coefficients.data()), incremental.Evaluate(coefficients.data()));
+    EXPECT_EQ(numQuads, incremental.GetNumberOfUpdatedQuads());
+
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<size_t> index(0, coefficients.size() - 1);
+    std::uniform_real_distribution<double> delta(-0.05, 0.05);
+    for (int i = 0; i < 50; ++i) {
+      const size_t c = index(generator);
+      coefficients[c] += delta(generator);
+
+      const auto actual = incremental.Evaluate(coefficients.data());
+      // a spoke is the corner of at most 4 quads
+      EXPECT_GE(4u, incremental.GetNumberOfUpdatedQuads());
+      ExpectTermsNear(srep.CreateObjective(sampler).Evaluate(coefficients.data()), actual);
+    }
+
+    // re-evaluating the same point doesn't update anything
+    const auto before = incremental.Evaluate(coefficients.data());
+    EXPECT_EQ(0u, incremental.GetNumberOfUpdatedQuads());
+    ExpectTermsNear(before, incremental.Evaluate(coefficients.data()));
+
+    // changing every spoke falls back to a full evaluation
+    for (size_t c = 3; c < coefficients.size(); c += 4) {
+      coefficients[c] += 0.01;
+    }
+    ExpectTermsNear(srep.CreateObjective(sampler).Evaluate(coefficients.data()), incremental.Evaluate(coefficients.data()));
+    EXPECT_EQ(numQuads, incremental.GetNumberOfUpdatedQuads());
+  }
+}
+
+TEST(RefinementObjectiveTest, RecoversAfterError) {
+  const SphereSampler sampler;
+  const DiskSRep srep(2);
+  auto objective = srep.CreateObjective(sampler);
+  auto coefficients = srep.coefficients;
+  objective.Evaluate(coefficients.data());
+
+  coefficients[5] = std::nan("");
+  EXPECT_THROW(objective.Evaluate(coefficients.data()), std::invalid_argument);
+
+  coefficients[5] = srep.coefficients[5] + 0.01;
+  ExpectTermsNear(srep.CreateObjective(sampler).Evaluate(coefficients.data()), objective.Evaluate(coefficients.data()));
+}
+
+TEST(RefinementObjectiveTest, GradientMatchesFullEvaluation) {
+  const SphereSampler sampler;
+  for (size_t level = 0; level <= 2; ++level) {
+    ExpectGradientMatchesDifferences(DiskSRep(level), sampler, 1e-5);
+  }
+
+  const DiskSRep srep(1);
+  auto objective = srep.CreateObjective(sampler);
+  std::vector<double> gradient(objective.GetNumberOfCoefficients());
+  EXPECT_THROW(objective.EvaluateWithGradient(srep.coefficients.data(), {1.0, 1.0, 1.0}, 0.0, gradient.data()),
+    std::invalid_argument);
+}
+
+TEST(RefinementObjectiveTest, GradientMatchesFullEvaluationWithRSradPenalty) {
+  const SphereSampler sampler;
+  ExpectGradientMatchesDifferences(DiskSRep(0), sampler, 1e-5, 1.0);
+  ExpectGradientMatchesDifferences(DiskSRep(1), sampler, 1e-5, 1.0);
+  // the level 2 srep only crosses its spokes when they are tilted far enough to nearly fold the rSrad matrix,
+  // where the penalty curves so sharply that the differences themselves are only good to about 1e-4
+  ExpectGradientMatchesDifferences(DiskSRep(2), sampler, 1e-3, 2.0);
+}
+
+TEST(RefinementObjectiveTest, GradientMatchesFullEvaluationOfImageField) {
+  // the image sampler differentiates its field exactly instead of by differences
+  const SphereField field;
+  const auto sampler = field.CreateSampler();
+  for (size_t level = 0; level <= 2; ++level) {
+    ExpectGradientMatchesDifferences(DiskSRep(level), sampler, 1e-5);
+  }
+}
+
+TEST(RefinementObjectiveTest, GradientSamplesTheFieldOnce) {
+  const CountingSampler sampler;
+  const DiskSRep srep(2);
+  auto objective = srep.CreateObjective(sampler);
+  std::vector<double> gradient(objective.GetNumberOfCoefficients());
+  objective.EvaluateWithGradient(srep.coefficients.data(), {1.0, 2.0, 3.0}, 1e-6, gradient.data());
+
+  // the evaluation, the tips for their derivatives, and the differences of the default SampleDerivatives,
+  // no matter how many coefficients there are
+  EXPECT_EQ(1u, sampler.numDerivativeCalls);
+  EXPECT_EQ(3u, sampler.numSampleCalls);
+}
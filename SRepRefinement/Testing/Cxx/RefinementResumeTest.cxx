@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include <SRepRefinementCheckpoint.h>
+#include <SRepRefinementTask.h>
+#include <vtkSlicerSRepRefinementLogic.h>
+
+#include "SRepRefinementTestHelpers.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+using sreprefinement::RefinementCheckpoint;
+using sreprefinement::RefinementTask;
+
+namespace {
+
+constexpr double initialRegionSize = 0.01;
+// small enough that the sweeps don't stop early
+constexpr double finalRegionSize = 1e-5;
+constexpr int maxIterations = 100;
+constexpr int interpolationLevel = 1;
+constexpr double L0Weight = 0.004;
+constexpr double L1Weight = 20;
+constexpr double L2Weight = 50;
+
+vtkSmartPointer<vtkSlicerSRepRefinementLogic> MakePatchLogic(const std::string& checkpointFileName) {
+  auto logic = vtkSmartPointer<vtkSlicerSRepRefinementLogic>::New();
+  logic->SetDistanceMethodToMesh();
+  logic->SetPyramidLevels(1);
+  // the up spokes are refined first, so the test only has to watch them
+  logic->SetConcurrentUpDown(false);
+  logic->SetPatchSize(2);
+  logic->SetMaxPatchSweeps(3);
+  logic->SetCheckpointFileName(checkpointFileName);
+  logic->SetCheckpointInterval(0.0);
+  return logic;
+}
+
+bool FileExists(const std::string& fileName) {
+  return static_cast<bool>(std::ifstream(fileName));
+}
+
+// Starts a refinement and cancels it once it has written a checkpoint, which is returned
+RefinementCheckpoint WriteCheckpoint(
+  vtkSlicerSRepRefinementLogic* logic,
+  vtkMRMLModelNode* model,
+  vtkMRMLEllipticalSRepNode* srep,
+  const std::string& fileName)
+{
+  std::remove(fileName.c_str());
+  auto cancelled = vtkSmartPointer<vtkMRMLEllipticalSRepNode>::New();
+  auto task = logic->RunAsync(model, srep, initialRegionSize, finalRegionSize, maxIterations, interpolationLevel,
+    L0Weight, L1Weight, L2Weight, cancelled);
+  RefinementCheckpoint checkpoint;
+  while (!task->WaitFor(0.005)) {
+    if (sreprefinement::ReadRefinementCheckpoint(fileName, checkpoint)) {
+      task->Cancel();
+    }
+  }
+  EXPECT_EQ(RefinementTask::Status::Cancelled, task->GetStatus()) << "the refinement finished before it was cancelled";
+  EXPECT_TRUE(sreprefinement::ReadRefinementCheckpoint(fileName, checkpoint));
+  std::remove(fileName.c_str());
+  return checkpoint;
+}
+
+} // namespace {}
+
+TEST(RefinementResumeTest, PatchRefinementResumesFromItsSweep) {
+  const auto model = srepRefinementTestHelpers::MakeEllipsoidModel();
+  const auto srep = srepRefinementTestHelpers::MakeEllipsoidSRep(12, 4);
+
+  // the uninterrupted refinement
+  const auto fullFileName = ::testing::TempDir() + "/RefinementResumeTestFull.ckpt";
+  std::remove(fullFileName.c_str());
+  auto fullLogic = MakePatchLogic(fullFileName);
+  auto full = vtkSmartPointer<vtkMRMLEllipticalSRepNode>::New();
+  fullLogic->Run(model, srep, initialRegionSize, finalRegionSize, maxIterations, interpolationLevel,
+    L0Weight, L1Weight, L2Weight, full);
+  const auto fullEvaluations = fullLogic->GetTelemetry().GetNumberOfRecordedEvaluations();
+  EXPECT_FALSE(FileExists(fullFileName));
+
+  // cancel once the up spokes are past the first sweep
+  const auto fileName = ::testing::TempDir() + "/RefinementResumeTest.ckpt";
+  std::remove(fileName.c_str());
+  auto logic = MakePatchLogic(fileName);
+  auto cancelled = vtkSmartPointer<vtkMRMLEllipticalSRepNode>::New();
+  auto task = logic->RunAsync(model, srep, initialRegionSize, finalRegionSize, maxIterations, interpolationLevel,
+    L0Weight, L1Weight, L2Weight, cancelled);
+  RefinementCheckpoint checkpoint;
+  while (!task->WaitFor(0.005)) {
+    if (sreprefinement::ReadRefinementCheckpoint(fileName, checkpoint) && checkpoint.up.sweep >= 1) {
+      task->Cancel();
+    }
+  }
+  ASSERT_EQ(RefinementTask::Status::Cancelled, task->GetStatus()) << "the refinement finished before it was cancelled";
+  ASSERT_TRUE(sreprefinement::ReadRefinementCheckpoint(fileName, checkpoint));
+  EXPECT_EQ(RefinementCheckpoint::Stage::Up, checkpoint.stage);
+  EXPECT_GE(checkpoint.up.sweep, 1);
+  EXPECT_LE(checkpoint.up.sweepEvaluations, checkpoint.up.evaluations);
+
+  // the resumed refinement skips the sweeps that were done, so it needs fewer evaluations
+  auto resumed = vtkSmartPointer<vtkMRMLEllipticalSRepNode>::New();
+  logic->Run(model, srep, initialRegionSize, finalRegionSize, maxIterations, interpolationLevel,
+    L0Weight, L1Weight, L2Weight, resumed);
+  const auto resumedEvaluations = logic->GetTelemetry().GetNumberOfRecordedEvaluations();
+  EXPECT_FALSE(FileExists(fileName));
+  EXPECT_TRUE(logic->GetLastRefinementStatus().IsCompleted());
+  EXPECT_LT(resumedEvaluations, fullEvaluations);
+
+  // and still fits the model about as well
+  const double inputDistance = srepRefinementTestHelpers::ComputeMeanBoundaryDistance(srep, model);
+  const double fullDistance = srepRefinementTestHelpers::ComputeMeanBoundaryDistance(full, model);
+  const double resumedDistance = srepRefinementTestHelpers::ComputeMeanBoundaryDistance(resumed, model);
+  EXPECT_LT(fullDistance, inputDistance);
+  EXPECT_LT(resumedDistance, inputDistance);
+  EXPECT_LT(resumedDistance, 2.0 * fullDistance);
+}
+
+TEST(RefinementResumeTest, BudgetsAreInTheCheckpointKey) {
+  const auto model = srepRefinementTestHelpers::MakeEllipsoidModel();
+  const auto srep = srepRefinementTestHelpers::MakeEllipsoidSRep(12, 4);
+  const auto fileName = ::testing::TempDir() + "/RefinementResumeTestKey.ckpt";
+  auto logic = MakePatchLogic(fileName);
+  const auto key = WriteCheckpoint(logic, model, srep, fileName).key;
+  EXPECT_EQ(key, WriteCheckpoint(logic, model, srep, fileName).key);
+
+  // budgets that are never reached still make it a different refinement
+  logic->SetStageTimeBudget(1000.0);
+  const auto timeBudgetKey = WriteCheckpoint(logic, model, srep, fileName).key;
+  EXPECT_NE(key, timeBudgetKey);
+  logic->SetStageTimeBudget(0.0);
+  logic->SetStageEvaluationBudget(100000);
+  const auto evaluationBudgetKey = WriteCheckpoint(logic, model, srep, fileName).key;
+  EXPECT_NE(key, evaluationBudgetKey);
+  EXPECT_NE(timeBudgetKey, evaluationBudgetKey);
+}
@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+#include <SRepRefinementTelemetry.h>
+#include <vtkSlicerSRepRefinementLogic.h>
+
+#include "SRepRefinementTestHelpers.h"
+
+#include <vtkTable.h>
+#include <vtkVariant.h>
+
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using sreprefinement::RefinementTelemetry;
+
+namespace {
+
+RefinementTelemetry::Evaluation MakeEvaluation(int iteration) {
+  return RefinementTelemetry::Evaluation{
+    iteration, 0.0, 1, RefinementTelemetry::Spokes::Down, 0.5 * iteration, 0.25, 0.125, 0.5 * iteration + 0.375};
+}
+
+} // namespace {}
+
+TEST(RefinementTelemetryTest, KeepsMostRecentEvaluations) {
+  RefinementTelemetry telemetry(3);
+  telemetry.Start();
+  EXPECT_TRUE(telemetry.GetEvaluations().empty());
+
+  for (int i = 1; i <= 5; ++i) {
+    telemetry.Record(MakeEvaluation(i));
+  }
+  EXPECT_EQ(5u, telemetry.GetNumberOfRecordedEvaluations());
+
+  const auto evaluations = telemetry.GetEvaluations();
+  ASSERT_EQ(3u, evaluations.size());
+  EXPECT_EQ(3, evaluations[0].iteration);
+  EXPECT_EQ(4, evaluations[1].iteration);
+  EXPECT_EQ(5, evaluations[2].iteration);
+  EXPECT_LE(evaluations[0].time, evaluations[2].time);
+  EXPECT_GE(evaluations[0].time, 0.0);
+
+  telemetry.Start();
+  EXPECT_TRUE(telemetry.GetEvaluations().empty());
+  EXPECT_EQ(0u, telemetry.GetNumberOfRecordedEvaluations());
+}
+
+TEST(RefinementTelemetryTest, ZeroCapacityRecordsNothing) {
+  RefinementTelemetry telemetry(0);
+  telemetry.Record(MakeEvaluation(1));
+  EXPECT_TRUE(telemetry.GetEvaluations().empty());
+  EXPECT_EQ(1u, telemetry.GetNumberOfRecordedEvaluations());
+
+  telemetry.SetCapacity(2);
+  EXPECT_EQ(2u, telemetry.GetCapacity());
+  EXPECT_EQ(0u, telemetry.GetNumberOfRecordedEvaluations());
+  telemetry.Record(MakeEvaluation(1));
+  EXPECT_EQ(1u, telemetry.GetEvaluations().size());
+}
+
+TEST(RefinementTelemetryTest, WriteCSV) {
+  RefinementTelemetry telemetry(10);
+  telemetry.Record(MakeEvaluation(2));
+
+  std::ostringstream os;
+  telemetry.WriteCSV(os);
+  std::istringstream is(os.str());
+  std::string header;
+  std::string row;
+  std::getline(is, header);
+  std::getline(is, row);
+  EXPECT_EQ("iteration,time,level,spokes,L0,L1,L2,value", header);
+  EXPECT_EQ(0u, row.find("2,"));
+  EXPECT_NE(std::string::npos, row.find(",1,down,1,0.25,0.125,1.375"));
+}
+
+TEST(RefinementTelemetryTest, WriteJSON) {
+  RefinementTelemetry telemetry(10);
+  std::ostringstream empty;
+  telemetry.WriteJSON(empty);
+  EXPECT_NE(std::string::npos, empty.str().find("\"evaluations\": []"));
+
+  auto evaluation = MakeEvaluation(7);
+  evaluation.srad = std::numeric_limits<double>::infinity();
+  telemetry.Record(evaluation);
+
+  std::ostringstream os;
+  telemetry.WriteJSON(os);
+  const auto json = os.str();
+  EXPECT_NE(std::string::npos, json.find("\"recorded\": 1"));
+  EXPECT_NE(std::string::npos, json.find("\"iteration\": 7"));
+  EXPECT_NE(std::string::npos, json.find("\"spokes\": \"down\""));
+  EXPECT_NE(std::string::npos, json.find("\"L2\": null"));
+}
+
+TEST(RefinementTelemetryTest, LogicTable) {
+  const auto model = srepRefinementTestHelpers::MakeEllipsoidModel();
+  const auto srep = srepRefinementTestHelpers::MakeEllipsoidSRep(8, 4);
+  auto logic = vtkSmartPointer<vtkSlicerSRepRefinementLogic>::New();
+  logic->SetDistanceMethodToMesh();
+  logic->SetPyramidLevels(1);
+  auto refined = vtkSmartPointer<vtkMRMLEllipticalSRepNode>::New();
+  logic->Run(model, srep, 0.01, 0.001, 20, 1, 0.004, 20, 50, refined);
+
+  vtkNew<vtkTable> table;
+  logic->GetTelemetryAsTable(table);
+  const auto evaluations = logic->GetTelemetry().GetEvaluations();
+  ASSERT_FALSE(evaluations.empty());
+  ASSERT_EQ(static_cast<vtkIdType>(evaluations.size()), table->GetNumberOfRows());
+  ASSERT_EQ(8, table->GetNumberOfColumns());
+  for (const char* name : {"iteration", "time", "level", "spokes", "L0", "L1", "L2", "value"}) {
+    EXPECT_NE(nullptr, table->GetColumnByName(name)) << name;
+  }
+  for (vtkIdType i = 0; i < table->GetNumberOfRows(); ++i) {
+    const auto& evaluation = evaluations[i];
+    EXPECT_EQ(evaluation.iteration, table->GetValueByName(i, "iteration").ToInt());
+    EXPECT_EQ(evaluation.time, table->GetValueByName(i, "time").ToDouble());
+    EXPECT_EQ(static_cast<int>(evaluation.level), table->GetValueByName(i, "level").ToInt());
+    EXPECT_EQ(RefinementTelemetry::ToString(evaluation.spokes), table->GetValueByName(i, "spokes").ToString());
+    EXPECT_EQ(evaluation.distanceSquared, table->GetValueByName(i, "L0").ToDouble());
+    EXPECT_EQ(evaluation.normalPenalty, table->GetValueByName(i, "L1").ToDouble());
+    EXPECT_EQ(evaluation.srad, table->GetValueByName(i, "L2").ToDouble());
+    EXPECT_EQ(evaluation.value, table->GetValueByName(i, "value").ToDouble());
+  }
+
+  // the table is replaced, not appended to
+  logic->GetTelemetryAsTable(table);
+  EXPECT_EQ(static_cast<vtkIdType>(evaluations.size()), table->GetNumberOfRows());
+  EXPECT_THROW(logic->GetTelemetryAsTable(nullptr), std::invalid_argument);
+}
@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+#include <SRepSDFCache.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using sreprefinement::Hasher;
+using sreprefinement::SDFCache;
+
+namespace {
+
+struct Field {
+  SDFCache::Dimensions dimensions{{3, 4, 5}};
+  std::vector<float> distances;
+  std::vector<float> gradients;
+
+  Field() {
+    for (size_t i = 0; i < 60; ++i) {
+      distances.push_back(static_cast<float>(i) - 30.0f);
+      gradients.push_back(1.0f);
+      gradients.push_back(static_cast<float>(i));
+      gradients.push_back(-1.0f);
+    }
+  }
+};
+
+// Creates an empty directory for the cache files of one test, since a size limit applies to every
+// cache file in the directory
+std::string CreateCacheDirectory(const std::string& name) {
+  const std::string directory = ::testing::TempDir() + name;
+#ifdef _WIN32
+  _mkdir(directory.c_str());
+#else
+  mkdir(directory.c_str(), 0755);
+#endif
+  return directory;
+}
+
+} // namespace {}
+
+TEST(SDFCacheTest, Hasher) {
+  Hasher a;
+  a.Add(1.0);
+  a.Add(uint64_t(2));
+  Hasher b;
+  b.Add(uint64_t(2));
+  b.Add(1.0);
+  EXPECT_NE(a.GetHash(), b.GetHash());
+
+  const double values[2] = {1.0, 2.0};
+  Hasher c;
+  c.Add(values, 2);
+  Hasher d;
+  d.Add(1.0);
+  d.Add(2.0);
+  EXPECT_EQ(c.GetHash(), d.GetHash());
+  EXPECT_NE(Hasher().GetHash(), c.GetHash());
+}
+
+TEST(SDFCacheTest, StoreAndFind) {
+  const SDFCache cache(::testing::TempDir());
+  const Field field;
+  const SDFCache::Key key = 0x1234abcd;
+  std::remove(cache.GetFileName(key).c_str());
+  EXPECT_FALSE(cache.Find(key, false));
+
+  ASSERT_TRUE(cache.Store(key, field.dimensions, field.distances.data(), field.gradients.data()));
+  const auto entry = cache.Find(key, true);
+  ASSERT_TRUE(entry);
+  EXPECT_EQ(field.dimensions, entry->GetDimensions());
+  ASSERT_NE(nullptr, entry->GetGradients());
+  for (size_t i = 0; i < field.distances.size(); ++i) {
+    EXPECT_EQ(field.distances[i], entry->GetDistances()[i]);
+  }
+  for (size_t i = 0; i < field.gradients.size(); ++i) {
+    EXPECT_EQ(field.gradients[i], entry->GetGradients()[i]);
+  }
+  EXPECT_FALSE(cache.Find(key + 1, false));
+  std::remove(cache.GetFileName(key).c_str());
+}
+
+TEST(SDFCacheTest, DistancesOnly) {
+  const SDFCache cache(::testing::TempDir());
+  const Field field;
+  const SDFCache::Key key = 42;
+  ASSERT_TRUE(cache.Store(key, field.dimensions, field.distances.data(), nullptr));
+  EXPECT_FALSE(cache.Find(key, true));
+  const auto entry = cache.Find(key, false);
+  ASSERT_TRUE(entry);
+  EXPECT_EQ(nullptr, entry->GetGradients());
+  EXPECT_EQ(field.distances.back(), entry->GetDistances()[59]);
+
+  // replacing with gradients makes it a hit for both
+  ASSERT_TRUE(cache.Store(key, field.dimensions, field.distances.data(), field.gradients.data()));
+  EXPECT_TRUE(cache.Find(key, true));
+  std::remove(cache.GetFileName(key).c_str());
+}
+
+TEST(SDFCacheTest, CorruptFileIsAMiss) {
+  const SDFCache cache(::testing::TempDir());
+  const Field field;
+  const SDFCache::Key key = 7;
+  ASSERT_TRUE(cache.Store(key, field.dimensions, field.distances.data(), nullptr));
+
+  // truncate
+  std::vector<char> contents;
+  {
+    std::ifstream file(cache.GetFileName(key), std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+  {
+    std::ofstream file(cache.GetFileName(key), std::ios::binary | std::ios::trunc);
+    file.write(contents.data(), contents.size() - 4);
+  }
+  EXPECT_FALSE(cache.Find(key, false));
+
+  {
+    std::ofstream file(cache.GetFileName(key), std::ios::binary | std::ios::trunc);
+    file << "not a cache file";
+  }
+  EXPECT_FALSE(cache.Find(key, false));
+  std::remove(cache.GetFileName(key).c_str());
+}
+
+TEST(SDFCacheTest, EvictsLeastRecentlyUsed) {
+  const Field field;
+  const std::string directory = CreateCacheDirectory("SDFCacheTestEviction");
+  const SDFCache unlimited(directory);
+  for (const SDFCache::Key key : {1, 2, 3, 4}) {
+    std::remove(unlimited.GetFileName(key).c_str());
+  }
+  ASSERT_EQ(0u, unlimited.GetSize());
+
+  // room for two fields with gradients, but not three
+  ASSERT_TRUE(unlimited.Store(1, field.dimensions, field.distances.data(), field.gradients.data()));
+  const uint64_t fieldSize = unlimited.GetSize();
+  std::remove(unlimited.GetFileName(1).c_str());
+  const SDFCache cache(directory, 2 * fieldSize + fieldSize / 2);
+
+  // waits between uses so their file times differ
+  const auto nextUse = []() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  };
+  ASSERT_TRUE(cache.Store(1, field.dimensions, field.distances.data(), field.gradients.data()));
+  nextUse();
+  ASSERT_TRUE(cache.Store(2, field.dimensions, field.distances.data(), field.gradients.data()));
+  nextUse();
+  EXPECT_TRUE(cache.Find(1, true));
+  nextUse();
+  ASSERT_TRUE(cache.Store(3, field.dimensions, field.distances.data(), field.gradients.data()));
+
+  // 2 was used longest ago
+  EXPECT_TRUE(cache.Find(1, true));
+  EXPECT_FALSE(cache.Find(2, false));
+  EXPECT_TRUE(cache.Find(3, true));
+  EXPECT_LE(cache.GetSize(), 2 * fieldSize + fieldSize / 2);
+
+  // a field larger than the limit is still stored, and everything else is removed
+  const SDFCache tiny(directory, 1);
+  nextUse();
+  ASSERT_TRUE(tiny.Store(4, field.dimensions, field.distances.data(), nullptr));
+  EXPECT_TRUE(tiny.Find(4, false));
+  EXPECT_FALSE(tiny.Find(1, false));
+  EXPECT_FALSE(tiny.Find(3, false));
+
+  std::remove(cache.GetFileName(4).c_str());
+  EXPECT_EQ(0u, unlimited.GetSize());
+}
@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+#include <SRepSDFSampler.h>
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+using sreprefinement::SDFSampler;
+
+namespace {
+
+// field where the distance is x + 2y + 3z and the gradient is constant
+struct LinearField {
+  SDFSampler::Dimensions dimensions{{4, 5, 6}};
+  std::vector<float> distances;
+  std::vector<float> gradients;
+
+  LinearField() {
+    for (size_t z = 0; z < dimensions[2]; ++z) {
+      for (size_t y = 0; y < dimensions[1]; ++y) {
+        for (size_t x = 0; x < dimensions[0]; ++x) {
+          distances.push_back(static_cast<float>(x + 2 * y + 3 * z));
+          gradients.push_back(1.0f);
+          gradients.push_back(2.0f);
+          gradients.push_back(3.0f);
+        }
+      }
+    }
+  }
+};
+
+const SDFSampler::AffineTransform identity{{
+  1, 0, 0, 0,
+  0, 1, 0, 0,
+  0, 0, 1, 0,
+}};
+
+} // namespace {}
+
+TEST(SDFSamplerTest, Construction) {
+  LinearField field;
+  EXPECT_NO_THROW(SDFSampler(field.dimensions, identity, field.distances.data(), field.gradients.data()));
+  EXPECT_THROW(SDFSampler(field.dimensions, identity, nullptr, field.gradients.data()), std::invalid_argument);
+  EXPECT_THROW(SDFSampler(field.dimensions, identity, field.distances.data(), nullptr), std::invalid_argument);
+  EXPECT_THROW(SDFSampler(SDFSampler::Dimensions{{1, 5, 6}}, identity, field.distances.data(), field.gradients.data()), std::invalid_argument);
+
+  const SDFSampler sampler(field.dimensions, identity, field.distances.data(), field.gradients.data());
+  EXPECT_EQ(field.dimensions, sampler.GetDimensions());
+  EXPECT_LE(field.distances.size() * 4 * sizeof(float), sampler.GetMemorySize());
+}
+
+TEST(SDFSamplerTest, TrilinearInterpolation) {
+  LinearField field;
+  const SDFSampler sampler(field.dimensions, identity, field.distances.data(), field.gradients.data());
+  const double length = std::sqrt(14.0);
+
+  const std::vector<double> points{
+    0, 0, 0,
+    3, 4, 5,
+    1.25, 2.5, 3.75,
+    2.9, 0.1, 4.5,
+  };
+  std::vector<double> distances(4);
+  std::vector<double> normals(12);
+  sampler.Sample(4, points.data(), distances.data(), normals.data());
+
+  for (size_t i = 0; i < 4; ++i) {
+    const double* p = &points[3 * i];
+    EXPECT_NEAR(p[0] + 2 * p[1] + 3 * p[2], distances[i], 1e-5);
+    EXPECT_NEAR(1 / length, normals[3 * i + 0], 1e-6);
+    EXPECT_NEAR(2 / length, normals[3 * i + 1], 1e-6);
+    EXPECT_NEAR(3 / length, normals[3 * i + 2], 1e-6);
+  }
+
+  // normals are optional
+  double distance = 0;
+  sampler.Sample(1, &points[6], &distance, nullptr);
+  EXPECT_NEAR(distances[2], distance, 1e-12);
+}
+
+TEST(SDFSamplerTest, WorldToIndexTransform) {
+  LinearField field;
+  // world coordinates in [0,1] scaled to the field, offset by 1 in x
+  const SDFSampler::AffineTransform worldToIndex{{
+    3, 0, 0, 1,
+    0, 4, 0, 0,
+    0, 0, 5, 0,
+  }};
+  const SDFSampler sampler(field.dimensions, worldToIndex, field.distances.data(), field.gradients.data());
+
+  const double point[3] = {0.25, 0.5, 0.5};
+  double distance = 0;
+  double normal[3];
+  sampler.Sample(point, distance, normal);
+  EXPECT_NEAR(1.75 + 2 * 2 + 3 * 2.5, distance, 1e-5);
+}
+
+TEST(SDFSamplerTest, ClampsOutsideOfField) {
+  LinearField field;
+  const SDFSampler sampler(field.dimensions, identity, field.distances.data(), field.gradients.data());
+
+  double distance = 0;
+  double normal[3];
+  const double below[3] = {-10, -10, -10};
+  sampler.Sample(below, distance, normal);
+  EXPECT_NEAR(0, distance, 1e-6);
+
+  const double above[3] = {100, 2, 100};
+  sampler.Sample(above, distance, normal);
+  EXPECT_NEAR(3 + 2 * 2 + 3 * 5, distance, 1e-5);
+}
+
+TEST(SDFSamplerTest, ZeroGradient) {
+  LinearField field;
+  std::fill(field.gradients.begin(), field.gradients.end(), 0.0f);
+  const SDFSampler sampler(field.dimensions, identity, field.distances.data(), field.gradients.data());
+
+  double distance = 0;
+  double normal[3] = {1, 1, 1};
+  const double point[3] = {1.5, 1.5, 1.5};
+  sampler.Sample(point, distance, normal);
+  EXPECT_EQ(0, normal[0]);
+  EXPECT_EQ(0, normal[1]);
+  EXPECT_EQ(0, normal[2]);
+}
+
+TEST(SDFSamplerTest, DerivativesMatchDifferences) {
+  // distance to a sphere of radius 2 around (3, 3, 3), whose normals turn from voxel to voxel
+  const SDFSampler::Dimensions dimensions{{7, 7, 7}};
+  std::vector<float> distances;
+  std::vector<float> gradients;
+  for (size_t z = 0; z < dimensions[2]; ++z) {
+    for (size_t y = 0; y < dimensions[1]; ++y) {
+      for (size_t x = 0; x < dimensions[0]; ++x) {
+        const double p[3] = {x - 3.0, y - 3.0, z - 3.0};
+        const double length = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+        distances.push_back(static_cast<float>(length - 2));
+        for (size_t c = 0; c < 3; ++c) {
+          gradients.push_back(static_cast<float>(length > 0 ? p[c] / length : 0.0));
+        }
+      }
+    }
+  }
+  // rotated and scaled, so every world axis mixes the index axes
+  const SDFSampler::AffineTransform worldToIndex{{
+    0.8, -0.6, 0.0, 3,
+    0.6, 0.8, 0.0, 3,
+    0.0, 0.0, 1.5, 3,
+  }};
+  const SDFSampler sampler(dimensions, worldToIndex, distances.data(), gradients.data());
+
+  // away from the faces of the cells, where the interpolation has kinks
+  const std::vector<double> points = {
+    0.3, 1.1, 0.7,
+    -1.2, 0.45, -0.3,
+    1.9, -0.4, 1.23,
+  };
+  const size_t count = points.size() / 3;
+  std::vector<double> distanceGradients(3 * count);
+  std::vector<double> normalJacobians(9 * count);
+  sampler.SampleDerivatives(count, points.data(), distanceGradients.data(), normalJacobians.data());
+
+  std::vector<double> expectedDistanceGradients(3 * count);
+  std::vector<double> expectedNormalJacobians(9 * count);
+  sampler.DistanceSampler::SampleDerivatives(count, points.data(), expectedDistanceGradients.data(), expectedNormalJacobians.data());
+  for (size_t i = 0; i < distanceGradients.size(); ++i) {
+    EXPECT_NEAR(expectedDistanceGradients[i], distanceGradients[i], 1e-6) << "distance gradient " << i;
+  }
+  for (size_t i = 0; i < normalJacobians.size(); ++i) {
+    EXPECT_NEAR(expectedNormalJacobians[i], normalJacobians[i], 1e-6) << "normal jacobian " << i;
+  }
+
+  // outside of the field the distance doesn't change along the clamped axis
+  const double outside[3] = {0.3, 0.2, 10};
+  double distanceGradient[3];
+  double normalJacobian[9];
+  sampler.SampleDerivatives(1, outside, distanceGradient, normalJacobian);
+  EXPECT_EQ(0, distanceGradient[2]);
+  EXPECT_EQ(0, normalJacobian[2]);
+  EXPECT_EQ(0, normalJacobian[5]);
+  EXPECT_EQ(0, normalJacobian[8]);
+}
@@ -0,0 +1,106 @@
+#ifndef srepRefinementModuleUnitTestHelpers_h
+#define srepRefinementModuleUnitTestHelpers_h
+
+#include <vtkEllipticalSRep.h>
+#include <vtkImplicitPolyDataDistance.h>
+#include <vtkMRMLEllipticalSRepNode.h>
+#include <vtkMRMLModelNode.h>
+#include <vtkMath.h>
+#include <vtkNew.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkSphereSource.h>
+#include <vtkTransform.h>
+#include <vtkTransformPolyDataFilter.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace srepRefinementTestHelpers {
+
+/// Radii of the ellipsoid the refinement tests fit to, along x, y and z.
+constexpr double EllipsoidRadii[3] = {3.0, 2.0, 1.0};
+
+/// Creates a model of the ellipsoid with EllipsoidRadii centered at the origin.
+inline vtkSmartPointer<vtkMRMLModelNode> MakeEllipsoidModel() {
+  vtkNew<vtkSphereSource> sphere;
+  sphere->SetRadius(1.0);
+  sphere->SetThetaResolution(48);
+  sphere->SetPhiResolution(32);
+  vtkNew<vtkTransform> scale;
+  scale->Scale(EllipsoidRadii[0], EllipsoidRadii[1], EllipsoidRadii[2]);
+  vtkNew<vtkTransformPolyDataFilter> transform;
+  transform->SetInputConnection(sphere->GetOutputPort());
+  transform->SetTransform(scale);
+  transform->Update();
+
+  auto model = vtkSmartPointer<vtkMRMLModelNode>::New();
+  model->SetAndObservePolyData(transform->GetOutput());
+  return model;
+}
+
+/// Creates a rough srep of the ellipsoid with EllipsoidRadii, with a skeleton a little smaller than
+/// its medial sheet so the refinement has something to do.
+inline vtkSmartPointer<vtkMRMLEllipticalSRepNode> MakeEllipsoidSRep(int numLines, int numSteps) {
+  const double rx = EllipsoidRadii[0];
+  const double ry = EllipsoidRadii[1];
+  const double rz = EllipsoidRadii[2];
+  const double mra = 0.8 * (rx * rx - rz * rz) / rx;
+  const double mrb = 0.8 * (ry * ry - rz * rz) / ry;
+  const auto boundaryHeight = [&](double x, double y) {
+    return rz * std::sqrt(std::max(0.01, 1.0 - x * x / (rx * rx) - y * y / (ry * ry)));
+  };
+
+  auto srep = vtkSmartPointer<vtkEllipticalSRep>::New();
+  srep->Resize(numLines, numSteps);
+  for (int l = 0; l < numLines; ++l) {
+    const double theta = vtkMath::Pi() - 2.0 * vtkMath::Pi() * l / numLines;
+    const double spineX = (mra * mra - mrb * mrb) * std::cos(theta) / mra;
+    const double crestX = mra * std::cos(theta);
+    const double crestY = mrb * std::sin(theta);
+    for (int s = 0; s < numSteps; ++s) {
+      const double t = static_cast<double>(s) / (numSteps - 1);
+      const double x = spineX + t * (crestX - spineX);
+      const double y = t * crestY;
+      const double z = boundaryHeight(x, y);
+      const srep::Point3d skeletalPoint(x, y, 0.0);
+      auto* point = srep->GetSkeletalPoint(l, s);
+      point->SetUpSpoke(vtkSRepSpoke::SmartCreate(skeletalPoint, srep::Point3d(x, y, z)));
+      point->SetDownSpoke(vtkSRepSpoke::SmartCreate(skeletalPoint, srep::Point3d(x, y, -z)));
+      if (srep->IsCrestStep(s)) {
+        // the point of the ellipse around the ellipsoid's middle in the same direction
+        const double scale = 1.0 / std::sqrt(x * x / (rx * rx) + y * y / (ry * ry));
+        point->SetCrestSpoke(vtkSRepSpoke::SmartCreate(skeletalPoint, srep::Point3d(scale * x, scale * y, 0.0)));
+      }
+    }
+  }
+
+  auto node = vtkSmartPointer<vtkMRMLEllipticalSRepNode>::New();
+  node->SetEllipticalSRep(srep);
+  return node;
+}
+
+/// Gets the mean distance of the up and down spokes' boundary points from the model.
+inline double ComputeMeanBoundaryDistance(vtkMRMLEllipticalSRepNode* srepNode, vtkMRMLModelNode* model) {
+  vtkNew<vtkImplicitPolyDataDistance> distance;
+  distance->SetInput(model->GetPolyData());
+  const auto& srep = *srepNode->GetEllipticalSRep();
+  double sum = 0.0;
+  int count = 0;
+  for (vtkEllipticalSRep::IndexType l = 0; l < srep.GetNumberOfLines(); ++l) {
+    for (vtkEllipticalSRep::IndexType s = 0; s < srep.GetNumberOfSteps(); ++s) {
+      const auto* point = srep.GetSkeletalPoint(l, s);
+      for (const auto* spoke : {point->GetUpSpoke(), point->GetDownSpoke()}) {
+        const auto boundary = spoke->GetBoundaryPoint();
+        double x[3] = {boundary[0], boundary[1], boundary[2]};
+        sum += std::abs(distance->EvaluateFunction(x));
+        ++count;
+      }
+    }
+  }
+  return sum / count;
+}
+
+}
+
+#endif
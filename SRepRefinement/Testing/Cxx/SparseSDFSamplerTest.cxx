@@ -0,0 +1,197 @@
+#include <gtest/gtest.h>
+#include <SRepSDFSampler.h>
+#include <SRepSparseSDFSampler.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+using sreprefinement::SDFSampler;
+using sreprefinement::SparseSDFSampler;
+
+namespace {
+
+// sphere of radius 12 centered in a 45x41x43 field, so the last brick along each axis is partial
+struct SphereField {
+  SDFSampler::Dimensions dimensions{{45, 41, 43}};
+  double center[3] = {22, 20, 21};
+  double radius = 12;
+  std::vector<float> distances;
+  std::vector<float> gradients;
+
+  SphereField() {
+    for (size_t z = 0; z < dimensions[2]; ++z) {
+      for (size_t y = 0; y < dimensions[1]; ++y) {
+        for (size_t x = 0; x < dimensions[0]; ++x) {
+          const double d[3] = {x - center[0], y - center[1], z - center[2]};
+          const double length = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+          distances.push_back(static_cast<float>(length - radius));
+          for (int i = 0; i < 3; ++i) {
+            gradients.push_back(static_cast<float>(length > 0 ? d[i] / length : 0));
+          }
+        }
+      }
+    }
+  }
+};
+
+const SDFSampler::AffineTransform identity{{
+  1, 0, 0, 0,
+  0, 1, 0, 0,
+  0, 0, 1, 0,
+}};
+
+} // namespace {}
+
+TEST(SparseSDFSamplerTest, Construction) {
+  SphereField field;
+  EXPECT_THROW(SparseSDFSampler(field.dimensions, identity, nullptr, 2), std::invalid_argument);
+  EXPECT_THROW(SparseSDFSampler(SDFSampler::Dimensions{{45, 1, 43}}, identity, field.distances.data(), 2), std::invalid_argument);
+
+  const SparseSDFSampler sparse(field.dimensions, identity, field.distances.data(), 2);
+  const SDFSampler dense(field.dimensions, identity, field.distances.data(), field.gradients.data());
+  EXPECT_EQ(field.dimensions, sparse.GetDimensions());
+  EXPECT_LT(0u, sparse.GetNumberOfBricks());
+  EXPECT_LT(sparse.GetNumberOfBricks(), 6u * 6u * 6u);
+  EXPECT_LT(sparse.GetMemorySize(), dense.GetMemorySize());
+
+  // a wider band keeps more bricks
+  const SparseSDFSampler wide(field.dimensions, identity, field.distances.data(), 16);
+  EXPECT_LT(sparse.GetNumberOfBricks(), wide.GetNumberOfBricks());
+}
+
+TEST(SparseSDFSamplerTest, MatchesDenseInNarrowBand) {
+  SphereField field;
+  const size_t narrowBandWidth = 3;
+  const SparseSDFSampler sparse(field.dimensions, identity, field.distances.data(), narrowBandWidth);
+  const SDFSampler dense(field.dimensions, identity, field.distances.data(), field.gradients.data());
+
+  // points within the narrow band in many directions
+  std::vector<double> points;
+  for (int i = 0; i < 200; ++i) {
+    const double theta = 0.37 * i;
+    const double phi = std::acos(1 - 2 * (i + 0.5) / 200);
+    const double r = field.radius + narrowBandWidth * std::sin(1.3 * i);
+    points.push_back(field.center[0] + r * std::sin(phi) * std::cos(theta));
+    points.push_back(field.center[1] + r * std::sin(phi) * std::sin(theta));
+    points.push_back(field.center[2] + r * std::cos(phi));
+  }
+  const size_t count = points.size() / 3;
+
+  std::vector<double> sparseDistances(count);
+  std::vector<double> sparseNormals(3 * count);
+  sparse.Sample(count, points.data(), sparseDistances.data(), sparseNormals.data());
+  std::vector<double> denseDistances(count);
+  dense.Sample(count, points.data(), denseDistances.data(), nullptr);
+
+  for (size_t i = 0; i < count; ++i) {
+    // same samples, same interpolation
+    EXPECT_NEAR(denseDistances[i], sparseDistances[i], 1e-5);
+
+    // normals point away from the center
+    const double* p = &points[3 * i];
+    double radial[3] = {p[0] - field.center[0], p[1] - field.center[1], p[2] - field.center[2]};
+    const double length = std::sqrt(radial[0] * radial[0] + radial[1] * radial[1] + radial[2] * radial[2]);
+    const double dot = (radial[0] * sparseNormals[3 * i] + radial[1] * sparseNormals[3 * i + 1] + radial[2] * sparseNormals[3 * i + 2]) / length;
+    EXPECT_NEAR(1.0, dot, 0.01);
+  }
+}
+
+TEST(SparseSDFSamplerTest, NormalsMatchDenseGradientImage) {
+  // The dense sampler gets its normals from a gradient image, central differences of the voxels as
+  // itk::GradientImageFilter computes them. The sparse sampler differences its interpolated field instead.
+  SphereField field;
+  const auto& dims = field.dimensions;
+  const auto at = [&](size_t x, size_t y, size_t z) {
+    return static_cast<double>(field.distances[(z * dims[1] + y) * dims[0] + x]);
+  };
+  std::vector<float> gradients;
+  for (size_t z = 0; z < dims[2]; ++z) {
+    for (size_t y = 0; y < dims[1]; ++y) {
+      for (size_t x = 0; x < dims[0]; ++x) {
+        const size_t index[3] = {x, y, z};
+        for (size_t axis = 0; axis < 3; ++axis) {
+          size_t before[3] = {x, y, z};
+          size_t after[3] = {x, y, z};
+          before[axis] = index[axis] > 0 ? index[axis] - 1 : 0;
+          after[axis] = std::min(index[axis] + 1, dims[axis] - 1);
+          const double difference = at(after[0], after[1], after[2]) - at(before[0], before[1], before[2]);
+          gradients.push_back(static_cast<float>(difference / static_cast<double>(after[axis] - before[axis])));
+        }
+      }
+    }
+  }
+
+  const size_t narrowBandWidth = 4;
+  const SparseSDFSampler sparse(dims, identity, field.distances.data(), narrowBandWidth);
+  const SDFSampler dense(dims, identity, field.distances.data(), gradients.data());
+
+  std::vector<double> points;
+  for (int i = 0; i < 500; ++i) {
+    const double theta = 0.71 * i;
+    const double phi = std::acos(1 - 2 * (i + 0.5) / 500);
+    const double r = field.radius + (narrowBandWidth - 1) * std::sin(0.9 * i);
+    points.push_back(field.center[0] + r * std::sin(phi) * std::cos(theta));
+    points.push_back(field.center[1] + r * std::sin(phi) * std::sin(theta));
+    points.push_back(field.center[2] + r * std::cos(phi));
+  }
+  const size_t count = points.size() / 3;
+
+  std::vector<double> distances(count);
+  std::vector<double> sparseNormals(3 * count);
+  std::vector<double> denseNormals(3 * count);
+  sparse.Sample(count, points.data(), distances.data(), sparseNormals.data());
+  dense.Sample(count, points.data(), distances.data(), denseNormals.data());
+  for (size_t i = 0; i < count; ++i) {
+    const double* a = &sparseNormals[3 * i];
+    const double* b = &denseNormals[3 * i];
+    EXPECT_NEAR(1.0, a[0] * b[0] + a[1] * b[1] + a[2] * b[2], 1e-6) << "point " << i;
+  }
+}
+
+TEST(SparseSDFSamplerTest, FarField) {
+  SphereField field;
+  const SparseSDFSampler sparse(field.dimensions, identity, field.distances.data(), 1);
+
+  // corners of the field are far from the surface, where the distance is almost linear
+  const double points[3][3] = {
+    {0, 0, 0},
+    {44, 40, 42},
+    {2.5, 38.5, 1.5},
+  };
+  for (const auto& p : points) {
+    const double d[3] = {p[0] - field.center[0], p[1] - field.center[1], p[2] - field.center[2]};
+    const double expected = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]) - field.radius;
+    double distance = 0;
+    double normal[3];
+    sparse.Sample(p, distance, normal);
+    EXPECT_NEAR(expected, distance, 0.5);
+    EXPECT_NEAR(1.0, std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]), 1e-9);
+  }
+}
+
+TEST(SparseSDFSamplerTest, WorldToIndexTransform) {
+  SphereField field;
+  // world coordinates are half the voxel index, offset by 1 in x
+  const SDFSampler::AffineTransform worldToIndex{{
+    2, 0, 0, 1,
+    0, 2, 0, 0,
+    0, 0, 2, 0,
+  }};
+  const SparseSDFSampler sparse(field.dimensions, worldToIndex, field.distances.data(), 2);
+  const SDFSampler dense(field.dimensions, worldToIndex, field.distances.data(), field.gradients.data());
+
+  const double point[3] = {(field.center[0] + field.radius - 1) / 2, field.center[1] / 2, field.center[2] / 2};
+  double sparseDistance = 0;
+  double sparseNormal[3];
+  sparse.Sample(point, sparseDistance, sparseNormal);
+  double denseDistance = 0;
+  double denseNormal[3];
+  dense.Sample(point, denseDistance, denseNormal);
+
+  EXPECT_NEAR(denseDistance, sparseDistance, 1e-5);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_NEAR(denseNormal[i], sparseNormal[i], 1e-3);
+  }
+}
@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+#include <SRepSpokePatches.h>
+
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+
+using sreprefinement::CreateSpokePatches;
+using sreprefinement::DoSpokePatchesInteract;
+using sreprefinement::GetSpokePatchIndices;
+using sreprefinement::SpokePatch;
+
+TEST(SpokePatchesTest, PatchesCoverGridAndColorsDontInteract) {
+  constexpr size_t numLines = 22;
+  constexpr size_t numSteps = 9;
+  const auto colors = CreateSpokePatches(numLines, numSteps, 4, 1);
+  ASSERT_LT(1u, colors.size());
+
+  std::vector<int> coverage(numLines * numSteps, 0);
+  for (const auto& patches : colors) {
+    for (size_t i = 0; i < patches.size(); ++i) {
+      for (const size_t index : GetSpokePatchIndices(patches[i], numLines, numSteps)) {
+        ++coverage[index];
+      }
+      for (size_t j = 0; j < i; ++j) {
+        EXPECT_FALSE(DoSpokePatchesInteract(patches[i], patches[j], numLines));
+      }
+    }
+  }
+  for (const int count : coverage) {
+    // every spoke is in a tile, and the overlaps put some in more than one patch
+    EXPECT_LE(1, count);
+  }
+  // the spoke at the first line and step is also in the overlap of the patches of the last line tile
+  EXPECT_LT(1, coverage[0]);
+}
+
+TEST(SpokePatchesTest, LargePatchIsWholeGrid) {
+  const auto colors = CreateSpokePatches(6, 3, 10, 2);
+  ASSERT_EQ(1u, colors.size());
+  ASSERT_EQ(1u, colors[0].size());
+  const auto& patch = colors[0][0];
+  EXPECT_EQ(0u, patch.firstLine);
+  EXPECT_EQ(6u, patch.numLines);
+  EXPECT_EQ(0u, patch.firstStep);
+  EXPECT_EQ(3u, patch.numSteps);
+  EXPECT_EQ(18u, GetSpokePatchIndices(patch, 6, 3).size());
+}
+
+TEST(SpokePatchesTest, Interaction) {
+  constexpr size_t numLines = 10;
+  const auto patch = [](size_t firstLine, size_t numLines, size_t firstStep, size_t numSteps) {
+    return SpokePatch{firstLine, numLines, firstStep, numSteps};
+  };
+  // diagonal neighbors share a quad
+  EXPECT_TRUE(DoSpokePatchesInteract(patch(0, 2, 0, 2), patch(2, 2, 2, 2), numLines));
+  // two lines apart share the rSrad penalty of the line between them
+  EXPECT_TRUE(DoSpokePatchesInteract(patch(0, 2, 0, 2), patch(3, 2, 0, 2), numLines));
+  EXPECT_FALSE(DoSpokePatchesInteract(patch(0, 2, 0, 2), patch(4, 2, 0, 2), numLines));
+  EXPECT_FALSE(DoSpokePatchesInteract(patch(0, 2, 0, 2), patch(2, 2, 3, 2), numLines));
+  // lines wrap around
+  EXPECT_TRUE(DoSpokePatchesInteract(patch(0, 2, 0, 2), patch(8, 1, 0, 2), numLines));
+  EXPECT_TRUE(DoSpokePatchesInteract(patch(9, 2, 0, 2), patch(2, 2, 0, 2), numLines));
+  EXPECT_FALSE(DoSpokePatchesInteract(patch(9, 2, 0, 2), patch(3, 2, 0, 2), numLines));
+}
+
+TEST(SpokePatchesTest, InvalidArguments) {
+  EXPECT_THROW(CreateSpokePatches(0, 3, 2, 1), std::invalid_argument);
+  EXPECT_THROW(CreateSpokePatches(4, 3, 0, 1), std::invalid_argument);
+}
@@ -18,14 +18,15 @@
 // Qt includes
 #include <QDebug>
 #include <QMessageBox>
+#include <QTimer>
 
 // Slicer includes
 #include "qSlicerSRepRefinementModuleWidget.h"
 #include "ui_qSlicerSRepRefinementModuleWidget.h"
 #include "vtkSlicerSRepRefinementLogic.h"
 
-#include "SRepProgressHelper.h"
-#include <srepUtil.h>
+#include <cmath>
+#include <memory>
 
 //-----------------------------------------------------------------------------
 /// \ingroup Slicer_QtModules_ExtensionTemplate
@@ -35,6 +36,10 @@ class qSlicerSRepRefinementModuleWidgetPrivate: public Ui_qSlicerSRepRefinementM
 public:
   qSlicerSRepRefinementModuleWidgetPrivate(qSlicerSRepRefinementModuleWidget* object);
   vtkSlicerSRepRefinementLogic* logic() const;
+
+  std::unique_ptr<sreprefinement::RefinementTask> task;
+  // polls the task from the GUI thread, which is the only thread that may update the output node
+  QTimer refinementTimer;
 private:
   qSlicerSRepRefinementModuleWidget* const q_ptr;
 };
@@ -44,8 +49,12 @@ private:
 
 //-----------------------------------------------------------------------------
 qSlicerSRepRefinementModuleWidgetPrivate::qSlicerSRepRefinementModuleWidgetPrivate(qSlicerSRepRefinementModuleWidget* object)
-  : q_ptr(object)
-{}
+  : task()
+  , refinementTimer()
+  , q_ptr(object)
+{
+  this->refinementTimer.setInterval(250);
+}
 
 //-----------------------------------------------------------------------------
 vtkSlicerSRepRefinementLogic* qSlicerSRepRefinementModuleWidgetPrivate::logic() const
@@ -73,8 +82,11 @@ void qSlicerSRepRefinementModuleWidget::setup()
   d->setupUi(this);
   this->Superclass::setup();
   d->progressBar->hide();
+  d->cancelButton->hide();
 
   QObject::connect(d->refineButton, SIGNAL(clicked()), this, SLOT(refine()));
+  QObject::connect(d->cancelButton, SIGNAL(clicked()), this, SLOT(cancelRefinement()));
+  QObject::connect(&d->refinementTimer, SIGNAL(timeout()), this, SLOT(updateRefinement()));
 }
 
 //-----------------------------------------------------------------------------
@@ -103,23 +115,69 @@ void qSlicerSRepRefinementModuleWidget::refine()
   const auto normalMatchWeight = d->normalMatchWeightCTKSlider->value();
   const auto geometricIllegalityWeight = d->geometricIllegalityWeightCTKSlider->value();
 
+  if (d->task) {
+    return;
+  }
+
   try {
-  d->progressBar->show();
-  const auto fin = srep::util::finally([&d](){ d->progressBar->hide(); });
-  SRepProgressHelper<QProgressBar> progressManager(*(d->logic()), d->progressBar);
-  d->logic()->Run(
-    model,
-    inputSRep,
-    initialRegionSize,
-    finalRegionSize,
-    maxIterations,
-    interpolationLevel,
-    imageMatchWeight,
-    normalMatchWeight,
-    geometricIllegalityWeight,
-    outputSRep);
+    d->task = d->logic()->RunAsync(
+      model,
+      inputSRep,
+      initialRegionSize,
+      finalRegionSize,
+      maxIterations,
+      interpolationLevel,
+      imageMatchWeight,
+      normalMatchWeight,
+      geometricIllegalityWeight,
+      outputSRep);
   } catch (const std::exception& e) {
     QMessageBox::warning(this, "Error refining SRep", e.what());
-  } 
+    return;
+  }
+
+  d->progressBar->setMaximum(100);
+  d->progressBar->setValue(0);
+  d->progressBar->show();
+  d->refineButton->setEnabled(false);
+  d->cancelButton->setEnabled(true);
+  d->cancelButton->show();
+  d->refinementTimer.start();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerSRepRefinementModuleWidget::cancelRefinement()
+{
+  Q_D(qSlicerSRepRefinementModuleWidget);
+  if (d->task) {
+    d->task->Cancel();
+    d->cancelButton->setEnabled(false);
+  }
 }
 
+//-----------------------------------------------------------------------------
+void qSlicerSRepRefinementModuleWidget::updateRefinement()
+{
+  Q_D(qSlicerSRepRefinementModuleWidget);
+  if (!d->task) {
+    d->refinementTimer.stop();
+    return;
+  }
+
+  // check before publishing so the final result is not missed
+  const bool done = d->task->IsDone();
+  d->progressBar->setValue(static_cast<int>(d->task->GetProgress() * 100));
+  d->task->PublishResult();
+  if (!done) {
+    return;
+  }
+
+  d->refinementTimer.stop();
+  const auto task = std::move(d->task);
+  d->progressBar->hide();
+  d->cancelButton->hide();
+  d->refineButton->setEnabled(true);
+  if (task->GetStatus() == sreprefinement::RefinementTask::Status::Failed) {
+    QMessageBox::warning(this, "Error refining SRep", QString::fromStdString(task->GetErrorMessage()));
+  }
+}
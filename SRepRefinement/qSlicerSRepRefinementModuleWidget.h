@@ -40,8 +40,12 @@ public:
 
 public slots:
   void refine();
+  void cancelRefinement();
   void setMRMLScene(vtkMRMLScene* scene) override;
 
+protected slots:
+  void updateRefinement();
+
 protected:
   QScopedPointer<qSlicerSRepRefinementModuleWidgetPrivate> d_ptr;
 